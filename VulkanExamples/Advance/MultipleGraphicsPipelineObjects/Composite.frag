@@ -0,0 +1,40 @@
+/*
+* Learning Vulkan - ISBN: 9781786469809
+*
+* Author: Parminder Singh, parminder.vulkan@gmail.com
+* Linkedin: https://www.linkedin.com/in/parmindersingh18
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#version 450
+
+// Resolves the weighted blended transparency over the color attachment. The
+// average color of the transparent fragments covers 1 - revealage of what is
+// behind them, the pipeline blends with SRC_ALPHA, ONE_MINUS_SRC_ALPHA.
+layout (input_attachment_index = 0, binding = 0) uniform subpassInput accumulation;
+layout (input_attachment_index = 1, binding = 1) uniform subpassInput revealage;
+layout (location = 0) out vec4 outColor;
+
+void main() {
+	vec4 accum		= subpassLoad(accumulation);
+	float reveal	= subpassLoad(revealage).r;
+
+	outColor = vec4(accum.rgb / clamp(accum.a, 1e-4, 5e4), 1.0 - reveal);
+}
@@ -0,0 +1,118 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include "VulkanShader.h"
+
+class VulkanDevice;
+class VulkanPipeline;
+
+// Stable LSD radix sort of 32 bit keys with a 32 bit value each, on the GPU.
+// Every pass sorts on eight bits with the reduce then scan scheme:
+//	RadixHistogram.comp	digit counts of each block of keys
+//	RadixScan.comp		exclusive scan of the counts, the output offsets
+//	RadixScatter.comp	stable move of the keys and values to their offset
+// Four passes ping pong between two pairs of buffers and leave the result in
+// the first pair. RadixDepthKeys.comp fills the first pair with the view depth
+// of instance positions, so transparent instances can be drawn back to front.
+//
+// The kernels are specialized with the workgroup size of the device and the
+// number of keys per invocation, and created through the pipeline cache.
+class GpuRadixSort
+{
+public:
+	enum Kernel {
+		KERNEL_DEPTH_KEYS,
+		KERNEL_HISTOGRAM,
+		KERNEL_SCAN,
+		KERNEL_SCATTER,
+		KERNEL_TOTAL
+	};
+
+	// Shader file of each kernel, without the extension
+	static const char* const kernelNames[KERNEL_TOTAL];
+
+	GpuRadixSort();
+	~GpuRadixSort();
+
+	// Create the kernels from their SPIR-V and the buffers for up to 'capacity' keys
+	void initialize(VulkanDevice* device, VulkanPipeline* pipelineObj, uint32_t capacity,
+		const uint32_t* const spirv[KERNEL_TOTAL], const size_t spirvSize[KERNEL_TOTAL]);
+	void destroy();
+
+	bool isInitialized() const { return deviceObj != NULL; }
+	uint32_t getCapacity() const { return capacity; }
+
+	// Keys and values to sort, sorted after recordSort(). Transfer source and destination.
+	VkBuffer getKeyBuffer() const { return keys[0].buffer; }
+	VkBuffer getValueBuffer() const { return values[0].buffer; }
+
+	// Buffer of vec4 instance positions read by recordDepthKeys()
+	void setPositions(VkBuffer positions);
+
+	// Record the keys of the first 'count' positions, farthest from the camera first, with
+	// the instance index as value. The camera of the model view matrix looks down -Z.
+	void recordDepthKeys(VkCommandBuffer cmd, uint32_t count, const glm::mat4& modelView);
+
+	// Record the sort of the first 'count' keys and values, outside of a render pass.
+	// The buffers can be read by the shaders, vertex input and transfers afterwards.
+	void recordSort(VkCommandBuffer cmd, uint32_t count);
+
+	// CPU reference, sorts exactly like the GPU and gives the same result
+	static void sortReference(std::vector<uint32_t>& sortKeys, std::vector<uint32_t>& sortValues);
+
+	// CPU reference of the depth key of RadixDepthKeys.comp
+	static uint32_t makeDepthKey(float depth);
+
+private:
+	struct Buffer {
+		VkBuffer		buffer;
+		VkDeviceMemory	memory;
+	};
+
+	void createBuffer(Buffer* buffer, VkDeviceSize size, VkBufferUsageFlags usage);
+	void destroyBuffer(Buffer* buffer);
+	void createDescriptors();
+	void recordBarrier(VkCommandBuffer cmd, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess);
+
+	VulkanDevice*			deviceObj;
+	uint32_t				capacity;
+	uint32_t				workgroupSize;
+	uint32_t				blockSize;			// Keys per workgroup of the histogram and scatter
+	uint32_t				maxBlockCount;
+
+	Buffer					keys[2];
+	Buffer					values[2];
+	Buffer					histogram;			// Digit major counts, then offsets, of every block
+	VkBuffer				positions;
+
+	VulkanShader			shaders[KERNEL_TOTAL];
+	VkPipeline				pipelines[KERNEL_TOTAL];
+	VkDescriptorSetLayout	descLayout;
+	VkPipelineLayout		pipelineLayout;
+	VkDescriptorPool		descriptorPool;
+	VkDescriptorSet			descriptorSets[2];	// Reading the first pair and writing the second, and the reverse
+};
@@ -0,0 +1,108 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include <map>
+
+// Collects the draws of a frame as packets tagged with a 64-bit sort key and
+// records them grouped by state. Packets sharing a pipeline and descriptor set
+// end up next to each other, so the redundant vkCmdBindPipeline,
+// vkCmdBindDescriptorSets and vkCmdBindVertexBuffers calls can be skipped.
+//
+// Sort key layout, most significant first:
+//	63..60	pass			pass order, opaque, translucent, weighted blended
+//	59..48	pipeline		pipeline id, assigned by the queue
+//	47..32	material		descriptor set id, assigned by the queue
+//	31..0	depth			view space depth, front to back, back to front
+//							in the translucent pass so the blending is right
+class RenderQueue
+{
+public:
+	// Passes of the sort key, drawn in this order. The weighted blended
+	// transparency is recorded in a subpass of its own.
+	enum Pass {
+		PASS_OPAQUE,
+		PASS_TRANSLUCENT,
+		PASS_WEIGHTED_OIT
+	};
+
+	struct DrawPacket
+	{
+		VkPipeline			pipeline;
+		VkPipelineLayout	pipelineLayout;
+		VkDescriptorSet		descriptorSet;
+		VkBuffer			vertexBuffer;
+		uint32_t			vertexCount;
+		uint32_t			firstVertex;
+	};
+
+	struct BindCounts
+	{
+		uint32_t pipelines;
+		uint32_t descriptorSets;
+		uint32_t vertexBuffers;
+		uint32_t draws;
+	};
+
+	RenderQueue();
+	~RenderQueue();
+
+	// Drop the packets of the previous frame
+	void begin();
+
+	// Queue a draw, the depth is the view space distance to the camera
+	void submit(uint32_t pass, float depth, const DrawPacket& packet);
+
+	// Radix sort the queued packets on their key
+	void sort();
+
+	// Record the packets of a pass in sorted order, skipping the redundant binds.
+	// Returns the number of draws recorded.
+	uint32_t emit(VkCommandBuffer cmd, uint32_t pass);
+
+	// Binds the packets need in submission order and in sorted order
+	const BindCounts& getUnsortedBinds() const { return unsortedBinds; }
+	const BindCounts& getSortedBinds() const { return sortedBinds; }
+
+	static uint64_t makeSortKey(uint32_t pass, uint32_t pipelineId, uint32_t materialId, float depth);
+
+private:
+	uint32_t getPipelineId(VkPipeline pipeline);
+	uint32_t getMaterialId(VkDescriptorSet descriptorSet);
+
+	// Walk the packets in the given order, recording them when cmd is not null
+	BindCounts walk(const uint32_t* walkOrder, size_t count, VkCommandBuffer cmd) const;
+
+	std::vector<DrawPacket>				packets;
+	std::vector<uint64_t>				keys;
+	std::vector<uint32_t>				order;			// Packet indices, sorted by key after sort()
+	std::vector<uint64_t>				scratchKeys;
+	std::vector<uint32_t>				scratchOrder;
+	std::map<VkPipeline, uint32_t>		pipelineIds;
+	std::map<VkDescriptorSet, uint32_t>	materialIds;
+	BindCounts							unsortedBinds;
+	BindCounts							sortedBinds;	// Summed over the emitted passes
+};
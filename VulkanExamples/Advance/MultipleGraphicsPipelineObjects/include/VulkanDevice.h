@@ -28,6 +28,7 @@
 #include "Headers.h"
 //#include "VulkanQueue.h"
 #include "VulkanLED.h"
+#include "VulkanSamplerCache.h"
 
 class VulkanApplication;
 
@@ -63,6 +64,9 @@ public:
 	VulkanLayerAndExtension		layerExtension;
 	VkPhysicalDeviceFeatures	deviceFeatures;
 
+	// Shared samplers, textures with the same sampler state use the same handle
+	VulkanSamplerCache			samplerCache;
+
 public:
 	VkResult createDevice(std::vector<const char *>& layers, std::vector<const char *>& extensions);
 	void destroyDevice();
@@ -27,22 +27,34 @@
 #include "Headers.h"
 #include "VulkanDescriptor.h"
 #include "Wrappers.h"
+#include "RenderQueue.h"
 
 class VulkanRenderer;
 class VulkanDrawable : public VulkanDescriptor
 {
 public:
+	// How the drawable blends over what is behind it
+	enum Transparency {
+		TRANSPARENCY_ALPHA_BLEND,		// Straight alpha blending, drawn back to front
+		TRANSPARENCY_WEIGHTED_OIT		// Weighted blended order independent transparency
+	};
+
 	VulkanDrawable(VulkanRenderer* parent = 0);
 	~VulkanDrawable();
 
 	void createVertexBuffer(const void *vertexData, uint32_t dataSize, uint32_t dataStride, bool useTexture);
-	void prepare();
+	// Queue the draws of the drawable for the current frame
+	void submitDraws(RenderQueue& queue);
 	void render();
 	void update();
 
 	void setPipeline(VkPipeline* vulkanPipeline) { pipeline = vulkanPipeline; }
 	VkPipeline* getPipeline() { return pipeline; }
 
+	// Set before the pipeline is created, it selects the pipeline's subpass and blend state
+	void setTransparency(Transparency mode) { transparency = mode; }
+	Transparency getTransparency() const { return transparency; }
+
 	void createUniformBuffer();
 	void createDescriptorPool(bool useTexture);
 	void createDescriptorResources();
@@ -50,11 +62,7 @@ public:
 	void createDescriptorSetLayout(bool useTexture);
 	void createPipelineLayout();
 
-	void initViewports(VkCommandBuffer* cmd);
-	void initScissors(VkCommandBuffer* cmd);
-
 	void destroyVertexBuffer();
-	void destroyCommandBuffer();
 	void destroyUniformBuffer();
 
 	void setTextures(TextureData* tex);
@@ -82,10 +90,6 @@ public:
 	int antiDir;
 	float rot;
 private:
-	std::vector<VkCommandBuffer> vecCmdDraw;			// Command buffer for drawing
-	void recordCommandBuffer(int currentImage, VkCommandBuffer* cmdDraw);
-	VkViewport viewport;
-	VkRect2D   scissor;
 	TextureData* textures;
 
 	glm::mat4 Projection;
@@ -95,4 +99,5 @@ private:
 
 	VulkanRenderer* rendererObj;
 	VkPipeline*		pipeline;
+	Transparency	transparency;
 };
\ No newline at end of file
@@ -25,6 +25,7 @@
 
 #pragma once
 #include "Headers.h"
+#include <map>
 class VulkanShader;
 class VulkanDrawable;
 class VulkanDevice;
@@ -48,16 +49,29 @@ public:
 	// Returns the created pipeline object, it takes the drawable object which 
 	// contains the vertex input rate and data interpretation information, 
 	// shader files, boolean flag checking enabled depth, and flag to check
-	// if the vertex input are available. 	
-	bool createPipeline(VulkanDrawable* drawableObj, VkPipeline* pipeline, VulkanShader* shaderObj, VkBool32 includeDepth,bool clear, VkBool32 includeVi = true);
+	// if the vertex input are available. All pipelines share the renderer's render pass,
+	// the transparency mode of the drawable selects the subpass and the blend state.
+	bool createPipeline(VulkanDrawable* drawableObj, VkPipeline* pipeline, VulkanShader* shaderObj, VkBool32 includeDepth, VkBool32 includeVi = true);
 
-	// Destruct the pipeline cache object
+	// Returns a pipeline drawing a fullscreen triangle without vertex input into a
+	// subpass of the renderer's render pass, blended over its color attachment.
+	// The pipeline is owned by the caller.
+	bool createFullscreenPipeline(VulkanShader* shaderObj, VkPipelineLayout pipelineLayout, uint32_t subpass, VkPipeline* pipeline);
+
+	// Returns the compute pipeline of the shader's compute stage, specialized with
+	// the current constants of the stage. Pipelines are cached by shader module,
+	// layout and constant values, and are owned by the pipeline object.
+	bool createComputePipeline(VulkanShader* shaderObj, VkPipelineLayout pipelineLayout, VkPipeline* pipeline);
+
+	// Destruct the pipeline cache object and the specialized compute pipelines
 	void destroyPipelineCache();
 
 public:
 	// Pipeline preparation member variables
 	// Pipeline cache object
 	VkPipelineCache						pipelineCache;
+	// Compute pipelines created by createComputePipeline()
+	std::map<uint64_t, VkPipeline>		computePipelines;
 	VulkanApplication*					appObj;
 	VulkanDevice*						deviceObj;
 };
\ No newline at end of file
@@ -28,12 +28,28 @@
 #include "VulkanSwapChain.h"
 #include "VulkanDrawable.h"
 #include "VulkanShader.h"
+#include "VulkanShaderCompiler.h"
 #include "VulkanPipeline.h"
+#include "RenderQueue.h"
+#include "GpuRadixSort.h"
+#include "WeightedBlendedOit.h"
 
 // Number of samples needs to be the same at image creation
 // Used at renderpass creation (in attachment) and pipeline creation
 #define NUM_SAMPLES VK_SAMPLE_COUNT_1_BIT
 
+// Instances the GPU radix sort is created and checked for
+#define RADIX_SORT_INSTANCE_COUNT (1 << 20)
+
+// Subpasses of the render pass, in execution order
+#define SUBPASS_COLOR			0	// Opaque and alpha blended drawables
+#define SUBPASS_WEIGHTED_OIT	1	// Accumulation of the weighted blended transparency
+#define SUBPASS_COMPOSITE		2	// Weighted blended transparency resolved over the color
+#define SUBPASS_COUNT			3
+
+// Opacity of the weighted blended drawables, a specialization constant of TextureOIT.frag
+#define WEIGHTED_OIT_OPACITY	0.5f
+
 // The Vulkan Renderer is custom class, it is not a Vulkan specific class.
 // It works as a presentation manager.
 // It manages the presentation windows and drawing surfaces.
@@ -69,6 +85,7 @@ public:
 	inline VkCommandPool getCommandPoolGraphics()  { return cmdPoolGrpahics; }
 	inline VkCommandPool getCommandPoolCompute()   { return cmdPoolCompute; }
 	inline VulkanShader*  getShader()				{ return &shaderObj; }
+	inline VulkanShader*  getShaderWeightedOit()	{ return &oitShaderObj; }
 	inline VulkanPipeline*	getPipelineObject()		{ return &pipelineObj; }
 
 	void createCommandPoolGraphics();							// Create command pool
@@ -77,13 +94,16 @@ public:
 	void createDepthImage();							// Create depth image
 	void createVertexBuffer();
 	void createComputeBuffer();
-	void createRenderPass(bool includeDepth, bool clear);	// Render Pass creation
-	void createFrameBuffer(bool includeDepth, bool clear);
+	void createRadixSort();								// Create the GPU radix sort and check it once
+	void createWeightedOitComposite();					// Create the resolve of the weighted blended transparency
+	void createRenderPass(bool includeDepth);			// Render Pass creation
+	void createFrameBuffer(bool includeDepth);
+	void compileShaders();								// Queue the GLSL shaders on the shader compiler
 	void createShaders();
 	void createPipelineStateManagement();
 	void createDescriptors();
-	void createTextureLinear (const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
-	void createTextureOptimal(const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+	void createTextureLinear (const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_UNDEFINED);
+	void createTextureOptimal(const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_UNDEFINED);
 
 	void destroyCommandBuffer();
 	void destroyCommandPool();
@@ -92,10 +112,12 @@ public:
 	void destroyRenderpass();										// Destroy the render pass object when no more required
 	void destroyFramebuffers();
 	void destroyPipeline();
-	void destroyDrawableCommandBuffer();
+	void destroyDrawCommandBuffer();
 	void destroyDrawableSynchronizationObjects();
 	void destroyDrawableUniformBuffer();
 	void destroyTextureResource();
+	void destroyRadixSort();
+	void destroyWeightedOit();
 
 public:
 #ifdef _WIN32
@@ -123,12 +145,12 @@ public:
 	VkCommandBuffer		cmdVertexBuffer;		// Command buffer for vertex buffer - Triangle geometry
 	VkCommandBuffer		cmdTexture;				// Command buffer for creating the texture
 
-	VkRenderPass		renderPass[2];				// Render pass created object
-	std::vector<VkFramebuffer> framebuffers[2];	// Number of frame buffer corresponding to each swap chain
+	VkRenderPass		renderPass;				// Render pass shared by all the drawables
+	std::vector<VkFramebuffer> framebuffers;	// Number of frame buffer corresponding to each swap chain
 	std::vector<VkPipeline*> pipelineList;		// List of pipelines
 	VkSemaphore presentCompleteSemaphore;
 	VkSemaphore drawingCompleteSemaphore;
-	std::vector< std::vector<VkCommandBuffer> > vecCmdDraw; // Vector of commandbuffer for each corresponding swapchain image
+	std::vector<VkCommandBuffer> vecCmdDraw;	// Command buffer drawing the frame, for each swapchain image
 
 	int					width, height;
 	TextureData			texture;
@@ -140,5 +162,23 @@ private:
 	VulkanSwapChain*   swapChainObj;
 	std::vector<VulkanDrawable*> drawableList;
 	VulkanShader 	   shaderObj;
+	VulkanShader 	   oitShaderObj;		// Texture.vert and TextureOIT.frag, for the weighted blended drawables
+	bool			   weightedOitAvailable;	// False without the TextureOIT or composite SPIR-V, alpha blending instead
 	VulkanPipeline 	   pipelineObj;
+
+	// Record the drawables into one render pass instance
+	void recordCommandBuffer(int currentImage, VkCommandBuffer* cmdDraw);
+	void recordFrame(int currentImage);
+	RenderQueue		   renderQueue;		// Draws of the frame, sorted by state
+	GpuRadixSort	   radixSort;		// Key and value sort of up to RADIX_SORT_INSTANCE_COUNT instances
+	WeightedBlendedOit weightedOit;		// Transparency attachments and their composite
+
+	// Sort the view depth of a cloud of instances on the GPU and compare with the CPU reference
+	void checkRadixSort();
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+	// SPIR-V of the shaders queued by compileShaders()
+	VulkanShaderCompiler::SpirvFuture vertSPV, fragSPV, compSPV;
+	VulkanShaderCompiler::SpirvFuture oitFragSPV, compositeVertSPV, compositeFragSPV;
+	VulkanShaderCompiler::SpirvFuture radixSPV[GpuRadixSort::KERNEL_TOTAL];
+#endif
 };
\ No newline at end of file
@@ -25,6 +25,32 @@
 
 #pragma once
 #include "Headers.h"
+#include <map>
+
+// Values of the specialization constants of one shader stage. The GLSL
+// int, uint, float and bool constants are all 32 bit, values are stored
+// as such and laid out in the order they were first set.
+class SpecializationConstants
+{
+public:
+	void set(uint32_t constantID, uint32_t value);
+	void set(uint32_t constantID, int32_t value);
+	void set(uint32_t constantID, float value);
+	void set(uint32_t constantID, bool value);
+
+	bool empty() const { return mapEntries.empty(); }
+
+	// Specialization info pointing into this object, valid until the next set()
+	const VkSpecializationInfo* getInfo();
+
+	// Hash of the constant ids and values, used to cache specialized pipelines
+	uint64_t getHash() const;
+
+private:
+	std::vector<VkSpecializationMapEntry>	mapEntries;
+	std::vector<uint32_t>					values;
+	VkSpecializationInfo					info;
+};
 
 // Shader class managing the shader conversion, compilation, linking
 class VulkanShader
@@ -42,21 +68,30 @@ public:
 	// Kill the shader when not required
 	void destroyShaders();
 
+	// Specialization constants of a stage, used by the pipelines created afterwards
+	SpecializationConstants& getSpecialization(VkShaderStageFlagBits shaderStage) { return specializations[shaderStage]; }
+
+	// Shader stages with their current specialization info, to create a pipeline from
+	const std::vector<VkPipelineShaderStageCreateInfo>& getStages();
+
 #ifdef AUTO_COMPILE_GLSL_TO_SPV
-	// Convert GLSL shader to SPIR-V shader
-	bool GLSLtoSPV(const VkShaderStageFlagBits shaderType, const char *pshader, std::vector<unsigned int> &spirv);
+	// Convert GLSL shader to SPIR-V shader, thread safe
+	static bool GLSLtoSPV(const VkShaderStageFlagBits shaderType, const char *pshader, std::vector<unsigned int> &spirv);
 
 	// Entry point to build the shaders
 	void buildShader(const char* vertShaderText, const char* entryPoint, VkShaderStageFlagBits shaderStage);
 
 	// Type of shader language. This could be - EShLangVertex,Tessellation Control, 
 	// Tessellation Evaluation, Geometry, Fragment and Compute
-	EShLanguage getLanguage(const VkShaderStageFlagBits shader_type);
+	static EShLanguage getLanguage(const VkShaderStageFlagBits shader_type);
 
 	// Initialize the TBuitInResource
-	void initializeResources(TBuiltInResource &Resources);
+	static void initializeResources(TBuiltInResource &Resources);
 #endif
 
 	// Vk structure storing vertex & fragment shader information
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStagesVector;
+
+	// Specialization constants of each stage
+	std::map<VkShaderStageFlagBits, SpecializationConstants> specializations;
 };
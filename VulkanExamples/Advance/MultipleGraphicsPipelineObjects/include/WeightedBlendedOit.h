@@ -0,0 +1,89 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include "VulkanShader.h"
+
+class VulkanDevice;
+class VulkanPipeline;
+
+// Weighted blended order independent transparency (McGuire and Bavoil 2013).
+// The transparent drawables add their weighted, premultiplied color to an
+// accumulation attachment and multiply their transparency into a revealage
+// attachment, in any order. A fullscreen triangle then divides the weights
+// out and blends the average color over the color attachment. The two
+// attachments are transient and only live in the render pass instance:
+//	SUBPASS_WEIGHTED_OIT	TextureOIT.frag writes both attachments
+//	SUBPASS_COMPOSITE		Composite.frag reads them as input attachments
+class WeightedBlendedOit
+{
+public:
+	// Sum of the weighted colors and coverages, and product of the transparencies
+	static const VkFormat accumulationFormat	= VK_FORMAT_R16G16B16A16_SFLOAT;
+	static const VkFormat revealageFormat		= VK_FORMAT_R16_SFLOAT;
+
+	WeightedBlendedOit();
+	~WeightedBlendedOit();
+
+	// Create the accumulation and revealage attachments of the framebuffer size
+	void createAttachments(VulkanDevice* device, uint32_t width, uint32_t height);
+
+	// Create the composite pipeline of the subpass from the SPIR-V of
+	// Composite.vert and Composite.frag, after createAttachments()
+	void createComposite(VulkanPipeline* pipelineObj, uint32_t subpass,
+		const uint32_t* vertSpirv, size_t vertSpirvSize, const uint32_t* fragSpirv, size_t fragSpirvSize);
+
+	// Destroy the composite and the attachments
+	void destroy();
+
+	VkImageView getAccumulationView() const { return accumulation.view; }
+	VkImageView getRevealageView() const { return revealage.view; }
+
+	// Record the composite, in its subpass. The viewport and scissor are dynamic states.
+	void recordComposite(VkCommandBuffer cmd);
+
+private:
+	struct Attachment {
+		VkImage			image;
+		VkDeviceMemory	memory;
+		VkImageView		view;
+	};
+
+	void createAttachment(Attachment* attachment, VkFormat format, uint32_t width, uint32_t height);
+	void destroyAttachment(Attachment* attachment);
+	void createDescriptors();
+
+	VulkanDevice*			deviceObj;
+	Attachment				accumulation;
+	Attachment				revealage;
+
+	VulkanShader			shaderObj;
+	VkPipeline				pipeline;
+	VkDescriptorSetLayout	descLayout;
+	VkPipelineLayout		pipelineLayout;
+	VkDescriptorPool		descriptorPool;
+	VkDescriptorSet			descriptorSet;
+};
@@ -59,15 +59,23 @@ struct TextureData{
 	VkMemoryAllocateInfo	memoryAlloc;
 	VkDeviceMemory			mem;
 	VkImageView				view;
+	VkFormat				format;
 	uint32_t				mipMapLevels;
 	uint32_t				layerCount;
 	uint32_t				textureWidth, textureHeight;
 	VkDescriptorImageInfo	descsImgInfo;
 };
 
+// Translate the format read from the KTX/DDS header into its Vulkan equivalent.
+// Returns VK_FORMAT_UNDEFINED when Vulkan has no matching format.
+VkFormat getVulkanFormat(gli::format format);
+
 /***************PPM PARSER CLASS***************/
 #include "Headers.h"
 
+// Streaming reader for binary (P6) and ASCII (P3) PPM files with 8 bit samples.
+// The file is memory mapped and decoded straight into the caller memory,
+// typically a mapped linear image or staging buffer, as RGBA with opaque alpha.
 class PpmParser
 {
 public:
@@ -80,10 +88,23 @@ public:
 	const char* filename() { return ppmFile.c_str(); }
 
 private:
+	bool mapFile(const char *filename);
+	void unmapFile();
+
 	bool isValid;
+	bool isBinary;				// P6 when true, P3 otherwise
 	int32_t imageWidth;
 	int32_t imageHeight;
-	int32_t dataPosition;
+	int32_t maxValue;			// Largest sample value, the samples are rescaled to 0..255
+	int32_t dataPosition;		// Offset of the first sample in the file
 	std::string ppmFile;
-	gli::texture2D* tex2D;
+
+	const uint8_t* fileData;	// Read only mapping of the whole file
+	size_t fileSize;
+#ifdef _WIN32
+	void* fileHandle;			// HANDLE of the file and of its mapping object
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
 };
\ No newline at end of file
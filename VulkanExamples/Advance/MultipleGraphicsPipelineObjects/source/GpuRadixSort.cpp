@@ -0,0 +1,396 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "GpuRadixSort.h"
+#include "VulkanDevice.h"
+#include "VulkanPipeline.h"
+#include <algorithm>
+
+// Preferred invocations per workgroup, clamped to the device limits. The shared
+// memory of the kernels is sized for at most this many invocations.
+#define RADIX_WORKGROUP_SIZE	256
+#define RADIX_ITEMS_PER_THREAD	16
+#define RADIX_BITS				8
+#define RADIX_BUCKETS			(1 << RADIX_BITS)
+#define RADIX_KEY_BITS			32
+
+// Push constant block shared by the kernels
+struct RadixSortConstants {
+	glm::vec4	depthRow;
+	uint32_t	count;
+	uint32_t	shift;
+	uint32_t	blockCount;
+};
+
+const char* const GpuRadixSort::kernelNames[KERNEL_TOTAL] = {
+	"RadixDepthKeys",
+	"RadixHistogram",
+	"RadixScan",
+	"RadixScatter",
+};
+
+GpuRadixSort::GpuRadixSort()
+{
+	deviceObj		= NULL;
+	capacity		= 0;
+	workgroupSize	= 0;
+	blockSize		= 0;
+	maxBlockCount	= 0;
+	memset(keys, 0, sizeof(keys));
+	memset(values, 0, sizeof(values));
+	memset(&histogram, 0, sizeof(histogram));
+	positions		= VK_NULL_HANDLE;
+	memset(pipelines, 0, sizeof(pipelines));
+	descLayout		= VK_NULL_HANDLE;
+	pipelineLayout	= VK_NULL_HANDLE;
+	descriptorPool	= VK_NULL_HANDLE;
+	memset(descriptorSets, 0, sizeof(descriptorSets));
+}
+
+GpuRadixSort::~GpuRadixSort()
+{
+}
+
+void GpuRadixSort::initialize(VulkanDevice* device, VulkanPipeline* pipelineObj, uint32_t keyCapacity,
+	const uint32_t* const spirv[KERNEL_TOTAL], const size_t spirvSize[KERNEL_TOTAL])
+{
+	VkResult result;
+
+	deviceObj	= device;
+	capacity	= keyCapacity;
+
+	// The mask words of the scatter need a multiple of 32 invocations
+	const VkPhysicalDeviceLimits& limits = deviceObj->gpuProps.limits;
+	const uint32_t maxInvocations = std::min<uint32_t>(RADIX_WORKGROUP_SIZE,
+		std::min(limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations));
+	workgroupSize = 32;
+	while (workgroupSize * 2 <= maxInvocations) {
+		workgroupSize *= 2;
+	}
+	blockSize		= workgroupSize * RADIX_ITEMS_PER_THREAD;
+	maxBlockCount	= (capacity + blockSize - 1) / blockSize;
+	assert((capacity + workgroupSize - 1) / workgroupSize <= limits.maxComputeWorkGroupCount[0]);
+
+	const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	for (int i = 0; i < 2; i++) {
+		createBuffer(&keys[i], (VkDeviceSize)capacity * sizeof(uint32_t), usage);
+		createBuffer(&values[i], (VkDeviceSize)capacity * sizeof(uint32_t), usage);
+	}
+	createBuffer(&histogram, (VkDeviceSize)RADIX_BUCKETS * maxBlockCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	createDescriptors();
+
+	VkPushConstantRange pushConstantRange;
+	pushConstantRange.stageFlags	= VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset		= 0;
+	pushConstantRange.size			= sizeof(RadixSortConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.pNext					= NULL;
+	pipelineLayoutCreateInfo.flags					= 0;
+	pipelineLayoutCreateInfo.setLayoutCount			= 1;
+	pipelineLayoutCreateInfo.pSetLayouts			= &descLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount	= 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges	= &pushConstantRange;
+	result = vkCreatePipelineLayout(deviceObj->device, &pipelineLayoutCreateInfo, NULL, &pipelineLayout);
+	assert(result == VK_SUCCESS);
+
+	for (int kernel = 0; kernel < KERNEL_TOTAL; kernel++) {
+		shaders[kernel].buildShaderModuleWithSPV((uint32_t*)spirv[kernel], spirvSize[kernel], "main", VK_SHADER_STAGE_COMPUTE_BIT);
+
+		SpecializationConstants& specialization = shaders[kernel].getSpecialization(VK_SHADER_STAGE_COMPUTE_BIT);
+		specialization.set(0, workgroupSize);						// local_size_x_id
+		specialization.set(1, (uint32_t)RADIX_ITEMS_PER_THREAD);	// ITEMS_PER_THREAD
+
+		bool pipelineCreated = pipelineObj->createComputePipeline(&shaders[kernel], pipelineLayout, &pipelines[kernel]);
+		assert(pipelineCreated);
+	}
+}
+
+void GpuRadixSort::destroy()
+{
+	if (!deviceObj) {
+		return;
+	}
+
+	// The pipelines belong to the pipeline cache object
+	for (int kernel = 0; kernel < KERNEL_TOTAL; kernel++) {
+		shaders[kernel].destroyShaders();
+	}
+	vkDestroyDescriptorPool(deviceObj->device, descriptorPool, NULL);
+	vkDestroyPipelineLayout(deviceObj->device, pipelineLayout, NULL);
+	vkDestroyDescriptorSetLayout(deviceObj->device, descLayout, NULL);
+
+	for (int i = 0; i < 2; i++) {
+		destroyBuffer(&keys[i]);
+		destroyBuffer(&values[i]);
+	}
+	destroyBuffer(&histogram);
+
+	*this = GpuRadixSort();
+}
+
+void GpuRadixSort::createBuffer(Buffer* buffer, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+	VkResult result;
+	bool pass;
+
+	VkBufferCreateInfo bufInfo		= {};
+	bufInfo.sType					= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufInfo.pNext					= NULL;
+	bufInfo.usage					= usage;
+	bufInfo.size					= size;
+	bufInfo.sharingMode				= VK_SHARING_MODE_EXCLUSIVE;
+	bufInfo.flags					= 0;
+	result = vkCreateBuffer(deviceObj->device, &bufInfo, NULL, &buffer->buffer);
+	assert(result == VK_SUCCESS);
+
+	VkMemoryRequirements memRqrmnt;
+	vkGetBufferMemoryRequirements(deviceObj->device, buffer->buffer, &memRqrmnt);
+
+	VkMemoryAllocateInfo allocInfo	= {};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext					= NULL;
+	allocInfo.allocationSize		= memRqrmnt.size;
+	pass = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocInfo.memoryTypeIndex);
+	assert(pass);
+	result = vkAllocateMemory(deviceObj->device, &allocInfo, NULL, &buffer->memory);
+	assert(result == VK_SUCCESS);
+	result = vkBindBufferMemory(deviceObj->device, buffer->buffer, buffer->memory, 0);
+	assert(result == VK_SUCCESS);
+}
+
+void GpuRadixSort::destroyBuffer(Buffer* buffer)
+{
+	vkDestroyBuffer(deviceObj->device, buffer->buffer, NULL);
+	vkFreeMemory(deviceObj->device, buffer->memory, NULL);
+	buffer->buffer = VK_NULL_HANDLE;
+	buffer->memory = VK_NULL_HANDLE;
+}
+
+void GpuRadixSort::createDescriptors()
+{
+	VkResult result;
+
+	// 0: keys in, 1: values in, 2: keys out, 3: values out, 4: histogram, 5: positions
+	VkDescriptorSetLayoutBinding layoutBindings[6] = {};
+	for (uint32_t i = 0; i < 6; i++) {
+		layoutBindings[i].binding				= i;
+		layoutBindings[i].descriptorType		= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layoutBindings[i].descriptorCount		= 1;
+		layoutBindings[i].stageFlags			= VK_SHADER_STAGE_COMPUTE_BIT;
+		layoutBindings[i].pImmutableSamplers	= NULL;
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptorLayout = {};
+	descriptorLayout.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorLayout.pNext			= NULL;
+	descriptorLayout.bindingCount	= 6;
+	descriptorLayout.pBindings		= layoutBindings;
+	result = vkCreateDescriptorSetLayout(deviceObj->device, &descriptorLayout, NULL, &descLayout);
+	assert(result == VK_SUCCESS);
+
+	VkDescriptorPoolSize descriptorTypePool;
+	descriptorTypePool.type				= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorTypePool.descriptorCount	= 2 * 6;
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.pNext			= NULL;
+	descriptorPoolCreateInfo.maxSets		= 2;
+	descriptorPoolCreateInfo.poolSizeCount	= 1;
+	descriptorPoolCreateInfo.pPoolSizes		= &descriptorTypePool;
+	result = vkCreateDescriptorPool(deviceObj->device, &descriptorPoolCreateInfo, NULL, &descriptorPool);
+	assert(result == VK_SUCCESS);
+
+	VkDescriptorSetLayout setLayouts[2] = { descLayout, descLayout };
+	VkDescriptorSetAllocateInfo dsAllocInfo = {};
+	dsAllocInfo.sType				= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsAllocInfo.pNext				= NULL;
+	dsAllocInfo.descriptorPool		= descriptorPool;
+	dsAllocInfo.descriptorSetCount	= 2;
+	dsAllocInfo.pSetLayouts			= setLayouts;
+	result = vkAllocateDescriptorSets(deviceObj->device, &dsAllocInfo, descriptorSets);
+	assert(result == VK_SUCCESS);
+
+	// The positions are bound by setPositions(), only the depth keys read them
+	VkDescriptorBufferInfo bufferInfos[2][5];
+	VkWriteDescriptorSet writes[2 * 5] = {};
+	for (int set = 0; set < 2; set++) {
+		const int in = set;
+		const int out = 1 - set;
+		bufferInfos[set][0].buffer = keys[in].buffer;
+		bufferInfos[set][1].buffer = values[in].buffer;
+		bufferInfos[set][2].buffer = keys[out].buffer;
+		bufferInfos[set][3].buffer = values[out].buffer;
+		bufferInfos[set][4].buffer = histogram.buffer;
+
+		for (uint32_t binding = 0; binding < 5; binding++) {
+			bufferInfos[set][binding].offset	= 0;
+			bufferInfos[set][binding].range		= VK_WHOLE_SIZE;
+
+			VkWriteDescriptorSet& write = writes[set * 5 + binding];
+			write.sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet			= descriptorSets[set];
+			write.dstBinding		= binding;
+			write.descriptorCount	= 1;
+			write.descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo		= &bufferInfos[set][binding];
+		}
+	}
+	vkUpdateDescriptorSets(deviceObj->device, 2 * 5, writes, 0, NULL);
+}
+
+void GpuRadixSort::setPositions(VkBuffer positionBuffer)
+{
+	positions = positionBuffer;
+
+	VkDescriptorBufferInfo bufferInfo = { positions, 0, VK_WHOLE_SIZE };
+	VkWriteDescriptorSet writes[2] = {};
+	for (int set = 0; set < 2; set++) {
+		writes[set].sType			= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[set].dstSet			= descriptorSets[set];
+		writes[set].dstBinding		= 5;
+		writes[set].descriptorCount	= 1;
+		writes[set].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[set].pBufferInfo		= &bufferInfo;
+	}
+	vkUpdateDescriptorSets(deviceObj->device, 2, writes, 0, NULL);
+}
+
+void GpuRadixSort::recordBarrier(VkCommandBuffer cmd, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext			= NULL;
+	barrier.srcAccessMask	= srcAccess;
+	barrier.dstAccessMask	= dstAccess;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+void GpuRadixSort::recordDepthKeys(VkCommandBuffer cmd, uint32_t count, const glm::mat4& modelView)
+{
+	assert(positions != VK_NULL_HANDLE && count <= capacity);
+	if (count == 0) {
+		return;
+	}
+
+	// View space depth is the z row of the model view matrix, negated since the camera looks down -Z
+	RadixSortConstants constants = {};
+	constants.depthRow	= glm::vec4(-modelView[0][2], -modelView[1][2], -modelView[2][2], -modelView[3][2]);
+	constants.count		= count;
+
+	// The second set writes the first pair of buffers
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[KERNEL_DEPTH_KEYS]);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[1], 0, NULL);
+	vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(cmd, (count + workgroupSize - 1) / workgroupSize, 1, 1);
+}
+
+void GpuRadixSort::recordSort(VkCommandBuffer cmd, uint32_t count)
+{
+	assert(count <= capacity);
+	if (count == 0) {
+		return;
+	}
+
+	// The keys may have just been written by a shader or a copy
+	VkMemoryBarrier barrier = {};
+	barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext			= NULL;
+	barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	RadixSortConstants constants = {};
+	constants.count			= count;
+	constants.blockCount	= (count + blockSize - 1) / blockSize;
+
+	for (uint32_t shift = 0; shift < RADIX_KEY_BITS; shift += RADIX_BITS) {
+		constants.shift = shift;
+
+		// Even passes read the first pair, odd passes the second
+		const VkDescriptorSet& descriptorSet = descriptorSets[(shift / RADIX_BITS) & 1];
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+		vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[KERNEL_HISTOGRAM]);
+		vkCmdDispatch(cmd, constants.blockCount, 1, 1);
+		recordBarrier(cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[KERNEL_SCAN]);
+		vkCmdDispatch(cmd, 1, 1, 1);
+		recordBarrier(cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[KERNEL_SCATTER]);
+		vkCmdDispatch(cmd, constants.blockCount, 1, 1);
+
+		// The next pass reads the scattered keys and writes the histogram again
+		recordBarrier(cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+			VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+	}
+}
+
+uint32_t GpuRadixSort::makeDepthKey(float depth)
+{
+	// Flipped float bits sort as unsigned integers, inverted for the farthest to come first
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	const uint32_t ordered = (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+	return ~ordered;
+}
+
+void GpuRadixSort::sortReference(std::vector<uint32_t>& sortKeys, std::vector<uint32_t>& sortValues)
+{
+	assert(sortKeys.size() == sortValues.size());
+	const size_t count = sortKeys.size();
+	std::vector<uint32_t> scratchKeys(count);
+	std::vector<uint32_t> scratchValues(count);
+
+	for (uint32_t shift = 0; shift < RADIX_KEY_BITS; shift += RADIX_BITS) {
+		uint32_t offsets[RADIX_BUCKETS] = {};
+		for (size_t i = 0; i < count; i++) {
+			offsets[(sortKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+			const uint32_t bucketCount = offsets[bucket];
+			offsets[bucket] = offset;
+			offset += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			const uint32_t destination = offsets[(sortKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+			scratchKeys[destination]	= sortKeys[i];
+			scratchValues[destination]	= sortValues[i];
+		}
+		sortKeys.swap(scratchKeys);
+		sortValues.swap(scratchValues);
+	}
+}
@@ -0,0 +1,210 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "RenderQueue.h"
+
+#define SORT_KEY_PASS_BITS		4
+#define SORT_KEY_PIPELINE_BITS	12
+#define SORT_KEY_MATERIAL_BITS	16
+#define RADIX_BITS				8
+#define RADIX_BUCKETS			(1 << RADIX_BITS)
+
+RenderQueue::RenderQueue()
+{
+	memset(&unsortedBinds, 0, sizeof(unsortedBinds));
+	memset(&sortedBinds, 0, sizeof(sortedBinds));
+}
+
+RenderQueue::~RenderQueue()
+{
+}
+
+uint64_t RenderQueue::makeSortKey(uint32_t pass, uint32_t pipelineId, uint32_t materialId, float depth)
+{
+	assert(pass < (1u << SORT_KEY_PASS_BITS));
+	assert(pipelineId < (1u << SORT_KEY_PIPELINE_BITS));
+	assert(materialId < (1u << SORT_KEY_MATERIAL_BITS));
+
+	// The bits of a non-negative float sort like the float itself,
+	// anything behind the camera is clamped to the front
+	if (!(depth > 0.0f)) {
+		depth = 0.0f;
+	}
+	uint32_t depthBits;
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+	if (pass == PASS_TRANSLUCENT) {
+		depthBits = ~depthBits;
+	}
+
+	return ((uint64_t)pass << 60) | ((uint64_t)pipelineId << 48) | ((uint64_t)materialId << 32) | depthBits;
+}
+
+uint32_t RenderQueue::getPipelineId(VkPipeline pipeline)
+{
+	std::map<VkPipeline, uint32_t>::iterator it = pipelineIds.find(pipeline);
+	if (it != pipelineIds.end()) {
+		return it->second;
+	}
+	uint32_t id = (uint32_t)pipelineIds.size();
+	pipelineIds[pipeline] = id;
+	return id;
+}
+
+uint32_t RenderQueue::getMaterialId(VkDescriptorSet descriptorSet)
+{
+	std::map<VkDescriptorSet, uint32_t>::iterator it = materialIds.find(descriptorSet);
+	if (it != materialIds.end()) {
+		return it->second;
+	}
+	uint32_t id = (uint32_t)materialIds.size();
+	materialIds[descriptorSet] = id;
+	return id;
+}
+
+void RenderQueue::begin()
+{
+	// Ids are handed out in submission order, pipelines and descriptor
+	// sets may have been recreated since the previous frame
+	packets.clear();
+	keys.clear();
+	pipelineIds.clear();
+	materialIds.clear();
+}
+
+void RenderQueue::submit(uint32_t pass, float depth, const DrawPacket& packet)
+{
+	keys.push_back(makeSortKey(pass, getPipelineId(packet.pipeline), getMaterialId(packet.descriptorSet), depth));
+	packets.push_back(packet);
+}
+
+void RenderQueue::sort()
+{
+	const uint32_t count = (uint32_t)packets.size();
+	order.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		order[i] = i;
+	}
+	unsortedBinds = walk(order.data(), count, VK_NULL_HANDLE);
+	memset(&sortedBinds, 0, sizeof(sortedBinds));
+
+	// LSD radix sort of the (key, index) pairs, eight bits per pass. The
+	// passes where every key falls in the same bucket are skipped, with few
+	// pipelines and materials most of the upper bytes are constant.
+	scratchKeys.resize(count);
+	scratchOrder.resize(count);
+	for (uint32_t shift = 0; shift < 64; shift += RADIX_BITS) {
+		uint32_t histogram[RADIX_BUCKETS] = {};
+		for (uint32_t i = 0; i < count; i++) {
+			histogram[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+		}
+		if (count == 0 || histogram[(keys[0] >> shift) & (RADIX_BUCKETS - 1)] == count) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+			uint32_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t dst = histogram[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+			scratchKeys[dst] = keys[i];
+			scratchOrder[dst] = order[i];
+		}
+		keys.swap(scratchKeys);
+		order.swap(scratchOrder);
+	}
+}
+
+uint32_t RenderQueue::emit(VkCommandBuffer cmd, uint32_t pass)
+{
+	assert(order.size() == packets.size());
+
+	// The pass is the top of the key, its packets are next to each other
+	size_t begin = 0;
+	while (begin < keys.size() && (keys[begin] >> 60) < pass) {
+		begin++;
+	}
+	size_t end = begin;
+	while (end < keys.size() && (keys[end] >> 60) == pass) {
+		end++;
+	}
+
+	const BindCounts counts = walk(order.data() + begin, end - begin, cmd);
+	sortedBinds.pipelines		+= counts.pipelines;
+	sortedBinds.descriptorSets	+= counts.descriptorSets;
+	sortedBinds.vertexBuffers	+= counts.vertexBuffers;
+	sortedBinds.draws			+= counts.draws;
+	return counts.draws;
+}
+
+RenderQueue::BindCounts RenderQueue::walk(const uint32_t* walkOrder, size_t count, VkCommandBuffer cmd) const
+{
+	BindCounts counts = {};
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+	VkDescriptorSet boundSet = VK_NULL_HANDLE;
+	VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+
+	for (size_t i = 0; i < count; i++) {
+		const DrawPacket& packet = packets[walkOrder[i]];
+
+		if (packet.pipeline != boundPipeline) {
+			if (cmd) {
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipeline);
+			}
+			boundPipeline = packet.pipeline;
+			counts.pipelines++;
+		}
+
+		// Binding a pipeline keeps the descriptor sets bound, rebind only
+		// when the set changes or it was bound through another layout
+		if (packet.descriptorSet != boundSet || packet.pipelineLayout != boundLayout) {
+			if (cmd) {
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipelineLayout,
+					0, 1, &packet.descriptorSet, 0, NULL);
+			}
+			boundSet = packet.descriptorSet;
+			boundLayout = packet.pipelineLayout;
+			counts.descriptorSets++;
+		}
+
+		if (packet.vertexBuffer != boundVertexBuffer) {
+			if (cmd) {
+				const VkDeviceSize offsets[1] = { 0 };
+				vkCmdBindVertexBuffers(cmd, 0, 1, &packet.vertexBuffer, offsets);
+			}
+			boundVertexBuffer = packet.vertexBuffer;
+			counts.vertexBuffers++;
+		}
+
+		if (cmd) {
+			vkCmdDraw(cmd, packet.vertexCount, 1, packet.firstVertex, 0);
+		}
+		counts.draws++;
+	}
+	return counts;
+}
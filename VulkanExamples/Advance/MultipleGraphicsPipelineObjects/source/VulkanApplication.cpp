@@ -174,6 +174,7 @@ void VulkanApplication::resize()
 	rendererObj->destroyFramebuffers();
 	rendererObj->destroyCommandPool();
 	rendererObj->destroyPipeline();
+	rendererObj->destroyRadixSort();
 	rendererObj->getPipelineObject()->destroyPipelineCache();
 	for each (VulkanDrawable* drawableObj in *rendererObj->getDrawingItems())
 	{
@@ -185,6 +186,7 @@ void VulkanApplication::resize()
 	rendererObj->destroyDrawableUniformBuffer();
 	rendererObj->destroyTextureResource();
 	rendererObj->destroyDepthBuffer();
+	rendererObj->destroyWeightedOit();
 	rendererObj->initialize();
 	prepare();
 
@@ -195,6 +197,7 @@ void VulkanApplication::deInitialize()
 {
 	// Destroy all the pipeline objects
 	rendererObj->destroyPipeline();
+	rendererObj->destroyRadixSort();
 
 	// Destroy the associate pipeline cache
 	rendererObj->getPipelineObject()->destroyPipelineCache();
@@ -205,13 +208,15 @@ void VulkanApplication::deInitialize()
 	}
 
 	rendererObj->getShader()->destroyShaders();
+	rendererObj->getShaderWeightedOit()->destroyShaders();
 	rendererObj->destroyFramebuffers();
 	rendererObj->destroyRenderpass();
 	rendererObj->destroyDrawableVertexBuffer();
 	rendererObj->destroyDrawableUniformBuffer();
 
-	rendererObj->destroyDrawableCommandBuffer();
+	rendererObj->destroyDrawCommandBuffer();
 	rendererObj->destroyDepthBuffer();
+	rendererObj->destroyWeightedOit();
 	rendererObj->getSwapChain()->destroySwapChain();
 	rendererObj->destroyCommandBuffer();
 	rendererObj->destroyDrawableSynchronizationObjects();
@@ -59,6 +59,11 @@ VkResult VulkanDevice::createDevice(std::vector<const char *>& layers, std::vect
 	VkPhysicalDeviceFeatures setEnabledFeatures = {VK_FALSE};
 	setEnabledFeatures.samplerAnisotropy = deviceFeatures.samplerAnisotropy;
 
+	// Block compressed texture formats are only usable when their feature is enabled
+	setEnabledFeatures.textureCompressionBC			= deviceFeatures.textureCompressionBC;
+	setEnabledFeatures.textureCompressionETC2		= deviceFeatures.textureCompressionETC2;
+	setEnabledFeatures.textureCompressionASTC_LDR	= deviceFeatures.textureCompressionASTC_LDR;
+
 	VkDeviceCreateInfo deviceInfo		= {};
 	deviceInfo.sType					= VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceInfo.pNext					= NULL;
@@ -73,6 +78,8 @@ VkResult VulkanDevice::createDevice(std::vector<const char *>& layers, std::vect
 	result = vkCreateDevice(*gpu, &deviceInfo, NULL, &device);
 	assert(result == VK_SUCCESS);
 
+	samplerCache.initialize(device, gpuProps.limits.maxSamplerAllocationCount);
+
 	return result;
 }
 
@@ -221,6 +228,7 @@ VkResult VulkanDevice::getTransferQueueHandle()
 
 void VulkanDevice::destroyDevice()
 {
+	samplerCache.destroySamplers();
 	vkDestroyDevice(device, NULL);
 }
 
@@ -48,6 +48,7 @@ VulkanDrawable::VulkanDrawable(VulkanRenderer* parent) {
 	//vkCreateSemaphore(deviceObj->device, &presentCompleteSemaphoreCreateInfo, NULL, &presentCompleteSemaphore);
 	//vkCreateSemaphore(deviceObj->device, &drawingCompleteSemaphoreCreateInfo, NULL, &drawingCompleteSemaphore);
 	antiDir = false;
+	transparency = TRANSPARENCY_ALPHA_BLEND;
 	rot = 0;
 }
 
@@ -55,13 +56,6 @@ VulkanDrawable::~VulkanDrawable()
 {
 }
 
-void VulkanDrawable::destroyCommandBuffer()
-{
-	for (int i = 0; i<vecCmdDraw.size(); i++) {
-		vkFreeCommandBuffers(deviceObj->device, rendererObj->cmdPoolGrpahics, 1, &vecCmdDraw[i]);
-	}
-}
-
 void VulkanDrawable::createUniformBuffer()
 {
 	VkResult  result;
@@ -319,26 +313,6 @@ void VulkanDrawable::createDescriptorSet(bool useTexture)
 	vkUpdateDescriptorSets(deviceObj->device, useTexture ? 2 : 1, writes, 0, NULL);
 }
 
-void VulkanDrawable::initViewports(VkCommandBuffer* cmd)
-{
-	viewport.height		= (float)rendererObj->height;
-	viewport.width		= (float)rendererObj->width;
-	viewport.minDepth	= (float) 0.0f;
-	viewport.maxDepth	= (float) 1.0f;
-	viewport.x			= 0;
-	viewport.y			= 0;
-	vkCmdSetViewport(*cmd, 0, NUMBER_OF_VIEWPORTS, &viewport);
-}
-
-void VulkanDrawable::initScissors(VkCommandBuffer* cmd)
-{
-	scissor.extent.width	= rendererObj->width;
-	scissor.extent.height	= rendererObj->height;
-	scissor.offset.x		= 0;
-	scissor.offset.y		= 0;
-	vkCmdSetScissor(*cmd, 0, NUMBER_OF_SCISSORS, &scissor);
-}
-
 void VulkanDrawable::destroyVertexBuffer()
 {
 	vkDestroyBuffer(rendererObj->getDevice()->device, VertexBuffer.buf, NULL);
@@ -357,97 +331,21 @@ void VulkanDrawable::setTextures(TextureData * tex)
 	textures = tex;
 }
 
-void VulkanDrawable::recordCommandBuffer(int currentImage, VkCommandBuffer* cmdDraw)
-{
-	VulkanDevice* deviceObj			= rendererObj->getDevice();
-	VulkanPipeline* pipelineObj 	= rendererObj->getPipelineObject();
-
-	// Specify the clear color value
-	VkClearValue clearValues[2];
-	clearValues[0].color.float32[0]		= 1.0f;
-	clearValues[0].color.float32[1]		= 1.0f;
-	clearValues[0].color.float32[2]		= 1.0f;
-	clearValues[0].color.float32[3]		= 1.0f;
-
-	// Specify the depth/stencil clear value
-	clearValues[1].depthStencil.depth	= 1.0f;
-	clearValues[1].depthStencil.stencil	= 0;
-
-	// Define the VkRenderPassBeginInfo control structure
-	VkRenderPassBeginInfo renderPassBegin;
-	renderPassBegin.sType						= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBegin.pNext						= NULL;
-	if (!this->antiDir)
-	{
-		renderPassBegin.renderPass = rendererObj->renderPass[0];
-		renderPassBegin.framebuffer = rendererObj->framebuffers[0][currentImage];
-	}
-	else
-	{
-		renderPassBegin.renderPass = rendererObj->renderPass[1];
-		renderPassBegin.framebuffer = rendererObj->framebuffers[1][currentImage];
-	}
-	//renderPassBegin.framebuffer					= rendererObj->framebuffers[currentImage];
-	renderPassBegin.renderArea.offset.x			= 0;
-	renderPassBegin.renderArea.offset.y			= 0;
-	renderPassBegin.renderArea.extent.width		= rendererObj->width;
-	renderPassBegin.renderArea.extent.height	= rendererObj->height;
-	renderPassBegin.clearValueCount				= 2;
-	renderPassBegin.pClearValues				= clearValues;
-	
-	// Start recording the render pass instance
-	vkCmdBeginRenderPass(*cmdDraw, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
-
-	// Bound the command buffer with the graphics pipeline
-	vkCmdBindPipeline(*cmdDraw, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
-	vkCmdBindDescriptorSets(*cmdDraw, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-		0, 1, descriptorSet.data(), 0, NULL);
-	// Bound the command buffer with the graphics pipeline
-	const VkDeviceSize offsets[1] = { 0 };
-	vkCmdBindVertexBuffers(*cmdDraw, 0, 1, &VertexBuffer.buf, offsets);
-
-	// Define the dynamic viewport here
-	initViewports(cmdDraw);
-
-	// Define the scissoring 
-	initScissors(cmdDraw);
-
-	// Issue the draw command 6 faces consisting of 2 triangles each with 3 vertices.
-	vkCmdDraw(*cmdDraw, 3 * 2 * 6, 1, 0, 0);
-
-	// End of render pass instance recording
-	vkCmdEndRenderPass(*cmdDraw);
-}
-
-void VulkanDrawable::prepare()
+void VulkanDrawable::submitDraws(RenderQueue& queue)
 {
-	VulkanDevice* deviceObj = rendererObj->getDevice();
-	int swapChainColorBuffer = rendererObj->getSwapChain()->scPublicVars.colorBuffer.size();
-	if (vecCmdDraw.size() != swapChainColorBuffer)
-	{
-		vecCmdDraw.resize(swapChainColorBuffer);
-	}
-
-	// For each swapbuffer color surface image buffer 
-	// allocate the corresponding command buffer
-	for (int i = 0; i < rendererObj->getSwapChain()->scPublicVars.colorBuffer.size(); i++){
-		// Allocate, create and start command buffer recording
-		//VkCommandBuffer commandBuffer;
-		CommandBufferMgr::allocCommandBuffer(&deviceObj->device, rendererObj->getCommandPoolGraphics(), &vecCmdDraw[i]);
-		CommandBufferMgr::beginCommandBuffer(vecCmdDraw[i]);
-		//CommandBufferMgr::allocCommandBuffer(&deviceObj->device, rendererObj->getCommandPoolGraphics(), &commandBuffer);
-		//CommandBufferMgr::beginCommandBuffer(commandBuffer);
-		// Create the render pass instance 
-		recordCommandBuffer(i, &vecCmdDraw[i]);
-		//recordCommandBuffer(i, &commandBuffer);
-
-		// Finish the command buffer recording
-		CommandBufferMgr::endCommandBuffer(vecCmdDraw[i]);
-		rendererObj->vecCmdDraw[i].push_back(vecCmdDraw[i]);
-		//CommandBufferMgr::endCommandBuffer(commandBuffer);
-		//rendererObj->vecCmdDraw[i].push_back(commandBuffer);
-	}
-
+	RenderQueue::DrawPacket packet;
+	packet.pipeline			= *pipeline;
+	packet.pipelineLayout	= pipelineLayout;
+	packet.descriptorSet	= descriptorSet[0];
+	packet.vertexBuffer		= VertexBuffer.buf;
+	packet.vertexCount		= 3 * 2 * 6;	// 6 faces consisting of 2 triangles each with 3 vertices
+	packet.firstVertex		= 0;
+
+	// Distance of the cube center from the camera, which looks down -Z. Alpha
+	// blended cubes are drawn back to front, weighted blended ones in any order.
+	glm::vec4 center = View * Model * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	const uint32_t pass = (transparency == TRANSPARENCY_WEIGHTED_OIT) ? RenderQueue::PASS_WEIGHTED_OIT : RenderQueue::PASS_TRANSLUCENT;
+	queue.submit(pass, -center.z, packet);
 }
 
 void VulkanDrawable::update()
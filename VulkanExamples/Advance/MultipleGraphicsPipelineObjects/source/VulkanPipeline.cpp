@@ -53,7 +53,7 @@ void VulkanPipeline::createPipelineCache()
 	assert(result == VK_SUCCESS);
 }
 
-bool VulkanPipeline::createPipeline(VulkanDrawable* drawableObj, VkPipeline* pipeline, VulkanShader* shaderObj, VkBool32 includeDepth, bool clear, VkBool32 includeVi)
+bool VulkanPipeline::createPipeline(VulkanDrawable* drawableObj, VkPipeline* pipeline, VulkanShader* shaderObj, VkBool32 includeDepth, VkBool32 includeVi)
 {
 	// Initialize the dynamic states, initially its empty
 	VkDynamicState dynamicStateEnables[VK_DYNAMIC_STATE_RANGE_SIZE];
@@ -100,10 +100,14 @@ bool VulkanPipeline::createPipeline(VulkanDrawable* drawableObj, VkPipeline* pip
 	rasterStateInfo.depthBiasSlopeFactor			= 0;
 	rasterStateInfo.lineWidth						= 1.0f;
 
+	// Weighted blended transparency writes the accumulation and revealage
+	// attachments of its own subpass instead of blending into the color
+	const bool weightedOit = drawableObj->getTransparency() == VulkanDrawable::TRANSPARENCY_WEIGHTED_OIT;
+
 	// Create the viewport state create info and provide the 
 	// the number of viewport and scissors being used in the
 	// rendering pipeline.
-	VkPipelineColorBlendAttachmentState colorBlendAttachmentStateInfo[1] = {};
+	VkPipelineColorBlendAttachmentState colorBlendAttachmentStateInfo[2] = {};
 	colorBlendAttachmentStateInfo[0].colorWriteMask			= 0xf;
 	colorBlendAttachmentStateInfo[0].blendEnable			= VK_TRUE;
 	//colorBlendAttachmentStateInfo[0].alphaBlendOp			= VK_BLEND_OP_ADD;
@@ -123,11 +127,29 @@ bool VulkanPipeline::createPipeline(VulkanDrawable* drawableObj, VkPipeline* pip
 		VK_COLOR_COMPONENT_B_BIT |
 		VK_COLOR_COMPONENT_A_BIT;
 
+	if (weightedOit) {
+		// Accumulation: sum of the weighted premultiplied colors and coverages
+		colorBlendAttachmentStateInfo[0].srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachmentStateInfo[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachmentStateInfo[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachmentStateInfo[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+
+		// Revealage: product of the transparencies, dst * (1 - alpha)
+		colorBlendAttachmentStateInfo[1].blendEnable			= VK_TRUE;
+		colorBlendAttachmentStateInfo[1].srcColorBlendFactor	= VK_BLEND_FACTOR_ZERO;
+		colorBlendAttachmentStateInfo[1].dstColorBlendFactor	= VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
+		colorBlendAttachmentStateInfo[1].colorBlendOp			= VK_BLEND_OP_ADD;
+		colorBlendAttachmentStateInfo[1].srcAlphaBlendFactor	= VK_BLEND_FACTOR_ZERO;
+		colorBlendAttachmentStateInfo[1].dstAlphaBlendFactor	= VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		colorBlendAttachmentStateInfo[1].alphaBlendOp			= VK_BLEND_OP_ADD;
+		colorBlendAttachmentStateInfo[1].colorWriteMask			= VK_COLOR_COMPONENT_R_BIT;
+	}
+
 	VkPipelineColorBlendStateCreateInfo colorBlendStateInfo = {};
 	colorBlendStateInfo.sType				= VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 	colorBlendStateInfo.flags				= 0;
 	colorBlendStateInfo.pNext				= NULL;
-	colorBlendStateInfo.attachmentCount		= 1;
+	colorBlendStateInfo.attachmentCount		= weightedOit ? 2 : 1;
 	colorBlendStateInfo.pAttachments		= colorBlendAttachmentStateInfo;
 	colorBlendStateInfo.logicOpEnable		= VK_FALSE;
 	colorBlendStateInfo.blendConstants[0]	= 1.0f;
@@ -155,7 +177,8 @@ bool VulkanPipeline::createPipeline(VulkanDrawable* drawableObj, VkPipeline* pip
 	depthStencilStateInfo.pNext								= NULL;
 	depthStencilStateInfo.flags								= 0;
 	depthStencilStateInfo.depthTestEnable					= includeDepth;
-	depthStencilStateInfo.depthWriteEnable					= includeDepth;
+	// The transparency is tested against the depth of the first subpass, it does not occlude itself
+	depthStencilStateInfo.depthWriteEnable					= includeDepth && !weightedOit;
 	depthStencilStateInfo.depthCompareOp					= VK_COMPARE_OP_LESS_OR_EQUAL;
 	depthStencilStateInfo.depthBoundsTestEnable				= VK_FALSE;
 	depthStencilStateInfo.stencilTestEnable					= VK_FALSE;
@@ -201,13 +224,10 @@ bool VulkanPipeline::createPipeline(VulkanDrawable* drawableObj, VkPipeline* pip
 	pipelineInfo.pDynamicState			= &dynamicState;
 	pipelineInfo.pViewportState			= &viewportStateInfo;
 	pipelineInfo.pDepthStencilState		= &depthStencilStateInfo;
-	pipelineInfo.pStages				= &shaderObj->shaderStagesVector[0];
+	pipelineInfo.pStages				= &shaderObj->getStages()[0];
 	pipelineInfo.stageCount				= (uint32_t)shaderObj->shaderStagesVector.size();
-	if(clear)
-		pipelineInfo.renderPass = appObj->rendererObj->renderPass[0];
-	else
-		pipelineInfo.renderPass = appObj->rendererObj->renderPass[1];
-	pipelineInfo.subpass				= 0;
+	pipelineInfo.renderPass				= appObj->rendererObj->renderPass;
+	pipelineInfo.subpass				= weightedOit ? SUBPASS_WEIGHTED_OIT : SUBPASS_COLOR;
 
 	// Create the pipeline using the meta-data store in the VkGraphicsPipelineCreateInfo object
 	if (vkCreateGraphicsPipelines(deviceObj->device, pipelineCache, 1, &pipelineInfo, NULL, pipeline) == VK_SUCCESS)
@@ -220,8 +240,165 @@ bool VulkanPipeline::createPipeline(VulkanDrawable* drawableObj, VkPipeline* pip
 	}
 }
 
+bool VulkanPipeline::createFullscreenPipeline(VulkanShader* shaderObj, VkPipelineLayout pipelineLayout, uint32_t subpass, VkPipeline* pipeline)
+{
+	// The vertex shader makes the triangle from the vertex index
+	VkPipelineVertexInputStateCreateInfo vertexInputStateInfo = {};
+	vertexInputStateInfo.sType					= VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputStateInfo.pNext					= NULL;
+	vertexInputStateInfo.flags					= 0;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
+	inputAssemblyInfo.sType						= VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssemblyInfo.pNext						= NULL;
+	inputAssemblyInfo.flags						= 0;
+	inputAssemblyInfo.primitiveRestartEnable	= VK_FALSE;
+	inputAssemblyInfo.topology					= VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineRasterizationStateCreateInfo rasterStateInfo = {};
+	rasterStateInfo.sType						= VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterStateInfo.pNext						= NULL;
+	rasterStateInfo.flags						= 0;
+	rasterStateInfo.polygonMode					= VK_POLYGON_MODE_FILL;
+	rasterStateInfo.cullMode					= VK_CULL_MODE_NONE;
+	rasterStateInfo.frontFace					= VK_FRONT_FACE_CLOCKWISE;
+	rasterStateInfo.depthClampEnable			= VK_FALSE;
+	rasterStateInfo.rasterizerDiscardEnable		= VK_FALSE;
+	rasterStateInfo.depthBiasEnable				= VK_FALSE;
+	rasterStateInfo.lineWidth					= 1.0f;
+
+	// Blends over the color attachment with the alpha of the fragment
+	VkPipelineColorBlendAttachmentState colorBlendAttachmentStateInfo = {};
+	colorBlendAttachmentStateInfo.blendEnable			= VK_TRUE;
+	colorBlendAttachmentStateInfo.srcColorBlendFactor	= VK_BLEND_FACTOR_SRC_ALPHA;
+	colorBlendAttachmentStateInfo.dstColorBlendFactor	= VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorBlendAttachmentStateInfo.colorBlendOp			= VK_BLEND_OP_ADD;
+	colorBlendAttachmentStateInfo.srcAlphaBlendFactor	= VK_BLEND_FACTOR_ONE;
+	colorBlendAttachmentStateInfo.dstAlphaBlendFactor	= VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachmentStateInfo.alphaBlendOp			= VK_BLEND_OP_ADD;
+	colorBlendAttachmentStateInfo.colorWriteMask		= VK_COLOR_COMPONENT_R_BIT |
+		VK_COLOR_COMPONENT_G_BIT |
+		VK_COLOR_COMPONENT_B_BIT |
+		VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo colorBlendStateInfo = {};
+	colorBlendStateInfo.sType				= VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendStateInfo.flags				= 0;
+	colorBlendStateInfo.pNext				= NULL;
+	colorBlendStateInfo.attachmentCount		= 1;
+	colorBlendStateInfo.pAttachments		= &colorBlendAttachmentStateInfo;
+	colorBlendStateInfo.logicOpEnable		= VK_FALSE;
+
+	VkPipelineViewportStateCreateInfo viewportStateInfo = {};
+	viewportStateInfo.sType					= VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportStateInfo.pNext					= NULL;
+	viewportStateInfo.flags					= 0;
+	viewportStateInfo.viewportCount			= NUMBER_OF_VIEWPORTS;
+	viewportStateInfo.scissorCount			= NUMBER_OF_SCISSORS;
+	viewportStateInfo.pScissors				= NULL;
+	viewportStateInfo.pViewports			= NULL;
+
+	// Same dynamic viewport and scissor as the drawable pipelines
+	VkDynamicState dynamicStateEnables[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType				= VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.pNext				= NULL;
+	dynamicState.pDynamicStates		= dynamicStateEnables;
+	dynamicState.dynamicStateCount	= 2;
+
+	VkPipelineMultisampleStateCreateInfo multiSampleStateInfo = {};
+	multiSampleStateInfo.sType					= VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multiSampleStateInfo.pNext					= NULL;
+	multiSampleStateInfo.flags					= 0;
+	multiSampleStateInfo.rasterizationSamples	= NUM_SAMPLES;
+
+	// No depth state, the subpass has no depth attachment
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType					= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext					= NULL;
+	pipelineInfo.layout					= pipelineLayout;
+	pipelineInfo.basePipelineHandle		= 0;
+	pipelineInfo.basePipelineIndex		= 0;
+	pipelineInfo.flags					= 0;
+	pipelineInfo.pVertexInputState		= &vertexInputStateInfo;
+	pipelineInfo.pInputAssemblyState	= &inputAssemblyInfo;
+	pipelineInfo.pRasterizationState	= &rasterStateInfo;
+	pipelineInfo.pColorBlendState		= &colorBlendStateInfo;
+	pipelineInfo.pTessellationState		= NULL;
+	pipelineInfo.pMultisampleState		= &multiSampleStateInfo;
+	pipelineInfo.pDynamicState			= &dynamicState;
+	pipelineInfo.pViewportState			= &viewportStateInfo;
+	pipelineInfo.pDepthStencilState		= NULL;
+	pipelineInfo.pStages				= &shaderObj->getStages()[0];
+	pipelineInfo.stageCount				= (uint32_t)shaderObj->shaderStagesVector.size();
+	pipelineInfo.renderPass				= appObj->rendererObj->renderPass;
+	pipelineInfo.subpass				= subpass;
+
+	return vkCreateGraphicsPipelines(deviceObj->device, pipelineCache, 1, &pipelineInfo, NULL, pipeline) == VK_SUCCESS;
+}
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+bool VulkanPipeline::createComputePipeline(VulkanShader* shaderObj, VkPipelineLayout pipelineLayout, VkPipeline* pipeline)
+{
+	const std::vector<VkPipelineShaderStageCreateInfo>& stages = shaderObj->getStages();
+
+	const VkPipelineShaderStageCreateInfo* computeStage = NULL;
+	for (size_t i = 0; i < stages.size(); i++) {
+		if (stages[i].stage == VK_SHADER_STAGE_COMPUTE_BIT) {
+			computeStage = &stages[i];
+		}
+	}
+	assert(computeStage);
+
+	// The same module specialized with the same values gives the same pipeline
+	uint64_t key = 0xcbf29ce484222325ULL;
+	key = hashBytes(key, &computeStage->module, sizeof(computeStage->module));
+	key = hashBytes(key, &pipelineLayout, sizeof(pipelineLayout));
+	key = hashBytes(key, computeStage->pName, strlen(computeStage->pName));
+	if (computeStage->pSpecializationInfo) {
+		const uint64_t constantsHash = shaderObj->getSpecialization(VK_SHADER_STAGE_COMPUTE_BIT).getHash();
+		key = hashBytes(key, &constantsHash, sizeof(constantsHash));
+	}
+
+	std::map<uint64_t, VkPipeline>::iterator it = computePipelines.find(key);
+	if (it != computePipelines.end()) {
+		*pipeline = it->second;
+		return true;
+	}
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo = {};
+	computePipelineCreateInfo.sType					= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCreateInfo.pNext					= NULL;
+	computePipelineCreateInfo.flags					= 0;
+	computePipelineCreateInfo.stage					= *computeStage;
+	computePipelineCreateInfo.layout				= pipelineLayout;
+	computePipelineCreateInfo.basePipelineHandle	= 0;
+	computePipelineCreateInfo.basePipelineIndex		= 0;
+
+	if (vkCreateComputePipelines(deviceObj->device, pipelineCache, 1, &computePipelineCreateInfo, NULL, pipeline) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	computePipelines[key] = *pipeline;
+	return true;
+}
+
 // Destroy the pipeline cache object when no more required
 void VulkanPipeline::destroyPipelineCache()
 {
+	for (std::map<uint64_t, VkPipeline>::iterator it = computePipelines.begin(); it != computePipelines.end(); ++it) {
+		vkDestroyPipeline(deviceObj->device, it->second, NULL);
+	}
+	computePipelines.clear();
+
 	vkDestroyPipelineCache(deviceObj->device, pipelineCache, NULL);
 }
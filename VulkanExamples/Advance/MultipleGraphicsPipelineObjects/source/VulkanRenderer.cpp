@@ -27,6 +27,7 @@
 #include "VulkanApplication.h"
 #include "Wrappers.h"
 #include "MeshData.h"
+#include <chrono>
 
 VulkanRenderer::VulkanRenderer(VulkanApplication * app, VulkanDevice* deviceObject)
 {
@@ -42,9 +43,11 @@ VulkanRenderer::VulkanRenderer(VulkanApplication * app, VulkanDevice* deviceObje
 	drawableList.push_back(drawableObj);
 	drawableObj = new VulkanDrawable(this);
 	drawableObj->antiDir = true;
+	drawableObj->setTransparency(VulkanDrawable::TRANSPARENCY_WEIGHTED_OIT);
 	drawableList.push_back(drawableObj);
 	cmdPoolGrpahics = NULL;
 	cmdPoolCompute = NULL;
+	weightedOitAvailable = true;
 
 	VkSemaphoreCreateInfo presentCompleteSemaphoreCreateInfo;
 	presentCompleteSemaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -75,6 +78,10 @@ VulkanRenderer::~VulkanRenderer()
 
 void VulkanRenderer::initialize()
 {
+	// All the shaders compile in the background while
+	// the other resources are created.
+	compileShaders();
+
 	// We need command buffers for graphics operation, so create a command buffer pool for graphics
 	createCommandPoolGraphics();
 
@@ -86,12 +93,10 @@ void VulkanRenderer::initialize()
 	
 	const bool includeDepth = true;
 	// Create the render pass now..
-	createRenderPass(includeDepth, true);
-	createRenderPass(includeDepth, false);
+	createRenderPass(includeDepth);
 
 	// Use render pass and create frame buffer
-	createFrameBuffer(includeDepth, true);
-	createFrameBuffer(includeDepth, false);
+	createFrameBuffer(includeDepth);
 
 	// Create the vertex and fragment shader
 	createShaders();
@@ -116,24 +121,125 @@ void VulkanRenderer::initialize()
 	// Manage the pipeline state objects
 	createPipelineStateManagement();
 
+	createWeightedOitComposite();
+
 	createComputeBuffer();
 
+	createRadixSort();
+
 	// Use the number of swapchain images count and resize the vecCmdDraw
 	vecCmdDraw.resize(swapChainObj->scPublicVars.swapchainImageCount);
 }
 
 void VulkanRenderer::prepare()
 {
-	// Clear the existing command buffers
-	//destroyDrawableCommandBuffer();
+	// For each swapbuffer color surface image buffer 
+	// allocate the corresponding command buffer
 	for (int i = 0; i < vecCmdDraw.size(); i++) {
-		vecCmdDraw[i].clear();
+		CommandBufferMgr::allocCommandBuffer(&deviceObj->device, cmdPoolGrpahics, &vecCmdDraw[i]);
+		recordFrame(i);
 	}
 
+	const RenderQueue::BindCounts& unsortedBinds	= renderQueue.getUnsortedBinds();
+	const RenderQueue::BindCounts& sortedBinds		= renderQueue.getSortedBinds();
+	std::cout << "Render queue: " << sortedBinds.draws << " draws" << std::endl;
+	std::cout << "\tsubmission order binds: " << unsortedBinds.pipelines << " pipeline, "
+		<< unsortedBinds.descriptorSets << " descriptor set, " << unsortedBinds.vertexBuffers << " vertex buffer" << std::endl;
+	std::cout << "\tsorted order binds:     " << sortedBinds.pipelines << " pipeline, "
+		<< sortedBinds.descriptorSets << " descriptor set, " << sortedBinds.vertexBuffers << " vertex buffer" << std::endl;
+}
+
+void VulkanRenderer::recordFrame(int currentImage)
+{
+	// Beginning the command buffer implicitly resets it, the graphics
+	// command pool is created with the reset command buffer flag
+	CommandBufferMgr::beginCommandBuffer(vecCmdDraw[currentImage]);
+
+	// Create the render pass instance 
+	recordCommandBuffer(currentImage, &vecCmdDraw[currentImage]);
+
+	// Finish the command buffer recording
+	CommandBufferMgr::endCommandBuffer(vecCmdDraw[currentImage]);
+}
+
+void VulkanRenderer::recordCommandBuffer(int currentImage, VkCommandBuffer* cmdDraw)
+{
+	// Specify the clear color value
+	VkClearValue clearValues[4];
+	clearValues[0].color.float32[0]		= 1.0f;
+	clearValues[0].color.float32[1]		= 1.0f;
+	clearValues[0].color.float32[2]		= 1.0f;
+	clearValues[0].color.float32[3]		= 1.0f;
+
+	// Specify the depth/stencil clear value
+	clearValues[1].depthStencil.depth	= 1.0f;
+	clearValues[1].depthStencil.stencil	= 0;
+
+	// Nothing accumulated yet, everything revealed
+	clearValues[2].color.float32[0]		= 0.0f;
+	clearValues[2].color.float32[1]		= 0.0f;
+	clearValues[2].color.float32[2]		= 0.0f;
+	clearValues[2].color.float32[3]		= 0.0f;
+	clearValues[3].color.float32[0]		= 1.0f;
+	clearValues[3].color.float32[1]		= 0.0f;
+	clearValues[3].color.float32[2]		= 0.0f;
+	clearValues[3].color.float32[3]		= 0.0f;
+
+	// Define the VkRenderPassBeginInfo control structure
+	VkRenderPassBeginInfo renderPassBegin;
+	renderPassBegin.sType						= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBegin.pNext						= NULL;
+	renderPassBegin.renderPass					= renderPass;
+	renderPassBegin.framebuffer					= framebuffers[currentImage];
+	renderPassBegin.renderArea.offset.x			= 0;
+	renderPassBegin.renderArea.offset.y			= 0;
+	renderPassBegin.renderArea.extent.width		= width;
+	renderPassBegin.renderArea.extent.height	= height;
+	renderPassBegin.clearValueCount				= 4;
+	renderPassBegin.pClearValues				= clearValues;
+
+	// All the drawables render into one render pass instance, the attachments
+	// are loaded and stored once per frame instead of once per drawable
+	vkCmdBeginRenderPass(*cmdDraw, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+
+	// The viewport and scissor are dynamic states shared by all the pipelines
+	VkViewport viewport;
+	viewport.x			= 0;
+	viewport.y			= 0;
+	viewport.width		= (float)width;
+	viewport.height		= (float)height;
+	viewport.minDepth	= (float) 0.0f;
+	viewport.maxDepth	= (float) 1.0f;
+	vkCmdSetViewport(*cmdDraw, 0, NUMBER_OF_VIEWPORTS, &viewport);
+
+	VkRect2D scissor;
+	scissor.offset.x		= 0;
+	scissor.offset.y		= 0;
+	scissor.extent.width	= width;
+	scissor.extent.height	= height;
+	vkCmdSetScissor(*cmdDraw, 0, NUMBER_OF_SCISSORS, &scissor);
+
+	// Gather the draws, group them by state and record them
+	renderQueue.begin();
 	for each (VulkanDrawable* drawableObj in drawableList)
 	{
-		drawableObj->prepare();
+		drawableObj->submitDraws(renderQueue);
+	}
+	renderQueue.sort();
+	renderQueue.emit(*cmdDraw, RenderQueue::PASS_OPAQUE);
+	renderQueue.emit(*cmdDraw, RenderQueue::PASS_TRANSLUCENT);
+
+	// The weighted blended drawables accumulate in their own subpass,
+	// which the last subpass resolves over the color
+	vkCmdNextSubpass(*cmdDraw, VK_SUBPASS_CONTENTS_INLINE);
+	const uint32_t weightedOitDraws = renderQueue.emit(*cmdDraw, RenderQueue::PASS_WEIGHTED_OIT);
+	vkCmdNextSubpass(*cmdDraw, VK_SUBPASS_CONTENTS_INLINE);
+	if (weightedOitDraws) {
+		weightedOit.recordComposite(*cmdDraw);
 	}
+
+	// End of render pass instance recording
+	vkCmdEndRenderPass(*cmdDraw);
 }
 
 void VulkanRenderer::update()
@@ -332,7 +438,7 @@ void VulkanRenderer::createCommandPoolGraphics()
 	cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	cmdPoolInfo.pNext = NULL;
 	cmdPoolInfo.queueFamilyIndex = deviceObj->graphicsQueueWithPresentIndex;
-	cmdPoolInfo.flags = 0;
+	cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;	// The draw command buffers are recorded every frame
 
 	res = vkCreateCommandPool(deviceObj->device, &cmdPoolInfo, NULL, &cmdPoolGrpahics);
 	assert(res == VK_SUCCESS);
@@ -470,6 +576,28 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 	// Get number of mip-map levels
 	texture->mipMapLevels	= uint32_t(image2D.levels());
 
+	// Use the format stored in the texture file unless the caller overrides it
+	if (format == VK_FORMAT_UNDEFINED) {
+		format = getVulkanFormat(image2D.format());
+	}
+	assert(format != VK_FORMAT_UNDEFINED);
+	texture->format = format;
+
+	// Block compressed formats are optional, make sure the
+	// device can sample the format with optimal tiling
+	VkFormatProperties formatProps;
+	vkGetPhysicalDeviceFormatProperties(*deviceObj->gpu, format, &formatProps);
+	if (!(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+		std::cout << "Texture format " << format << " of " << filename << " cannot be sampled by this device." << std::endl;
+		assert(0);
+		return;
+	}
+
+	// Compressed formats can not be used as storage images, drop the usage if not supported
+	if ((imageUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) && !(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+		imageUsageFlags &= ~VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+
 	// Create a staging buffer resource states using.
 	// Indicate it be the source of the transfer command.
 	// .usage	= VK_BUFFER_USAGE_TRANSFER_SRC_BIT
@@ -581,8 +709,10 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 	std::vector<VkBufferImageCopy> bufferImgCopyList;
 
 
-	uint32_t bufferOffset = 0;
+	VkDeviceSize bufferOffset = 0;
 	// Iterater through each mip level and set buffer image copy -
+	// The extent is given in texels, for block compressed formats the
+	// levels smaller than a block are copied as a whole block.
 	for (uint32_t i = 0; i < texture->mipMapLevels; i++)
 	{
 		VkBufferImageCopy bufImgCopyItem = {};
@@ -598,7 +728,7 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 		bufferImgCopyList.push_back(bufImgCopyItem);
 
 		// adjust buffer offset
-		bufferOffset += uint32_t(image2D[i].size());
+		bufferOffset += image2D[i].size();
 	}
 
 	// Copy the staging buffer memory data contain
@@ -674,8 +804,8 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 	samplerCI.borderColor				= VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 	samplerCI.unnormalizedCoordinates	= VK_FALSE;
 
-	error = vkCreateSampler(deviceObj->device, &samplerCI, nullptr, &texture->sampler);
-	assert(!error);
+	// Get a shared sampler from the device sampler cache
+	texture->sampler = deviceObj->samplerCache.acquireSampler(samplerCI);
 
 	// Create image view to allow shader to access the texture information -
 	VkImageViewCreateInfo viewCI = {};
@@ -712,6 +842,22 @@ void VulkanRenderer::createTextureLinear(const char* filename, TextureData *text
 	// Get number of mip-map levels
 	texture->mipMapLevels	= uint32_t(image2D.levels());
 
+	// Use the format stored in the texture file unless the caller overrides it
+	if (format == VK_FORMAT_UNDEFINED) {
+		format = getVulkanFormat(image2D.format());
+	}
+	assert(format != VK_FORMAT_UNDEFINED);
+	texture->format = format;
+
+	// Linear tiling support is very limited and block compressed
+	// formats are generally not supported, use the staging path then
+	VkFormatProperties formatProps;
+	vkGetPhysicalDeviceFormatProperties(*deviceObj->gpu, format, &formatProps);
+	if (!(formatProps.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+		createTextureOptimal(filename, texture, imageUsageFlags, format);
+		return;
+	}
+
 	// Create image resource states using VkImageCreateInfo
 	VkImageCreateInfo imageCreateInfo   = {};
 	imageCreateInfo.sType				= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -776,13 +922,17 @@ void VulkanRenderer::createTextureLinear(const char* filename, TextureData *text
 	error = vkMapMemory(deviceObj->device, texture->mem, 0, texture->memoryAlloc.allocationSize, 0, (void**)&data);
 	assert(!error);
 
-	// Load image texture data in the mapped buffer
+	// Load image texture data in the mapped buffer, a row
+	// is a row of blocks for block compressed formats
+	const gli::dim3_t blockExtent	= gli::block_dimensions(image2D.format());
+	const uint32_t rowCount			= (texture->textureHeight + blockExtent.y - 1) / blockExtent.y;
+	const size_t rowSize			= ((texture->textureWidth + blockExtent.x - 1) / blockExtent.x) * gli::block_size(image2D.format());
+
 	uint8_t* dataTemp = (uint8_t*)image2D.data();
-	for (int y = 0; y < image2D[0].dimensions().y; y++)
+	for (uint32_t y = 0; y < rowCount; y++)
 	{
-		size_t imageSize = image2D[0].dimensions().y * 4;
-		memcpy(data, dataTemp, imageSize);
-		dataTemp += imageSize;
+		memcpy(data, dataTemp, rowSize);
+		dataTemp += rowSize;
 
 		// Advance row by row pitch information
 		data += layout.rowPitch;
@@ -854,9 +1004,8 @@ void VulkanRenderer::createTextureLinear(const char* filename, TextureData *text
 	samplerCI.borderColor			= VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 	samplerCI.unnormalizedCoordinates = VK_FALSE;
 
-	// Create the sampler
-	error = vkCreateSampler(deviceObj->device, &samplerCI, NULL, &texture->sampler);
-	assert(!error);
+	// Get a shared sampler from the device sampler cache
+	texture->sampler = deviceObj->samplerCache.acquireSampler(samplerCI);
 
 	// Create image view to allow shader to access the texture information -
 	VkImageViewCreateInfo viewCI	= {};
@@ -887,19 +1036,20 @@ void VulkanRenderer::createTextureLinear(const char* filename, TextureData *text
 	}
 }
 
-void VulkanRenderer::createRenderPass(bool isDepthSupported, bool clear)
+void VulkanRenderer::createRenderPass(bool isDepthSupported)
 {
 	// Dependency on VulkanSwapChain::createSwapChain() to 
 	// get the color surface image and VulkanRenderer::createDepthBuffer()
 	// to get the depth buffer image.
 	
 	VkResult  result;
-	// Attach the color buffer and depth buffer as an attachment to render pass instance
-	VkAttachmentDescription attachments[2];
+	// Attach the color buffer, depth buffer and the transparency attachments to render pass instance
+	VkAttachmentDescription attachments[4];
+	uint32_t attachmentCount = 1;
 	attachments[0].format					= swapChainObj->scPublicVars.format;
 	attachments[0].samples					= NUM_SAMPLES;
-	attachments[0].loadOp = clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	//attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	// The frame is drawn in a single render pass instance: clear on load, store for presentation
+	attachments[0].loadOp					= VK_ATTACHMENT_LOAD_OP_CLEAR;
 	attachments[0].storeOp					= VK_ATTACHMENT_STORE_OP_STORE;
 	attachments[0].stencilLoadOp			= VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[0].stencilStoreOp			= VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -912,16 +1062,33 @@ void VulkanRenderer::createRenderPass(bool isDepthSupported, bool clear)
 	{
 		attachments[1].format				= Depth.format;
 		attachments[1].samples				= NUM_SAMPLES;
-		attachments[1].loadOp = clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		//attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		attachments[1].storeOp				= VK_ATTACHMENT_STORE_OP_STORE;
-		attachments[1].stencilLoadOp		= VK_ATTACHMENT_LOAD_OP_LOAD;
-		attachments[1].stencilStoreOp		= VK_ATTACHMENT_STORE_OP_STORE;
+		// Nothing reads the depth after the frame, it never leaves the tile memory
+		attachments[1].loadOp				= VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[1].storeOp				= VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].stencilLoadOp		= VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[1].stencilStoreOp		= VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		attachments[1].initialLayout		= VK_IMAGE_LAYOUT_UNDEFINED;
 		attachments[1].finalLayout			= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 		attachments[1].flags				= VK_ATTACHMENT_DESCRIPTION_MAY_ALIAS_BIT;
+		attachmentCount++;
 	}
 
+	// The weighted blended transparency attachments only live in the render pass
+	// instance: cleared on load, read by the composite subpass and never stored
+	const uint32_t accumulationIndex		= attachmentCount++;
+	const uint32_t revealageIndex			= attachmentCount++;
+	attachments[accumulationIndex].format			= WeightedBlendedOit::accumulationFormat;
+	attachments[accumulationIndex].samples			= NUM_SAMPLES;
+	attachments[accumulationIndex].loadOp			= VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[accumulationIndex].storeOp			= VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[accumulationIndex].stencilLoadOp	= VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[accumulationIndex].stencilStoreOp	= VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[accumulationIndex].initialLayout	= VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[accumulationIndex].finalLayout		= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	attachments[accumulationIndex].flags			= 0;
+	attachments[revealageIndex]						= attachments[accumulationIndex];
+	attachments[revealageIndex].format				= WeightedBlendedOit::revealageFormat;
+
 	// Define the color buffer attachment binding point and layout information
 	VkAttachmentReference colorReference	= {};
 	colorReference.attachment				= 0;
@@ -932,66 +1099,118 @@ void VulkanRenderer::createRenderPass(bool isDepthSupported, bool clear)
 	depthReference.attachment				= 1;
 	depthReference.layout					= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+	// The transparency attachments are written by one subpass and read by the next
+	VkAttachmentReference oitColorReferences[2];
+	oitColorReferences[0].attachment		= accumulationIndex;
+	oitColorReferences[0].layout			= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	oitColorReferences[1].attachment		= revealageIndex;
+	oitColorReferences[1].layout			= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference oitInputReferences[2];
+	oitInputReferences[0].attachment		= accumulationIndex;
+	oitInputReferences[0].layout			= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	oitInputReferences[1].attachment		= revealageIndex;
+	oitInputReferences[1].layout			= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
 	// Specify the attachments - color, depth, resolve, preserve etc.
-	VkSubpassDescription subpass			= {};
-	subpass.pipelineBindPoint				= VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.flags							= 0;
-	subpass.inputAttachmentCount			= 0;
-	subpass.pInputAttachments				= NULL;
-	subpass.colorAttachmentCount			= 1;
-	subpass.pColorAttachments				= &colorReference;
-	subpass.pResolveAttachments				= NULL;
-	subpass.pDepthStencilAttachment			= isDepthSupported ? &depthReference : NULL;
-	subpass.preserveAttachmentCount			= 0;
-	subpass.pPreserveAttachments			= NULL;
+	VkSubpassDescription subpasses[SUBPASS_COUNT] = {};
+	subpasses[SUBPASS_COLOR].pipelineBindPoint			= VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpasses[SUBPASS_COLOR].flags						= 0;
+	subpasses[SUBPASS_COLOR].inputAttachmentCount		= 0;
+	subpasses[SUBPASS_COLOR].pInputAttachments			= NULL;
+	subpasses[SUBPASS_COLOR].colorAttachmentCount		= 1;
+	subpasses[SUBPASS_COLOR].pColorAttachments			= &colorReference;
+	subpasses[SUBPASS_COLOR].pResolveAttachments		= NULL;
+	subpasses[SUBPASS_COLOR].pDepthStencilAttachment	= isDepthSupported ? &depthReference : NULL;
+	subpasses[SUBPASS_COLOR].preserveAttachmentCount	= 0;
+	subpasses[SUBPASS_COLOR].pPreserveAttachments		= NULL;
+
+	// Depth tested against the first subpass, the color is kept for the composite
+	subpasses[SUBPASS_WEIGHTED_OIT]						= subpasses[SUBPASS_COLOR];
+	subpasses[SUBPASS_WEIGHTED_OIT].colorAttachmentCount	= 2;
+	subpasses[SUBPASS_WEIGHTED_OIT].pColorAttachments		= oitColorReferences;
+	subpasses[SUBPASS_WEIGHTED_OIT].preserveAttachmentCount	= 1;
+	subpasses[SUBPASS_WEIGHTED_OIT].pPreserveAttachments	= &colorReference.attachment;
+
+	subpasses[SUBPASS_COMPOSITE]						= subpasses[SUBPASS_COLOR];
+	subpasses[SUBPASS_COMPOSITE].inputAttachmentCount	= 2;
+	subpasses[SUBPASS_COMPOSITE].pInputAttachments		= oitInputReferences;
+	subpasses[SUBPASS_COMPOSITE].pDepthStencilAttachment	= NULL;
+
+	// All dependencies are per pixel, the tiles never leave the chip between subpasses
+	VkSubpassDependency dependencies[3]		= {};
+	// The transparency is tested against the depth written by the first subpass
+	dependencies[0].srcSubpass				= SUBPASS_COLOR;
+	dependencies[0].dstSubpass				= SUBPASS_WEIGHTED_OIT;
+	dependencies[0].srcStageMask			= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstStageMask			= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask			= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstAccessMask			= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+	dependencies[0].dependencyFlags			= VK_DEPENDENCY_BY_REGION_BIT;
+
+	// The composite blends over the color of the first subpass
+	dependencies[1].srcSubpass				= SUBPASS_COLOR;
+	dependencies[1].dstSubpass				= SUBPASS_COMPOSITE;
+	dependencies[1].srcStageMask			= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].dstStageMask			= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].srcAccessMask			= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask			= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dependencyFlags			= VK_DEPENDENCY_BY_REGION_BIT;
+
+	// and reads the accumulation and revealage at its own pixel
+	dependencies[2].srcSubpass				= SUBPASS_WEIGHTED_OIT;
+	dependencies[2].dstSubpass				= SUBPASS_COMPOSITE;
+	dependencies[2].srcStageMask			= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[2].dstStageMask			= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[2].srcAccessMask			= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[2].dstAccessMask			= VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+	dependencies[2].dependencyFlags			= VK_DEPENDENCY_BY_REGION_BIT;
 
 	// Specify the attachement and subpass associate with render pass
 	VkRenderPassCreateInfo rpInfo			= {};
 	rpInfo.sType							= VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	rpInfo.pNext							= NULL;
-	rpInfo.attachmentCount					= isDepthSupported ? 2 : 1;
+	rpInfo.attachmentCount					= attachmentCount;
 	rpInfo.pAttachments						= attachments;
-	rpInfo.subpassCount						= 1;
-	rpInfo.pSubpasses						= &subpass;
-	rpInfo.dependencyCount					= 0;
-	rpInfo.pDependencies					= NULL;
+	rpInfo.subpassCount						= SUBPASS_COUNT;
+	rpInfo.pSubpasses						= subpasses;
+	rpInfo.dependencyCount					= isDepthSupported ? 3 : 2;
+	rpInfo.pDependencies					= isDepthSupported ? dependencies : &dependencies[1];
 
 	// Create the render pass object
-	if(clear)
-		result = vkCreateRenderPass(deviceObj->device, &rpInfo, NULL, &renderPass[0]);
-	else
-		result = vkCreateRenderPass(deviceObj->device, &rpInfo, NULL, &renderPass[1]);
+	result = vkCreateRenderPass(deviceObj->device, &rpInfo, NULL, &renderPass);
 	assert(result == VK_SUCCESS);
 }
 
-void VulkanRenderer::createFrameBuffer(bool includeDepth, bool clear)
+void VulkanRenderer::createFrameBuffer(bool includeDepth)
 {
 	// Dependency on createDepthBuffer(), createRenderPass() and createSwapChain()
 	VkResult  result;
-	VkImageView attachments[2];
-	attachments[1] = Depth.view;
+	// Same attachment order as createRenderPass(), the color view is set per swapchain image
+	VkImageView attachments[4];
+	uint32_t attachmentCount = 1;
+	if (includeDepth) {
+		attachments[attachmentCount++] = Depth.view;
+	}
+	attachments[attachmentCount++] = weightedOit.getAccumulationView();
+	attachments[attachmentCount++] = weightedOit.getRevealageView();
 
 	VkFramebufferCreateInfo fbInfo	= {};
 	fbInfo.sType					= VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 	fbInfo.pNext					= NULL;
-	if(clear)
-		fbInfo.renderPass			= renderPass[0];
-	else
-		fbInfo.renderPass			= renderPass[1];
-
-	fbInfo.attachmentCount			= includeDepth ? 2 : 1;
+	fbInfo.renderPass				= renderPass;
+	fbInfo.attachmentCount			= attachmentCount;
 	fbInfo.pAttachments				= attachments;
 	fbInfo.width					= width;
 	fbInfo.height					= height;
 	fbInfo.layers					= 1;
 
 	uint32_t i;
-	int idx = clear ? 0 : 1;
-	framebuffers[idx].clear();
-	framebuffers[idx].resize(swapChainObj->scPublicVars.swapchainImageCount);
+	framebuffers.clear();
+	framebuffers.resize(swapChainObj->scPublicVars.swapchainImageCount);
 	for (i = 0; i < swapChainObj->scPublicVars.swapchainImageCount; i++) {
 		attachments[0] = swapChainObj->scPublicVars.colorBuffer[i].view;
-		result = vkCreateFramebuffer(deviceObj->device, &fbInfo, NULL, &framebuffers[idx].at(i));
+		result = vkCreateFramebuffer(deviceObj->device, &fbInfo, NULL, &framebuffers.at(i));
 		assert(result == VK_SUCCESS);
 	}
 }
@@ -999,17 +1218,14 @@ void VulkanRenderer::createFrameBuffer(bool includeDepth, bool clear)
 void VulkanRenderer::destroyFramebuffers()
 {
 	for (uint32_t i = 0; i < swapChainObj->scPublicVars.swapchainImageCount; i++) {
-		vkDestroyFramebuffer(deviceObj->device, framebuffers[0].at(i), NULL);
-		vkDestroyFramebuffer(deviceObj->device, framebuffers[1].at(i), NULL);
+		vkDestroyFramebuffer(deviceObj->device, framebuffers.at(i), NULL);
 	}
-	framebuffers[0].clear();
-	framebuffers[1].clear();
+	framebuffers.clear();
 }
 
 void VulkanRenderer::destroyRenderpass()
 {
-	vkDestroyRenderPass(deviceObj->device, renderPass[0], NULL);
-	vkDestroyRenderPass(deviceObj->device, renderPass[1], NULL);
+	vkDestroyRenderPass(deviceObj->device, renderPass, NULL);
 }
 
 void VulkanRenderer::destroyDrawableVertexBuffer()
@@ -1031,16 +1247,15 @@ void VulkanRenderer::destroyDrawableUniformBuffer()
 void VulkanRenderer::destroyTextureResource()
 {
 	vkFreeMemory(deviceObj->device, texture.mem, NULL);
-	vkDestroySampler(deviceObj->device, texture.sampler, NULL);
+	deviceObj->samplerCache.releaseSampler(texture.sampler);
 	vkDestroyImage(deviceObj->device, texture.image, NULL);
 	vkDestroyImageView(deviceObj->device, texture.view, NULL);
 }
 
-void VulkanRenderer::destroyDrawableCommandBuffer()
+void VulkanRenderer::destroyDrawCommandBuffer()
 {
-	for each (VulkanDrawable* drawableObj in drawableList)
-	{
-		drawableObj->destroyCommandBuffer();
+	for (int i = 0; i < vecCmdDraw.size(); i++) {
+		vkFreeCommandBuffers(deviceObj->device, cmdPoolGrpahics, 1, &vecCmdDraw[i]);
 	}
 }
 
@@ -1080,6 +1295,9 @@ void VulkanRenderer::buildSwapChainAndDepthImage()
 	
 	// Create the depth image
 	createDepthImage();
+
+	// and the weighted blended transparency attachments of the same size
+	weightedOit.createAttachments(deviceObj, width, height);
 }
 
 void VulkanRenderer::createVertexBuffer()
@@ -1127,8 +1345,10 @@ void VulkanRenderer::createComputeBuffer()
 	size_t sizeCompt;
 
 #ifdef AUTO_COMPILE_GLSL_TO_SPV
-	compShaderCode = readFile("./../Compute.comp", &sizeCompt);
-	computeShaders.buildShader((const char*)compShaderCode, "main", VK_SHADER_STAGE_COMPUTE_BIT);
+	// Wait for the compute shader queued by compileShaders()
+	const std::vector<unsigned int>& compSPVCode = compSPV.get();
+	assert(!compSPVCode.empty());
+	computeShaders.buildShaderModuleWithSPV((uint32_t*)compSPVCode.data(), compSPVCode.size() * sizeof(unsigned int), "main", VK_SHADER_STAGE_COMPUTE_BIT);
 #else
 	compShaderCode = readFile("./../Compute-comp.spv", &sizeCompt);
 	computeShaders.buildShaderModuleWithSPV((uint32_t*)compShaderCode, sizeCompt, "main", VK_SHADER_STAGE_COMPUTE_BIT);
@@ -1273,29 +1493,314 @@ void VulkanRenderer::createComputeBuffer()
 
 }
 
+// Host visible buffer for the uploads and read backs of checkRadixSort()
+static void createHostBuffer(VulkanDevice* deviceObj, VkBufferUsageFlags usage, VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* memory)
+{
+	VkResult result;
+	bool pass;
+
+	VkBufferCreateInfo bufInfo		= {};
+	bufInfo.sType					= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufInfo.pNext					= NULL;
+	bufInfo.usage					= usage;
+	bufInfo.size					= size;
+	bufInfo.sharingMode				= VK_SHARING_MODE_EXCLUSIVE;
+	bufInfo.flags					= 0;
+	result = vkCreateBuffer(deviceObj->device, &bufInfo, NULL, buffer);
+	assert(result == VK_SUCCESS);
+
+	VkMemoryRequirements memRqrmnt;
+	vkGetBufferMemoryRequirements(deviceObj->device, *buffer, &memRqrmnt);
+
+	VkMemoryAllocateInfo allocInfo	= {};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext					= NULL;
+	allocInfo.allocationSize		= memRqrmnt.size;
+	pass = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &allocInfo.memoryTypeIndex);
+	assert(pass);
+	result = vkAllocateMemory(deviceObj->device, &allocInfo, NULL, memory);
+	assert(result == VK_SUCCESS);
+	result = vkBindBufferMemory(deviceObj->device, *buffer, *memory, 0);
+	assert(result == VK_SUCCESS);
+}
+
+void VulkanRenderer::createRadixSort()
+{
+	const uint32_t* spirv[GpuRadixSort::KERNEL_TOTAL];
+	size_t spirvSize[GpuRadixSort::KERNEL_TOTAL];
+
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+	// Wait for the kernels queued by compileShaders()
+	bool isComplete = true;
+	for (int kernel = 0; kernel < GpuRadixSort::KERNEL_TOTAL; kernel++) {
+		const std::vector<unsigned int>& kernelSPVCode = radixSPV[kernel].get();
+		isComplete			= isComplete && !kernelSPVCode.empty();
+		spirv[kernel]		= kernelSPVCode.data();
+		spirvSize[kernel]	= kernelSPVCode.size() * sizeof(unsigned int);
+	}
+	if (isComplete) {
+		radixSort.initialize(deviceObj, &pipelineObj, RADIX_SORT_INSTANCE_COUNT, spirv, spirvSize);
+	}
+#else
+	bool isComplete = true;
+	void* kernelShaderCode[GpuRadixSort::KERNEL_TOTAL];
+	for (int kernel = 0; kernel < GpuRadixSort::KERNEL_TOTAL; kernel++) {
+		std::string fileName = std::string("./../") + GpuRadixSort::kernelNames[kernel] + "-comp.spv";
+		kernelShaderCode[kernel]	= readFile(fileName.c_str(), &spirvSize[kernel]);
+		spirv[kernel]				= (uint32_t*)kernelShaderCode[kernel];
+		isComplete					= isComplete && kernelShaderCode[kernel];
+	}
+	if (isComplete) {
+		radixSort.initialize(deviceObj, &pipelineObj, RADIX_SORT_INSTANCE_COUNT, spirv, spirvSize);
+	}
+	for (int kernel = 0; kernel < GpuRadixSort::KERNEL_TOTAL; kernel++) {
+		free(kernelShaderCode[kernel]);
+	}
+#endif
+
+	// Nothing draws with the sort yet, the sample runs without it
+	if (!isComplete) {
+		std::cout << "Radix sort kernels not found, the GPU radix sort and its check are skipped" << std::endl;
+		return;
+	}
+
+	// The sort does not depend on the window, check it on the first initialization only
+	if (!application->isResizing) {
+		checkRadixSort();
+	}
+}
+
+void VulkanRenderer::checkRadixSort()
+{
+	const uint32_t count = radixSort.getCapacity();
+	const VkDeviceSize arraySize = (VkDeviceSize)count * sizeof(uint32_t);
+
+	// A cloud of instances in front of the camera
+	VkBuffer positionBuffer;
+	VkDeviceMemory positionMemory;
+	createHostBuffer(deviceObj, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, count * sizeof(glm::vec4), &positionBuffer, &positionMemory);
+
+	glm::vec4* positions;
+	VkResult result = vkMapMemory(deviceObj->device, positionMemory, 0, VK_WHOLE_SIZE, 0, (void**)&positions);
+	assert(result == VK_SUCCESS);
+	for (uint32_t i = 0; i < count; i++) {
+		positions[i] = glm::vec4(rand() / (float)RAND_MAX * 20.0f - 10.0f, rand() / (float)RAND_MAX * 20.0f - 10.0f,
+			rand() / (float)RAND_MAX * -50.0f, 1.0f);
+	}
+	vkUnmapMemory(deviceObj->device, positionMemory);
+	radixSort.setPositions(positionBuffer);
+
+	// Keys followed by values
+	VkBuffer readbackBuffer;
+	VkDeviceMemory readbackMemory;
+	createHostBuffer(deviceObj, VK_BUFFER_USAGE_TRANSFER_DST_BIT, arraySize * 2, &readbackBuffer, &readbackMemory);
+
+	VkBufferCopy copyRegions[2] = {
+		{ 0, 0,			arraySize },
+		{ 0, arraySize,	arraySize },
+	};
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext			= NULL;
+	barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_TRANSFER_READ_BIT;
+
+	VkMemoryBarrier hostBarrier = {};
+	hostBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	hostBarrier.pNext			= NULL;
+	hostBarrier.srcAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	hostBarrier.dstAccessMask	= VK_ACCESS_HOST_READ_BIT;
+
+	if (!getCommandPoolCompute()) createCommandPoolCompute();
+	VkCommandBuffer commandBuffers[2];
+	for (int i = 0; i < 2; i++) {
+		CommandBufferMgr::allocCommandBuffer(&deviceObj->device, getCommandPoolCompute(), &commandBuffers[i]);
+	}
+
+	// The unsorted keys, as input of the CPU reference
+	CommandBufferMgr::beginCommandBuffer(commandBuffers[0]);
+	radixSort.recordDepthKeys(commandBuffers[0], count, glm::mat4(1.0f));
+	vkCmdPipelineBarrier(commandBuffers[0], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+	vkCmdCopyBuffer(commandBuffers[0], radixSort.getKeyBuffer(), readbackBuffer, 1, &copyRegions[0]);
+	vkCmdCopyBuffer(commandBuffers[0], radixSort.getValueBuffer(), readbackBuffer, 1, &copyRegions[1]);
+	vkCmdPipelineBarrier(commandBuffers[0], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, NULL, 0, NULL);
+	CommandBufferMgr::endCommandBuffer(commandBuffers[0]);
+	CommandBufferMgr::submitCommandBuffer(deviceObj->queueComupte, &commandBuffers[0]);
+
+	uint32_t* readback;
+	result = vkMapMemory(deviceObj->device, readbackMemory, 0, VK_WHOLE_SIZE, 0, (void**)&readback);
+	assert(result == VK_SUCCESS);
+	std::vector<uint32_t> referenceKeys(readback, readback + count);
+	std::vector<uint32_t> referenceValues(readback + count, readback + 2 * count);
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	GpuRadixSort::sortReference(referenceKeys, referenceValues);
+	const double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// The sort on its own, timed around the submission, which waits for the queue to idle
+	CommandBufferMgr::beginCommandBuffer(commandBuffers[1]);
+	radixSort.recordSort(commandBuffers[1], count);
+	vkCmdCopyBuffer(commandBuffers[1], radixSort.getKeyBuffer(), readbackBuffer, 1, &copyRegions[0]);
+	vkCmdCopyBuffer(commandBuffers[1], radixSort.getValueBuffer(), readbackBuffer, 1, &copyRegions[1]);
+	vkCmdPipelineBarrier(commandBuffers[1], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, NULL, 0, NULL);
+	CommandBufferMgr::endCommandBuffer(commandBuffers[1]);
+
+	start = std::chrono::high_resolution_clock::now();
+	CommandBufferMgr::submitCommandBuffer(deviceObj->queueComupte, &commandBuffers[1]);
+	const double gpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const bool match = memcmp(readback, referenceKeys.data(), arraySize) == 0 &&
+		memcmp(readback + count, referenceValues.data(), arraySize) == 0;
+	std::cout << "Radix sort of " << count << " instance depths: GPU " << gpuTime << " ms, CPU reference "
+		<< cpuTime << " ms, " << (match ? "results match" : "RESULTS DIFFER") << std::endl;
+	assert(match);
+
+	vkUnmapMemory(deviceObj->device, readbackMemory);
+	vkFreeCommandBuffers(deviceObj->device, getCommandPoolCompute(), 2, commandBuffers);
+	vkDestroyBuffer(deviceObj->device, readbackBuffer, NULL);
+	vkFreeMemory(deviceObj->device, readbackMemory, NULL);
+	vkDestroyBuffer(deviceObj->device, positionBuffer, NULL);
+	vkFreeMemory(deviceObj->device, positionMemory, NULL);
+}
+
+void VulkanRenderer::destroyRadixSort()
+{
+	radixSort.destroy();
+}
+
+void VulkanRenderer::createWeightedOitComposite()
+{
+	// No drawable accumulates without the shaders, the composite is never recorded
+	if (!weightedOitAvailable)
+		return;
+
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+	// Wait for the composite stages queued by compileShaders()
+	const std::vector<unsigned int>& vertSPVCode = compositeVertSPV.get();
+	const std::vector<unsigned int>& fragSPVCode = compositeFragSPV.get();
+
+	weightedOit.createComposite(&pipelineObj, SUBPASS_COMPOSITE,
+		vertSPVCode.data(), vertSPVCode.size() * sizeof(unsigned int),
+		fragSPVCode.data(), fragSPVCode.size() * sizeof(unsigned int));
+#else
+	size_t sizeVert, sizeFrag;
+	void* vertShaderCode = readFile("./../Composite-vert.spv", &sizeVert);
+	void* fragShaderCode = readFile("./../Composite-frag.spv", &sizeFrag);
+
+	weightedOit.createComposite(&pipelineObj, SUBPASS_COMPOSITE,
+		(uint32_t*)vertShaderCode, sizeVert, (uint32_t*)fragShaderCode, sizeFrag);
+	free(vertShaderCode);
+	free(fragShaderCode);
+#endif
+}
+
+void VulkanRenderer::destroyWeightedOit()
+{
+	weightedOit.destroy();
+}
+
+void VulkanRenderer::compileShaders()
+{
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+	// Compiled already by a previous initialization
+	if (vertSPV.valid())
+		return;
+
+	VulkanShaderCompiler* compilerObj = VulkanShaderCompiler::GetInstance();
+	void* shaderCode;
+	size_t size;
+
+	shaderCode	= readFile("./../Texture.vert", &size);
+	vertSPV		= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_VERTEX_BIT);
+	free(shaderCode);
+
+	shaderCode	= readFile("./../Texture.frag", &size);
+	fragSPV		= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_FRAGMENT_BIT);
+	free(shaderCode);
+
+	shaderCode	= readFile("./../TextureOIT.frag", &size);
+	oitFragSPV	= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_FRAGMENT_BIT);
+	free(shaderCode);
+
+	shaderCode			= readFile("./../Composite.vert", &size);
+	compositeVertSPV	= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_VERTEX_BIT);
+	free(shaderCode);
+
+	shaderCode			= readFile("./../Composite.frag", &size);
+	compositeFragSPV	= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_FRAGMENT_BIT);
+	free(shaderCode);
+
+	shaderCode	= readFile("./../Compute.comp", &size);
+	compSPV		= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_COMPUTE_BIT);
+	free(shaderCode);
+
+	for (int kernel = 0; kernel < GpuRadixSort::KERNEL_TOTAL; kernel++) {
+		std::string fileName = std::string("./../") + GpuRadixSort::kernelNames[kernel] + ".comp";
+		shaderCode			= readFile(fileName.c_str(), &size);
+		radixSPV[kernel]	= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_COMPUTE_BIT);
+		free(shaderCode);
+	}
+#endif
+}
+
 void VulkanRenderer::createShaders()
 {
 	if (application->isResizing)
 		return;
 
-	void* vertShaderCode, *fragShaderCode;
-	size_t sizeVert, sizeFrag;
+	void* vertShaderCode, *fragShaderCode, *oitFragShaderCode;
+	size_t sizeVert, sizeFrag, sizeOitFrag;
 	shaderObj.shaderStagesVector.clear();
+	oitShaderObj.shaderStagesVector.clear();
 
 #ifdef AUTO_COMPILE_GLSL_TO_SPV
-	vertShaderCode = readFile("./../Texture.vert", &sizeVert);
-	fragShaderCode = readFile("./../Texture.frag", &sizeFrag);
-
-	//shaderObj.buildShader((const char*)vertShaderCode, (const char*)fragShaderCode);
-	shaderObj.buildShader((const char*)vertShaderCode, "main", VK_SHADER_STAGE_VERTEX_BIT);
-	shaderObj.buildShader((const char*)fragShaderCode, "main", VK_SHADER_STAGE_FRAGMENT_BIT);
+	// Wait for the graphics stages queued by compileShaders()
+	const std::vector<unsigned int>& vertSPVCode = vertSPV.get();
+	const std::vector<unsigned int>& fragSPVCode = fragSPV.get();
+	const std::vector<unsigned int>& oitFragSPVCode = oitFragSPV.get();
+	assert(!vertSPVCode.empty() && !fragSPVCode.empty());
+	weightedOitAvailable = !oitFragSPVCode.empty() && !compositeVertSPV.get().empty() && !compositeFragSPV.get().empty();
+
+	shaderObj.buildShaderModuleWithSPV((uint32_t*)vertSPVCode.data(), vertSPVCode.size() * sizeof(unsigned int), "main", VK_SHADER_STAGE_VERTEX_BIT);
+	shaderObj.buildShaderModuleWithSPV((uint32_t*)fragSPVCode.data(), fragSPVCode.size() * sizeof(unsigned int), "main", VK_SHADER_STAGE_FRAGMENT_BIT);
+	if (weightedOitAvailable) {
+		oitShaderObj.buildShaderModuleWithSPV((uint32_t*)vertSPVCode.data(), vertSPVCode.size() * sizeof(unsigned int), "main", VK_SHADER_STAGE_VERTEX_BIT);
+		oitShaderObj.buildShaderModuleWithSPV((uint32_t*)oitFragSPVCode.data(), oitFragSPVCode.size() * sizeof(unsigned int), "main", VK_SHADER_STAGE_FRAGMENT_BIT);
+	}
 #else
 	vertShaderCode = readFile("./../Texture-vert.spv", &sizeVert);
 	fragShaderCode = readFile("./../Texture-frag.spv", &sizeFrag);
+	oitFragShaderCode = readFile("./../TextureOIT-frag.spv", &sizeOitFrag);
+
+	// The composite is created later, with the framebuffer, only check that its stages are there
+	size_t sizeComposite;
+	void* compositeVertCode = readFile("./../Composite-vert.spv", &sizeComposite);
+	void* compositeFragCode = readFile("./../Composite-frag.spv", &sizeComposite);
+	weightedOitAvailable = oitFragShaderCode && compositeVertCode && compositeFragCode;
+	free(compositeVertCode);
+	free(compositeFragCode);
 
 	shaderObj.buildShaderModuleWithSPV((uint32_t*)vertShaderCode, sizeVert, "main", VK_SHADER_STAGE_VERTEX_BIT);
 	shaderObj.buildShaderModuleWithSPV((uint32_t*)fragShaderCode, sizeFrag, "main", VK_SHADER_STAGE_FRAGMENT_BIT);
+	if (weightedOitAvailable) {
+		oitShaderObj.buildShaderModuleWithSPV((uint32_t*)vertShaderCode, sizeVert, "main", VK_SHADER_STAGE_VERTEX_BIT);
+		oitShaderObj.buildShaderModuleWithSPV((uint32_t*)oitFragShaderCode, sizeOitFrag, "main", VK_SHADER_STAGE_FRAGMENT_BIT);
+	}
 #endif
+
+	if (!weightedOitAvailable) {
+		std::cout << "Weighted blended transparency shaders not found, falling back to alpha blending" << std::endl;
+		for each (VulkanDrawable* drawableObj in drawableList)
+		{
+			if (drawableObj->getTransparency() == VulkanDrawable::TRANSPARENCY_WEIGHTED_OIT)
+				drawableObj->setTransparency(VulkanDrawable::TRANSPARENCY_ALPHA_BLEND);
+		}
+		return;
+	}
+
+	oitShaderObj.getSpecialization(VK_SHADER_STAGE_FRAGMENT_BIT).set(0, WEIGHTED_OIT_OPACITY);	// OPACITY
 }
 
 // Create the descriptor set
@@ -1327,8 +1832,11 @@ void VulkanRenderer::createPipelineStateManagement()
 	const bool depthPresent = true;
 	for each (VulkanDrawable* drawableObj in drawableList)
 	{
+		// The weighted blended drawables write the accumulation and revealage
+		VulkanShader* drawableShader = (drawableObj->getTransparency() == VulkanDrawable::TRANSPARENCY_WEIGHTED_OIT) ? &oitShaderObj : &shaderObj;
+
 		VkPipeline* pipeline = (VkPipeline*)malloc(sizeof(VkPipeline));
-		if (pipelineObj.createPipeline(drawableObj, pipeline, &shaderObj, depthPresent, !drawableObj->antiDir))
+		if (pipelineObj.createPipeline(drawableObj, pipeline, drawableShader, depthPresent))
 		{
 			pipelineList.push_back(pipeline);
 			drawableObj->setPipeline(pipeline);
@@ -1437,6 +1945,10 @@ bool VulkanRenderer::renderAll()
 	VkResult result = swapChainObj->fpAcquireNextImageKHR(deviceObj->device, swapChain,
 		UINT64_MAX, presentCompleteSemaphore, VK_NULL_HANDLE, &currentColorImage);
 
+	// The previous submission has completed, sort the draws at their current
+	// depth and record the frame again
+	recordFrame(currentColorImage);
+
 	VkPipelineStageFlags submitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
 	VkSubmitInfo submitInfo = {};
@@ -1445,13 +1957,13 @@ bool VulkanRenderer::renderAll()
 	submitInfo.waitSemaphoreCount = 1;
 	submitInfo.pWaitSemaphores = &presentCompleteSemaphore;
 	submitInfo.pWaitDstStageMask = &submitPipelineStages;
-	submitInfo.commandBufferCount = (uint32_t)vecCmdDraw[currentColorImage].size();// (uint32_t)sizeof(vecCmdDraw[currentColorImage]) / sizeof(VkCommandBuffer);
-	submitInfo.pCommandBuffers = &vecCmdDraw[currentColorImage][0];
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &vecCmdDraw[currentColorImage];
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = &drawingCompleteSemaphore;
 	
 	// Queue the command buffer for execution
-	CommandBufferMgr::submitCommandBuffer(deviceObj->queue, &vecCmdDraw[currentColorImage][0], &submitInfo);
+	CommandBufferMgr::submitCommandBuffer(deviceObj->queue, &vecCmdDraw[currentColorImage], &submitInfo);
 
 	// Present the image in the window
 	VkPresentInfoKHR present = {};
@@ -0,0 +1,129 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "VulkanSamplerCache.h"
+
+VulkanSamplerCache::SamplerKey::SamplerKey(const VkSamplerCreateInfo& samplerCI)
+{
+	assert(samplerCI.pNext == NULL && samplerCI.flags == 0);
+
+	magFilter				= samplerCI.magFilter;
+	minFilter				= samplerCI.minFilter;
+	mipmapMode				= samplerCI.mipmapMode;
+	addressModeU			= samplerCI.addressModeU;
+	addressModeV			= samplerCI.addressModeV;
+	addressModeW			= samplerCI.addressModeW;
+	mipLodBias				= samplerCI.mipLodBias;
+	anisotropyEnable		= samplerCI.anisotropyEnable;
+	maxAnisotropy			= samplerCI.anisotropyEnable ? samplerCI.maxAnisotropy : 1.0f;	// Ignored when disabled
+	compareEnable			= samplerCI.compareEnable;
+	compareOp				= samplerCI.compareEnable ? samplerCI.compareOp : VK_COMPARE_OP_NEVER;
+	minLod					= samplerCI.minLod;
+	maxLod					= samplerCI.maxLod;
+	borderColor				= samplerCI.borderColor;
+	unnormalizedCoordinates	= samplerCI.unnormalizedCoordinates;
+}
+
+bool VulkanSamplerCache::SamplerKey::operator<(const SamplerKey& other) const
+{
+	return std::tie(magFilter, minFilter, mipmapMode, addressModeU, addressModeV, addressModeW,
+			mipLodBias, anisotropyEnable, maxAnisotropy, compareEnable, compareOp, minLod, maxLod,
+			borderColor, unnormalizedCoordinates)
+		< std::tie(other.magFilter, other.minFilter, other.mipmapMode, other.addressModeU, other.addressModeV, other.addressModeW,
+			other.mipLodBias, other.anisotropyEnable, other.maxAnisotropy, other.compareEnable, other.compareOp, other.minLod, other.maxLod,
+			other.borderColor, other.unnormalizedCoordinates);
+}
+
+VulkanSamplerCache::VulkanSamplerCache()
+{
+	device			= VK_NULL_HANDLE;
+	maxSamplerCount	= 0;
+}
+
+VulkanSamplerCache::~VulkanSamplerCache()
+{
+}
+
+void VulkanSamplerCache::initialize(VkDevice logicalDevice, uint32_t maxSamplerAllocationCount)
+{
+	device			= logicalDevice;
+	maxSamplerCount	= maxSamplerAllocationCount;
+}
+
+VkSampler VulkanSamplerCache::acquireSampler(const VkSamplerCreateInfo& samplerCI)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	SamplerKey key(samplerCI);
+	std::map<SamplerKey, SamplerEntry>::iterator it = samplers.find(key);
+	if (it != samplers.end()) {
+		it->second.refCount++;
+		return it->second.sampler;
+	}
+
+	if (samplers.size() >= maxSamplerCount) {
+		std::cout << "Sampler allocation count exceeds maxSamplerAllocationCount (" << maxSamplerCount << ")" << std::endl;
+	}
+
+	SamplerEntry entry;
+	entry.refCount = 1;
+	VkResult result = vkCreateSampler(device, &samplerCI, NULL, &entry.sampler);
+	assert(result == VK_SUCCESS);
+
+	samplers.insert(std::make_pair(key, entry));
+	return entry.sampler;
+}
+
+void VulkanSamplerCache::releaseSampler(VkSampler sampler)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	for (std::map<SamplerKey, SamplerEntry>::iterator it = samplers.begin(); it != samplers.end(); ++it)
+	{
+		if (it->second.sampler != sampler) {
+			continue;
+		}
+
+		if (--it->second.refCount == 0) {
+			vkDestroySampler(device, sampler, NULL);
+			samplers.erase(it);
+		}
+		return;
+	}
+
+	// Not a sampler from this cache
+	assert(0);
+}
+
+void VulkanSamplerCache::destroySamplers()
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	for (std::map<SamplerKey, SamplerEntry>::iterator it = samplers.begin(); it != samplers.end(); ++it)
+	{
+		vkDestroySampler(device, it->second.sampler, NULL);
+	}
+	samplers.clear();
+}
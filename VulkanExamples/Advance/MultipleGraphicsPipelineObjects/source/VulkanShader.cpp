@@ -26,6 +26,7 @@
 #include "VulkanShader.h"
 #include "VulkanApplication.h"
 #include "VulkanDevice.h"
+#include "SpirvCache.h"
 
 
 void VulkanShader::buildShaderModuleWithSPV(uint32_t *shaderText, size_t shaderSPVSize, const char* entryPoint, VkShaderStageFlagBits shaderStageFlag)
@@ -65,8 +66,83 @@ void VulkanShader::destroyShaders()
 	}
 }
 
+const std::vector<VkPipelineShaderStageCreateInfo>& VulkanShader::getStages()
+{
+	for (size_t i = 0; i < shaderStagesVector.size(); i++)
+	{
+		std::map<VkShaderStageFlagBits, SpecializationConstants>::iterator it = specializations.find(shaderStagesVector[i].stage);
+		shaderStagesVector[i].pSpecializationInfo = (it == specializations.end() || it->second.empty()) ? NULL : it->second.getInfo();
+	}
+	return shaderStagesVector;
+}
+
+void SpecializationConstants::set(uint32_t constantID, uint32_t value)
+{
+	for (size_t i = 0; i < mapEntries.size(); i++)
+	{
+		if (mapEntries[i].constantID == constantID) {
+			values[i] = value;
+			return;
+		}
+	}
+
+	VkSpecializationMapEntry mapEntry;
+	mapEntry.constantID	= constantID;
+	mapEntry.offset		= (uint32_t)(values.size() * sizeof(uint32_t));
+	mapEntry.size		= sizeof(uint32_t);
+	mapEntries.push_back(mapEntry);
+	values.push_back(value);
+}
+
+void SpecializationConstants::set(uint32_t constantID, int32_t value)
+{
+	set(constantID, (uint32_t)value);
+}
+
+void SpecializationConstants::set(uint32_t constantID, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	set(constantID, bits);
+}
+
+void SpecializationConstants::set(uint32_t constantID, bool value)
+{
+	set(constantID, (uint32_t)(value ? VK_TRUE : VK_FALSE));
+}
+
+const VkSpecializationInfo* SpecializationConstants::getInfo()
+{
+	info.mapEntryCount	= (uint32_t)mapEntries.size();
+	info.pMapEntries	= mapEntries.data();
+	info.dataSize		= values.size() * sizeof(uint32_t);
+	info.pData			= values.data();
+	return &info;
+}
+
+uint64_t SpecializationConstants::getHash() const
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < mapEntries.size(); i++)
+	{
+		hash = (hash ^ mapEntries[i].constantID) * 0x100000001b3ULL;
+		hash = (hash ^ values[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
 #ifdef AUTO_COMPILE_GLSL_TO_SPV
 
+// glslang keeps process wide tables, they are set up on the first
+// compilation only and released when the application exits.
+static void initializeGlslang()
+{
+	static struct GlslangProcess {
+		GlslangProcess()	{ glslang::InitializeProcess(); }
+		~GlslangProcess()	{ glslang::FinalizeProcess(); }
+	} glslangProcess;
+}
+
 // Helper function intaking the GLSL vertex and fragment shader. 
 // It prepares the shaders to be consumed in the SPIR-V format 
 // with the help of glslang library helper functions.
@@ -87,8 +163,6 @@ void VulkanShader::buildShader(const char *shaderText, const char* entryPoint, V
 	shaderStage.stage = shaderStageFlag;
 	shaderStage.pName = entryPoint;
 
-	glslang::InitializeProcess();
-
 	retVal = GLSLtoSPV(shaderStageFlag, shaderText, shaderSPV);
 	assert(retVal);
 
@@ -102,8 +176,6 @@ void VulkanShader::buildShader(const char *shaderText, const char* entryPoint, V
 	assert(result == VK_SUCCESS);
 
 	shaderStagesVector.push_back(shaderStage);
-
-	glslang::FinalizeProcess();
 }
 
 //
@@ -112,14 +184,22 @@ void VulkanShader::buildShader(const char *shaderText, const char* entryPoint, V
 //
 bool VulkanShader::GLSLtoSPV(const VkShaderStageFlagBits shaderType, const char *pshader, std::vector<unsigned int> &spirv)
 {
+	// Enable SPIR-V and Vulkan rules when parsing GLSL
+	EShMessages messages = (EShMessages)(EShMsgSpvRules | EShMsgVulkanRules);
+
+	// Reuse the SPIR-V of a previous run when neither the source nor the options changed
+	const uint64_t cacheKey = SpirvCache::computeKey(pshader, shaderType, "main", messages);
+	if (SpirvCache::load(cacheKey, spirv)) {
+		return true;
+	}
+
+	initializeGlslang();
+
 	glslang::TProgram* program = new glslang::TProgram;
 	const char *shaderStrings[1];
 	TBuiltInResource Resources;
 	initializeResources(Resources);
 
-	// Enable SPIR-V and Vulkan rules when parsing GLSL
-	EShMessages messages = (EShMessages)(EShMsgSpvRules | EShMsgVulkanRules);
-
 	EShLanguage stage = getLanguage(shaderType);
 	glslang::TShader* shader = new glslang::TShader(stage);
 
@@ -144,6 +224,8 @@ bool VulkanShader::GLSLtoSPV(const VkShaderStageFlagBits shaderType, const char
 	glslang::GlslangToSpv(*program->getIntermediate(stage), spirv);
 	delete program;
 	delete shader;
+
+	SpirvCache::store(cacheKey, spirv);
 	return true;
 }
 
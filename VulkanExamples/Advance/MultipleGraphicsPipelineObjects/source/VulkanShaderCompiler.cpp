@@ -0,0 +1,104 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "VulkanShaderCompiler.h"
+#include "VulkanShader.h"
+#include <algorithm>
+
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+
+std::unique_ptr<VulkanShaderCompiler> VulkanShaderCompiler::instance;
+std::once_flag VulkanShaderCompiler::onlyOnce;
+
+VulkanShaderCompiler::VulkanShaderCompiler()
+{
+	isExiting = false;
+
+	unsigned int workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned int i = 0; i < workerCount; i++) {
+		workers.push_back(std::thread(&VulkanShaderCompiler::workerMain, this));
+	}
+}
+
+VulkanShaderCompiler::~VulkanShaderCompiler()
+{
+	{
+		std::lock_guard<std::mutex> lock(taskMutex);
+		isExiting = true;
+	}
+	taskCondition.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+// Returns the Single ton object of VulkanShaderCompiler
+VulkanShaderCompiler* VulkanShaderCompiler::GetInstance()
+{
+	std::call_once(onlyOnce, []() { instance.reset(new VulkanShaderCompiler()); });
+	return instance.get();
+}
+
+VulkanShaderCompiler::SpirvFuture VulkanShaderCompiler::compile(const char* shaderText, VkShaderStageFlagBits shaderStage)
+{
+	std::string text(shaderText);
+
+	// std::function needs a copyable target, share the packaged task
+	std::shared_ptr<std::packaged_task<std::vector<unsigned int>()> > task =
+		std::make_shared<std::packaged_task<std::vector<unsigned int>()> >([text, shaderStage]() {
+			std::vector<unsigned int> spirv;
+			if (!VulkanShader::GLSLtoSPV(shaderStage, text.c_str(), spirv)) {
+				spirv.clear();
+			}
+			return spirv;
+		});
+
+	SpirvFuture spirv = task->get_future().share();
+	{
+		std::lock_guard<std::mutex> lock(taskMutex);
+		tasks.push_back([task]() { (*task)(); });
+	}
+	taskCondition.notify_one();
+	return spirv;
+}
+
+void VulkanShaderCompiler::workerMain()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(taskMutex);
+			taskCondition.wait(lock, [this]() { return isExiting || !tasks.empty(); });
+			if (tasks.empty()) {
+				return;
+			}
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+#endif
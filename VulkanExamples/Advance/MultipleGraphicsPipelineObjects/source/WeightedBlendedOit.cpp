@@ -0,0 +1,242 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "WeightedBlendedOit.h"
+#include "VulkanDevice.h"
+#include "VulkanPipeline.h"
+
+WeightedBlendedOit::WeightedBlendedOit()
+{
+	deviceObj		= NULL;
+	memset(&accumulation, 0, sizeof(accumulation));
+	memset(&revealage, 0, sizeof(revealage));
+	pipeline		= VK_NULL_HANDLE;
+	descLayout		= VK_NULL_HANDLE;
+	pipelineLayout	= VK_NULL_HANDLE;
+	descriptorPool	= VK_NULL_HANDLE;
+	descriptorSet	= VK_NULL_HANDLE;
+}
+
+WeightedBlendedOit::~WeightedBlendedOit()
+{
+}
+
+void WeightedBlendedOit::createAttachments(VulkanDevice* device, uint32_t width, uint32_t height)
+{
+	deviceObj = device;
+	createAttachment(&accumulation, accumulationFormat, width, height);
+	createAttachment(&revealage, revealageFormat, width, height);
+}
+
+void WeightedBlendedOit::createComposite(VulkanPipeline* pipelineObj, uint32_t subpass,
+	const uint32_t* vertSpirv, size_t vertSpirvSize, const uint32_t* fragSpirv, size_t fragSpirvSize)
+{
+	VkResult result;
+	assert(deviceObj);
+
+	createDescriptors();
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.pNext					= NULL;
+	pipelineLayoutCreateInfo.flags					= 0;
+	pipelineLayoutCreateInfo.setLayoutCount			= 1;
+	pipelineLayoutCreateInfo.pSetLayouts			= &descLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount	= 0;
+	pipelineLayoutCreateInfo.pPushConstantRanges	= NULL;
+	result = vkCreatePipelineLayout(deviceObj->device, &pipelineLayoutCreateInfo, NULL, &pipelineLayout);
+	assert(result == VK_SUCCESS);
+
+	shaderObj.buildShaderModuleWithSPV((uint32_t*)vertSpirv, vertSpirvSize, "main", VK_SHADER_STAGE_VERTEX_BIT);
+	shaderObj.buildShaderModuleWithSPV((uint32_t*)fragSpirv, fragSpirvSize, "main", VK_SHADER_STAGE_FRAGMENT_BIT);
+
+	bool pipelineCreated = pipelineObj->createFullscreenPipeline(&shaderObj, pipelineLayout, subpass, &pipeline);
+	assert(pipelineCreated);
+}
+
+void WeightedBlendedOit::destroy()
+{
+	if (!deviceObj) {
+		return;
+	}
+
+	if (pipeline) {
+		vkDestroyPipeline(deviceObj->device, pipeline, NULL);
+		shaderObj.destroyShaders();
+		vkDestroyDescriptorPool(deviceObj->device, descriptorPool, NULL);
+		vkDestroyPipelineLayout(deviceObj->device, pipelineLayout, NULL);
+		vkDestroyDescriptorSetLayout(deviceObj->device, descLayout, NULL);
+	}
+
+	destroyAttachment(&accumulation);
+	destroyAttachment(&revealage);
+
+	*this = WeightedBlendedOit();
+}
+
+void WeightedBlendedOit::recordComposite(VkCommandBuffer cmd)
+{
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+	vkCmdDraw(cmd, 3, 1, 0, 0);
+}
+
+void WeightedBlendedOit::createAttachment(Attachment* attachment, VkFormat format, uint32_t width, uint32_t height)
+{
+	VkResult result;
+	bool pass;
+
+	// Nothing outside the render pass reads the attachments, they can stay in tile memory
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType			= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.pNext			= NULL;
+	imageInfo.imageType		= VK_IMAGE_TYPE_2D;
+	imageInfo.format		= format;
+	imageInfo.extent.width	= width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth	= 1;
+	imageInfo.mipLevels		= 1;
+	imageInfo.arrayLayers	= 1;
+	imageInfo.samples		= VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling		= VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.queueFamilyIndexCount = 0;
+	imageInfo.pQueueFamilyIndices	= NULL;
+	imageInfo.sharingMode			= VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.usage					= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	imageInfo.initialLayout			= VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.flags					= 0;
+	result = vkCreateImage(deviceObj->device, &imageInfo, NULL, &attachment->image);
+	assert(result == VK_SUCCESS);
+
+	VkMemoryRequirements memRqrmnt;
+	vkGetImageMemoryRequirements(deviceObj->device, attachment->image, &memRqrmnt);
+
+	VkMemoryAllocateInfo allocInfo	= {};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext					= NULL;
+	allocInfo.allocationSize		= memRqrmnt.size;
+	// Lazily allocated memory is never committed when the attachment stays on
+	// chip, any other memory type does when the device has none
+	pass = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &allocInfo.memoryTypeIndex);
+	if (!pass) {
+		pass = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits, 0, &allocInfo.memoryTypeIndex);
+	}
+	assert(pass);
+	result = vkAllocateMemory(deviceObj->device, &allocInfo, NULL, &attachment->memory);
+	assert(result == VK_SUCCESS);
+	result = vkBindImageMemory(deviceObj->device, attachment->image, attachment->memory, 0);
+	assert(result == VK_SUCCESS);
+
+	// The render pass moves the attachments out of the undefined layout
+	VkImageViewCreateInfo imgViewInfo = {};
+	imgViewInfo.sType							= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imgViewInfo.pNext							= NULL;
+	imgViewInfo.image							= attachment->image;
+	imgViewInfo.viewType						= VK_IMAGE_VIEW_TYPE_2D;
+	imgViewInfo.format							= format;
+	imgViewInfo.components						= { VK_COMPONENT_SWIZZLE_IDENTITY };
+	imgViewInfo.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	imgViewInfo.subresourceRange.baseMipLevel	= 0;
+	imgViewInfo.subresourceRange.levelCount		= 1;
+	imgViewInfo.subresourceRange.baseArrayLayer	= 0;
+	imgViewInfo.subresourceRange.layerCount		= 1;
+	imgViewInfo.flags							= 0;
+	result = vkCreateImageView(deviceObj->device, &imgViewInfo, NULL, &attachment->view);
+	assert(result == VK_SUCCESS);
+}
+
+void WeightedBlendedOit::destroyAttachment(Attachment* attachment)
+{
+	vkDestroyImageView(deviceObj->device, attachment->view, NULL);
+	vkDestroyImage(deviceObj->device, attachment->image, NULL);
+	vkFreeMemory(deviceObj->device, attachment->memory, NULL);
+	memset(attachment, 0, sizeof(*attachment));
+}
+
+void WeightedBlendedOit::createDescriptors()
+{
+	VkResult result;
+
+	// 0: accumulation, 1: revealage, read at the pixel of the fragment
+	VkDescriptorSetLayoutBinding layoutBindings[2] = {};
+	for (uint32_t i = 0; i < 2; i++) {
+		layoutBindings[i].binding				= i;
+		layoutBindings[i].descriptorType		= VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		layoutBindings[i].descriptorCount		= 1;
+		layoutBindings[i].stageFlags			= VK_SHADER_STAGE_FRAGMENT_BIT;
+		layoutBindings[i].pImmutableSamplers	= NULL;
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptorLayout = {};
+	descriptorLayout.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorLayout.pNext			= NULL;
+	descriptorLayout.flags			= 0;
+	descriptorLayout.bindingCount	= 2;
+	descriptorLayout.pBindings		= layoutBindings;
+	result = vkCreateDescriptorSetLayout(deviceObj->device, &descriptorLayout, NULL, &descLayout);
+	assert(result == VK_SUCCESS);
+
+	VkDescriptorPoolSize poolSize;
+	poolSize.type				= VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	poolSize.descriptorCount	= 2;
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.pNext			= NULL;
+	descriptorPoolCreateInfo.maxSets		= 1;
+	descriptorPoolCreateInfo.poolSizeCount	= 1;
+	descriptorPoolCreateInfo.pPoolSizes		= &poolSize;
+	result = vkCreateDescriptorPool(deviceObj->device, &descriptorPoolCreateInfo, NULL, &descriptorPool);
+	assert(result == VK_SUCCESS);
+
+	VkDescriptorSetAllocateInfo dsAllocInfo;
+	dsAllocInfo.sType				= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsAllocInfo.pNext				= NULL;
+	dsAllocInfo.descriptorPool		= descriptorPool;
+	dsAllocInfo.descriptorSetCount	= 1;
+	dsAllocInfo.pSetLayouts			= &descLayout;
+	result = vkAllocateDescriptorSets(deviceObj->device, &dsAllocInfo, &descriptorSet);
+	assert(result == VK_SUCCESS);
+
+	VkDescriptorImageInfo imageInfos[2];
+	imageInfos[0].sampler		= VK_NULL_HANDLE;
+	imageInfos[0].imageView		= accumulation.view;
+	imageInfos[0].imageLayout	= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfos[1]				= imageInfos[0];
+	imageInfos[1].imageView		= revealage.view;
+
+	VkWriteDescriptorSet writes[2] = {};
+	for (uint32_t i = 0; i < 2; i++) {
+		writes[i].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].pNext				= NULL;
+		writes[i].dstSet			= descriptorSet;
+		writes[i].dstBinding		= i;
+		writes[i].dstArrayElement	= 0;
+		writes[i].descriptorCount	= 1;
+		writes[i].descriptorType	= VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		writes[i].pImageInfo		= &imageInfos[i];
+	}
+	vkUpdateDescriptorSets(deviceObj->device, 2, writes, 0, NULL);
+}
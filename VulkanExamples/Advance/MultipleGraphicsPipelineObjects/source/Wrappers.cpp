@@ -26,6 +26,23 @@
 #include "Wrappers.h"
 #include "VulkanApplication.h"
 
+#include <algorithm>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__AVX2__) || defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
 void CommandBufferMgr::allocCommandBuffer(const VkDevice* device, const VkCommandPool cmdPool, VkCommandBuffer* cmdBuf, const VkCommandBufferAllocateInfo* commandBufferInfo)
 {
 	// Dependency on the intialize SwapChain Extensions and initialize CommandPool
@@ -126,19 +143,119 @@ void CommandBufferMgr::submitCommandBuffer(const VkQueue& queue, const VkCommand
 	assert(!result);
 }
 
+VkFormat getVulkanFormat(gli::format format)
+{
+	switch (format)
+	{
+	// Uncompressed formats
+	case gli::FORMAT_R8_UNORM:						return VK_FORMAT_R8_UNORM;
+	case gli::FORMAT_RG8_UNORM:						return VK_FORMAT_R8G8_UNORM;
+	case gli::FORMAT_RGB8_UNORM:					return VK_FORMAT_R8G8B8_UNORM;
+	case gli::FORMAT_RGBA8_UNORM:					return VK_FORMAT_R8G8B8A8_UNORM;
+	case gli::FORMAT_R8_SRGB:						return VK_FORMAT_R8_SRGB;
+	case gli::FORMAT_RG8_SRGB:						return VK_FORMAT_R8G8_SRGB;
+	case gli::FORMAT_RGB8_SRGB:						return VK_FORMAT_R8G8B8_SRGB;
+	case gli::FORMAT_RGBA8_SRGB:					return VK_FORMAT_R8G8B8A8_SRGB;
+	case gli::FORMAT_BGRA8_UNORM:					return VK_FORMAT_B8G8R8A8_UNORM;
+	case gli::FORMAT_BGRA8_SRGB:					return VK_FORMAT_B8G8R8A8_SRGB;
+	case gli::FORMAT_R16_SFLOAT:					return VK_FORMAT_R16_SFLOAT;
+	case gli::FORMAT_RG16_SFLOAT:					return VK_FORMAT_R16G16_SFLOAT;
+	case gli::FORMAT_RGBA16_SFLOAT:					return VK_FORMAT_R16G16B16A16_SFLOAT;
+	case gli::FORMAT_R32_SFLOAT:					return VK_FORMAT_R32_SFLOAT;
+	case gli::FORMAT_RG32_SFLOAT:					return VK_FORMAT_R32G32_SFLOAT;
+	case gli::FORMAT_RGBA32_SFLOAT:					return VK_FORMAT_R32G32B32A32_SFLOAT;
+	case gli::FORMAT_RGB10A2_UNORM:					return VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+	case gli::FORMAT_RG11B10_UFLOAT:				return VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+	case gli::FORMAT_RGB9E5_UFLOAT:					return VK_FORMAT_E5B9G9R9_UFLOAT_PACK32;
+
+	// BC formats, DXT1-5 are BC1-3, ATI1N/ATI2N are BC4/BC5 and BPTC is BC6H/BC7
+	case gli::FORMAT_RGB_DXT1_UNORM:				return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case gli::FORMAT_RGB_DXT1_SRGB:					return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_DXT1_UNORM:				return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_DXT1_SRGB:				return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_DXT3_UNORM:				return VK_FORMAT_BC2_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_DXT3_SRGB:				return VK_FORMAT_BC2_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_DXT5_UNORM:				return VK_FORMAT_BC3_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_DXT5_SRGB:				return VK_FORMAT_BC3_SRGB_BLOCK;
+	case gli::FORMAT_R_ATI1N_UNORM:					return VK_FORMAT_BC4_UNORM_BLOCK;
+	case gli::FORMAT_R_ATI1N_SNORM:					return VK_FORMAT_BC4_SNORM_BLOCK;
+	case gli::FORMAT_RG_ATI2N_UNORM:				return VK_FORMAT_BC5_UNORM_BLOCK;
+	case gli::FORMAT_RG_ATI2N_SNORM:				return VK_FORMAT_BC5_SNORM_BLOCK;
+	case gli::FORMAT_RGB_BP_UFLOAT:					return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+	case gli::FORMAT_RGB_BP_SFLOAT:					return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+	case gli::FORMAT_RGB_BP_UNORM:					return VK_FORMAT_BC7_UNORM_BLOCK;
+	case gli::FORMAT_RGB_BP_SRGB:					return VK_FORMAT_BC7_SRGB_BLOCK;
+
+	// ETC2 and EAC formats, ETC1 data is a valid subset of ETC2
+	case gli::FORMAT_RGB_ETC_UNORM:					return VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;
+	case gli::FORMAT_RGB_ETC2_UNORM:				return VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;
+	case gli::FORMAT_RGB_ETC_SRGB:					return VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ETC2_PUNCHTHROUGH_UNORM:	return VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ETC2_PUNCHTHROUGH_SRGB:	return VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ETC2_UNORM:				return VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ETC2_SRGB:				return VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK;
+	case gli::FORMAT_R11_EAC_UNORM:					return VK_FORMAT_EAC_R11_UNORM_BLOCK;
+	case gli::FORMAT_R11_EAC_SNORM:					return VK_FORMAT_EAC_R11_SNORM_BLOCK;
+	case gli::FORMAT_RG11_EAC_UNORM:				return VK_FORMAT_EAC_R11G11_UNORM_BLOCK;
+	case gli::FORMAT_RG11_EAC_SNORM:				return VK_FORMAT_EAC_R11G11_SNORM_BLOCK;
+
+	// ASTC LDR formats
+	case gli::FORMAT_RGBA_ASTC_4X4_UNORM:			return VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_5X4_UNORM:			return VK_FORMAT_ASTC_5x4_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_5X5_UNORM:			return VK_FORMAT_ASTC_5x5_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_6X5_UNORM:			return VK_FORMAT_ASTC_6x5_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_6X6_UNORM:			return VK_FORMAT_ASTC_6x6_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_8X5_UNORM:			return VK_FORMAT_ASTC_8x5_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_8X6_UNORM:			return VK_FORMAT_ASTC_8x6_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_8X8_UNORM:			return VK_FORMAT_ASTC_8x8_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_10X5_UNORM:			return VK_FORMAT_ASTC_10x5_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_10X6_UNORM:			return VK_FORMAT_ASTC_10x6_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_10X8_UNORM:			return VK_FORMAT_ASTC_10x8_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_10X10_UNORM:			return VK_FORMAT_ASTC_10x10_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_12X10_UNORM:			return VK_FORMAT_ASTC_12x10_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_12X12_UNORM:			return VK_FORMAT_ASTC_12x12_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_4X4_SRGB:			return VK_FORMAT_ASTC_4x4_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_5X4_SRGB:			return VK_FORMAT_ASTC_5x4_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_5X5_SRGB:			return VK_FORMAT_ASTC_5x5_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_6X5_SRGB:			return VK_FORMAT_ASTC_6x5_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_6X6_SRGB:			return VK_FORMAT_ASTC_6x6_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_8X5_SRGB:			return VK_FORMAT_ASTC_8x5_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_8X6_SRGB:			return VK_FORMAT_ASTC_8x6_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_8X8_SRGB:			return VK_FORMAT_ASTC_8x8_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_10X5_SRGB:			return VK_FORMAT_ASTC_10x5_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_10X6_SRGB:			return VK_FORMAT_ASTC_10x6_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_10X8_SRGB:			return VK_FORMAT_ASTC_10x8_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_10X10_SRGB:			return VK_FORMAT_ASTC_10x10_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_12X10_SRGB:			return VK_FORMAT_ASTC_12x10_SRGB_BLOCK;
+	case gli::FORMAT_RGBA_ASTC_12X12_SRGB:			return VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+
+	default:										return VK_FORMAT_UNDEFINED;
+	}
+}
+
 // PPM parser implementation
 PpmParser::PpmParser()
 {
 	isValid			= false;
+	isBinary		= false;
 	imageWidth		= 0;
 	imageHeight		= 0;
+	maxValue		= 0;
 	ppmFile			= "invalid file name";
 	dataPosition	= 0;
+	fileData		= NULL;
+	fileSize		= 0;
+#ifdef _WIN32
+	fileHandle		= INVALID_HANDLE_VALUE;
+	mappingHandle	= NULL;
+#else
+	fileDescriptor	= -1;
+#endif
 }
 
 PpmParser::~PpmParser()
 {
-
+	unmapFile();
 }
 
 int32_t PpmParser::getImageWidth()
@@ -151,25 +268,213 @@ int32_t PpmParser::getImageHeight()
 	return imageHeight;
 }
 
+bool PpmParser::mapFile(const char *filename)
+{
+#ifdef _WIN32
+	fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0) {
+		return false;
+	}
+	fileSize = size_t(size.QuadPart);
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mappingHandle) {
+		return false;
+	}
+
+	fileData = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	return fileData != NULL;
+#else
+	fileDescriptor = open(filename, O_RDONLY);
+	if (fileDescriptor < 0) {
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) {
+		return false;
+	}
+	fileSize = size_t(fileStat.st_size);
+
+	void* mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+
+	// The file is read once from the front to the back
+	madvise(mapping, fileSize, MADV_SEQUENTIAL);
+	fileData = (const uint8_t*)mapping;
+	return true;
+#endif
+}
+
+void PpmParser::unmapFile()
+{
+#ifdef _WIN32
+	if (fileData)							UnmapViewOfFile(fileData);
+	if (mappingHandle)						CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)	CloseHandle(fileHandle);
+	mappingHandle	= NULL;
+	fileHandle		= INVALID_HANDLE_VALUE;
+#else
+	if (fileData)				munmap((void*)fileData, fileSize);
+	if (fileDescriptor >= 0)	close(fileDescriptor);
+	fileDescriptor	= -1;
+#endif
+	fileData	= NULL;
+	fileSize	= 0;
+	isValid		= false;
+}
+
+// Parse an unsigned decimal number from the header or from P3 data,
+// skipping white spaces and comments. Returns false at the end of the data.
+static bool parsePpmNumber(const uint8_t* data, size_t size, size_t& position, int32_t& value)
+{
+	while (position < size)
+	{
+		if (data[position] == '#') {
+			while (position < size && data[position] != '\n')
+				position++;
+		}
+		else if (isspace(data[position])) {
+			position++;
+		}
+		else {
+			break;
+		}
+	}
+
+	if (position >= size || !isdigit(data[position])) {
+		return false;
+	}
+
+	value = 0;
+	while (position < size && isdigit(data[position]))
+		value = value * 10 + (data[position++] - '0');
+	return true;
+}
+
 bool PpmParser::getHeaderInfo(const char *filename)
 {
-	tex2D = new gli::texture2D(gli::load(filename));
-	imageHeight = static_cast<uint32_t>(tex2D[0].dimensions().x);
-	imageWidth  = static_cast<uint32_t>(tex2D[0].dimensions().y);
+	unmapFile();
+	ppmFile = filename;
+
+	if (!mapFile(filename) || fileSize < 2 || fileData[0] != 'P' || (fileData[1] != '3' && fileData[1] != '6')) {
+		std::cout << "Unable to read PPM file " << filename << std::endl;
+		unmapFile();
+		return false;
+	}
+	isBinary = fileData[1] == '6';
+
+	size_t position = 2;
+	if (!parsePpmNumber(fileData, fileSize, position, imageWidth)
+		|| !parsePpmNumber(fileData, fileSize, position, imageHeight)
+		|| !parsePpmNumber(fileData, fileSize, position, maxValue)
+		|| imageWidth <= 0 || imageHeight <= 0 || maxValue <= 0 || maxValue > 255) {
+		std::cout << "Invalid or 16 bit PPM header in " << filename << std::endl;
+		unmapFile();
+		return false;
+	}
+
+	// A single white space separates the header from the samples
+	dataPosition = int32_t(position + 1);
+	if (isBinary && fileSize < size_t(dataPosition) + size_t(imageWidth) * imageHeight * 3) {
+		std::cout << "Truncated PPM file " << filename << std::endl;
+		unmapFile();
+		return false;
+	}
+
+	isValid = true;
 	return true;
 }
 
+// Expand one row of RGB texels to RGBA with an opaque alpha
+static void expandRowRGBToRGBA(const uint8_t* rgb, uint8_t* rgba, int32_t width)
+{
+	int32_t x = 0;
+
+#if defined(__AVX2__)
+	// 8 texels per iteration, each 128 bit lane expands 4 texels out of a 16 byte load,
+	// stop early enough for the second load of 16 bytes to stay inside the row.
+	const __m256i shuffle256	= _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+												   0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i alpha256		= _mm256_set1_epi32(0xFF000000);
+	for (; x + 10 <= width; x += 8)
+	{
+		const __m256i src = _mm256_inserti128_si256(_mm256_castsi128_si256(
+			_mm_loadu_si128((const __m128i*)(rgb + x * 3))),
+			_mm_loadu_si128((const __m128i*)(rgb + x * 3 + 12)), 1);
+		_mm256_storeu_si256((__m256i*)(rgba + x * 4), _mm256_or_si256(_mm256_shuffle_epi8(src, shuffle256), alpha256));
+	}
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+	// 4 texels per iteration out of a 16 byte load
+	const __m128i shuffle128	= _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha128		= _mm_set1_epi32(0xFF000000);
+	for (; x + 6 <= width; x += 4)
+	{
+		const __m128i src = _mm_loadu_si128((const __m128i*)(rgb + x * 3));
+		_mm_storeu_si128((__m128i*)(rgba + x * 4), _mm_or_si128(_mm_shuffle_epi8(src, shuffle128), alpha128));
+	}
+#endif
+
+	for (; x < width; x++)
+	{
+		rgba[x * 4 + 0] = rgb[x * 3 + 0];
+		rgba[x * 4 + 1] = rgb[x * 3 + 1];
+		rgba[x * 4 + 2] = rgb[x * 3 + 2];
+		rgba[x * 4 + 3] = 255;
+	}
+}
+
 bool PpmParser::loadImageData(int rowPitch, uint8_t *data)
 {
-	uint8_t* dataTemp = (uint8_t*)tex2D->data();
-	for (int y = 0; y < imageHeight; y++)
+	if (!isValid || rowPitch < imageWidth * 4) {
+		return false;
+	}
+
+	if (isBinary)
 	{
-		size_t imageSize = imageWidth * 4;
-		memcpy(data, dataTemp, imageSize);
-		dataTemp += imageSize;
+		const uint8_t* rgb = fileData + dataPosition;
+		for (int32_t y = 0; y < imageHeight; y++)
+		{
+			uint8_t* row = data + size_t(y) * rowPitch;
+			expandRowRGBToRGBA(rgb, row, imageWidth);
+			rgb += imageWidth * 3;
+
+			// Samples are in the 0..maxValue range
+			if (maxValue != 255) {
+				for (int32_t x = 0; x < imageWidth * 4; x++)
+					if ((x & 3) != 3) row[x] = uint8_t(row[x] * 255 / maxValue);
+			}
+		}
+		return true;
+	}
 
-		// Advance row by row pitch information
-		data += rowPitch;
+	// ASCII samples are parsed straight into the destination rows
+	size_t position = size_t(dataPosition);
+	for (int32_t y = 0; y < imageHeight; y++)
+	{
+		uint8_t* row = data + size_t(y) * rowPitch;
+		for (int32_t x = 0; x < imageWidth; x++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				int32_t value;
+				if (!parsePpmNumber(fileData, fileSize, position, value)) {
+					std::cout << "Truncated PPM file " << ppmFile << std::endl;
+					return false;
+				}
+				row[x * 4 + c] = uint8_t(std::min(value, maxValue) * 255 / maxValue);
+			}
+			row[x * 4 + 3] = 255;
+		}
 	}
 
 	return true;
@@ -0,0 +1,50 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+
+// Coarse front to back ordering of the instances, so the nearest cubes fill the
+// depth buffer first and the early depth test rejects the fragments behind them.
+// The positions are binned by view depth with a counting sort, the order inside
+// a bin is the instance order. The depths are computed on the job system.
+class InstanceDepthOrder
+{
+public:
+	InstanceDepthOrder();
+	~InstanceDepthOrder();
+
+	// Order 'count' instances by the view depth of their position, nearest bin first. Positions
+	// are read as vec4 every 'stride' bytes, those with a zero w are not drawn and go last.
+	const std::vector<uint32_t>& sort(const void* positions, size_t stride, uint32_t count, const glm::mat4& modelView);
+
+	// Instance index of each position in the draw, as of the last sort
+	const std::vector<uint32_t>& getOrder() const { return order; }
+
+private:
+	std::vector<float>		depths;
+	std::vector<glm::vec2>	chunkRanges;	// Nearest and farthest depth of each job
+	std::vector<uint32_t>	order;
+};
@@ -0,0 +1,114 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+
+// Work-stealing job scheduler shared by the CPU side of the renderer.
+// Every worker owns a deque, it pushes and pops its own jobs at the back
+// and steals the oldest jobs at the front of the others when it runs dry.
+// Jobs queued from other threads go to a shared queue all workers steal from.
+// A thread waiting on a job runs queued jobs meanwhile instead of blocking.
+class JobSystem
+{
+private:
+	// CTOR: Starts one worker per hardware thread, minus the main thread
+	JobSystem();
+
+public:
+	// DTOR: Runs the queued jobs and joins the workers
+	~JobSystem();
+
+	struct Job;
+	typedef std::shared_ptr<Job> JobHandle;
+
+private:
+	// Variable for Single Ton implementation
+	static std::unique_ptr<JobSystem> instance;
+	static std::once_flag onlyOnce;
+
+public:
+	static JobSystem* GetInstance();
+
+	// Queue a job, it starts once all the dependencies are complete
+	JobHandle run(const std::function<void()>& work, const std::vector<JobHandle>& dependencies = std::vector<JobHandle>());
+
+	// Wait for the job to complete, the calling thread runs other jobs meanwhile
+	void wait(const JobHandle& job);
+
+	// Split [begin, end) into chunks of at most 'grainSize' elements and call
+	// body(chunkBegin, chunkEnd) for each of them on the workers. Returns once
+	// all the chunks are done, the calling thread processes chunks too.
+	void parallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& body);
+
+	// Queue work that must run on the main thread, like the Vulkan
+	// calls on objects that need external synchronization (queues, pools).
+	void runOnMainThread(const std::function<void()>& work);
+
+	// Run the work queued by runOnMainThread(), called by the main thread once per frame
+	void executeMainThreadJobs();
+
+	// Number of threads running jobs, the workers and the main thread
+	unsigned int getThreadCount() const { return (unsigned int)workers.size() + 1; }
+
+private:
+	struct WorkQueue
+	{
+		std::deque<Job*>	jobs;
+		std::mutex			mutex;
+	};
+
+	void workerMain(unsigned int index);
+	void schedule(Job* job);
+	void complete(Job* job);
+	Job* takeJob();
+	bool runOneJob();
+
+	std::vector<std::thread>				workers;
+	std::vector<std::unique_ptr<WorkQueue> >	queues;			// One per worker, the last one is shared
+
+	std::atomic<unsigned int>				queuedJobCount;
+	std::mutex								sleepMutex;
+	std::condition_variable					sleepCondition;
+	bool									isExiting;
+
+	std::vector<std::function<void()> >		mainThreadJobs;
+	std::mutex								mainThreadMutex;
+};
+
+struct JobSystem::Job
+{
+	std::function<void()>		work;
+	std::atomic<int>			pendingCount;	// Dependencies not complete yet
+	std::atomic<bool>			isComplete;
+	std::vector<JobHandle>		dependents;		// Jobs waiting on this one
+	std::mutex					mutex;			// Guards isComplete against new dependents
+	JobHandle					self;			// Keeps the job alive while queued
+};
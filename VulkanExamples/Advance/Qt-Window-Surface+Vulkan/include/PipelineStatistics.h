@@ -0,0 +1,61 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+
+class VulkanDevice;
+
+// Counts the fragment shader invocations of a frame with a pipeline statistics
+// query. The fragments discarded by the early depth test are never shaded, so
+// the count divided by the pixel count is the overdraw that reached the shader.
+class PipelineStatistics
+{
+public:
+	PipelineStatistics();
+	~PipelineStatistics();
+
+	// Needs the pipelineStatisticsQuery device feature, without it nothing is recorded
+	void create(VulkanDevice* device);
+	void destroy();
+
+	bool isSupported() const { return queryPool != VK_NULL_HANDLE; }
+
+	// Reset outside of the render pass, then begin and end
+	// inside it around the draws to measure
+	void recordReset(VkCommandBuffer cmd);
+	void recordBegin(VkCommandBuffer cmd);
+	void recordEnd(VkCommandBuffer cmd);
+
+	// Accumulate the counts of the completed frame and print the
+	// averages every 'reportInterval' frames
+	void collect(uint32_t pixelCount, const char* label, uint32_t reportInterval = 256);
+
+private:
+	VulkanDevice*	deviceObj;
+	VkQueryPool		queryPool;
+	uint64_t		fragmentSum;
+	uint32_t		frameCount;
+};
@@ -47,6 +47,7 @@ public:
 	VkPhysicalDevice*					gpu;		// Physical device
 	VkPhysicalDeviceProperties			gpuProps;	// Physical device attributes
     VkPhysicalDeviceMemoryProperties	memoryProperties;
+	VkPhysicalDeviceFeatures			deviceFeatures;	// Features supported by the physical device
 
 public:
 	// Queue
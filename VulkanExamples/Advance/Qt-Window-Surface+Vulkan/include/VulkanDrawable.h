@@ -27,6 +27,8 @@
 #include "Headers.h"
 #include "VulkanDescriptor.h"
 #include "Wrappers.h"
+#include "InstanceDepthOrder.h"
+#include "PipelineStatistics.h"
 
 class VulkanRenderer;
 class VulkanDrawable : public VulkanDescriptor
@@ -51,6 +53,9 @@ public:
 		//uint32_t texIndex;
 	};
 
+	// Fill 'count' instances and their positions in place, split in jobs on the job system
+	static void generateInstanceData(InstanceData* instances, glm::vec4* positions, size_t count);
+
 	// Contains the instanced data
 	struct {
 		VkBuffer buffer = VK_NULL_HANDLE;
@@ -58,6 +63,10 @@ public:
 		size_t size = 0;
 		VkDescriptorBufferInfo descriptor;
 	} instanceBuffer;
+
+	// Draw the instances front to back, reordered every few frames
+	void setDepthOrder(bool enable);
+	bool getDepthOrder() const { return depthOrderEnabled; }
 	////////////////////////////////////////////////////
 
 	void setPipeline(VkPipeline* vulkanPipeline) { pipeline = vulkanPipeline; }
@@ -106,6 +115,9 @@ public:
 private:
 	std::vector<VkCommandBuffer> vecCmdDraw;			// Command buffer for drawing
 	void recordCommandBuffer(int currentImage, VkCommandBuffer* cmdDraw);
+	void reorderInstances();
+	// Move the staged instances in place into 'order' of generation indices, generation order when NULL
+	void permuteStagingInstances(const std::vector<uint32_t>* order);
 	VkViewport viewport;
 	VkRect2D   scissor;
 	VkSemaphore presentCompleteSemaphore;
@@ -115,7 +127,25 @@ private:
 	glm::mat4 View;
 	glm::mat4 Model;
 	glm::mat4 MVP;
+	float     rotation;		// Advanced by update(), the drawables are updated in parallel
 
 	VulkanRenderer* rendererObj;
 	VkPipeline*		pipeline;
+
+	std::vector<glm::vec4>		instancePositions;	// Depth order key, in generation order
+	std::vector<uint32_t>		stagingSlots;		// Staging index of each instance, in generation order
+	std::vector<uint32_t>		stagingGather;		// Source index of each staging element during a reordering
+	struct {
+		VkBuffer		buffer;
+		VkDeviceMemory	memory;
+		InstanceData*	mapped;
+	} instanceStaging;								// The only CPU copy of the instances, in draw order, copied to instanceBuffer
+	VkCommandBuffer		cmdInstanceOrder;			// Copy of the staging buffer after a reordering
+
+	InstanceDepthOrder	depthOrder;
+	bool				depthOrderEnabled;
+	bool				depthOrderDirty;			// Reorder with the next frame
+	uint32_t			depthOrderFrame;			// Frames since the last reordering
+
+	PipelineStatistics	statistics;					// Overdraw of the instances
 };
\ No newline at end of file
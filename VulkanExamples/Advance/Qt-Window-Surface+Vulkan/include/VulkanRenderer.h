@@ -29,6 +29,7 @@
 #include "VulkanDrawable.h"
 #include "VulkanShader.h"
 #include "VulkanPipeline.h"
+#include "JobSystem.h"
 //#include "../QtSource/rasterwindow.h"
 #include <QtGui>
 #include <QMainWindow>
@@ -52,6 +53,7 @@ public slots:
 
 protected:
 	void resizeEvent(QResizeEvent *ev) override;
+	void keyPressEvent(QKeyEvent *ev) override;
 
 	// Qt function ends
 public:
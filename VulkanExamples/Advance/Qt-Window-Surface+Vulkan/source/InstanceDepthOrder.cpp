@@ -0,0 +1,99 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "InstanceDepthOrder.h"
+#include "JobSystem.h"
+#include <cfloat>
+#include <algorithm>
+
+// Depth bins between the nearest and the farthest instance. The order inside a
+// bin is the instance order, a few bins are enough for the early depth test.
+#define DEPTH_BIN_COUNT 64
+
+// Instances per depth job
+#define DEPTH_CHUNK_SIZE 16384
+
+InstanceDepthOrder::InstanceDepthOrder()
+{
+}
+
+InstanceDepthOrder::~InstanceDepthOrder()
+{
+}
+
+const std::vector<uint32_t>& InstanceDepthOrder::sort(const void* positions, size_t stride, uint32_t count, const glm::mat4& modelView)
+{
+	depths.resize(count);
+	order.resize(count);
+	chunkRanges.assign((count + DEPTH_CHUNK_SIZE - 1) / DEPTH_CHUNK_SIZE, glm::vec2(FLT_MAX, -FLT_MAX));
+
+	// View space depth is the z row of the model view matrix, negated since the camera looks down -Z
+	const glm::vec4 depthRow(-modelView[0][2], -modelView[1][2], -modelView[2][2], -modelView[3][2]);
+
+	JobSystem::GetInstance()->parallelFor(0, count, DEPTH_CHUNK_SIZE, [&](size_t begin, size_t end) {
+		glm::vec2& range = chunkRanges[begin / DEPTH_CHUNK_SIZE];
+		for (size_t i = begin; i < end; i++) {
+			const glm::vec4& position = *(const glm::vec4*)((const uint8_t*)positions + i * stride);
+			if (position.w == 0.0f) {
+				depths[i] = FLT_MAX;
+				continue;
+			}
+			depths[i]	= glm::dot(depthRow, glm::vec4(glm::vec3(position), 1.0f));
+			range.x		= std::min(range.x, depths[i]);
+			range.y		= std::max(range.y, depths[i]);
+		}
+	});
+
+	float nearest	= FLT_MAX;
+	float farthest	= -FLT_MAX;
+	for (size_t i = 0; i < chunkRanges.size(); i++) {
+		nearest		= std::min(nearest, chunkRanges[i].x);
+		farthest	= std::max(farthest, chunkRanges[i].y);
+	}
+
+	// Counting sort on the bins, the hidden instances in an extra last bin
+	const float binScale = farthest > nearest ? DEPTH_BIN_COUNT / (farthest - nearest) : 0.0f;
+	uint32_t binOffsets[DEPTH_BIN_COUNT + 1] = {};
+	for (uint32_t i = 0; i < count; i++) {
+		const uint32_t bin = depths[i] == FLT_MAX ? DEPTH_BIN_COUNT :
+			std::min((uint32_t)((depths[i] - nearest) * binScale), (uint32_t)DEPTH_BIN_COUNT - 1);
+		binOffsets[bin]++;
+	}
+
+	uint32_t offset = 0;
+	for (uint32_t bin = 0; bin <= DEPTH_BIN_COUNT; bin++) {
+		const uint32_t binCount = binOffsets[bin];
+		binOffsets[bin] = offset;
+		offset += binCount;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		const uint32_t bin = depths[i] == FLT_MAX ? DEPTH_BIN_COUNT :
+			std::min((uint32_t)((depths[i] - nearest) * binScale), (uint32_t)DEPTH_BIN_COUNT - 1);
+		order[binOffsets[bin]++] = i;
+	}
+
+	return order;
+}
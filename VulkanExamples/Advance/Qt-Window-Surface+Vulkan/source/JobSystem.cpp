@@ -0,0 +1,240 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "JobSystem.h"
+#include <algorithm>
+
+std::unique_ptr<JobSystem> JobSystem::instance;
+std::once_flag JobSystem::onlyOnce;
+
+// Index of the queue owned by the current thread, threads
+// that are not workers use the shared queue at the end.
+static thread_local int threadQueueIndex = -1;
+
+JobSystem::JobSystem()
+{
+	isExiting		= false;
+	queuedJobCount	= 0;
+
+	unsigned int workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	for (unsigned int i = 0; i <= workerCount; i++) {
+		queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue));
+	}
+	for (unsigned int i = 0; i < workerCount; i++) {
+		workers.push_back(std::thread(&JobSystem::workerMain, this, i));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		isExiting = true;
+	}
+	sleepCondition.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+// Returns the Single ton object of JobSystem
+JobSystem* JobSystem::GetInstance()
+{
+	std::call_once(onlyOnce, []() { instance.reset(new JobSystem()); });
+	return instance.get();
+}
+
+JobSystem::JobHandle JobSystem::run(const std::function<void()>& work, const std::vector<JobHandle>& dependencies)
+{
+	JobHandle job = std::make_shared<Job>();
+	job->work			= work;
+	job->pendingCount	= 1;		// Held until all the dependencies are registered
+	job->isComplete		= false;
+	job->self			= job;
+
+	for (size_t i = 0; i < dependencies.size(); i++) {
+		Job* dependency = dependencies[i].get();
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (!dependency->isComplete) {
+			job->pendingCount++;
+			dependency->dependents.push_back(job);
+		}
+	}
+
+	if (--job->pendingCount == 0) {
+		schedule(job.get());
+	}
+	return job;
+}
+
+void JobSystem::schedule(Job* job)
+{
+	const int index = threadQueueIndex >= 0 ? threadQueueIndex : (int)queues.size() - 1;
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->jobs.push_back(job);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queuedJobCount++;
+	}
+	sleepCondition.notify_one();
+}
+
+JobSystem::Job* JobSystem::takeJob()
+{
+	const int ownIndex = threadQueueIndex;
+
+	// Newest job of the own queue first, it is the most likely to be in cache
+	if (ownIndex >= 0) {
+		WorkQueue& queue = *queues[ownIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			Job* job = queue.jobs.back();
+			queue.jobs.pop_back();
+			queuedJobCount--;
+			return job;
+		}
+	}
+
+	// Otherwise steal the oldest job of another queue, starting after the own one
+	const size_t queueCount = queues.size();
+	const size_t start = ownIndex >= 0 ? ownIndex + 1 : 0;
+	for (size_t i = 0; i < queueCount; i++) {
+		WorkQueue& queue = *queues[(start + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			Job* job = queue.jobs.front();
+			queue.jobs.pop_front();
+			queuedJobCount--;
+			return job;
+		}
+	}
+	return NULL;
+}
+
+void JobSystem::complete(Job* job)
+{
+	std::vector<JobHandle> dependents;
+	{
+		std::lock_guard<std::mutex> lock(job->mutex);
+		job->isComplete = true;
+		dependents.swap(job->dependents);
+	}
+
+	for (size_t i = 0; i < dependents.size(); i++) {
+		if (--dependents[i]->pendingCount == 0) {
+			schedule(dependents[i].get());
+		}
+	}
+
+	// The queue reference goes, the handles of the callers may still hold the job
+	JobHandle self;
+	self.swap(job->self);
+}
+
+bool JobSystem::runOneJob()
+{
+	Job* job = takeJob();
+	if (!job) {
+		return false;
+	}
+
+	job->work();
+	complete(job);
+	return true;
+}
+
+void JobSystem::workerMain(unsigned int index)
+{
+	threadQueueIndex = (int)index;
+
+	for (;;) {
+		if (runOneJob()) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepCondition.wait(lock, [this]() { return isExiting || queuedJobCount > 0; });
+		if (isExiting && queuedJobCount == 0) {
+			return;
+		}
+	}
+}
+
+void JobSystem::wait(const JobHandle& job)
+{
+	while (!job->isComplete) {
+		if (!runOneJob()) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::parallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& body)
+{
+	if (begin >= end) {
+		return;
+	}
+	grainSize = std::max<size_t>(grainSize, 1);
+
+	// A single chunk is not worth the scheduling
+	if (end - begin <= grainSize) {
+		body(begin, end);
+		return;
+	}
+
+	std::vector<JobHandle> chunks;
+	chunks.reserve((end - begin + grainSize - 1) / grainSize);
+	for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += grainSize) {
+		const size_t chunkEnd = std::min(chunkBegin + grainSize, end);
+		chunks.push_back(run([&body, chunkBegin, chunkEnd]() { body(chunkBegin, chunkEnd); }));
+	}
+
+	for (size_t i = 0; i < chunks.size(); i++) {
+		wait(chunks[i]);
+	}
+}
+
+void JobSystem::runOnMainThread(const std::function<void()>& work)
+{
+	std::lock_guard<std::mutex> lock(mainThreadMutex);
+	mainThreadJobs.push_back(work);
+}
+
+void JobSystem::executeMainThreadJobs()
+{
+	std::vector<std::function<void()> > jobs;
+	{
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+		jobs.swap(mainThreadJobs);
+	}
+
+	for (size_t i = 0; i < jobs.size(); i++) {
+		jobs[i]();
+	}
+}
@@ -0,0 +1,115 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PipelineStatistics.h"
+#include "VulkanDevice.h"
+
+PipelineStatistics::PipelineStatistics()
+{
+	deviceObj	= NULL;
+	queryPool	= VK_NULL_HANDLE;
+	fragmentSum	= 0;
+	frameCount	= 0;
+}
+
+PipelineStatistics::~PipelineStatistics()
+{
+}
+
+void PipelineStatistics::create(VulkanDevice* device)
+{
+	deviceObj = device;
+	if (deviceObj->deviceFeatures.pipelineStatisticsQuery != VK_TRUE) {
+		std::cout << "Pipeline statistics queries are not supported, no overdraw report" << std::endl;
+		return;
+	}
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType					= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.pNext					= NULL;
+	queryPoolInfo.flags					= 0;
+	queryPoolInfo.queryType				= VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	queryPoolInfo.queryCount			= 1;
+	queryPoolInfo.pipelineStatistics	= VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+	VkResult result = vkCreateQueryPool(deviceObj->device, &queryPoolInfo, NULL, &queryPool);
+	assert(result == VK_SUCCESS);
+}
+
+void PipelineStatistics::destroy()
+{
+	if (queryPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(deviceObj->device, queryPool, NULL);
+	}
+	*this = PipelineStatistics();
+}
+
+void PipelineStatistics::recordReset(VkCommandBuffer cmd)
+{
+	if (isSupported()) {
+		vkCmdResetQueryPool(cmd, queryPool, 0, 1);
+	}
+}
+
+void PipelineStatistics::recordBegin(VkCommandBuffer cmd)
+{
+	if (isSupported()) {
+		vkCmdBeginQuery(cmd, queryPool, 0, 0);
+	}
+}
+
+void PipelineStatistics::recordEnd(VkCommandBuffer cmd)
+{
+	if (isSupported()) {
+		vkCmdEndQuery(cmd, queryPool, 0);
+	}
+}
+
+void PipelineStatistics::collect(uint32_t pixelCount, const char* label, uint32_t reportInterval)
+{
+	if (!isSupported()) {
+		return;
+	}
+
+	// The frame was waited on, a query not available yet was not part of it
+	uint64_t fragments = 0;
+	VkResult result = vkGetQueryPoolResults(deviceObj->device, queryPool, 0, 1, sizeof(fragments),
+		&fragments, sizeof(fragments), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS) {
+		return;
+	}
+
+	fragmentSum += fragments;
+	if (++frameCount < reportInterval) {
+		return;
+	}
+
+	const double fragmentsPerFrame = (double)fragmentSum / frameCount;
+	std::cout << "Fragments shaded per frame: " << (uint64_t)fragmentsPerFrame
+		<< ", overdraw: " << std::fixed << std::setprecision(2) << fragmentsPerFrame / (pixelCount ? pixelCount : 1)
+		<< " (" << label << ")" << std::endl;
+	fragmentSum	= 0;
+	frameCount	= 0;
+}
@@ -0,0 +1,130 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SpirvCache.h"
+
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// SPIR-V module header magic number
+#define SPIRV_MAGIC_NUMBER 0x07230203
+
+// FNV-1a, good enough to address a handful of shaders
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+uint64_t SpirvCache::computeKey(const char* source, VkShaderStageFlagBits stage, const char* entryPoint, uint32_t options)
+{
+	const uint32_t version = SPIRV_CACHE_VERSION;
+
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	hash = hashBytes(hash, &version, sizeof(version));
+	hash = hashBytes(hash, &stage, sizeof(stage));
+	hash = hashBytes(hash, &options, sizeof(options));
+	hash = hashBytes(hash, entryPoint, strlen(entryPoint) + 1);
+	hash = hashBytes(hash, source, strlen(source));
+	return hash;
+}
+
+std::string SpirvCache::getFilename(uint64_t key)
+{
+	char name[32];
+	sprintf(name, "/%016llx.spv", (unsigned long long)key);
+	return std::string(SPIRV_CACHE_DIRECTORY) + name;
+}
+
+bool SpirvCache::load(uint64_t key, std::vector<unsigned int>& spirv)
+{
+	FILE* fp = fopen(getFilename(key).c_str(), "rb");
+	if (!fp) {
+		return false;
+	}
+
+	fseek(fp, 0L, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0L, SEEK_SET);
+
+	// At least the five words of the module header
+	bool isValid = size >= long(5 * sizeof(unsigned int)) && size % sizeof(unsigned int) == 0;
+	if (isValid) {
+		spirv.resize(size / sizeof(unsigned int));
+		isValid = fread(spirv.data(), size, 1, fp) == 1 && spirv[0] == SPIRV_MAGIC_NUMBER;
+	}
+	fclose(fp);
+
+	if (!isValid) {
+		spirv.clear();
+	}
+	return isValid;
+}
+
+void SpirvCache::store(uint64_t key, const std::vector<unsigned int>& spirv)
+{
+#ifdef _WIN32
+	_mkdir(SPIRV_CACHE_DIRECTORY);
+#else
+	mkdir(SPIRV_CACHE_DIRECTORY, 0755);
+#endif
+
+	// Write aside and rename, a concurrent or interrupted run never reads a partial module.
+	// The temporary name is unique to the process and thread, so writers of the same key
+	// never share a file and the last rename wins with a complete module.
+	char suffix[64];
+	sprintf(suffix, ".%d.%llx.tmp", int(getpid()), (unsigned long long)std::hash<std::thread::id>()(std::this_thread::get_id()));
+	const std::string filename	= getFilename(key);
+	const std::string tempname	= filename + suffix;
+
+	FILE* fp = fopen(tempname.c_str(), "wb");
+	if (!fp) {
+		return;
+	}
+
+	const bool isWritten = fwrite(spirv.data(), spirv.size() * sizeof(unsigned int), 1, fp) == 1;
+	fclose(fp);
+
+#ifdef _WIN32
+	// rename does not replace an existing file on Windows
+	remove(filename.c_str());
+#endif
+	if (!isWritten || rename(tempname.c_str(), filename.c_str()) != 0) {
+		remove(tempname.c_str());
+	}
+}
@@ -53,6 +53,12 @@ VkResult VulkanDevice::createDevice(std::vector<const char *>& layers, std::vect
 	queueInfo.queueCount				= 1;
 	queueInfo.pQueuePriorities			= queuePriorities;
 
+	vkGetPhysicalDeviceFeatures(*gpu, &deviceFeatures);
+
+	// Fragment shader invocation counts for the overdraw report
+	VkPhysicalDeviceFeatures setEnabledFeatures = {VK_FALSE};
+	setEnabledFeatures.pipelineStatisticsQuery = deviceFeatures.pipelineStatisticsQuery;
+
 	VkDeviceCreateInfo deviceInfo		= {};
 	deviceInfo.sType					= VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceInfo.pNext					= NULL;
@@ -62,7 +68,7 @@ VkResult VulkanDevice::createDevice(std::vector<const char *>& layers, std::vect
 	deviceInfo.ppEnabledLayerNames		= NULL;											// Device layers are deprecated
 	deviceInfo.enabledExtensionCount	= (uint32_t)extensions.size();
 	deviceInfo.ppEnabledExtensionNames	= extensions.size() ? extensions.data() : NULL;
-	deviceInfo.pEnabledFeatures			= NULL;
+	deviceInfo.pEnabledFeatures			= &setEnabledFeatures;
 
 	result = vkCreateDevice(*gpu, &deviceInfo, NULL, &device);
 	assert(result == VK_SUCCESS);
@@ -26,18 +26,126 @@
 #include "VulkanDrawable.h"
 
 #include "VulkanApplication.h"
-#include <random>
+#include "JobSystem.h"
+
+// MSVC does not define __SSE2__, its x64 target always has it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INSTANCE_GENERATION_SSE2
+#include <emmintrin.h>
+#endif
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define INSTANCE_BUFFER_BIND_ID 1
 #define INSTANCE_COUNT 2048*300
 #define M_PI 3.14
 
+// Seed of the instance generation, the same seed always gives the same scene
+#define INSTANCE_SEED 0x1b873593u
+// Instances generated per job
+#define INSTANCE_CHUNK_SIZE 4096
+// Frames between two depth orderings of the instances, each one moves the staged instances and copies them
+#define DEPTH_ORDER_INTERVAL 8
+
+// Philox4x32-10 counter based random number generator. The output only depends
+// on the key and the counter, so each instance draws its numbers from its own
+// index and the result does not depend on how the instances are split in jobs.
+static inline void philox4x32(uint32_t counter[4], uint32_t key0, uint32_t key1)
+{
+	for (int round = 0; round < 10; round++) {
+		const uint64_t product0 = (uint64_t)0xD2511F53u * counter[0];
+		const uint64_t product1 = (uint64_t)0xCD9E8D57u * counter[2];
+		const uint32_t next[4] = {
+			(uint32_t)(product1 >> 32) ^ counter[1] ^ key0,
+			(uint32_t)product1,
+			(uint32_t)(product0 >> 32) ^ counter[3] ^ key1,
+			(uint32_t)product0
+		};
+		memcpy(counter, next, sizeof(next));
+		key0 += 0x9E3779B9u;
+		key1 += 0xBB67AE85u;
+	}
+}
+
+// Uniform float in [0, 1) from the 24 high bits
+static inline float toUnitFloat(uint32_t bits)
+{
+	return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+#ifdef INSTANCE_GENERATION_SSE2
+// Four independent Philox4x32-10 streams, one per lane. counter[k] holds word k of the
+// four counters. _mm_mul_epu32 multiplies the even lanes, the odd lanes go through a shift.
+static inline void philox4x32x4(__m128i counter[4], uint32_t key0, uint32_t key1)
+{
+	const __m128i multiplier0 = _mm_set1_epi32((int)0xD2511F53u);
+	const __m128i multiplier1 = _mm_set1_epi32((int)0xCD9E8D57u);
+	for (int round = 0; round < 10; round++) {
+		__m128i high[2], low[2];
+		for (int k = 0; k < 2; k++) {
+			const __m128i value			= counter[k * 2];
+			const __m128i multiplier	= k ? multiplier1 : multiplier0;
+			// (lo0 lo2 hi0 hi2) and (lo1 lo3 hi1 hi3)
+			const __m128i even	= _mm_shuffle_epi32(_mm_mul_epu32(value, multiplier), _MM_SHUFFLE(3, 1, 2, 0));
+			const __m128i odd	= _mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_epi64(value, 32), multiplier), _MM_SHUFFLE(3, 1, 2, 0));
+			low[k]	= _mm_unpacklo_epi32(even, odd);
+			high[k]	= _mm_unpackhi_epi32(even, odd);
+		}
+		const __m128i next0 = _mm_xor_si128(_mm_xor_si128(high[1], counter[1]), _mm_set1_epi32((int)key0));
+		const __m128i next2 = _mm_xor_si128(_mm_xor_si128(high[0], counter[3]), _mm_set1_epi32((int)key1));
+		counter[0] = next0;
+		counter[1] = low[1];
+		counter[2] = next2;
+		counter[3] = low[0];
+		key0 += 0x9E3779B9u;
+		key1 += 0xBB67AE85u;
+	}
+}
+
+static inline __m128 toUnitFloat4(__m128i bits)
+{
+	return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(bits, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+}
+
+// Sine and cosine of non negative angles with the Cephes polynomials, 1e-7 off sinf and cosf
+static inline void sincos4(__m128 x, __m128* sine, __m128* cosine)
+{
+	// Octant rounded up to even, x is reduced to [-pi/4, pi/4] with pi/4 split in three parts
+	__m128i octant	= _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+	octant			= _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	const __m128 y	= _mm_cvtepi32_ps(octant);
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+
+	const __m128 z	= _mm_mul_ps(x, x);
+	__m128 polyCos	= _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z), _mm_set1_ps(-1.388731625493765e-3f));
+	polyCos			= _mm_add_ps(_mm_mul_ps(polyCos, z), _mm_set1_ps(4.166664568298827e-2f));
+	polyCos			= _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(polyCos, z), z), _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	polyCos			= _mm_add_ps(polyCos, _mm_set1_ps(1.0f));
+	__m128 polySin	= _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z), _mm_set1_ps(8.3321608736e-3f));
+	polySin			= _mm_add_ps(_mm_mul_ps(polySin, z), _mm_set1_ps(-1.6666654611e-1f));
+	polySin			= _mm_add_ps(_mm_mul_ps(_mm_mul_ps(polySin, z), x), x);
+
+	// Octants 2 and 6 swap the polynomials, the signs follow the quadrant
+	const __m128 swap		= _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+	const __m128 signSin	= _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29));
+	const __m128 signCos	= _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+	*sine	= _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, polyCos), _mm_andnot_ps(swap, polySin)), signSin);
+	*cosine	= _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, polySin), _mm_andnot_ps(swap, polyCos)), signCos);
+}
+#endif // INSTANCE_GENERATION_SSE2
+
 VulkanDrawable::VulkanDrawable(VulkanRenderer* parent) {
 	// Note: It's very important to initilize the member with 0 or respective value other wise it will break the system
 	memset(&UniformData, 0, sizeof(UniformData));
 	memset(&VertexBuffer, 0, sizeof(VertexBuffer));
+	memset(&instanceStaging, 0, sizeof(instanceStaging));
 	rendererObj = parent;
+	rotation = 0;
+	cmdInstanceOrder = VK_NULL_HANDLE;
+	depthOrderEnabled = true;
+	depthOrderDirty = true;
+	depthOrderFrame = 0;
 
 	VkSemaphoreCreateInfo presentCompleteSemaphoreCreateInfo;
 	presentCompleteSemaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -64,6 +172,7 @@ void VulkanDrawable::destroyCommandBuffer()
 	for (int i = 0; i<vecCmdDraw.size(); i++) {
 		vkFreeCommandBuffers(deviceObj->device, rendererObj->cmdPool, 1, &vecCmdDraw[i]);
 	}
+	vkFreeCommandBuffers(deviceObj->device, rendererObj->cmdPool, 1, &cmdInstanceOrder);
 }
 
 void VulkanDrawable::destroySynchronizationObjects()
@@ -399,6 +508,11 @@ void VulkanDrawable::destroyVertexBuffer()
 {
 	vkDestroyBuffer(rendererObj->getDevice()->device, VertexBuffer.buf, NULL);
 	vkFreeMemory(rendererObj->getDevice()->device, VertexBuffer.mem, NULL);
+
+	vkUnmapMemory(deviceObj->device, instanceStaging.memory);
+	vkDestroyBuffer(deviceObj->device, instanceStaging.buffer, NULL);
+	vkFreeMemory(deviceObj->device, instanceStaging.memory, NULL);
+	statistics.destroy();
 }
 
 void VulkanDrawable::destroyUniformBuffer()
@@ -437,8 +551,11 @@ void VulkanDrawable::recordCommandBuffer(int currentImage, VkCommandBuffer* cmdD
 	renderPassBegin.clearValueCount				= 2;
 	renderPassBegin.pClearValues				= clearValues;
 	
+	statistics.recordReset(*cmdDraw);
+
 	// Start recording the render pass instance
 	vkCmdBeginRenderPass(*cmdDraw, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+	statistics.recordBegin(*cmdDraw);
 
 	// Bound the command buffer with the graphics pipeline
 	vkCmdBindPipeline(*cmdDraw, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
@@ -459,6 +576,7 @@ void VulkanDrawable::recordCommandBuffer(int currentImage, VkCommandBuffer* cmdD
 	vkCmdDraw(*cmdDraw, 3 * 2 * 6, INSTANCE_COUNT, 0, 0);
 
 	// End of render pass instance recording
+	statistics.recordEnd(*cmdDraw);
 	vkCmdEndRenderPass(*cmdDraw);
 }
 
@@ -491,11 +609,10 @@ void VulkanDrawable::update()
 		glm::vec3(0, 1, 0)		// Head is up
 		);
 	Model = glm::mat4(1.0f);
-	static float rot = 0;
-	rot += 0.001f;
-	//rot += 1.0f;
-	Model = glm::rotate(Model, rot, glm::vec3(0.0, 1.0, 0.0))
-			* glm::rotate(Model, rot, glm::vec3(1.0, 1.0, 1.0));
+	rotation += 0.001f;
+	//rotation += 1.0f;
+	Model = glm::rotate(Model, rotation, glm::vec3(0.0, 1.0, 0.0))
+			* glm::rotate(Model, rotation, glm::vec3(1.0, 1.0, 1.0));
 
 	glm::mat4 MVP = Projection * View * Model;
 
@@ -533,6 +650,18 @@ void VulkanDrawable::render()
 	VkResult result = swapChainObj->fpAcquireNextImageKHR(deviceObj->device, swapChain,
 		UINT64_MAX, presentCompleteSemaphore, VK_NULL_HANDLE, &currentColorImage);
 
+	// Order the instances front to back every few frames as the scene turns, the previous
+	// frame was waited on so the staging buffer is free. Disabling restores the generation order.
+	bool reordered = false;
+	if (depthOrderEnabled) {
+		depthOrderFrame++;
+	}
+	if (depthOrderDirty || (depthOrderEnabled && depthOrderFrame >= DEPTH_ORDER_INTERVAL)) {
+		reorderInstances();
+		reordered = true;
+	}
+	VkCommandBuffer cmdBufs[2] = { cmdInstanceOrder, vecCmdDraw[currentColorImage] };
+
 	VkPipelineStageFlags submitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
 	VkSubmitInfo submitInfo = {};
@@ -541,13 +670,14 @@ void VulkanDrawable::render()
 	submitInfo.waitSemaphoreCount	= 1;
 	submitInfo.pWaitSemaphores		= &presentCompleteSemaphore;
 	submitInfo.pWaitDstStageMask	= &submitPipelineStages;
-	submitInfo.commandBufferCount	= (uint32_t)sizeof(&vecCmdDraw[currentColorImage]) / sizeof(VkCommandBuffer);
-	submitInfo.pCommandBuffers		= &vecCmdDraw[currentColorImage];
+	submitInfo.commandBufferCount	= reordered ? 2 : 1;
+	submitInfo.pCommandBuffers		= reordered ? &cmdBufs[0] : &cmdBufs[1];
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores	= &drawingCompleteSemaphore;
 
 	// Queue the command buffer for execution
 	CommandBufferMgr::submitCommandBuffer(deviceObj->queue, &vecCmdDraw[currentColorImage], &submitInfo);
+	statistics.collect(rendererObj->width * rendererObj->height, depthOrderEnabled ? "front to back" : "generation order");
 
 	// Present the image in the window
 	VkPresentInfoKHR present = {};
@@ -623,50 +753,97 @@ void VulkanDrawable::createPipelineLayout()
 	assert(result == VK_SUCCESS);
 }
 
+// Instances are placed on a flattened sphere with a random rotation. Each job
+// fills a chunk of the destination, the numbers of instance i come from the
+// Philox counters (i, 0) and (i, 1), so the output is the same for any thread count.
+// With SSE2 every instance goes through the four lane path, a partial last group
+// included, so the split in jobs does not change the results either.
+void VulkanDrawable::generateInstanceData(InstanceData* instances, glm::vec4* positions, size_t count)
+{
+	JobSystem::GetInstance()->parallelFor(0, count, INSTANCE_CHUNK_SIZE, [instances, positions](size_t begin, size_t end) {
+#ifdef INSTANCE_GENERATION_SSE2
+		// Four instances per iteration, the last group of a chunk is computed whole and written in part
+		for (size_t i = begin; i < end; i += 4)
+		{
+			const __m128i index = _mm_add_epi32(_mm_set1_epi32((int)i), _mm_setr_epi32(0, 1, 2, 3));
+			__m128i random[8] = { index, _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(),
+								  index, _mm_set1_epi32(1), _mm_setzero_si128(), _mm_setzero_si128() };
+			philox4x32x4(&random[0], INSTANCE_SEED, 0);
+			philox4x32x4(&random[4], INSTANCE_SEED, 0);
+
+			const __m128 theta		= _mm_mul_ps(_mm_set1_ps(2.0f * (float)M_PI), toUnitFloat4(random[0]));
+			const __m128 u			= toUnitFloat4(random[1]);
+			const __m128 cosPhi		= _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(2.0f), u));
+			const __m128 sinPhi		= _mm_mul_ps(_mm_set1_ps(2.0f), _mm_sqrt_ps(_mm_mul_ps(u, _mm_sub_ps(_mm_set1_ps(1.0f), u))));
+			__m128 sinTheta, cosTheta;
+			sincos4(theta, &sinTheta, &cosTheta);
+
+			float x[4], y[4], z[4], rot[3][4];
+			_mm_storeu_ps(x, _mm_mul_ps(_mm_mul_ps(sinPhi, cosTheta), _mm_set1_ps(1070.5f)));
+			_mm_storeu_ps(y, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(sinTheta, toUnitFloat4(random[2])), _mm_set1_ps(1000.0f / 1500.0f)), _mm_set1_ps(1070.5f)));
+			_mm_storeu_ps(z, _mm_mul_ps(cosPhi, _mm_set1_ps(1070.5f)));
+			_mm_storeu_ps(rot[0], _mm_mul_ps(toUnitFloat4(random[3]), _mm_set1_ps((float)(M_PI * 10))));
+			_mm_storeu_ps(rot[1], _mm_mul_ps(toUnitFloat4(random[4]), _mm_set1_ps((float)(M_PI * 10))));
+			_mm_storeu_ps(rot[2], _mm_mul_ps(toUnitFloat4(random[5]), _mm_set1_ps((float)(M_PI * 10))));
+
+			for (size_t lane = 0; lane < 4 && i + lane < end; lane++)
+			{
+				InstanceData& instance	= instances[i + lane];
+				instance.MVP[0]			= glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+				instance.MVP[1]			= glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+				instance.MVP[2]			= glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+				instance.MVP[3]			= glm::vec4(x[lane], y[lane], z[lane], 1.0f);
+				instance.rot			= glm::vec3(rot[0][lane], rot[1][lane], rot[2][lane]);
+				positions[i + lane]		= instance.MVP[3];
+			}
+		}
+#else
+		for (size_t i = begin; i < end; i++)
+		{
+			uint32_t random[8] = { (uint32_t)i, 0, 0, 0, (uint32_t)i, 1, 0, 0 };
+			philox4x32(&random[0], INSTANCE_SEED, 0);
+			philox4x32(&random[4], INSTANCE_SEED, 0);
+
+			// phi = acos(1 - 2u), its cosine and sine follow without the acos
+			const float theta		= 2.0f * (float)M_PI * toUnitFloat(random[0]);
+			const float u			= toUnitFloat(random[1]);
+			const float cosPhi		= 1.0f - 2.0f * u;
+			const float sinPhi		= 2.0f * sqrtf(u * (1.0f - u));
+			const float sinTheta	= sinf(theta);
+			const float cosTheta	= cosf(theta);
+
+			// Translation only, written in place instead of a glm::translate per instance
+			InstanceData& instance	= instances[i];
+			instance.MVP[0]			= glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+			instance.MVP[1]			= glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+			instance.MVP[2]			= glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+			instance.MVP[3]			= glm::vec4(sinPhi * cosTheta * 1070.5f,
+												sinTheta * toUnitFloat(random[2]) * (1000.0f / 1500.0f) * 1070.5f,
+												cosPhi * 1070.5f,
+												1.0f);
+			instance.rot			= glm::vec3(toUnitFloat(random[3]), toUnitFloat(random[4]), toUnitFloat(random[5])) * (float)(M_PI * 10);
+			positions[i]			= instance.MVP[3];
+		}
+#endif // INSTANCE_GENERATION_SSE2
+	});
+}
+
 void VulkanDrawable::prepareInstanceData()
 {
-	std::vector<InstanceData> instanceData;
-	instanceData.resize(INSTANCE_COUNT);
-
-	std::mt19937 rndGenerator(time(NULL));
-	std::uniform_real_distribution<double> uniformDist(0.0, 1.0);
-
-	//for (auto i = 0; i < INSTANCE_COUNT; i++)
-	//{
-	//	instanceData[i].rot = glm::vec3(M_PI * 10 * uniformDist(rndGenerator), M_PI * 10 * uniformDist(rndGenerator), M_PI *10* uniformDist(rndGenerator));
-	//	float theta = 2 * M_PI * uniformDist(rndGenerator);
-	//	float phi = acos(1 - 2 * uniformDist(rndGenerator));
-	//	glm::vec3 pos;
-	//	//instanceData[i].pos = glm::vec3(sin(phi) * cos(theta), sin(theta) * uniformDist(rndGenerator) / 1500.0f, cos(phi)) * 7.5f;
-	//	//instanceData[i].scale = 1.0f + uniformDist(rndGenerator) * 2.0f;
-	//	//instanceData[i].texIndex = 0;// rnd(textures.colorMap.layerCount);
-	//}
-
-	for (auto i = 0; i < INSTANCE_COUNT; i++)
-	{
-		Model = glm::mat4(1.0f);
-		static float rot = 0;
-		rot += .0005f;
-		//Model = glm::rotate(Model, rot, glm::vec3(0.0, 1.0, 0.0))
-		//	* glm::rotate(Model, rot, glm::vec3(1.0, 1.0, 1.0));
-		float theta = 2 * M_PI * uniformDist(rndGenerator);
-		float phi = acos(1 - 2 * uniformDist(rndGenerator));
-		glm::vec3 pos = glm::vec3(sin(phi) * cos(theta), 1000*sin(theta) * uniformDist(rndGenerator) / 1500.0f, cos(phi)) * 1070.5f;
-		Model = glm::translate(Model, pos);
-
-		instanceData[i].MVP = Model;
-		instanceData[i].rot = glm::vec3(M_PI * 10 * uniformDist(rndGenerator), M_PI * 10 * uniformDist(rndGenerator), M_PI * 10 * uniformDist(rndGenerator));
+	instanceBuffer.size = INSTANCE_COUNT * sizeof(InstanceData);
+
+	// Only the positions are kept aside for the depth order, the instances are generated into the staging buffer
+	instancePositions.resize(INSTANCE_COUNT);
+	stagingSlots.resize(INSTANCE_COUNT);
+	stagingGather.resize(INSTANCE_COUNT);
+	for (uint32_t i = 0; i < INSTANCE_COUNT; i++) {
+		stagingSlots[i] = i;
 	}
-	instanceBuffer.size = instanceData.size() * sizeof(InstanceData);
 
 	// Staging
 	// Instanced data is static, copy to device local memory 
 	// This results in better performance
-
-	struct {
-		VkDeviceMemory memory;
-		VkBuffer buffer;
-	} stagingBuffer;
+	// The staging buffer stays mapped, the instances are copied again in depth order
 
 	//////////////////////////////////////// 1.
 	{
@@ -686,24 +863,26 @@ void VulkanDrawable::prepareInstanceData()
 		bufCreateInfo.size = instanceBuffer.size;
 		bufCreateInfo.flags = 0;
 		VkBufferCreateInfo bufferCreateInfo = bufCreateInfo;
-		VkResult result = vkCreateBuffer(deviceObj->device, &bufferCreateInfo, nullptr, &stagingBuffer.buffer);
+		VkResult result = vkCreateBuffer(deviceObj->device, &bufferCreateInfo, nullptr, &instanceStaging.buffer);
 
-		vkGetBufferMemoryRequirements(deviceObj->device, stagingBuffer.buffer, &memReqs);
+		vkGetBufferMemoryRequirements(deviceObj->device, instanceStaging.buffer, &memReqs);
 		memAlloc.allocationSize = memReqs.size;
 		// Get the compatible type of memory
-		deviceObj->memoryTypeFromProperties(memReqs.memoryTypeBits,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &memAlloc.memoryTypeIndex);
+		// Coherent, the workers write straight into the mapping without flushing.
+		// Cached when available, the reordering reads the instances back.
+		if (!deviceObj->memoryTypeFromProperties(memReqs.memoryTypeBits,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &memAlloc.memoryTypeIndex)) {
+			deviceObj->memoryTypeFromProperties(memReqs.memoryTypeBits,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &memAlloc.memoryTypeIndex);
+		}
 
 		//memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-		result = vkAllocateMemory(deviceObj->device, &memAlloc, nullptr, &stagingBuffer.memory);
-		if (instanceData.data() != nullptr)
-		{
-			void *mapped;
-			vkMapMemory(deviceObj->device, stagingBuffer.memory, 0, instanceBuffer.size, 0, &mapped);
-			memcpy(mapped, instanceData.data(), instanceBuffer.size);
-			vkUnmapMemory(deviceObj->device, stagingBuffer.memory);
-		}
-		result = vkBindBufferMemory(deviceObj->device, stagingBuffer.buffer, stagingBuffer.memory, 0);
+		result = vkAllocateMemory(deviceObj->device, &memAlloc, nullptr, &instanceStaging.memory);
+
+		result = vkMapMemory(deviceObj->device, instanceStaging.memory, 0, instanceBuffer.size, 0, (void**)&instanceStaging.mapped);
+		assert(result == VK_SUCCESS);
+		generateInstanceData(instanceStaging.mapped, instancePositions.data(), INSTANCE_COUNT);
+		result = vkBindBufferMemory(deviceObj->device, instanceStaging.buffer, instanceStaging.memory, 0);
 	}
 	////////////////////////////////////////////// 1.
 
@@ -767,7 +946,7 @@ void VulkanDrawable::prepareInstanceData()
 	copyRegion.size = instanceBuffer.size;
 	vkCmdCopyBuffer(
 		copyCmd,
-		stagingBuffer.buffer,
+		instanceStaging.buffer,
 		instanceBuffer.buffer,
 		1,
 		&copyRegion);
@@ -785,7 +964,82 @@ void VulkanDrawable::prepareInstanceData()
 	instanceBuffer.descriptor.buffer = instanceBuffer.buffer;
 	instanceBuffer.descriptor.offset = 0;
 
-	// Destroy staging resources
-	vkDestroyBuffer(deviceObj->device, stagingBuffer.buffer, nullptr);
-	vkFreeMemory(deviceObj->device, stagingBuffer.memory, nullptr);
+	// Copies the staging buffer again after each reordering, submitted ahead of the drawing
+	CommandBufferMgr::allocCommandBuffer(&deviceObj->device, *rendererObj->getCommandPool(), &cmdInstanceOrder);
+	CommandBufferMgr::beginCommandBuffer(cmdInstanceOrder);
+
+	// The previous frame may still read the instances in its vertex input
+	vkCmdPipelineBarrier(cmdInstanceOrder, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, NULL, 0, NULL, 0, NULL);
+	vkCmdCopyBuffer(cmdInstanceOrder, instanceStaging.buffer, instanceBuffer.buffer, 1, &copyRegion);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext			= NULL;
+	barrier.srcAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	vkCmdPipelineBarrier(cmdInstanceOrder, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		0, 1, &barrier, 0, NULL, 0, NULL);
+	CommandBufferMgr::endCommandBuffer(cmdInstanceOrder);
+
+	statistics.create(deviceObj);
+}
+
+void VulkanDrawable::permuteStagingInstances(const std::vector<uint32_t>* order)
+{
+	// Where each staging element comes from, then where each instance lands
+	uint32_t* gather	= stagingGather.data();
+	uint32_t* slots		= stagingSlots.data();
+	JobSystem::GetInstance()->parallelFor(0, INSTANCE_COUNT, INSTANCE_CHUNK_SIZE, [gather, slots, order](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			gather[i] = slots[order ? (*order)[i] : i];
+		}
+	});
+	JobSystem::GetInstance()->parallelFor(0, INSTANCE_COUNT, INSTANCE_CHUNK_SIZE, [slots, order](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			slots[order ? (*order)[i] : i] = (uint32_t)i;
+		}
+	});
+
+	// Follow the cycles of the permutation with a single instance aside,
+	// a placed element points at itself
+	InstanceData* staging = instanceStaging.mapped;
+	for (uint32_t start = 0; start < INSTANCE_COUNT; start++) {
+		if (gather[start] == start) {
+			continue;
+		}
+
+		const InstanceData first = staging[start];
+		uint32_t slot = start;
+		while (gather[slot] != start) {
+			const uint32_t source = gather[slot];
+			staging[slot]	= staging[source];
+			gather[slot]	= slot;
+			slot			= source;
+		}
+		staging[slot]	= first;
+		gather[slot]	= slot;
+	}
+}
+
+void VulkanDrawable::reorderInstances()
+{
+	// Coherent staging memory, the device sees the writes once the copy is submitted
+	if (depthOrderEnabled) {
+		permuteStagingInstances(&depthOrder.sort(instancePositions.data(), sizeof(glm::vec4), INSTANCE_COUNT, View * Model));
+	}
+	else {
+		permuteStagingInstances(NULL);
+	}
+	depthOrderFrame = 0;
+	depthOrderDirty = false;
+}
+
+void VulkanDrawable::setDepthOrder(bool enable)
+{
+	// Sort on the next frame, or restore the generation order
+	depthOrderEnabled	= enable;
+	depthOrderDirty		= true;
 }
\ No newline at end of file
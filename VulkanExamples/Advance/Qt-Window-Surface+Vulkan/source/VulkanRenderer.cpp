@@ -97,10 +97,13 @@ void VulkanRenderer::prepare()
 
 void VulkanRenderer::update()
 {
-	for each (VulkanDrawable* drawableObj in drawableList)
-	{
-		drawableObj->update();
-	}
+	// Drawables update their own uniform data only, they are independent
+	JobSystem::GetInstance()->parallelFor(0, drawableList.size(), 1, [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			drawableList[i]->update();
+		}
+	});
 }
 
 bool VulkanRenderer::render()
@@ -120,6 +123,9 @@ bool VulkanRenderer::render()
 void VulkanRenderer::updateAndRender()
 {
 //	printf("=> UpdateAndRender...");
+	// Work the jobs handed back to the main thread since the last frame
+	JobSystem::GetInstance()->executeMainThreadJobs();
+
 	update();
 //	render();
 	for each (VulkanDrawable* drawableObj in drawableList)
@@ -740,3 +746,14 @@ void VulkanRenderer::resizeEvent(QResizeEvent* ev)
 	if (ev->MouseButtonRelease)
 		application->resize();
 }
+
+void VulkanRenderer::keyPressEvent(QKeyEvent* ev)
+{
+	// 'O' toggles the front to back ordering of the instances
+	if (ev->key() == Qt::Key_O) {
+		for each (VulkanDrawable* drawableObj in drawableList)
+		{
+			drawableObj->setDepthOrder(!drawableObj->getDepthOrder());
+		}
+	}
+}
@@ -0,0 +1,133 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include "ComputeContext.h"
+#include <chrono>
+
+// Frames the CPU records ahead of the GPU, each one has its own slot of animated
+// vertices, semaphores and fences
+#define FRAMES_IN_FLIGHT 2
+
+// 1 overlaps the compute of the next frame with the graphics of the current one,
+// 0 runs the compute of each frame alone before its graphics, as a baseline
+#define ASYNC_COMPUTE_OVERLAP 1
+
+// Frames averaged by each line of statistics
+#define ASYNC_COMPUTE_STATS_FRAMES 500
+
+// Per frame compute work on the compute queue: Animate.comp writes the vertices
+// of the frame, the graphics queue draws them once the frame's compute semaphore
+// is signaled. The compute of frame N+1 is submitted right after the graphics of
+// frame N and runs alongside it, in the other slot.
+//
+// When the compute family is not the graphics family, the animated vertices are
+// released by the compute queue and acquired by the graphics queue. The way back
+// needs no transfer, the next compute run of the slot overwrites all of them and
+// only waits for the graphics semaphore of the slot.
+//
+// Timestamps around the work of each queue give its busy time, printed with the
+// frame time every ASYNC_COMPUTE_STATS_FRAMES frames. The start timestamps are
+// written after the semaphore waits, the time spent waiting is not busy time.
+class AsyncCompute
+{
+public:
+	AsyncCompute();
+	~AsyncCompute();
+
+	// 'restVertices' holds 'vertexCount' vertices of 'vertexSize' bytes, starting with a vec4 position
+	void create(ComputeContext* context, VkCommandPool commandPool, VkBuffer restVertices, uint32_t vertexCount,
+		uint32_t vertexSize, const uint32_t* spirv, size_t spirvSize);
+
+	// Waits for the frames in flight first
+	void destroy();
+
+	bool isCreated() const { return context != NULL; }
+
+	// Model transform applied by the next compute submissions
+	void setModel(const glm::mat4& model) { modelTransform = model; }
+
+	uint32_t getFrameSlot() const { return (uint32_t)(frameIndex % FRAMES_IN_FLIGHT); }
+	VkBuffer getVertexBuffer(uint32_t slot) const { return slots[slot].animatedVertices.buffer; }
+
+	// Recorded into the draw command buffers of a slot, before and after the render pass
+	void recordGraphicsBegin(VkCommandBuffer cmd, uint32_t slot);
+	void recordGraphicsEnd(VkCommandBuffer cmd, uint32_t slot);
+
+	// Waits until the draw command buffers of the current slot can be submitted again
+	void beginFrame();
+
+	// Submits a draw command buffer of the current slot on the graphics queue, after
+	// the compute work of the slot
+	void submitGraphics(VkCommandBuffer cmd, VkSemaphore presentComplete, VkSemaphore drawingComplete);
+
+	// Submits the compute work of the next frame
+	void endFrame();
+
+private:
+	void recordCompute(uint32_t slot);
+	void submitCompute(uint32_t slot);
+
+	// Wait for the last submission of a slot and add up its timestamps
+	void waitCompute(uint32_t slot);
+	void waitGraphics(uint32_t slot);
+
+	VkQueryPool createQueryPool(uint32_t queueFamilyIndex);
+	double readQueries(VkQueryPool queryPool, uint32_t queueFamilyIndex);
+	void printStatistics();
+
+	ComputeContext*		context;
+	VkCommandPool		commandPool;
+	ComputeKernel		animateKernel;
+	VkBuffer			restVertices;
+	uint32_t			vertexCount;
+	uint32_t			vertexStride;			// In floats
+	bool				ownershipTransfer;		// Compute and graphics queues are of different families
+	glm::mat4			modelTransform;
+	uint64_t			frameIndex;
+
+	struct FrameSlot {
+		ComputeBuffer	animatedVertices;
+		ComputeBuffer	frameData;				// Host visible model transform and time of Animate.comp
+		VkCommandBuffer	computeCmd;
+		VkSemaphore		computeComplete;		// Waited by the graphics submission of the slot
+		VkSemaphore		graphicsComplete;		// Waited by the next compute submission of the slot
+		VkFence			computeFence;
+		VkFence			graphicsFence;
+		VkQueryPool		computeQueries;			// VK_NULL_HANDLE without timestamps on the queue
+		VkQueryPool		graphicsQueries;
+		bool			computePending;			// Submitted, fence not waited yet
+		bool			graphicsPending;
+		bool			graphicsSignaled;		// graphicsComplete signaled and not waited yet
+	};
+	FrameSlot			slots[FRAMES_IN_FLIGHT];
+
+	std::chrono::steady_clock::time_point	startTime;
+	std::chrono::steady_clock::time_point	statisticsStart;
+	double				computeBusy;			// Nanoseconds since statisticsStart
+	double				graphicsBusy;
+	uint32_t			statisticsFrames;
+};
@@ -0,0 +1,151 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include "VulkanShader.h"
+#include <map>
+
+class VulkanDevice;
+class VulkanPipeline;
+class ComputeKernel;
+
+// Storage buffer created by the compute context
+struct ComputeBuffer {
+	VkBuffer		buffer;
+	VkDeviceMemory	memory;
+	VkDeviceSize	size;
+	void*			mapped;		// Host visible buffers stay mapped until they are destroyed
+};
+
+// State shared by the compute kernels of a device: the pipeline cache of the
+// pipeline object, the descriptor pools and the buffers bound to the kernels.
+// Pools are added as the kernels cache more descriptor sets.
+class ComputeContext
+{
+public:
+	ComputeContext();
+	~ComputeContext();
+
+	// The pipeline cache of 'pipelineObj' is created already
+	void initialize(VulkanDevice* device, VulkanPipeline* pipelineObj);
+
+	// The kernels are destroyed first
+	void destroy();
+
+	bool isInitialized() const { return deviceObj != NULL; }
+	VulkanDevice* getDevice() const { return deviceObj; }
+	VulkanPipeline* getPipelineObject() const { return pipelineObj; }
+
+	// Preferred invocations per workgroup, clamped to the device limits
+	uint32_t getWorkgroupSize(uint32_t preferredSize) const;
+
+	// Buffer with the storage usage added to 'usage'
+	void createBuffer(ComputeBuffer* buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties);
+
+	// Also drops the descriptor sets of the kernels using the buffer
+	void destroyBuffer(ComputeBuffer* buffer);
+
+	// Drop the descriptor sets of the kernels using a buffer created elsewhere. Called
+	// before the buffer is destroyed, once the GPU is done with it.
+	void releaseBuffer(VkBuffer buffer);
+
+private:
+	friend class ComputeKernel;
+
+	struct DescriptorPool {
+		VkDescriptorPool	pool;
+		uint32_t			setCount;	// Sets allocated from the pool and not freed
+	};
+
+	VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout layout, VkDescriptorPool* pool);
+	void freeDescriptorSet(VkDescriptorPool pool, VkDescriptorSet descriptorSet);
+
+	VulkanDevice*					deviceObj;
+	VulkanPipeline*					pipelineObj;
+	std::vector<DescriptorPool>		descriptorPools;
+	std::vector<ComputeKernel*>		kernels;		// Created kernels, told about the released buffers
+};
+
+// A compute shader built once from its SPIR-V, with its descriptor set layout,
+// pipeline layout and pipeline. Binding i of the shader takes the i-th name of
+// the kernel, buffers are bound by name and stay bound for the dispatches that
+// follow. Each combination of bound buffers gets a descriptor set on its first
+// dispatch, later dispatches with the same buffers reuse it.
+//
+// The workgroup size is specialized as local_size_x_id 0, other constants are
+// set through getSpecialization() before create().
+class ComputeKernel
+{
+public:
+	// Largest number of bindings of a kernel
+	static const uint32_t maxBindings = 8;
+
+	ComputeKernel();
+	~ComputeKernel();
+
+	void create(ComputeContext* context, const uint32_t* spirv, size_t spirvSize, const char* const* bindingNames,
+		uint32_t bindingCount, uint32_t pushConstantSize, uint32_t workgroupSize);
+	void destroy();
+
+	bool isCreated() const { return context != NULL; }
+	uint32_t getWorkgroupSize() const { return workgroupSize; }
+
+	// Workgroups covering 'count' invocations along X
+	uint32_t getGroupCount(uint32_t count) const { return (count + workgroupSize - 1) / workgroupSize; }
+
+	SpecializationConstants& getSpecialization() { return shader.getSpecialization(VK_SHADER_STAGE_COMPUTE_BIT); }
+
+	// Bind a buffer to a named binding, VK_NULL_HANDLE leaves the binding unused
+	void bind(const char* name, VkBuffer buffer);
+
+	// Record a dispatch with the bound buffers, outside of a render pass. The push
+	// constants are the size given to create().
+	void recordDispatch(VkCommandBuffer cmd, uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1,
+		const void* pushConstants = NULL);
+
+private:
+	friend class ComputeContext;
+
+	struct CachedSet {
+		VkDescriptorSet		descriptorSet;
+		VkDescriptorPool	pool;
+	};
+
+	VkDescriptorSet getDescriptorSet();
+	void releaseBuffer(VkBuffer buffer);
+
+	ComputeContext*							context;
+	std::vector<std::string>				bindingNames;
+	std::vector<VkBuffer>					boundBuffers;
+	uint32_t								pushConstantSize;
+	uint32_t								workgroupSize;
+
+	VulkanShader							shader;
+	VkPipeline								pipeline;
+	VkDescriptorSetLayout					descLayout;
+	VkPipelineLayout						pipelineLayout;
+	std::map<std::vector<VkBuffer>, CachedSet>	descriptorSets;
+};
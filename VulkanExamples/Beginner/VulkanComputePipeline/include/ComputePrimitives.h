@@ -0,0 +1,129 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include "ComputeContext.h"
+
+class VulkanDevice;
+
+// Data parallel building blocks on storage buffers of 32 bit unsigned integers:
+//	PrimReduce.comp		sum of the values of each block, applied until one sum is left
+//	PrimScan.comp		inclusive or exclusive scan of each block, and the block totals
+//	PrimScanAdd.comp	adds the scanned block totals back to the blocks
+//	PrimCompact.comp	moves the flagged values to their scanned offset
+//	PrimHistogram.comp	counts of a bit field of the values, in shared memory first
+// Sums wrap around at 2^32 like the CPU references.
+//
+// The kernels are specialized with the workgroup size of the device and the
+// number of values per invocation, and created through the pipeline cache.
+// Devices with arithmetic subgroup operations in compute shaders run variants
+// built with SUBGROUP_OPS, which scan within a subgroup without shared memory.
+//
+// The kernels are compute kernels of a compute context, buffers are passed by the
+// caller and their descriptor sets are cached by the kernels. Buffers not created
+// by the context are released from it before they are destroyed.
+class ComputePrimitives
+{
+public:
+	enum Kernel {
+		KERNEL_REDUCE,
+		KERNEL_SCAN,
+		KERNEL_SCAN_ADD,
+		KERNEL_COMPACT,
+		KERNEL_HISTOGRAM,
+		KERNEL_TOTAL
+	};
+
+	// Shader file of each kernel, without the extension
+	static const char* const kernelNames[KERNEL_TOTAL];
+
+	// Largest bin count of recordHistogram()
+	static const uint32_t maxHistogramBins = 256;
+
+	ComputePrimitives();
+	~ComputePrimitives();
+
+	// Invocations per workgroup of the kernels on the device
+	static uint32_t getWorkgroupSize(const VulkanDevice* device);
+
+	// True when the SUBGROUP_OPS variants of the kernels can run on the device
+	static bool isSubgroupSupported(const VulkanDevice* device);
+
+	// Create the kernels from their SPIR-V and the scratch buffers for up to 'capacity' values
+	void initialize(ComputeContext* context, uint32_t capacity,
+		const uint32_t* const spirv[KERNEL_TOTAL], const size_t spirvSize[KERNEL_TOTAL]);
+	void destroy();
+
+	bool isInitialized() const { return context != NULL; }
+	uint32_t getCapacity() const { return capacity; }
+
+	// The record functions are called outside of a render pass. They wait for earlier
+	// compute shader and transfer writes of their inputs, and leave their outputs
+	// readable by the compute shaders and transfers that follow. Every buffer needs
+	// the storage usage.
+
+	// Sum of the first 'count' values into the first value of 'result'
+	void recordReduce(VkCommandBuffer cmd, VkBuffer input, uint32_t count, VkBuffer result);
+
+	// Inclusive or exclusive scan of the first 'count' values, 'output' may be 'input'
+	void recordScan(VkCommandBuffer cmd, VkBuffer input, VkBuffer output, uint32_t count, bool inclusive);
+
+	// Values with a flag of one moved to the front of 'output' in their order, and
+	// their number in the first value of 'outputCount'. Flags are zero or one.
+	// 'outputCount' needs the transfer destination usage, it is cleared when 'count' is zero.
+	void recordCompact(VkCommandBuffer cmd, VkBuffer input, VkBuffer flags, uint32_t count, VkBuffer output, VkBuffer outputCount);
+
+	// Counts of the bits of the values from 'shift' on, in 'binCount' bins. The bin
+	// count is a power of two up to maxHistogramBins, 'bins' needs the transfer
+	// destination usage to be cleared.
+	void recordHistogram(VkCommandBuffer cmd, VkBuffer input, uint32_t count, uint32_t shift, uint32_t binCount, VkBuffer bins);
+
+	// CPU references, they give the same results as the GPU
+	static uint32_t reduceReference(const std::vector<uint32_t>& values);
+	static void scanReference(const std::vector<uint32_t>& values, bool inclusive, std::vector<uint32_t>& scanned);
+	static void compactReference(const std::vector<uint32_t>& values, const std::vector<uint32_t>& flags, std::vector<uint32_t>& compacted);
+	static void histogramReference(const std::vector<uint32_t>& values, uint32_t shift, uint32_t binCount, std::vector<uint32_t>& bins);
+
+private:
+	// Buffers of the kernel bindings, VK_NULL_HANDLE for the ones it does not use
+	void recordDispatch(VkCommandBuffer cmd, Kernel kernel, const void* constants, uint32_t groupCount, VkBuffer input, VkBuffer output,
+		VkBuffer flags = VK_NULL_HANDLE, VkBuffer sums = VK_NULL_HANDLE, VkBuffer count = VK_NULL_HANDLE);
+	void recordBarrier(VkCommandBuffer cmd);
+	void recordScanLevel(VkCommandBuffer cmd, VkBuffer input, VkBuffer output, uint32_t count, bool inclusive, uint32_t level);
+
+	// A single block for no values, the reduce and compaction still write their result
+	uint32_t getBlockCount(uint32_t count) const { return count ? (count + blockSize - 1) / blockSize : 1; }
+
+	ComputeContext*				context;
+	uint32_t					capacity;
+	uint32_t					workgroupSize;
+	uint32_t					blockSize;			// Values per workgroup
+
+	std::vector<ComputeBuffer>	levelSums;			// Block totals of each level of the reduce and scan
+	ComputeBuffer				offsets;			// Scanned flags of the compaction
+
+	ComputeKernel				kernels[KERNEL_TOTAL];
+};
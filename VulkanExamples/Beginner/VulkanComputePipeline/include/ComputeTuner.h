@@ -0,0 +1,76 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include "ComputeContext.h"
+#include <map>
+
+// Picks the fastest workgroup size of a compute kernel on the device. Variants of
+// the kernel are specialized with each candidate size, their dispatches are timed
+// with timestamp queries on the compute queue and the fastest one is kept.
+//
+// The choices are saved to a profile file of the device, named after its vendor
+// and device IDs, and are reused until the driver version or the SPIR-V of the
+// kernel changes. Without timestamps on the compute queue nothing is timed and
+// the default size is used.
+class ComputeTuner
+{
+public:
+	// Records one timed run of a variant into 'cmd': binds the buffers of the run
+	// and dispatches the groups needed at the variant's workgroup size
+	typedef void (*RecordFunction)(VkCommandBuffer cmd, ComputeKernel* kernel, void* userData);
+
+	ComputeTuner();
+	~ComputeTuner();
+
+	// Loads the profile of the device from 'profileDirectory'
+	void initialize(ComputeContext* context, VkCommandPool commandPool, const char* profileDirectory);
+
+	// Workgroup size of the kernel, tuned when the profile does not have it. The
+	// arguments are those of ComputeKernel::create(), the kernel must declare its
+	// workgroup size with local_size_x_id = 0.
+	uint32_t tune(const char* kernelName, const uint32_t* spirv, size_t spirvSize, const char* const* bindingNames,
+		uint32_t bindingCount, uint32_t pushConstantSize, uint32_t defaultSize, RecordFunction record, void* userData);
+
+	const std::string& getProfilePath() const { return profilePath; }
+
+private:
+	struct Choice {
+		uint32_t	spirvHash;		// SPIR-V the size was tuned for
+		uint32_t	workgroupSize;
+	};
+
+	// Duration of the fastest run of a variant, in nanoseconds
+	double timeVariant(ComputeKernel* kernel, RecordFunction record, void* userData);
+
+	void loadProfile();
+	void saveProfile();
+
+	ComputeContext*					context;
+	VkCommandPool					commandPool;
+	std::string						profilePath;
+	std::map<std::string, Choice>	choices;
+};
@@ -0,0 +1,53 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+
+// Directory holding the compiled shaders, relative to the working directory
+#ifndef SPIRV_CACHE_DIRECTORY
+#define SPIRV_CACHE_DIRECTORY "./SpirvCache"
+#endif
+
+// Bump when the compiler or its options change in a way the key does not capture
+#define SPIRV_CACHE_VERSION 1
+
+// Content addressed disk cache of the SPIR-V produced from GLSL at run time.
+// The key hashes everything the result depends on (source text, stage, entry point
+// and compile options), so an edited shader simply misses and gets recompiled.
+class SpirvCache
+{
+public:
+	static uint64_t computeKey(const char* source, VkShaderStageFlagBits stage, const char* entryPoint, uint32_t options);
+
+	// Returns false when the key is not cached or its file is not valid SPIR-V
+	static bool load(uint64_t key, std::vector<unsigned int>& spirv);
+
+	// Write the SPIR-V for the key, failures only cost a recompilation next time
+	static void store(uint64_t key, const std::vector<unsigned int>& spirv);
+
+private:
+	static std::string getFilename(uint64_t key);
+};
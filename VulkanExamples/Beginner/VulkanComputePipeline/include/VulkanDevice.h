@@ -28,6 +28,7 @@
 #include "Headers.h"
 //#include "VulkanQueue.h"
 #include "VulkanLED.h"
+#include "VulkanSamplerCache.h"
 
 class VulkanApplication;
 
@@ -48,6 +49,10 @@ public:
 	VkPhysicalDeviceProperties			gpuProps;	// Physical device attributes
     VkPhysicalDeviceMemoryProperties	memoryProperties;
 
+	// Subgroup size and VkSubgroupFeatureFlags usable by compute shaders, zero before Vulkan 1.1
+	uint32_t							subgroupSize;
+	uint32_t							subgroupOperations;
+
 public:
 	// Queue
 	VkQueue									queue;							// Vulkan Graphics Queue object
@@ -63,6 +68,9 @@ public:
 	VulkanLayerAndExtension		layerExtension;
 	VkPhysicalDeviceFeatures	deviceFeatures;
 
+	// Shared samplers, textures with the same sampler state use the same handle
+	VulkanSamplerCache			samplerCache;
+
 public:
 	VkResult createDevice(std::vector<const char *>& layers, std::vector<const char *>& extensions);
 	void destroyDevice();
@@ -70,6 +78,9 @@ public:
 	bool memoryTypeFromProperties(uint32_t typeBits, VkFlags requirements_mask, uint32_t *typeIndex);
 	bool memoryTypeFromProperties(VkFlags requirements_mask, uint32_t *typeIndex);
 
+	// Query the subgroup properties, needs an instance and a device of Vulkan 1.1 or later
+	void getSubgroupProperties(uint32_t instanceApiVersion);
+
 	// Get the avaialbe queues exposed by the physical devices
 	void getPhysicalDeviceQueuesAndProperties();
 
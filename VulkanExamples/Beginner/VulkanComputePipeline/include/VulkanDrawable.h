@@ -27,6 +27,7 @@
 #include "Headers.h"
 #include "VulkanDescriptor.h"
 #include "Wrappers.h"
+#include "AsyncCompute.h"
 
 class VulkanRenderer;
 class VulkanDrawable : public VulkanDescriptor
@@ -82,12 +83,12 @@ public:
 	VkVertexInputAttributeDescription	viIpAttrb[2];
 
 private:
-	std::vector<VkCommandBuffer> vecCmdDraw;			// Command buffer for drawing
-	void recordCommandBuffer(int currentImage, VkCommandBuffer* cmdDraw);
+	std::vector<VkCommandBuffer> vecCmdDraw;			// Command buffer for drawing, for each swapchain image and frame slot
+	void recordCommandBuffer(int currentImage, uint32_t frameSlot, VkCommandBuffer* cmdDraw);
 	VkViewport viewport;
 	VkRect2D   scissor;
-	VkSemaphore presentCompleteSemaphore;
-	VkSemaphore drawingCompleteSemaphore;
+	VkSemaphore presentCompleteSemaphore[FRAMES_IN_FLIGHT];
+	VkSemaphore drawingCompleteSemaphore[FRAMES_IN_FLIGHT];
 	TextureData* textures;
 
 	glm::mat4 Projection;
@@ -30,12 +30,13 @@
 //Define class here
 class VulkanInstance{
 public:
-    VulkanInstance(){}
+    VulkanInstance() { apiVersion = 0; }
     ~VulkanInstance(){}
 
 public:
     // VulkanInstance member variables
     VkInstance	instance;
+	uint32_t	apiVersion;		// Vulkan version the instance was created for
 
 	// Vulkan instance specific layer and extensions
 	VulkanLayerAndExtension		layerExtension;
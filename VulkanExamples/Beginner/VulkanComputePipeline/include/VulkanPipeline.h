@@ -25,6 +25,7 @@
 
 #pragma once
 #include "Headers.h"
+#include <map>
 class VulkanShader;
 class VulkanDrawable;
 class VulkanDevice;
@@ -51,13 +52,34 @@ public:
 	// if the vertex input are available. 	
 	bool createPipeline(VulkanDrawable* drawableObj, VkPipeline* pipeline, VulkanShader* shaderObj, VkBool32 includeDepth, VkBool32 includeVi = true);
 
-	// Destruct the pipeline cache object
+	// Returns the compute pipeline of the shader's compute stage, specialized with
+	// the current constants of the stage. Pipelines are cached by shader module,
+	// layout, entry point and constant values, and are owned by the pipeline object.
+	bool createComputePipeline(VulkanShader* shaderObj, VkPipelineLayout pipelineLayout, VkPipeline* pipeline);
+
+	// Destroy a pipeline returned by createComputePipeline() and forget it. Called before
+	// its shader module or layout is destroyed, a recycled handle would find it otherwise.
+	void destroyComputePipeline(VkPipeline pipeline);
+
+	// Destruct the pipeline cache object and the specialized compute pipelines
 	void destroyPipelineCache();
 
+	// Everything a compute pipeline is created from, compared in full
+	struct ComputePipelineKey {
+		VkShaderModule			module;
+		VkPipelineLayout		layout;
+		std::string				entryName;
+		std::vector<uint32_t>	constants;		// SpecializationConstants::getKey()
+
+		bool operator<(const ComputePipelineKey& other) const;
+	};
+
 public:
 	// Pipeline preparation member variables
 	// Pipeline cache object
 	VkPipelineCache						pipelineCache;
+	// Compute pipelines created by createComputePipeline()
+	std::map<ComputePipelineKey, VkPipeline>	computePipelines;
 	VulkanApplication*					appObj;
 	VulkanDevice*						deviceObj;
 };
\ No newline at end of file
@@ -28,12 +28,27 @@
 #include "VulkanSwapChain.h"
 #include "VulkanDrawable.h"
 #include "VulkanShader.h"
+#include "VulkanShaderCompiler.h"
 #include "VulkanPipeline.h"
+#include "ComputeContext.h"
+#include "ComputeTuner.h"
+#include "ComputePrimitives.h"
+#include "AsyncCompute.h"
 
 // Number of samples needs to be the same at image creation
 // Used at renderpass creation (in attachment) and pipeline creation
 #define NUM_SAMPLES VK_SAMPLE_COUNT_1_BIT
 
+// Workgroup size of Compute.comp when the device has no timestamps to tune
+// it, clamped to the device limit and passed as a specialization constant
+#define COMPUTE_WORKGROUP_SIZE 64
+
+// Values copied by each timed run of the workgroup size tuner
+#define COMPUTE_TUNING_ELEMENTS (1 << 20)
+
+// Values the compute primitives are created and checked for
+#define COMPUTE_PRIMITIVES_CAPACITY (1 << 22)
+
 // The Vulkan Renderer is custom class, it is not a Vulkan specific class.
 // It works as a presentation manager.
 // It manages the presentation windows and drawing surfaces.
@@ -69,20 +84,24 @@ public:
 	inline VkCommandPool getCommandPoolCompute()   { return cmdPoolCompute; }
 	inline VulkanShader*  getShader()				{ return &shaderObj; }
 	inline VulkanPipeline*	getPipelineObject()		{ return &pipelineObj; }
+	inline AsyncCompute*	getAsyncCompute()		{ return &asyncCompute; }
 
 	void createCommandPoolGraphics();							// Create command pool
 	void createCommandPoolCompute();							// Create command pool
 	void buildSwapChainAndDepthImage();					// Create swapchain color image and depth image
 	void createDepthImage();							// Create depth image
 	void createVertexBuffer();
-	void createComputeBuffer();
+	void createComputeContext();						// Create the compute context and its copy kernel
+	void createComputePrimitives();						// Create the compute primitives and check them once
+	void createAsyncCompute();							// Create the per frame compute work of the drawables
 	void createRenderPass(bool includeDepth, bool clear = true);	// Render Pass creation
 	void createFrameBuffer(bool includeDepth);
+	void compileShaders();								// Queue the GLSL shaders on the shader compiler
 	void createShaders();
 	void createPipelineStateManagement();
 	void createDescriptors();
-	void createTextureLinear (const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
-	void createTextureOptimal(const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+	void createTextureLinear (const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_UNDEFINED);
+	void createTextureOptimal(const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_UNDEFINED);
 
 	void destroyCommandBuffer();
 	void destroyCommandPool();
@@ -95,6 +114,9 @@ public:
 	void destroyDrawableSynchronizationObjects();
 	void destroyDrawableUniformBuffer();
 	void destroyTextureResource();
+	void destroyComputePrimitives();
+	void destroyComputeContext();
+	void destroyAsyncCompute();
 public:
 #ifdef _WIN32
 #define APP_NAME_STR_LEN 80
@@ -136,4 +158,20 @@ private:
 	std::vector<VulkanDrawable*> drawableList;
 	VulkanShader 	   shaderObj;
 	VulkanPipeline 	   pipelineObj;
+	ComputeContext	   computeContext;		// Descriptor pools and buffers of the compute kernels
+	ComputeKernel	   copyKernel;			// Compute.comp, copies its input buffer to its output buffer
+	uint32_t		   copyWorkgroupSize;	// Tuned size of the copy kernel, 0 until the first initialization
+	ComputePrimitives  computePrimitives;	// Reduce, scan, compaction and histogram of up to COMPUTE_PRIMITIVES_CAPACITY values
+	AsyncCompute	   asyncCompute;		// Animation of the drawable vertices, overlapped with the graphics of the previous frame
+
+	// Check the copy kernel once
+	void checkComputeCopy();
+
+	// Compare the primitives with their CPU reference and print their throughput
+	void checkComputePrimitives(bool subgroupKernels);
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+	// SPIR-V of the shaders queued by compileShaders()
+	VulkanShaderCompiler::SpirvFuture vertSPV, fragSPV, compSPV, animSPV;
+	VulkanShaderCompiler::SpirvFuture primitivesSPV[ComputePrimitives::KERNEL_TOTAL];
+#endif
 };
\ No newline at end of file
@@ -0,0 +1,73 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <thread>
+
+// Shader build service, compiles GLSL to SPIR-V on a pool of worker threads.
+// Each compilation uses its own glslang TShader/TProgram, so all the stages of
+// all the programs compile concurrently. The caller gets a future of the SPIR-V
+// and creates the shader modules once everything it needs is ready.
+class VulkanShaderCompiler
+{
+private:
+	// CTOR: Starts one worker per hardware thread
+	VulkanShaderCompiler();
+
+public:
+	// DTOR: Waits for the queued compilations and joins the workers
+	~VulkanShaderCompiler();
+
+	typedef std::shared_future<std::vector<unsigned int> > SpirvFuture;
+
+private:
+	// Variable for Single Ton implementation
+	static std::unique_ptr<VulkanShaderCompiler> instance;
+	static std::once_flag onlyOnce;
+
+public:
+	static VulkanShaderCompiler* GetInstance();
+
+	// Queue the compilation of a GLSL shader, the text is copied. The SPIR-V
+	// of the future is empty when the shader does not compile.
+	SpirvFuture compile(const char* shaderText, VkShaderStageFlagBits shaderStage);
+
+private:
+	void workerMain();
+
+	std::vector<std::thread>			workers;
+	std::deque<std::function<void()> >	tasks;
+	std::mutex							taskMutex;
+	std::condition_variable				taskCondition;
+	bool								isExiting;
+};
+#endif
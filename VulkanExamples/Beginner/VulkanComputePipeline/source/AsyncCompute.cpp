@@ -0,0 +1,425 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AsyncCompute.h"
+#include "VulkanDevice.h"
+#include "Wrappers.h"
+
+// Invocations per workgroup of Animate.comp, the drawables have few vertices
+#define ANIMATE_WORKGROUP_SIZE	64
+
+// Per frame data of Animate.comp, std430 layout of its Frame buffer
+struct AnimateFrame {
+	glm::mat4	model;
+	float		time;
+};
+
+// Push constants of Animate.comp
+struct AnimateConstants {
+	uint32_t	vertexCount;
+	uint32_t	vertexStride;
+};
+
+// Stages the submissions wait their semaphores at: the compute for the graphics of
+// the slot, the graphics for the swapchain image and for the compute of the slot
+static const VkPipelineStageFlags computeWaitStage		= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+static const VkPipelineStageFlags graphicsWaitStages[2]	= { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
+
+// Start timestamp of a submission once its semaphore waits at 'waitStages' are over. One
+// at the top of the pipe could be written before the waits and count them as busy time,
+// an execution barrier from the waited stages chains to the waits and the timestamp
+// follows it. The commands after it wait as well, timestamps are for measurements.
+static void recordStartTimestamp(VkCommandBuffer cmd, VkPipelineStageFlags waitStages, VkQueryPool queryPool)
+{
+	vkCmdResetQueryPool(cmd, queryPool, 0, 2);
+	vkCmdPipelineBarrier(cmd, waitStages, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 0, NULL, 0, NULL);
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, queryPool, 0);
+}
+
+AsyncCompute::AsyncCompute()
+{
+	context				= NULL;
+	commandPool			= VK_NULL_HANDLE;
+	restVertices		= VK_NULL_HANDLE;
+	vertexCount			= 0;
+	vertexStride		= 0;
+	ownershipTransfer	= false;
+	modelTransform		= glm::mat4(1.0f);
+	frameIndex			= 0;
+	memset(slots, 0, sizeof(slots));
+	computeBusy			= 0.0;
+	graphicsBusy		= 0.0;
+	statisticsFrames	= 0;
+}
+
+AsyncCompute::~AsyncCompute()
+{
+}
+
+void AsyncCompute::create(ComputeContext* computeContext, VkCommandPool pool, VkBuffer vertices, uint32_t count,
+	uint32_t vertexSize, const uint32_t* spirv, size_t spirvSize)
+{
+	VkResult result;
+	context			= computeContext;
+	commandPool		= pool;
+	restVertices	= vertices;
+	vertexCount		= count;
+	vertexStride	= vertexSize / sizeof(float);
+	frameIndex		= 0;
+
+	VulkanDevice* deviceObj = context->getDevice();
+	ownershipTransfer = deviceObj->computeQueueIndex != deviceObj->graphicsQueueWithPresentIndex;
+
+	const char* const animateBindings[] = { "rest", "animated", "frame" };
+	animateKernel.create(context, spirv, spirvSize, animateBindings, 3, sizeof(AnimateConstants),
+		context->getWorkgroupSize(ANIMATE_WORKGROUP_SIZE));
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType	= VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext	= NULL;
+	semaphoreCreateInfo.flags	= 0;
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType	= VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.pNext	= NULL;
+	fenceCreateInfo.flags	= 0;
+
+	for (uint32_t slot = 0; slot < FRAMES_IN_FLIGHT; slot++) {
+		FrameSlot& frame = slots[slot];
+		context->createBuffer(&frame.animatedVertices, (VkDeviceSize)vertexCount * vertexSize,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		context->createBuffer(&frame.frameData, sizeof(AnimateFrame), 0,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		result = vkCreateSemaphore(deviceObj->device, &semaphoreCreateInfo, NULL, &frame.computeComplete);
+		assert(result == VK_SUCCESS);
+		result = vkCreateSemaphore(deviceObj->device, &semaphoreCreateInfo, NULL, &frame.graphicsComplete);
+		assert(result == VK_SUCCESS);
+		result = vkCreateFence(deviceObj->device, &fenceCreateInfo, NULL, &frame.computeFence);
+		assert(result == VK_SUCCESS);
+		result = vkCreateFence(deviceObj->device, &fenceCreateInfo, NULL, &frame.graphicsFence);
+		assert(result == VK_SUCCESS);
+
+		frame.computeQueries	= createQueryPool(deviceObj->computeQueueIndex);
+		frame.graphicsQueries	= createQueryPool(deviceObj->graphicsQueueWithPresentIndex);
+		frame.computePending	= false;
+		frame.graphicsPending	= false;
+		frame.graphicsSignaled	= false;
+
+		recordCompute(slot);
+	}
+
+	startTime			= std::chrono::steady_clock::now();
+	statisticsStart		= startTime;
+	computeBusy			= 0.0;
+	graphicsBusy		= 0.0;
+	statisticsFrames	= 0;
+}
+
+void AsyncCompute::destroy()
+{
+	if (!context) {
+		return;
+	}
+
+	VulkanDevice* deviceObj = context->getDevice();
+	for (uint32_t slot = 0; slot < FRAMES_IN_FLIGHT; slot++) {
+		waitCompute(slot);
+		waitGraphics(slot);
+	}
+
+	animateKernel.destroy();
+	for (uint32_t slot = 0; slot < FRAMES_IN_FLIGHT; slot++) {
+		FrameSlot& frame = slots[slot];
+		context->destroyBuffer(&frame.animatedVertices);
+		context->destroyBuffer(&frame.frameData);
+		vkFreeCommandBuffers(deviceObj->device, commandPool, 1, &frame.computeCmd);
+		vkDestroySemaphore(deviceObj->device, frame.computeComplete, NULL);
+		vkDestroySemaphore(deviceObj->device, frame.graphicsComplete, NULL);
+		vkDestroyFence(deviceObj->device, frame.computeFence, NULL);
+		vkDestroyFence(deviceObj->device, frame.graphicsFence, NULL);
+		if (frame.computeQueries) {
+			vkDestroyQueryPool(deviceObj->device, frame.computeQueries, NULL);
+		}
+		if (frame.graphicsQueries) {
+			vkDestroyQueryPool(deviceObj->device, frame.graphicsQueries, NULL);
+		}
+	}
+	memset(slots, 0, sizeof(slots));
+	context = NULL;
+}
+
+VkQueryPool AsyncCompute::createQueryPool(uint32_t queueFamilyIndex)
+{
+	VulkanDevice* deviceObj = context->getDevice();
+	if (!deviceObj->queueFamilyProps[queueFamilyIndex].timestampValidBits) {
+		return VK_NULL_HANDLE;
+	}
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType			= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.pNext			= NULL;
+	queryPoolInfo.queryType		= VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount	= 2;
+
+	VkQueryPool queryPool;
+	VkResult result = vkCreateQueryPool(deviceObj->device, &queryPoolInfo, NULL, &queryPool);
+	assert(result == VK_SUCCESS);
+	return queryPool;
+}
+
+void AsyncCompute::recordCompute(uint32_t slot)
+{
+	VulkanDevice* deviceObj = context->getDevice();
+	FrameSlot& frame = slots[slot];
+
+	CommandBufferMgr::allocCommandBuffer(&deviceObj->device, commandPool, &frame.computeCmd);
+	CommandBufferMgr::beginCommandBuffer(frame.computeCmd);
+	if (frame.computeQueries) {
+		recordStartTimestamp(frame.computeCmd, computeWaitStage, frame.computeQueries);
+	}
+
+	AnimateConstants constants;
+	constants.vertexCount	= vertexCount;
+	constants.vertexStride	= vertexStride;
+	animateKernel.bind("rest", restVertices);
+	animateKernel.bind("animated", frame.animatedVertices.buffer);
+	animateKernel.bind("frame", frame.frameData.buffer);
+	animateKernel.recordDispatch(frame.computeCmd, animateKernel.getGroupCount(vertexCount), 1, 1, &constants);
+
+	// Release the vertices to the graphics family, the semaphore of the slot orders the acquire
+	if (ownershipTransfer) {
+		VkBufferMemoryBarrier release = {};
+		release.sType				= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		release.pNext				= NULL;
+		release.srcAccessMask		= VK_ACCESS_SHADER_WRITE_BIT;
+		release.dstAccessMask		= 0;
+		release.srcQueueFamilyIndex	= deviceObj->computeQueueIndex;
+		release.dstQueueFamilyIndex	= deviceObj->graphicsQueueWithPresentIndex;
+		release.buffer				= frame.animatedVertices.buffer;
+		release.offset				= 0;
+		release.size				= VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(frame.computeCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, NULL, 1, &release, 0, NULL);
+	}
+
+	if (frame.computeQueries) {
+		vkCmdWriteTimestamp(frame.computeCmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.computeQueries, 1);
+	}
+	CommandBufferMgr::endCommandBuffer(frame.computeCmd);
+}
+
+void AsyncCompute::recordGraphicsBegin(VkCommandBuffer cmd, uint32_t slot)
+{
+	VulkanDevice* deviceObj = context->getDevice();
+	FrameSlot& frame = slots[slot];
+
+	if (frame.graphicsQueries) {
+		recordStartTimestamp(cmd, graphicsWaitStages[0] | graphicsWaitStages[1], frame.graphicsQueries);
+	}
+
+	// Acquire the vertices released by the compute queue, after the semaphore wait at the vertex input stage
+	if (ownershipTransfer) {
+		VkBufferMemoryBarrier acquire = {};
+		acquire.sType				= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		acquire.pNext				= NULL;
+		acquire.srcAccessMask		= 0;
+		acquire.dstAccessMask		= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		acquire.srcQueueFamilyIndex	= deviceObj->computeQueueIndex;
+		acquire.dstQueueFamilyIndex	= deviceObj->graphicsQueueWithPresentIndex;
+		acquire.buffer				= frame.animatedVertices.buffer;
+		acquire.offset				= 0;
+		acquire.size				= VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+			0, NULL, 1, &acquire, 0, NULL);
+	}
+}
+
+void AsyncCompute::recordGraphicsEnd(VkCommandBuffer cmd, uint32_t slot)
+{
+	if (slots[slot].graphicsQueries) {
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slots[slot].graphicsQueries, 1);
+	}
+}
+
+void AsyncCompute::beginFrame()
+{
+	const uint32_t slot = getFrameSlot();
+	waitGraphics(slot);
+
+#if ASYNC_COMPUTE_OVERLAP
+	// The compute of the first frame, the later ones are submitted by endFrame()
+	if (!slots[slot].computePending) {
+		submitCompute(slot);
+	}
+#else
+	// The GPU is idle, the compute runs alone and the graphics after it
+	waitGraphics((slot + 1) % FRAMES_IN_FLIGHT);
+	submitCompute(slot);
+	waitCompute(slot);
+#endif
+}
+
+void AsyncCompute::submitGraphics(VkCommandBuffer cmd, VkSemaphore presentComplete, VkSemaphore drawingComplete)
+{
+	VulkanDevice* deviceObj = context->getDevice();
+	FrameSlot& frame = slots[getFrameSlot()];
+
+	const VkSemaphore waitSemaphores[2] = { presentComplete, frame.computeComplete };
+	const VkSemaphore signalSemaphores[2] = { drawingComplete, frame.graphicsComplete };
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType				= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext				= NULL;
+	submitInfo.waitSemaphoreCount	= 2;
+	submitInfo.pWaitSemaphores		= waitSemaphores;
+	submitInfo.pWaitDstStageMask	= graphicsWaitStages;
+	submitInfo.commandBufferCount	= 1;
+	submitInfo.pCommandBuffers		= &cmd;
+	submitInfo.signalSemaphoreCount = 2;
+	submitInfo.pSignalSemaphores	= signalSemaphores;
+
+	// Not waited for here, the fence of the slot is waited by the frame after next
+	VkResult result = vkQueueSubmit(deviceObj->queue, 1, &submitInfo, frame.graphicsFence);
+	assert(result == VK_SUCCESS);
+	frame.graphicsPending	= true;
+	frame.graphicsSignaled	= true;
+}
+
+void AsyncCompute::endFrame()
+{
+	frameIndex++;
+	if (++statisticsFrames == ASYNC_COMPUTE_STATS_FRAMES) {
+		printStatistics();
+	}
+
+#if ASYNC_COMPUTE_OVERLAP
+	// Runs alongside the graphics of the frame just submitted
+	submitCompute(getFrameSlot());
+#endif
+}
+
+void AsyncCompute::submitCompute(uint32_t slot)
+{
+	VulkanDevice* deviceObj = context->getDevice();
+	FrameSlot& frame = slots[slot];
+
+	// The previous run of the slot is done with the frame data
+	waitCompute(slot);
+
+	AnimateFrame* frameData = (AnimateFrame*)frame.frameData.mapped;
+	frameData->model	= modelTransform;
+	frameData->time		= std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+
+	// The graphics of the slot's previous frame still reads the vertices about to be written
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType				= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext				= NULL;
+	submitInfo.waitSemaphoreCount	= frame.graphicsSignaled ? 1 : 0;
+	submitInfo.pWaitSemaphores		= &frame.graphicsComplete;
+	submitInfo.pWaitDstStageMask	= &computeWaitStage;
+	submitInfo.commandBufferCount	= 1;
+	submitInfo.pCommandBuffers		= &frame.computeCmd;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores	= &frame.computeComplete;
+
+	VkResult result = vkQueueSubmit(deviceObj->queueComupte, 1, &submitInfo, frame.computeFence);
+	assert(result == VK_SUCCESS);
+	frame.computePending	= true;
+	frame.graphicsSignaled	= false;
+}
+
+void AsyncCompute::waitCompute(uint32_t slot)
+{
+	FrameSlot& frame = slots[slot];
+	if (!frame.computePending) {
+		return;
+	}
+
+	VulkanDevice* deviceObj = context->getDevice();
+	VkResult result = vkWaitForFences(deviceObj->device, 1, &frame.computeFence, VK_TRUE, UINT64_MAX);
+	assert(result == VK_SUCCESS);
+	result = vkResetFences(deviceObj->device, 1, &frame.computeFence);
+	assert(result == VK_SUCCESS);
+
+	frame.computePending = false;
+	computeBusy += readQueries(frame.computeQueries, deviceObj->computeQueueIndex);
+}
+
+void AsyncCompute::waitGraphics(uint32_t slot)
+{
+	FrameSlot& frame = slots[slot];
+	if (!frame.graphicsPending) {
+		return;
+	}
+
+	VulkanDevice* deviceObj = context->getDevice();
+	VkResult result = vkWaitForFences(deviceObj->device, 1, &frame.graphicsFence, VK_TRUE, UINT64_MAX);
+	assert(result == VK_SUCCESS);
+	result = vkResetFences(deviceObj->device, 1, &frame.graphicsFence);
+	assert(result == VK_SUCCESS);
+
+	frame.graphicsPending = false;
+	graphicsBusy += readQueries(frame.graphicsQueries, deviceObj->graphicsQueueWithPresentIndex);
+}
+
+double AsyncCompute::readQueries(VkQueryPool queryPool, uint32_t queueFamilyIndex)
+{
+	if (!queryPool) {
+		return 0.0;
+	}
+
+	VulkanDevice* deviceObj = context->getDevice();
+	uint64_t timestamps[2];
+	VkResult result = vkGetQueryPoolResults(deviceObj->device, queryPool, 0, 2, sizeof(timestamps), timestamps,
+		sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	assert(result == VK_SUCCESS);
+
+	// Timestamps wrap around at their valid bits
+	const uint32_t timestampBits = deviceObj->queueFamilyProps[queueFamilyIndex].timestampValidBits;
+	const uint64_t timestampMask = timestampBits < 64 ? (1ull << timestampBits) - 1 : ~0ull;
+	return (double)((timestamps[1] - timestamps[0]) & timestampMask) * deviceObj->gpuProps.limits.timestampPeriod;
+}
+
+// The busy share adds up the work of both queues over the frame time, overlapped
+// work lowers the frame time of a GPU bound frame for the same busy time
+void AsyncCompute::printStatistics()
+{
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	const double frameTime		= std::chrono::duration<double, std::milli>(now - statisticsStart).count() / statisticsFrames;
+	const double graphicsTime	= graphicsBusy / 1000000.0 / statisticsFrames;
+	const double computeTime	= computeBusy / 1000000.0 / statisticsFrames;
+
+	std::cout << (ASYNC_COMPUTE_OVERLAP ? "Overlapped" : "Serial") << " compute"
+		<< (ownershipTransfer ? " on a separate queue family: " : " on the graphics queue family: ")
+		<< std::fixed << std::setprecision(3) << frameTime << " ms per frame, graphics "
+		<< graphicsTime << " ms, compute " << computeTime << " ms, GPU busy "
+		<< std::setprecision(1) << 100.0 * (graphicsTime + computeTime) / frameTime << "%" << std::endl;
+
+	statisticsStart		= now;
+	computeBusy			= 0.0;
+	graphicsBusy		= 0.0;
+	statisticsFrames	= 0;
+}
@@ -0,0 +1,354 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ComputeContext.h"
+#include "VulkanDevice.h"
+#include "VulkanPipeline.h"
+#include <algorithm>
+
+// Descriptor sets of each pool, every set can have all the bindings of a kernel
+#define COMPUTE_SETS_PER_POOL	32
+
+ComputeContext::ComputeContext()
+{
+	deviceObj	= NULL;
+	pipelineObj	= NULL;
+}
+
+ComputeContext::~ComputeContext()
+{
+}
+
+void ComputeContext::initialize(VulkanDevice* device, VulkanPipeline* pipeline)
+{
+	deviceObj	= device;
+	pipelineObj	= pipeline;
+}
+
+void ComputeContext::destroy()
+{
+	if (!deviceObj) {
+		return;
+	}
+	assert(kernels.empty());
+
+	for (size_t i = 0; i < descriptorPools.size(); i++) {
+		vkDestroyDescriptorPool(deviceObj->device, descriptorPools[i].pool, NULL);
+	}
+	descriptorPools.clear();
+
+	deviceObj	= NULL;
+	pipelineObj	= NULL;
+}
+
+uint32_t ComputeContext::getWorkgroupSize(uint32_t preferredSize) const
+{
+	const VkPhysicalDeviceLimits& limits = deviceObj->gpuProps.limits;
+	return std::min(preferredSize, std::min(limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations));
+}
+
+void ComputeContext::createBuffer(ComputeBuffer* buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties)
+{
+	VkResult result;
+	bool pass;
+
+	VkBufferCreateInfo bufInfo		= {};
+	bufInfo.sType					= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufInfo.pNext					= NULL;
+	bufInfo.usage					= usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	bufInfo.size					= size;
+	bufInfo.sharingMode				= VK_SHARING_MODE_EXCLUSIVE;
+	bufInfo.flags					= 0;
+	result = vkCreateBuffer(deviceObj->device, &bufInfo, NULL, &buffer->buffer);
+	assert(result == VK_SUCCESS);
+
+	VkMemoryRequirements memRqrmnt;
+	vkGetBufferMemoryRequirements(deviceObj->device, buffer->buffer, &memRqrmnt);
+
+	VkMemoryAllocateInfo allocInfo	= {};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext					= NULL;
+	allocInfo.allocationSize		= memRqrmnt.size;
+	pass = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits, memoryProperties, &allocInfo.memoryTypeIndex);
+	assert(pass);
+	result = vkAllocateMemory(deviceObj->device, &allocInfo, NULL, &buffer->memory);
+	assert(result == VK_SUCCESS);
+	result = vkBindBufferMemory(deviceObj->device, buffer->buffer, buffer->memory, 0);
+	assert(result == VK_SUCCESS);
+
+	buffer->size	= size;
+	buffer->mapped	= NULL;
+	if (memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		result = vkMapMemory(deviceObj->device, buffer->memory, 0, VK_WHOLE_SIZE, 0, &buffer->mapped);
+		assert(result == VK_SUCCESS);
+	}
+}
+
+void ComputeContext::destroyBuffer(ComputeBuffer* buffer)
+{
+	if (buffer->buffer == VK_NULL_HANDLE) {
+		return;
+	}
+
+	releaseBuffer(buffer->buffer);
+	if (buffer->mapped) {
+		vkUnmapMemory(deviceObj->device, buffer->memory);
+	}
+	vkDestroyBuffer(deviceObj->device, buffer->buffer, NULL);
+	vkFreeMemory(deviceObj->device, buffer->memory, NULL);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+void ComputeContext::releaseBuffer(VkBuffer buffer)
+{
+	for (size_t i = 0; i < kernels.size(); i++) {
+		kernels[i]->releaseBuffer(buffer);
+	}
+}
+
+VkDescriptorSet ComputeContext::allocateDescriptorSet(VkDescriptorSetLayout layout, VkDescriptorPool* pool)
+{
+	VkResult result;
+
+	// The first pool with a free set, or a new one
+	size_t poolIndex = 0;
+	while (poolIndex < descriptorPools.size() && descriptorPools[poolIndex].setCount == COMPUTE_SETS_PER_POOL) {
+		poolIndex++;
+	}
+
+	if (poolIndex == descriptorPools.size()) {
+		VkDescriptorPoolSize descriptorTypePool;
+		descriptorTypePool.type				= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorTypePool.descriptorCount	= COMPUTE_SETS_PER_POOL * ComputeKernel::maxBindings;
+
+		VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+		descriptorPoolCreateInfo.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		descriptorPoolCreateInfo.pNext			= NULL;
+		descriptorPoolCreateInfo.flags			= VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+		descriptorPoolCreateInfo.maxSets		= COMPUTE_SETS_PER_POOL;
+		descriptorPoolCreateInfo.poolSizeCount	= 1;
+		descriptorPoolCreateInfo.pPoolSizes		= &descriptorTypePool;
+
+		DescriptorPool descriptorPool;
+		descriptorPool.setCount = 0;
+		result = vkCreateDescriptorPool(deviceObj->device, &descriptorPoolCreateInfo, NULL, &descriptorPool.pool);
+		assert(result == VK_SUCCESS);
+		descriptorPools.push_back(descriptorPool);
+	}
+
+	VkDescriptorSetAllocateInfo dsAllocInfo = {};
+	dsAllocInfo.sType				= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsAllocInfo.pNext				= NULL;
+	dsAllocInfo.descriptorPool		= descriptorPools[poolIndex].pool;
+	dsAllocInfo.descriptorSetCount	= 1;
+	dsAllocInfo.pSetLayouts			= &layout;
+
+	VkDescriptorSet descriptorSet;
+	result = vkAllocateDescriptorSets(deviceObj->device, &dsAllocInfo, &descriptorSet);
+	assert(result == VK_SUCCESS);
+
+	descriptorPools[poolIndex].setCount++;
+	*pool = descriptorPools[poolIndex].pool;
+	return descriptorSet;
+}
+
+void ComputeContext::freeDescriptorSet(VkDescriptorPool pool, VkDescriptorSet descriptorSet)
+{
+	for (size_t i = 0; i < descriptorPools.size(); i++) {
+		if (descriptorPools[i].pool == pool) {
+			vkFreeDescriptorSets(deviceObj->device, pool, 1, &descriptorSet);
+			descriptorPools[i].setCount--;
+			return;
+		}
+	}
+	assert(false);
+}
+
+ComputeKernel::ComputeKernel()
+{
+	context				= NULL;
+	pushConstantSize	= 0;
+	workgroupSize		= 0;
+	pipeline			= VK_NULL_HANDLE;
+	descLayout			= VK_NULL_HANDLE;
+	pipelineLayout		= VK_NULL_HANDLE;
+}
+
+ComputeKernel::~ComputeKernel()
+{
+}
+
+void ComputeKernel::create(ComputeContext* computeContext, const uint32_t* spirv, size_t spirvSize, const char* const* names,
+	uint32_t bindingCount, uint32_t constantSize, uint32_t groupSize)
+{
+	VkResult result;
+	assert(bindingCount <= maxBindings);
+
+	context				= computeContext;
+	pushConstantSize	= constantSize;
+	workgroupSize		= groupSize;
+	bindingNames.assign(names, names + bindingCount);
+	boundBuffers.assign(bindingCount, VK_NULL_HANDLE);
+	VkDevice device = context->getDevice()->device;
+
+	VkDescriptorSetLayoutBinding layoutBindings[maxBindings] = {};
+	for (uint32_t i = 0; i < bindingCount; i++) {
+		layoutBindings[i].binding				= i;
+		layoutBindings[i].descriptorType		= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layoutBindings[i].descriptorCount		= 1;
+		layoutBindings[i].stageFlags			= VK_SHADER_STAGE_COMPUTE_BIT;
+		layoutBindings[i].pImmutableSamplers	= NULL;
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptorLayout = {};
+	descriptorLayout.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorLayout.pNext			= NULL;
+	descriptorLayout.bindingCount	= bindingCount;
+	descriptorLayout.pBindings		= layoutBindings;
+	result = vkCreateDescriptorSetLayout(device, &descriptorLayout, NULL, &descLayout);
+	assert(result == VK_SUCCESS);
+
+	VkPushConstantRange pushConstantRange;
+	pushConstantRange.stageFlags	= VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset		= 0;
+	pushConstantRange.size			= pushConstantSize;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.pNext					= NULL;
+	pipelineLayoutCreateInfo.flags					= 0;
+	pipelineLayoutCreateInfo.setLayoutCount			= 1;
+	pipelineLayoutCreateInfo.pSetLayouts			= &descLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount	= pushConstantSize ? 1 : 0;
+	pipelineLayoutCreateInfo.pPushConstantRanges	= pushConstantSize ? &pushConstantRange : NULL;
+	result = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, NULL, &pipelineLayout);
+	assert(result == VK_SUCCESS);
+
+	shader.buildShaderModuleWithSPV((uint32_t*)spirv, spirvSize, "main", VK_SHADER_STAGE_COMPUTE_BIT);
+	getSpecialization().set(0, workgroupSize);	// local_size_x_id
+
+	bool pipelineCreated = context->getPipelineObject()->createComputePipeline(&shader, pipelineLayout, &pipeline);
+	assert(pipelineCreated);
+
+	context->kernels.push_back(this);
+}
+
+void ComputeKernel::destroy()
+{
+	if (!context) {
+		return;
+	}
+
+	for (std::map<std::vector<VkBuffer>, CachedSet>::iterator it = descriptorSets.begin(); it != descriptorSets.end(); ++it) {
+		context->freeDescriptorSet(it->second.pool, it->second.descriptorSet);
+	}
+	context->kernels.erase(std::find(context->kernels.begin(), context->kernels.end(), this));
+
+	// The pipeline is cached by the pipeline object, drop it before its module and layout
+	VkDevice device = context->getDevice()->device;
+	context->getPipelineObject()->destroyComputePipeline(pipeline);
+	shader.destroyShaders();
+	vkDestroyPipelineLayout(device, pipelineLayout, NULL);
+	vkDestroyDescriptorSetLayout(device, descLayout, NULL);
+
+	*this = ComputeKernel();
+}
+
+void ComputeKernel::bind(const char* name, VkBuffer buffer)
+{
+	for (size_t i = 0; i < bindingNames.size(); i++) {
+		if (bindingNames[i] == name) {
+			boundBuffers[i] = buffer;
+			return;
+		}
+	}
+	assert(false);
+}
+
+VkDescriptorSet ComputeKernel::getDescriptorSet()
+{
+	std::map<std::vector<VkBuffer>, CachedSet>::iterator it = descriptorSets.find(boundBuffers);
+	if (it != descriptorSets.end()) {
+		return it->second.descriptorSet;
+	}
+
+	CachedSet cachedSet;
+	cachedSet.descriptorSet = context->allocateDescriptorSet(descLayout, &cachedSet.pool);
+
+	// Only the bound buffers are written, the shader does not use the others
+	VkDescriptorBufferInfo bufferInfos[maxBindings];
+	VkWriteDescriptorSet writes[maxBindings] = {};
+	uint32_t writeCount = 0;
+	for (uint32_t binding = 0; binding < boundBuffers.size(); binding++) {
+		if (boundBuffers[binding] == VK_NULL_HANDLE) {
+			continue;
+		}
+		bufferInfos[writeCount].buffer	= boundBuffers[binding];
+		bufferInfos[writeCount].offset	= 0;
+		bufferInfos[writeCount].range	= VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet& write = writes[writeCount];
+		write.sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet			= cachedSet.descriptorSet;
+		write.dstBinding		= binding;
+		write.descriptorCount	= 1;
+		write.descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo		= &bufferInfos[writeCount];
+		writeCount++;
+	}
+	vkUpdateDescriptorSets(context->getDevice()->device, writeCount, writes, 0, NULL);
+
+	descriptorSets[boundBuffers] = cachedSet;
+	return cachedSet.descriptorSet;
+}
+
+void ComputeKernel::releaseBuffer(VkBuffer buffer)
+{
+	std::map<std::vector<VkBuffer>, CachedSet>::iterator it = descriptorSets.begin();
+	while (it != descriptorSets.end()) {
+		if (std::find(it->first.begin(), it->first.end(), buffer) != it->first.end()) {
+			context->freeDescriptorSet(it->second.pool, it->second.descriptorSet);
+			descriptorSets.erase(it++);
+		}
+		else {
+			++it;
+		}
+	}
+
+	// A buffer still bound would be used by the next dispatch
+	std::replace(boundBuffers.begin(), boundBuffers.end(), buffer, (VkBuffer)VK_NULL_HANDLE);
+}
+
+void ComputeKernel::recordDispatch(VkCommandBuffer cmd, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ, const void* pushConstants)
+{
+	const VkDescriptorSet descriptorSet = getDescriptorSet();
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+	if (pushConstantSize) {
+		assert(pushConstants);
+		vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize, pushConstants);
+	}
+	vkCmdDispatch(cmd, groupCountX, groupCountY, groupCountZ);
+}
@@ -0,0 +1,293 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ComputePrimitives.h"
+#include "VulkanDevice.h"
+#include <algorithm>
+
+// Preferred invocations per workgroup, clamped to the device limits. The shared
+// memory of the kernels is sized for at most this many invocations.
+#define PRIMITIVE_WORKGROUP_SIZE	256
+#define PRIMITIVE_ITEMS_PER_THREAD	16
+
+// Push constant block shared by the kernels
+struct PrimitiveConstants {
+	uint32_t	count;
+	uint32_t	inclusive;
+	uint32_t	shift;
+	uint32_t	binCount;
+};
+
+const char* const ComputePrimitives::kernelNames[KERNEL_TOTAL] = {
+	"PrimReduce",
+	"PrimScan",
+	"PrimScanAdd",
+	"PrimCompact",
+	"PrimHistogram",
+};
+
+// Bindings of every kernel, PrimitiveConstants is the push constant block
+static const char* const primitiveBindings[] = {
+	"input",
+	"output",
+	"flags",
+	"sums",		// Block totals of the scan, offsets of the compaction
+	"count",
+};
+
+ComputePrimitives::ComputePrimitives()
+{
+	context			= NULL;
+	capacity		= 0;
+	workgroupSize	= 0;
+	blockSize		= 0;
+	memset(&offsets, 0, sizeof(offsets));
+}
+
+ComputePrimitives::~ComputePrimitives()
+{
+}
+
+uint32_t ComputePrimitives::getWorkgroupSize(const VulkanDevice* device)
+{
+	// A power of two, for the tree reduction of the kernels
+	const VkPhysicalDeviceLimits& limits = device->gpuProps.limits;
+	const uint32_t maxInvocations = std::min<uint32_t>(PRIMITIVE_WORKGROUP_SIZE,
+		std::min(limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations));
+	uint32_t size = 1;
+	while (size * 2 <= maxInvocations) {
+		size *= 2;
+	}
+	return size;
+}
+
+bool ComputePrimitives::isSubgroupSupported(const VulkanDevice* device)
+{
+#ifdef VK_VERSION_1_1
+	// The scan orders the invocations by subgroup, every subgroup of a workgroup has to be full
+	const uint32_t operations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+	const uint32_t subgroupSize = device->subgroupSize;
+	return (device->subgroupOperations & operations) == operations &&
+		subgroupSize > 0 && (subgroupSize & (subgroupSize - 1)) == 0 && subgroupSize <= getWorkgroupSize(device);
+#else
+	return false;
+#endif
+}
+
+void ComputePrimitives::initialize(ComputeContext* computeContext, uint32_t valueCapacity,
+	const uint32_t* const spirv[KERNEL_TOTAL], const size_t spirvSize[KERNEL_TOTAL])
+{
+	context			= computeContext;
+	capacity		= valueCapacity;
+	workgroupSize	= getWorkgroupSize(context->getDevice());
+	blockSize		= workgroupSize * PRIMITIVE_ITEMS_PER_THREAD;
+	assert(getBlockCount(capacity) <= context->getDevice()->gpuProps.limits.maxComputeWorkGroupCount[0]);
+
+	// One level of block totals per pass of the reduce, down to a single total
+	uint32_t levelCount = capacity;
+	do {
+		levelCount = getBlockCount(levelCount);
+		levelSums.push_back(ComputeBuffer());
+		context->createBuffer(&levelSums.back(), (VkDeviceSize)levelCount * sizeof(uint32_t), 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	} while (levelCount > 1);
+	context->createBuffer(&offsets, (VkDeviceSize)std::max<uint32_t>(capacity, 1) * sizeof(uint32_t), 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	for (int kernel = 0; kernel < KERNEL_TOTAL; kernel++) {
+		kernels[kernel].getSpecialization().set(1, (uint32_t)PRIMITIVE_ITEMS_PER_THREAD);	// ITEMS_PER_THREAD
+		kernels[kernel].create(context, spirv[kernel], spirvSize[kernel], primitiveBindings,
+			sizeof(primitiveBindings) / sizeof(primitiveBindings[0]), sizeof(PrimitiveConstants), workgroupSize);
+	}
+}
+
+void ComputePrimitives::destroy()
+{
+	if (!context) {
+		return;
+	}
+
+	for (int kernel = 0; kernel < KERNEL_TOTAL; kernel++) {
+		kernels[kernel].destroy();
+	}
+	for (size_t level = 0; level < levelSums.size(); level++) {
+		context->destroyBuffer(&levelSums[level]);
+	}
+	context->destroyBuffer(&offsets);
+
+	*this = ComputePrimitives();
+}
+
+void ComputePrimitives::recordDispatch(VkCommandBuffer cmd, Kernel kernel, const void* constants, uint32_t groupCount,
+	VkBuffer input, VkBuffer output, VkBuffer flags, VkBuffer sums, VkBuffer count)
+{
+	const VkBuffer buffers[] = { input, output, flags, sums, count };
+	for (size_t binding = 0; binding < sizeof(buffers) / sizeof(buffers[0]); binding++) {
+		kernels[kernel].bind(primitiveBindings[binding], buffers[binding]);
+	}
+	kernels[kernel].recordDispatch(cmd, groupCount, 1, 1, constants);
+}
+
+void ComputePrimitives::recordBarrier(VkCommandBuffer cmd)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext			= NULL;
+	barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+void ComputePrimitives::recordReduce(VkCommandBuffer cmd, VkBuffer input, uint32_t count, VkBuffer result)
+{
+	assert(count <= capacity);
+	recordBarrier(cmd);
+
+	PrimitiveConstants constants = {};
+	constants.count = count;
+
+	// Each pass sums the blocks of the previous one, the pass with a single block writes the result
+	VkBuffer levelInput = input;
+	for (uint32_t level = 0; ; level++) {
+		const uint32_t blockCount	= getBlockCount(constants.count);
+		const VkBuffer levelOutput	= blockCount > 1 ? levelSums[level].buffer : result;
+
+		recordDispatch(cmd, KERNEL_REDUCE, &constants, blockCount, levelInput, levelOutput);
+		recordBarrier(cmd);
+		if (blockCount == 1) {
+			break;
+		}
+		levelInput		= levelOutput;
+		constants.count	= blockCount;
+	}
+}
+
+void ComputePrimitives::recordScanLevel(VkCommandBuffer cmd, VkBuffer input, VkBuffer output, uint32_t count, bool inclusive, uint32_t level)
+{
+	PrimitiveConstants constants = {};
+	constants.count		= count;
+	constants.inclusive	= inclusive ? 1 : 0;
+
+	// The block totals are only written when there is more than one block
+	const uint32_t blockCount = getBlockCount(count);
+	recordDispatch(cmd, KERNEL_SCAN, &constants, blockCount, input, output, VK_NULL_HANDLE, levelSums[level].buffer);
+	recordBarrier(cmd);
+	if (blockCount == 1) {
+		return;
+	}
+
+	// Exclusive scan of the block totals in place, then added to their block
+	recordScanLevel(cmd, levelSums[level].buffer, levelSums[level].buffer, blockCount, false, level + 1);
+	recordDispatch(cmd, KERNEL_SCAN_ADD, &constants, blockCount, input, output, VK_NULL_HANDLE, levelSums[level].buffer);
+	recordBarrier(cmd);
+}
+
+void ComputePrimitives::recordScan(VkCommandBuffer cmd, VkBuffer input, VkBuffer output, uint32_t count, bool inclusive)
+{
+	assert(count <= capacity);
+	if (count == 0) {
+		return;
+	}
+
+	recordBarrier(cmd);
+	recordScanLevel(cmd, input, output, count, inclusive, 0);
+}
+
+void ComputePrimitives::recordCompact(VkCommandBuffer cmd, VkBuffer input, VkBuffer flags, uint32_t count, VkBuffer output, VkBuffer outputCount)
+{
+	assert(count <= capacity);
+	recordBarrier(cmd);
+
+	// Nothing to scan, the count is cleared instead of being left from an earlier compaction
+	if (count == 0) {
+		vkCmdFillBuffer(cmd, outputCount, 0, sizeof(uint32_t), 0);
+		recordBarrier(cmd);
+		return;
+	}
+
+	// The exclusive scan of the flags is the output offset of each kept value
+	recordScanLevel(cmd, flags, offsets.buffer, count, false, 0);
+
+	PrimitiveConstants constants = {};
+	constants.count = count;
+	recordDispatch(cmd, KERNEL_COMPACT, &constants, getBlockCount(count), input, output, flags, offsets.buffer, outputCount);
+	recordBarrier(cmd);
+}
+
+void ComputePrimitives::recordHistogram(VkCommandBuffer cmd, VkBuffer input, uint32_t count, uint32_t shift, uint32_t binCount, VkBuffer bins)
+{
+	assert(count <= capacity && shift < 32);
+	assert(binCount > 0 && binCount <= maxHistogramBins && (binCount & (binCount - 1)) == 0);
+
+	// The workgroups add their counts to the cleared bins
+	recordBarrier(cmd);
+	vkCmdFillBuffer(cmd, bins, 0, binCount * sizeof(uint32_t), 0);
+	recordBarrier(cmd);
+
+	PrimitiveConstants constants = {};
+	constants.count		= count;
+	constants.shift		= shift;
+	constants.binCount	= binCount;
+	recordDispatch(cmd, KERNEL_HISTOGRAM, &constants, getBlockCount(count), input, bins);
+	recordBarrier(cmd);
+}
+
+uint32_t ComputePrimitives::reduceReference(const std::vector<uint32_t>& values)
+{
+	uint32_t sum = 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		sum += values[i];
+	}
+	return sum;
+}
+
+void ComputePrimitives::scanReference(const std::vector<uint32_t>& values, bool inclusive, std::vector<uint32_t>& scanned)
+{
+	scanned.resize(values.size());
+	uint32_t sum = 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		const uint32_t value = values[i];
+		scanned[i] = inclusive ? sum + value : sum;
+		sum += value;
+	}
+}
+
+void ComputePrimitives::compactReference(const std::vector<uint32_t>& values, const std::vector<uint32_t>& flags, std::vector<uint32_t>& compacted)
+{
+	assert(values.size() == flags.size());
+	compacted.clear();
+	for (size_t i = 0; i < values.size(); i++) {
+		if (flags[i]) {
+			compacted.push_back(values[i]);
+		}
+	}
+}
+
+void ComputePrimitives::histogramReference(const std::vector<uint32_t>& values, uint32_t shift, uint32_t binCount, std::vector<uint32_t>& bins)
+{
+	bins.assign(binCount, 0);
+	for (size_t i = 0; i < values.size(); i++) {
+		bins[(values[i] >> shift) & (binCount - 1)]++;
+	}
+}
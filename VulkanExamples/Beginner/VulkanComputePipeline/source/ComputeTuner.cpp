@@ -0,0 +1,247 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ComputeTuner.h"
+#include "VulkanDevice.h"
+#include "VulkanPipeline.h"
+#include "Wrappers.h"
+#include <stdio.h>
+#include <algorithm>
+
+// Timed runs of each variant, after a warm up submission of the same runs
+#define COMPUTE_TUNER_RUNS	8
+
+// Workgroup sizes tried, the ones above the device limits are skipped
+static const uint32_t tunerCandidates[] = { 32, 64, 128, 256, 512, 1024 };
+
+// FNV-1a of the SPIR-V, tells when a saved choice is for another build of the kernel
+static uint32_t hashSpirv(const uint32_t* spirv, size_t spirvSize)
+{
+	const uint8_t* bytes = (const uint8_t*)spirv;
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < spirvSize; i++) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+// True when the module decorates a constant with SpecId 0, the id the variants
+// specialize with their workgroup size (local_size_x_id = 0 in the GLSL)
+static bool hasWorkgroupSizeSpecId(const uint32_t* spirv, size_t spirvSize)
+{
+	const uint32_t opDecorate = 71, decorationSpecId = 1;
+	const size_t wordCount = spirvSize / sizeof(uint32_t);
+
+	// Instructions follow the 5 words of the header, the high half of their first
+	// word is their length in words
+	for (size_t word = 5; word < wordCount; ) {
+		const uint32_t opcode = spirv[word] & 0xFFFF;
+		const uint32_t length = spirv[word] >> 16;
+		if (length == 0 || word + length > wordCount) {
+			return false;
+		}
+		if (opcode == opDecorate && length >= 4 && spirv[word + 2] == decorationSpecId && spirv[word + 3] == 0) {
+			return true;
+		}
+		word += length;
+	}
+	return false;
+}
+
+ComputeTuner::ComputeTuner()
+{
+	context		= NULL;
+	commandPool	= VK_NULL_HANDLE;
+}
+
+ComputeTuner::~ComputeTuner()
+{
+}
+
+void ComputeTuner::initialize(ComputeContext* computeContext, VkCommandPool pool, const char* profileDirectory)
+{
+	context		= computeContext;
+	commandPool	= pool;
+
+	const VkPhysicalDeviceProperties& props = context->getDevice()->gpuProps;
+	char fileName[64];
+	snprintf(fileName, sizeof(fileName), "ComputeProfile-%04x-%04x.txt", props.vendorID, props.deviceID);
+	profilePath = std::string(profileDirectory) + fileName;
+
+	loadProfile();
+}
+
+uint32_t ComputeTuner::tune(const char* kernelName, const uint32_t* spirv, size_t spirvSize, const char* const* bindingNames,
+	uint32_t bindingCount, uint32_t pushConstantSize, uint32_t defaultSize, RecordFunction record, void* userData)
+{
+	// Without the SpecId every variant would run at the size compiled in the shader
+	assert(hasWorkgroupSizeSpecId(spirv, spirvSize));
+
+	const uint32_t spirvHash = hashSpirv(spirv, spirvSize);
+	std::map<std::string, Choice>::const_iterator it = choices.find(kernelName);
+	if (it != choices.end() && it->second.spirvHash == spirvHash) {
+		return it->second.workgroupSize;
+	}
+
+	VulkanDevice* deviceObj = context->getDevice();
+	if (!deviceObj->queueFamilyProps[deviceObj->computeQueueIndex].timestampValidBits) {
+		return context->getWorkgroupSize(defaultSize);
+	}
+
+	// Each variant is a pipeline of its own, destroyed with the variant once its runs are waited on
+	const size_t cachedPipelines = context->getPipelineObject()->computePipelines.size();
+	uint32_t bestSize = context->getWorkgroupSize(defaultSize);
+	double bestTime = 0.0;
+	for (size_t i = 0; i < sizeof(tunerCandidates) / sizeof(tunerCandidates[0]); i++) {
+		const uint32_t size = tunerCandidates[i];
+		if (context->getWorkgroupSize(size) != size) {
+			continue;
+		}
+
+		ComputeKernel variant;
+		variant.create(context, spirv, spirvSize, bindingNames, bindingCount, pushConstantSize, size);
+		const double time = timeVariant(&variant, record, userData);
+		variant.destroy();
+
+		std::cout << kernelName << " with " << size << " invocations per workgroup: " << time / 1000.0 << " us" << std::endl;
+		if (bestTime == 0.0 || time < bestTime) {
+			bestSize = size;
+			bestTime = time;
+		}
+	}
+	std::cout << kernelName << " tuned to " << bestSize << " invocations per workgroup" << std::endl;
+	assert(context->getPipelineObject()->computePipelines.size() == cachedPipelines);
+
+	Choice choice;
+	choice.spirvHash		= spirvHash;
+	choice.workgroupSize	= bestSize;
+	choices[kernelName]		= choice;
+	saveProfile();
+
+	return bestSize;
+}
+
+double ComputeTuner::timeVariant(ComputeKernel* kernel, RecordFunction record, void* userData)
+{
+	VkResult result;
+	VulkanDevice* deviceObj = context->getDevice();
+	const uint32_t queryCount = 2 * COMPUTE_TUNER_RUNS;
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType			= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.pNext			= NULL;
+	queryPoolInfo.queryType		= VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount	= queryCount;
+	VkQueryPool queryPool;
+	result = vkCreateQueryPool(deviceObj->device, &queryPoolInfo, NULL, &queryPool);
+	assert(result == VK_SUCCESS);
+
+	VkCommandBuffer cmd;
+	CommandBufferMgr::allocCommandBuffer(&deviceObj->device, commandPool, &cmd);
+	CommandBufferMgr::beginCommandBuffer(cmd);
+	vkCmdResetQueryPool(cmd, queryPool, 0, queryCount);
+
+	// The runs write the same buffers, each one waits for the previous one
+	VkMemoryBarrier runBarrier = {};
+	runBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	runBarrier.pNext			= NULL;
+	runBarrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	runBarrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	for (uint32_t run = 0; run < COMPUTE_TUNER_RUNS; run++) {
+		if (run > 0) {
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				1, &runBarrier, 0, NULL, 0, NULL);
+		}
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2 * run);
+		record(cmd, kernel, userData);
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2 * run + 1);
+	}
+	CommandBufferMgr::endCommandBuffer(cmd);
+
+	// The first submission warms up the pipeline and caches, the second one is timed
+	CommandBufferMgr::submitCommandBuffer(deviceObj->queueComupte, &cmd);
+	CommandBufferMgr::submitCommandBuffer(deviceObj->queueComupte, &cmd);
+
+	uint64_t timestamps[queryCount];
+	result = vkGetQueryPoolResults(deviceObj->device, queryPool, 0, queryCount, sizeof(timestamps), timestamps,
+		sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	assert(result == VK_SUCCESS);
+
+	vkFreeCommandBuffers(deviceObj->device, commandPool, 1, &cmd);
+	vkDestroyQueryPool(deviceObj->device, queryPool, NULL);
+
+	// Timestamps wrap around at their valid bits
+	const uint32_t timestampBits = deviceObj->queueFamilyProps[deviceObj->computeQueueIndex].timestampValidBits;
+	const uint64_t timestampMask = timestampBits < 64 ? (1ull << timestampBits) - 1 : ~0ull;
+	uint64_t fastestTicks = ~0ull;
+	for (uint32_t run = 0; run < COMPUTE_TUNER_RUNS; run++) {
+		const uint64_t ticks = (timestamps[2 * run + 1] - timestamps[2 * run]) & timestampMask;
+		fastestTicks = std::min(fastestTicks, ticks);
+	}
+	return (double)fastestTicks * deviceObj->gpuProps.limits.timestampPeriod;
+}
+
+// The profile is a text file:
+//	driver <driver version>
+//	<kernel name> <SPIR-V hash> <workgroup size>
+// Choices made with another driver are dropped.
+void ComputeTuner::loadProfile()
+{
+	choices.clear();
+	FILE* fp = fopen(profilePath.c_str(), "r");
+	if (!fp) {
+		return;
+	}
+
+	char line[256];
+	uint32_t driverVersion = 0;
+	bool driverMatches = fgets(line, sizeof(line), fp) && sscanf(line, "driver %u", &driverVersion) == 1 &&
+		driverVersion == context->getDevice()->gpuProps.driverVersion;
+
+	while (driverMatches && fgets(line, sizeof(line), fp)) {
+		char name[128];
+		Choice choice;
+		if (sscanf(line, "%127s %x %u", name, &choice.spirvHash, &choice.workgroupSize) == 3 &&
+			context->getWorkgroupSize(choice.workgroupSize) == choice.workgroupSize) {
+			choices[name] = choice;
+		}
+	}
+	fclose(fp);
+}
+
+void ComputeTuner::saveProfile()
+{
+	FILE* fp = fopen(profilePath.c_str(), "w");
+	if (!fp) {
+		std::cout << "Unable to write the compute profile " << profilePath << std::endl;
+		return;
+	}
+
+	fprintf(fp, "driver %u\n", context->getDevice()->gpuProps.driverVersion);
+	for (std::map<std::string, Choice>::const_iterator it = choices.begin(); it != choices.end(); ++it) {
+		fprintf(fp, "%s %08x %u\n", it->first.c_str(), it->second.spirvHash, it->second.workgroupSize);
+	}
+	fclose(fp);
+}
@@ -92,6 +92,9 @@ VkResult VulkanApplication::handShakeWithDevice(VkPhysicalDevice* gpu, std::vect
 	// Get the physical device or GPU properties
 	vkGetPhysicalDeviceProperties(*gpu, &deviceObj->gpuProps);
 
+	// Get the subgroup size and operations, when the instance and device allow it
+	deviceObj->getSubgroupProperties(instanceObj.apiVersion);
+
 	// Get the memory properties from the physical device or GPU.
 	vkGetPhysicalDeviceMemoryProperties(*gpu, &deviceObj->memoryProperties);
 
@@ -171,9 +174,12 @@ void VulkanApplication::resize()
 	isResizing = true;
 
 	vkDeviceWaitIdle(deviceObj->device);
+	rendererObj->destroyAsyncCompute();
 	rendererObj->destroyFramebuffers();
 	rendererObj->destroyCommandPool();
 	rendererObj->destroyPipeline();
+	rendererObj->destroyComputePrimitives();
+	rendererObj->destroyComputeContext();
 	rendererObj->getPipelineObject()->destroyPipelineCache();
 	for each (VulkanDrawable* drawableObj in *rendererObj->getDrawingItems())
 	{
@@ -193,8 +199,14 @@ void VulkanApplication::resize()
 
 void VulkanApplication::deInitialize()
 {
+	// Wait for the frames in flight, then destroy the per frame compute work
+	vkDeviceWaitIdle(deviceObj->device);
+	rendererObj->destroyAsyncCompute();
+
 	// Destroy all the pipeline objects
 	rendererObj->destroyPipeline();
+	rendererObj->destroyComputePrimitives();
+	rendererObj->destroyComputeContext();
 
 	// Destroy the associate pipeline cache
 	rendererObj->getPipelineObject()->destroyPipelineCache();
@@ -30,6 +30,8 @@
 VulkanDevice::VulkanDevice(VkPhysicalDevice* physicalDevice) 
 {
 	gpu = physicalDevice;
+	subgroupSize		= 0;
+	subgroupOperations	= 0;
 }
 
 VulkanDevice::~VulkanDevice() 
@@ -46,12 +48,18 @@ VkResult VulkanDevice::createDevice(std::vector<const char *>& layers, std::vect
 
 	VkResult result;
 	float queuePriorities[1]			= { 1.0 };
-	VkDeviceQueueCreateInfo queueInfo	= {};
-	queueInfo.queueFamilyIndex			= computeQueueIndex; // Graphics with Compute Queue
-	queueInfo.sType						= VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queueInfo.pNext						= NULL;
-	queueInfo.queueCount				= 1;
-	queueInfo.pQueuePriorities			= queuePriorities;
+	VkDeviceQueueCreateInfo queueInfo[2]	= {};
+	queueInfo[0].queueFamilyIndex		= graphicsQueueIndex;
+	queueInfo[0].sType					= VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueInfo[0].pNext					= NULL;
+	queueInfo[0].queueCount				= 1;
+	queueInfo[0].pQueuePriorities		= queuePriorities;
+
+	// A queue of the compute family too when it is a separate one, its work
+	// runs asynchronously with the graphics queue
+	queueInfo[1]						= queueInfo[0];
+	queueInfo[1].queueFamilyIndex		= computeQueueIndex;
+	const uint32_t queueInfoCount		= computeQueueIndex == graphicsQueueIndex ? 1 : 2;
 
 
 	vkGetPhysicalDeviceFeatures(*gpu, &deviceFeatures);
@@ -59,11 +67,16 @@ VkResult VulkanDevice::createDevice(std::vector<const char *>& layers, std::vect
 	VkPhysicalDeviceFeatures setEnabledFeatures = {VK_FALSE};
 	setEnabledFeatures.samplerAnisotropy = deviceFeatures.samplerAnisotropy;
 
+	// Block compressed texture formats are only usable when their feature is enabled
+	setEnabledFeatures.textureCompressionBC			= deviceFeatures.textureCompressionBC;
+	setEnabledFeatures.textureCompressionETC2		= deviceFeatures.textureCompressionETC2;
+	setEnabledFeatures.textureCompressionASTC_LDR	= deviceFeatures.textureCompressionASTC_LDR;
+
 	VkDeviceCreateInfo deviceInfo		= {};
 	deviceInfo.sType					= VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceInfo.pNext					= NULL;
-	deviceInfo.queueCreateInfoCount		= 1;
-	deviceInfo.pQueueCreateInfos		= &queueInfo;
+	deviceInfo.queueCreateInfoCount		= queueInfoCount;
+	deviceInfo.pQueueCreateInfos		= queueInfo;
 	deviceInfo.enabledLayerCount		= 0;
 	deviceInfo.ppEnabledLayerNames		= NULL;											// Device layers are deprecated
 	deviceInfo.enabledExtensionCount	= (uint32_t)extensions.size();
@@ -73,6 +86,8 @@ VkResult VulkanDevice::createDevice(std::vector<const char *>& layers, std::vect
 	result = vkCreateDevice(*gpu, &deviceInfo, NULL, &device);
 	assert(result == VK_SUCCESS);
 
+	samplerCache.initialize(device, gpuProps.limits.maxSamplerAllocationCount);
+
 	return result;
 }
 
@@ -107,6 +122,33 @@ bool VulkanDevice::memoryTypeFromProperties(VkFlags requirementsMask, uint32_t *
 	return false;
 }
 
+void VulkanDevice::getSubgroupProperties(uint32_t instanceApiVersion)
+{
+	subgroupSize		= 0;
+	subgroupOperations	= 0;
+
+#ifdef VK_VERSION_1_1
+	if (instanceApiVersion < VK_API_VERSION_1_1 || gpuProps.apiVersion < VK_API_VERSION_1_1) {
+		return;
+	}
+
+	VkPhysicalDeviceSubgroupProperties subgroupProps = {};
+	subgroupProps.sType		= VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+	subgroupProps.pNext		= NULL;
+
+	VkPhysicalDeviceProperties2 properties = {};
+	properties.sType		= VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext		= &subgroupProps;
+	vkGetPhysicalDeviceProperties2(*gpu, &properties);
+
+	// Only the operations of the compute stage matter here
+	if (subgroupProps.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) {
+		subgroupSize		= subgroupProps.subgroupSize;
+		subgroupOperations	= subgroupProps.supportedOperations;
+	}
+#endif
+}
+
 void VulkanDevice::getPhysicalDeviceQueuesAndProperties()
 {
 	// Query queue families count with pass NULL as second parameter.
@@ -221,6 +263,7 @@ VkResult VulkanDevice::getTransferQueueHandle()
 
 void VulkanDevice::destroyDevice()
 {
+	samplerCache.destroySamplers();
 	vkDestroyDevice(device, NULL);
 }
 
@@ -230,6 +273,8 @@ void VulkanDevice::getDeviceQueue()
 {
 	// Parminder: this depends on intialiing the SwapChain to 
 	// get the graphics queue with presentation support
+	// The device only has queues of the graphics and compute families
+	assert(graphicsQueueWithPresentIndex == graphicsQueueIndex || graphicsQueueWithPresentIndex == computeQueueIndex);
 	vkGetDeviceQueue(device, graphicsQueueWithPresentIndex, 0, &queue);
 
 	// Get the compute queue
@@ -45,8 +45,11 @@ VulkanDrawable::VulkanDrawable(VulkanRenderer* parent) {
 
 	VulkanDevice* deviceObj = VulkanApplication::GetInstance()->deviceObj;
 
-	vkCreateSemaphore(deviceObj->device, &presentCompleteSemaphoreCreateInfo, NULL, &presentCompleteSemaphore);
-	vkCreateSemaphore(deviceObj->device, &drawingCompleteSemaphoreCreateInfo, NULL, &drawingCompleteSemaphore);
+	// A pair of semaphores for each frame in flight
+	for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		vkCreateSemaphore(deviceObj->device, &presentCompleteSemaphoreCreateInfo, NULL, &presentCompleteSemaphore[i]);
+		vkCreateSemaphore(deviceObj->device, &drawingCompleteSemaphoreCreateInfo, NULL, &drawingCompleteSemaphore[i]);
+	}
 }
 
 VulkanDrawable::~VulkanDrawable()
@@ -62,8 +65,10 @@ void VulkanDrawable::destroyCommandBuffer()
 
 void VulkanDrawable::destroySynchronizationObjects()
 {
-	vkDestroySemaphore(deviceObj->device, presentCompleteSemaphore, NULL);
-	vkDestroySemaphore(deviceObj->device, drawingCompleteSemaphore, NULL);
+	for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		vkDestroySemaphore(deviceObj->device, presentCompleteSemaphore[i], NULL);
+		vkDestroySemaphore(deviceObj->device, drawingCompleteSemaphore[i], NULL);
+	}
 }
 
 void VulkanDrawable::createUniformBuffer()
@@ -158,7 +163,7 @@ void VulkanDrawable::createVertexBuffer(const void *vertexData, uint32_t dataSiz
 	VkBufferCreateInfo bufInfo		= {};
 	bufInfo.sType					= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufInfo.pNext					= NULL;
-	bufInfo.usage					= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	bufInfo.usage					= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;	// Read by the animation kernel
 	bufInfo.size					= dataSize;
 	bufInfo.queueFamilyIndexCount	= 0;
 	bufInfo.pQueueFamilyIndices	= NULL;
@@ -361,10 +366,11 @@ void VulkanDrawable::setTextures(TextureData * tex)
 	textures = tex;
 }
 
-void VulkanDrawable::recordCommandBuffer(int currentImage, VkCommandBuffer* cmdDraw)
+void VulkanDrawable::recordCommandBuffer(int currentImage, uint32_t frameSlot, VkCommandBuffer* cmdDraw)
 {
 	VulkanDevice* deviceObj			= rendererObj->getDevice();
 	VulkanPipeline* pipelineObj 	= rendererObj->getPipelineObject();
+	AsyncCompute* asyncCompute		= rendererObj->getAsyncCompute();
 
 	// Specify the clear color value
 	VkClearValue clearValues[2];
@@ -389,6 +395,12 @@ void VulkanDrawable::recordCommandBuffer(int currentImage, VkCommandBuffer* cmdD
 	renderPassBegin.renderArea.extent.height	= rendererObj->height;
 	renderPassBegin.clearValueCount				= 2;
 	renderPassBegin.pClearValues				= clearValues;
+
+	// Acquire the vertices animated by the compute queue for this frame slot
+	const bool animated = asyncCompute->isCreated();
+	if (animated) {
+		asyncCompute->recordGraphicsBegin(*cmdDraw, frameSlot);
+	}
 	
 	// Start recording the render pass instance
 	vkCmdBeginRenderPass(*cmdDraw, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
@@ -399,7 +411,8 @@ void VulkanDrawable::recordCommandBuffer(int currentImage, VkCommandBuffer* cmdD
 		0, 1, descriptorSet.data(), 0, NULL);
 	// Bound the command buffer with the graphics pipeline
 	const VkDeviceSize offsets[1] = { 0 };
-	vkCmdBindVertexBuffers(*cmdDraw, 0, 1, &VertexBuffer.buf, offsets);
+	const VkBuffer vertices = animated ? asyncCompute->getVertexBuffer(frameSlot) : VertexBuffer.buf;
+	vkCmdBindVertexBuffers(*cmdDraw, 0, 1, &vertices, offsets);
 
 	// Define the dynamic viewport here
 	initViewports(cmdDraw);
@@ -412,22 +425,25 @@ void VulkanDrawable::recordCommandBuffer(int currentImage, VkCommandBuffer* cmdD
 
 	// End of render pass instance recording
 	vkCmdEndRenderPass(*cmdDraw);
+
+	if (animated) {
+		asyncCompute->recordGraphicsEnd(*cmdDraw, frameSlot);
+	}
 }
 
 void VulkanDrawable::prepare()
 {
 	VulkanDevice* deviceObj = rendererObj->getDevice();
-	if (vecCmdDraw.size() == 0)
-	vecCmdDraw.resize(rendererObj->getSwapChain()->scPublicVars.colorBuffer.size());
-	// For each swapbuffer color surface image buffer 
-	// allocate the corresponding command buffer
-	for (int i = 0; i < rendererObj->getSwapChain()->scPublicVars.colorBuffer.size(); i++){
+	// The frame slots draw different animated vertices, each swapbuffer
+	// color surface image has a command buffer for each of them
+	vecCmdDraw.resize(rendererObj->getSwapChain()->scPublicVars.colorBuffer.size() * FRAMES_IN_FLIGHT);
+	for (int i = 0; i < vecCmdDraw.size(); i++){
 		// Allocate, create and start command buffer recording
 		CommandBufferMgr::allocCommandBuffer(&deviceObj->device, rendererObj->getCommandPoolGraphics(), &vecCmdDraw[i]);
 		CommandBufferMgr::beginCommandBuffer(vecCmdDraw[i]);
 
 		// Create the render pass instance 
-		recordCommandBuffer(i, &vecCmdDraw[i]);
+		recordCommandBuffer(i / FRAMES_IN_FLIGHT, i % FRAMES_IN_FLIGHT, &vecCmdDraw[i]);
 
 		// Finish the command buffer recording
 		CommandBufferMgr::endCommandBuffer(vecCmdDraw[i]);
@@ -449,7 +465,22 @@ void VulkanDrawable::update()
 	Model = glm::rotate(Model, rot, glm::vec3(0.0, 1.0, 0.0))
 			* glm::rotate(Model, rot, glm::vec3(1.0, 1.0, 1.0));
 
-	glm::mat4 MVP = Projection * View * Model;
+	// The model rotation is applied to the vertices by the animation kernel on the
+	// compute queue, the uniform buffer only holds the view projection. The frames
+	// in flight read it, so it is only written when it changes. Without the kernel
+	// it holds the whole transform, as a single frame is in flight.
+	AsyncCompute* asyncCompute = rendererObj->getAsyncCompute();
+	glm::mat4 transform = Projection * View;
+	if (asyncCompute->isCreated()) {
+		asyncCompute->setModel(Model);
+	}
+	else {
+		transform = transform * Model;
+	}
+	if (transform == MVP) {
+		return;
+	}
+	MVP = transform;
 
 	// Invalidate the range of mapped buffer in order to make it visible to the host.
 	// If the memory property is set with VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
@@ -475,31 +506,45 @@ void VulkanDrawable::render()
 {
 	VulkanDevice* deviceObj			= rendererObj->getDevice();
 	VulkanSwapChain* swapChainObj	= rendererObj->getSwapChain();
+	AsyncCompute* asyncCompute		= rendererObj->getAsyncCompute();
 
 	uint32_t& currentColorImage		= swapChainObj->scPublicVars.currentColorBuffer;
 	VkSwapchainKHR& swapChain		= swapChainObj->scPublicVars.swapChain;
 
-	VkFence nullFence = VK_NULL_HANDLE;
+	// Wait until the command buffers and semaphores of the frame slot are free again
+	const bool animated				= asyncCompute->isCreated();
+	if (animated) {
+		asyncCompute->beginFrame();
+	}
+	const uint32_t frameSlot		= animated ? asyncCompute->getFrameSlot() : 0;
 	
 	// Get the index of the next available swapchain image:
 	VkResult result = swapChainObj->fpAcquireNextImageKHR(deviceObj->device, swapChain,
-		UINT64_MAX, presentCompleteSemaphore, VK_NULL_HANDLE, &currentColorImage);
-
-	VkPipelineStageFlags submitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType				= VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.pNext				= NULL;
-	submitInfo.waitSemaphoreCount	= 1;
-	submitInfo.pWaitSemaphores		= &presentCompleteSemaphore;
-	submitInfo.pWaitDstStageMask	= &submitPipelineStages;
-	submitInfo.commandBufferCount	= (uint32_t)sizeof(&vecCmdDraw[currentColorImage]) / sizeof(VkCommandBuffer);
-	submitInfo.pCommandBuffers		= &vecCmdDraw[currentColorImage];
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores	= &drawingCompleteSemaphore;
+		UINT64_MAX, presentCompleteSemaphore[frameSlot], VK_NULL_HANDLE, &currentColorImage);
 
-	// Queue the command buffer for execution
-	CommandBufferMgr::submitCommandBuffer(deviceObj->queue, &vecCmdDraw[currentColorImage], &submitInfo);
+	VkCommandBuffer& cmdDraw		= vecCmdDraw[currentColorImage * FRAMES_IN_FLIGHT + frameSlot];
+	if (animated) {
+		// Queue the command buffer for execution, after the compute work of the frame. The
+		// queue is not waited for, the CPU goes on with the next frame while it draws.
+		asyncCompute->submitGraphics(cmdDraw, presentCompleteSemaphore[frameSlot], drawingCompleteSemaphore[frameSlot]);
+	}
+	else {
+		VkPipelineStageFlags submitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType				= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext				= NULL;
+		submitInfo.waitSemaphoreCount	= 1;
+		submitInfo.pWaitSemaphores		= &presentCompleteSemaphore[frameSlot];
+		submitInfo.pWaitDstStageMask	= &submitPipelineStages;
+		submitInfo.commandBufferCount	= 1;
+		submitInfo.pCommandBuffers		= &cmdDraw;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores	= &drawingCompleteSemaphore[frameSlot];
+
+		// Queue the command buffer for execution, the queue is waited for
+		CommandBufferMgr::submitCommandBuffer(deviceObj->queue, &cmdDraw, &submitInfo);
+	}
 
 	// Present the image in the window
 	VkPresentInfoKHR present = {};
@@ -508,13 +553,18 @@ void VulkanDrawable::render()
 	present.swapchainCount		= 1;
 	present.pSwapchains			= &swapChain;
 	present.pImageIndices		= &currentColorImage;
-	present.pWaitSemaphores		= &drawingCompleteSemaphore;
+	present.pWaitSemaphores		= &drawingCompleteSemaphore[frameSlot];
 	present.waitSemaphoreCount	= 1;
 	present.pResults			= NULL;
 
 	// Queue the image for presentation,
 	result = swapChainObj->fpQueuePresentKHR(deviceObj->queue, &present);
 	assert(result == VK_SUCCESS);
+
+	// Queue the compute work of the next frame, it overlaps the graphics work just queued
+	if (animated) {
+		asyncCompute->endFrame();
+	}
 }
 
 void VulkanDrawable::createDescriptorSetLayout(bool useTexture)
@@ -41,6 +41,18 @@ VkResult VulkanInstance::createInstance(std::vector<const char *>& layers, std::
 	// VK_API_VERSION is now deprecated, use VK_MAKE_VERSION instead.
 	appInfo.apiVersion			= VK_MAKE_VERSION(1, 0, 0);
 
+#ifdef VK_VERSION_1_1
+	// Ask for Vulkan 1.1 when the loader has it, the subgroup properties of the
+	// devices are only reported to a 1.1 instance. A 1.0 loader lacks the entry point.
+	PFN_vkEnumerateInstanceVersion enumerateInstanceVersion =
+		(PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(NULL, "vkEnumerateInstanceVersion");
+	uint32_t loaderVersion = VK_MAKE_VERSION(1, 0, 0);
+	if (enumerateInstanceVersion && enumerateInstanceVersion(&loaderVersion) == VK_SUCCESS && loaderVersion >= VK_API_VERSION_1_1) {
+		appInfo.apiVersion		= VK_API_VERSION_1_1;
+	}
+#endif
+	apiVersion = appInfo.apiVersion;
+
 	// Define the Vulkan instance create info structure 
 	VkInstanceCreateInfo instInfo	= {};
 	instInfo.sType					= VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
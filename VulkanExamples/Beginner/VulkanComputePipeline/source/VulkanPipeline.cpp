@@ -191,7 +191,7 @@ bool VulkanPipeline::createPipeline(VulkanDrawable* drawableObj, VkPipeline* pip
 	pipelineInfo.pDynamicState			= &dynamicState;
 	pipelineInfo.pViewportState			= &viewportStateInfo;
 	pipelineInfo.pDepthStencilState		= &depthStencilStateInfo;
-	pipelineInfo.pStages				= &shaderObj->shaderStagesVector[0];
+	pipelineInfo.pStages				= &shaderObj->getStages()[0];
 	pipelineInfo.stageCount				= (uint32_t)shaderObj->shaderStagesVector.size();
 	pipelineInfo.renderPass				= appObj->rendererObj->renderPass;
 	pipelineInfo.subpass				= 0;
@@ -207,8 +207,84 @@ bool VulkanPipeline::createPipeline(VulkanDrawable* drawableObj, VkPipeline* pip
 	}
 }
 
+bool VulkanPipeline::ComputePipelineKey::operator<(const ComputePipelineKey& other) const
+{
+	if (module != other.module) {
+		return module < other.module;
+	}
+	if (layout != other.layout) {
+		return layout < other.layout;
+	}
+	if (entryName != other.entryName) {
+		return entryName < other.entryName;
+	}
+	return constants < other.constants;
+}
+
+bool VulkanPipeline::createComputePipeline(VulkanShader* shaderObj, VkPipelineLayout pipelineLayout, VkPipeline* pipeline)
+{
+	const std::vector<VkPipelineShaderStageCreateInfo>& stages = shaderObj->getStages();
+
+	const VkPipelineShaderStageCreateInfo* computeStage = NULL;
+	for (size_t i = 0; i < stages.size(); i++) {
+		if (stages[i].stage == VK_SHADER_STAGE_COMPUTE_BIT) {
+			computeStage = &stages[i];
+		}
+	}
+	assert(computeStage);
+
+	// The same module specialized with the same values gives the same pipeline
+	ComputePipelineKey key;
+	key.module		= computeStage->module;
+	key.layout		= pipelineLayout;
+	key.entryName	= computeStage->pName;
+	if (computeStage->pSpecializationInfo) {
+		key.constants = shaderObj->getSpecialization(VK_SHADER_STAGE_COMPUTE_BIT).getKey();
+	}
+
+	std::map<ComputePipelineKey, VkPipeline>::iterator it = computePipelines.find(key);
+	if (it != computePipelines.end()) {
+		*pipeline = it->second;
+		return true;
+	}
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo = {};
+	computePipelineCreateInfo.sType					= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCreateInfo.pNext					= NULL;
+	computePipelineCreateInfo.flags					= 0;
+	computePipelineCreateInfo.stage					= *computeStage;
+	computePipelineCreateInfo.layout				= pipelineLayout;
+	computePipelineCreateInfo.basePipelineHandle	= 0;
+	computePipelineCreateInfo.basePipelineIndex		= 0;
+
+	if (vkCreateComputePipelines(deviceObj->device, pipelineCache, 1, &computePipelineCreateInfo, NULL, pipeline) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	computePipelines[key] = *pipeline;
+	return true;
+}
+
+void VulkanPipeline::destroyComputePipeline(VkPipeline pipeline)
+{
+	for (std::map<ComputePipelineKey, VkPipeline>::iterator it = computePipelines.begin(); it != computePipelines.end(); ++it) {
+		if (it->second == pipeline) {
+			vkDestroyPipeline(deviceObj->device, pipeline, NULL);
+			computePipelines.erase(it);
+			return;
+		}
+	}
+	assert(false);
+}
+
 // Destroy the pipeline cache object when no more required
 void VulkanPipeline::destroyPipelineCache()
 {
+	for (std::map<ComputePipelineKey, VkPipeline>::iterator it = computePipelines.begin(); it != computePipelines.end(); ++it) {
+		vkDestroyPipeline(deviceObj->device, it->second, NULL);
+	}
+	computePipelines.clear();
+
 	vkDestroyPipelineCache(deviceObj->device, pipelineCache, NULL);
 }
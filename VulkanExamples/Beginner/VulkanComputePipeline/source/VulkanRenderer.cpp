@@ -27,6 +27,7 @@
 #include "VulkanApplication.h"
 #include "Wrappers.h"
 #include "MeshData.h"
+#include <algorithm>
 
 VulkanRenderer::VulkanRenderer(VulkanApplication * app, VulkanDevice* deviceObject)
 {
@@ -42,6 +43,7 @@ VulkanRenderer::VulkanRenderer(VulkanApplication * app, VulkanDevice* deviceObje
 	drawableList.push_back(drawableObj);
 	cmdPoolGrpahics = NULL;
 	cmdPoolCompute = NULL;
+	copyWorkgroupSize = 0;
 }
 
 VulkanRenderer::~VulkanRenderer()
@@ -57,6 +59,10 @@ VulkanRenderer::~VulkanRenderer()
 
 void VulkanRenderer::initialize()
 {
+	// All the shaders compile in the background while
+	// the other resources are created.
+	compileShaders();
+
 	// We need command buffers for graphics operation, so create a command buffer pool for graphics
 	createCommandPoolGraphics();
 
@@ -96,7 +102,11 @@ void VulkanRenderer::initialize()
 	// Manage the pipeline state objects
 	createPipelineStateManagement();
 
-	createComputeBuffer();
+	createComputeContext();
+
+	createComputePrimitives();
+
+	createAsyncCompute();
 }
 
 void VulkanRenderer::prepare()
@@ -441,6 +451,28 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 	// Get number of mip-map levels
 	texture->mipMapLevels	= uint32_t(image2D.levels());
 
+	// Use the format stored in the texture file unless the caller overrides it
+	if (format == VK_FORMAT_UNDEFINED) {
+		format = getVulkanFormat(image2D.format());
+	}
+	assert(format != VK_FORMAT_UNDEFINED);
+	texture->format = format;
+
+	// Block compressed formats are optional, make sure the
+	// device can sample the format with optimal tiling
+	VkFormatProperties formatProps;
+	vkGetPhysicalDeviceFormatProperties(*deviceObj->gpu, format, &formatProps);
+	if (!(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+		std::cout << "Texture format " << format << " of " << filename << " cannot be sampled by this device." << std::endl;
+		assert(0);
+		return;
+	}
+
+	// Compressed formats can not be used as storage images, drop the usage if not supported
+	if ((imageUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) && !(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+		imageUsageFlags &= ~VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+
 	// Create a staging buffer resource states using.
 	// Indicate it be the source of the transfer command.
 	// .usage	= VK_BUFFER_USAGE_TRANSFER_SRC_BIT
@@ -552,8 +584,10 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 	std::vector<VkBufferImageCopy> bufferImgCopyList;
 
 
-	uint32_t bufferOffset = 0;
+	VkDeviceSize bufferOffset = 0;
 	// Iterater through each mip level and set buffer image copy -
+	// The extent is given in texels, for block compressed formats the
+	// levels smaller than a block are copied as a whole block.
 	for (uint32_t i = 0; i < texture->mipMapLevels; i++)
 	{
 		VkBufferImageCopy bufImgCopyItem = {};
@@ -569,7 +603,7 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 		bufferImgCopyList.push_back(bufImgCopyItem);
 
 		// adjust buffer offset
-		bufferOffset += uint32_t(image2D[i].size());
+		bufferOffset += image2D[i].size();
 	}
 
 	// Copy the staging buffer memory data contain
@@ -645,8 +679,8 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 	samplerCI.borderColor				= VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 	samplerCI.unnormalizedCoordinates	= VK_FALSE;
 
-	error = vkCreateSampler(deviceObj->device, &samplerCI, nullptr, &texture->sampler);
-	assert(!error);
+	// Get a shared sampler from the device sampler cache
+	texture->sampler = deviceObj->samplerCache.acquireSampler(samplerCI);
 
 	// Create image view to allow shader to access the texture information -
 	VkImageViewCreateInfo viewCI = {};
@@ -683,6 +717,22 @@ void VulkanRenderer::createTextureLinear(const char* filename, TextureData *text
 	// Get number of mip-map levels
 	texture->mipMapLevels	= uint32_t(image2D.levels());
 
+	// Use the format stored in the texture file unless the caller overrides it
+	if (format == VK_FORMAT_UNDEFINED) {
+		format = getVulkanFormat(image2D.format());
+	}
+	assert(format != VK_FORMAT_UNDEFINED);
+	texture->format = format;
+
+	// Linear tiling support is very limited and block compressed
+	// formats are generally not supported, use the staging path then
+	VkFormatProperties formatProps;
+	vkGetPhysicalDeviceFormatProperties(*deviceObj->gpu, format, &formatProps);
+	if (!(formatProps.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+		createTextureOptimal(filename, texture, imageUsageFlags, format);
+		return;
+	}
+
 	// Create image resource states using VkImageCreateInfo
 	VkImageCreateInfo imageCreateInfo   = {};
 	imageCreateInfo.sType				= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -747,13 +797,17 @@ void VulkanRenderer::createTextureLinear(const char* filename, TextureData *text
 	error = vkMapMemory(deviceObj->device, texture->mem, 0, texture->memoryAlloc.allocationSize, 0, (void**)&data);
 	assert(!error);
 
-	// Load image texture data in the mapped buffer
+	// Load image texture data in the mapped buffer, a row
+	// is a row of blocks for block compressed formats
+	const gli::dim3_t blockExtent	= gli::block_dimensions(image2D.format());
+	const uint32_t rowCount			= (texture->textureHeight + blockExtent.y - 1) / blockExtent.y;
+	const size_t rowSize			= ((texture->textureWidth + blockExtent.x - 1) / blockExtent.x) * gli::block_size(image2D.format());
+
 	uint8_t* dataTemp = (uint8_t*)image2D.data();
-	for (int y = 0; y < image2D[0].dimensions().y; y++)
+	for (uint32_t y = 0; y < rowCount; y++)
 	{
-		size_t imageSize = image2D[0].dimensions().y * 4;
-		memcpy(data, dataTemp, imageSize);
-		dataTemp += imageSize;
+		memcpy(data, dataTemp, rowSize);
+		dataTemp += rowSize;
 
 		// Advance row by row pitch information
 		data += layout.rowPitch;
@@ -825,9 +879,8 @@ void VulkanRenderer::createTextureLinear(const char* filename, TextureData *text
 	samplerCI.borderColor			= VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 	samplerCI.unnormalizedCoordinates = VK_FALSE;
 
-	// Create the sampler
-	error = vkCreateSampler(deviceObj->device, &samplerCI, NULL, &texture->sampler);
-	assert(!error);
+	// Get a shared sampler from the device sampler cache
+	texture->sampler = deviceObj->samplerCache.acquireSampler(samplerCI);
 
 	// Create image view to allow shader to access the texture information -
 	VkImageViewCreateInfo viewCI	= {};
@@ -990,7 +1043,7 @@ void VulkanRenderer::destroyDrawableUniformBuffer()
 void VulkanRenderer::destroyTextureResource()
 {
 	vkFreeMemory(deviceObj->device, texture.mem, NULL);
-	vkDestroySampler(deviceObj->device, texture.sampler, NULL);
+	deviceObj->samplerCache.releaseSampler(texture.sampler);
 	vkDestroyImage(deviceObj->device, texture.image, NULL);
 	vkDestroyImageView(deviceObj->device, texture.view, NULL);
 }
@@ -1056,178 +1109,430 @@ void VulkanRenderer::createVertexBuffer()
 	CommandBufferMgr::submitCommandBuffer(deviceObj->queue, &cmdVertexBuffer);
 }
 
-void VulkanRenderer::createComputeBuffer() // To Do: There are memory leaks in this function need to fix.
+// Buffers of the copy kernel runs timed by the tuner
+struct CopyTuning {
+	VkBuffer	input;
+	VkBuffer	output;
+	uint32_t	elementCount;
+};
+
+static void recordCopyTuning(VkCommandBuffer cmd, ComputeKernel* kernel, void* userData)
 {
-	VkResult  result;
-	const int32_t bufferLength = 4096 * 4;
-	const uint32_t bufferSize = sizeof(int32_t) * bufferLength;
-	const VkDeviceSize memorySize = bufferSize * 2;
-	int32_t *payload;
-	VkDeviceMemory memory; // Memory required for mapping and unmapping
+	const CopyTuning* tuning = (const CopyTuning*)userData;
+	kernel->bind("input", tuning->input);
+	kernel->bind("output", tuning->output);
+	kernel->recordDispatch(cmd, kernel->getGroupCount(tuning->elementCount), 1, 1, &tuning->elementCount);
+}
+
+void VulkanRenderer::createComputeContext()
+{
+	computeContext.initialize(deviceObj, &pipelineObj);
+
+	const uint32_t* spirv;
+	size_t spirvSize;
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+	// Wait for the compute shader queued by compileShaders()
+	const std::vector<unsigned int>& compSPVCode = compSPV.get();
+	assert(!compSPVCode.empty());
+	spirv		= compSPVCode.data();
+	spirvSize	= compSPVCode.size() * sizeof(unsigned int);
+#else
+	void* compShaderCode = readFile("./../Compute-comp.spv", &spirvSize);
+	assert(compShaderCode);
+	spirv = (uint32_t*)compShaderCode;
+#endif
+
+	// Compute.comp copies its input buffer to its output buffer, the element count is pushed
+	const char* const copyBindings[] = { "input", "output" };
+
+	// Tuned once, resizing keeps the size. The profile next to the shaders skips
+	// the timing on the next runs.
+	if (!copyWorkgroupSize) {
+		if (!getCommandPoolCompute()) createCommandPoolCompute();
+
+		const VkDeviceSize tuningSize = COMPUTE_TUNING_ELEMENTS * sizeof(uint32_t);
+		ComputeBuffer input, output;
+		computeContext.createBuffer(&input, tuningSize, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		computeContext.createBuffer(&output, tuningSize, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		CopyTuning tuning;
+		tuning.input		= input.buffer;
+		tuning.output		= output.buffer;
+		tuning.elementCount	= COMPUTE_TUNING_ELEMENTS;
+
+		ComputeTuner tuner;
+		tuner.initialize(&computeContext, getCommandPoolCompute(), "./../");
+		copyWorkgroupSize = tuner.tune("Compute", spirv, spirvSize, copyBindings, 2, sizeof(uint32_t),
+			COMPUTE_WORKGROUP_SIZE, recordCopyTuning, &tuning);
 
-	int32_t* hostData = new int32_t[memorySize / sizeof(int32_t)];
-	for (uint32_t j = 0; j < memorySize / sizeof(int32_t); j++) {
-		hostData[j] = rand();
-		if (j < 4) printf("I:%d,", hostData[j]);
+		computeContext.destroyBuffer(&input);
+		computeContext.destroyBuffer(&output);
 	}
+	copyKernel.create(&computeContext, spirv, spirvSize, copyBindings, 2, sizeof(uint32_t), copyWorkgroupSize);
 
-	std::vector<BufferList> vkBufferList;
-	vkBufferList.resize(2);				// Two buffer one for Input another for Output
+#ifndef AUTO_COMPILE_GLSL_TO_SPV
+	free(compShaderCode);
+#endif
+
+	// The copy does not depend on the window, check it on the first initialization only
+	if (!application->isResizing) {
+		checkComputeCopy();
+	}
+}
+
+void VulkanRenderer::checkComputeCopy()
+{
+	const uint32_t elementCount = 4096 * 4;
+	const VkDeviceSize bufferSize = elementCount * sizeof(int32_t);
+	const VkMemoryPropertyFlags hostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	ComputeBuffer input, output;
+	computeContext.createBuffer(&input, bufferSize, 0, hostMemory);
+	computeContext.createBuffer(&output, bufferSize, 0, hostMemory);
+
+	int32_t* inputData = (int32_t*)input.mapped;
+	for (uint32_t i = 0; i < elementCount; i++) {
+		inputData[i] = rand();
+	}
+
+	if (!getCommandPoolCompute()) createCommandPoolCompute();
+	VkCommandBuffer commandBuffer;
+	CommandBufferMgr::allocCommandBuffer(&deviceObj->device, getCommandPoolCompute(), &commandBuffer);
+	CommandBufferMgr::beginCommandBuffer(commandBuffer);
+
+	copyKernel.bind("input", input.buffer);
+	copyKernel.bind("output", output.buffer);
+	copyKernel.recordDispatch(commandBuffer, copyKernel.getGroupCount(elementCount), 1, 1, &elementCount);
+
+	VkMemoryBarrier hostBarrier = {};
+	hostBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	hostBarrier.pNext			= NULL;
+	hostBarrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	hostBarrier.dstAccessMask	= VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, NULL, 0, NULL);
 
-	vkBufferList[0].index = 0;			// Input buffer properties
-	vkBufferList[0].size = bufferSize;
-	vkBufferList[1].index = bufferSize; // Output buffer properties
-	vkBufferList[1].size = bufferSize;
+	CommandBufferMgr::endCommandBuffer(commandBuffer);
+	CommandBufferMgr::submitCommandBuffer(deviceObj->queueComupte, &commandBuffer);
+
+	const bool match = memcmp(input.mapped, output.mapped, bufferSize) == 0;
+	std::cout << "Compute copy of " << elementCount << " values: " << (match ? "results match" : "RESULTS DIFFER") << std::endl;
+	assert(match);
+
+	vkFreeCommandBuffers(deviceObj->device, getCommandPoolCompute(), 1, &commandBuffer);
+	computeContext.destroyBuffer(&input);
+	computeContext.destroyBuffer(&output);
+}
 
-	allocateMemory(deviceObj, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memorySize, hostData, &memory);
-	createBuffer(deviceObj, &memory, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vkBufferList);
+void VulkanRenderer::destroyComputeContext()
+{
+	copyKernel.destroy();
+	computeContext.destroy();
+}
 
-	VulkanShader computeShaders;
-	void* compShaderCode;
-	size_t sizeCompt;
+void VulkanRenderer::createComputePrimitives()
+{
+	const uint32_t* spirv[ComputePrimitives::KERNEL_TOTAL];
+	size_t spirvSize[ComputePrimitives::KERNEL_TOTAL];
+	bool isComplete = true;
 
 #ifdef AUTO_COMPILE_GLSL_TO_SPV
-	compShaderCode = readFile("./../Compute.comp", &sizeCompt);
-	computeShaders.buildShader((const char*)compShaderCode, "main", VK_SHADER_STAGE_COMPUTE_BIT);
+	// Wait for the kernels queued by compileShaders()
+	for (int kernel = 0; kernel < ComputePrimitives::KERNEL_TOTAL; kernel++) {
+		const std::vector<unsigned int>& kernelSPVCode = primitivesSPV[kernel].get();
+		isComplete			= isComplete && !kernelSPVCode.empty();
+		spirv[kernel]		= kernelSPVCode.data();
+		spirvSize[kernel]	= kernelSPVCode.size() * sizeof(unsigned int);
+	}
+	if (isComplete) {
+		computePrimitives.initialize(&computeContext, COMPUTE_PRIMITIVES_CAPACITY, spirv, spirvSize);
+	}
+	const bool subgroupKernels = false;
 #else
-	compShaderCode = readFile("./../Compute-comp.spv", &sizeCompt);
-	computeShaders.buildShaderModuleWithSPV((uint32_t*)compShaderCode, sizeCompt, "main", VK_SHADER_STAGE_COMPUTE_BIT);
+	// The subgroup variants are compiled with SUBGROUP_OPS defined, for Vulkan 1.1
+	const bool subgroupKernels = ComputePrimitives::isSubgroupSupported(deviceObj);
+	const char* variant = subgroupKernels ? "-subgroup-comp.spv" : "-comp.spv";
+	void* kernelShaderCode[ComputePrimitives::KERNEL_TOTAL];
+	for (int kernel = 0; kernel < ComputePrimitives::KERNEL_TOTAL; kernel++) {
+		std::string fileName = std::string("./../") + ComputePrimitives::kernelNames[kernel] + variant;
+		kernelShaderCode[kernel]	= readFile(fileName.c_str(), &spirvSize[kernel]);
+		spirv[kernel]				= (uint32_t*)kernelShaderCode[kernel];
+		isComplete					= isComplete && kernelShaderCode[kernel];
+	}
+	if (isComplete) {
+		computePrimitives.initialize(&computeContext, COMPUTE_PRIMITIVES_CAPACITY, spirv, spirvSize);
+	}
+	for (int kernel = 0; kernel < ComputePrimitives::KERNEL_TOTAL; kernel++) {
+		free(kernelShaderCode[kernel]);
+	}
 #endif
 
-	VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[2] = {};
-	descriptorSetLayoutBindings[0].binding				= 0;
-	descriptorSetLayoutBindings[0].descriptorType		= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	descriptorSetLayoutBindings[0].descriptorCount		= 1;
-	descriptorSetLayoutBindings[0].stageFlags			= VK_SHADER_STAGE_COMPUTE_BIT;
-	descriptorSetLayoutBindings[0].pImmutableSamplers	= NULL;
-
-	descriptorSetLayoutBindings[1].binding				= 1;
-	descriptorSetLayoutBindings[1].descriptorType		= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	descriptorSetLayoutBindings[1].descriptorCount		= 1;
-	descriptorSetLayoutBindings[1].stageFlags			= VK_SHADER_STAGE_COMPUTE_BIT;
-	descriptorSetLayoutBindings[1].pImmutableSamplers	= NULL;
-
-	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {};
-	descriptorSetLayoutCreateInfo.sType					= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	descriptorSetLayoutCreateInfo.pNext					= 0;
-	descriptorSetLayoutCreateInfo.flags					= 0;
-	descriptorSetLayoutCreateInfo.bindingCount			= 2;
-	descriptorSetLayoutCreateInfo.pBindings				= descriptorSetLayoutBindings;
-
-	VkDescriptorSetLayout descriptorSetLayout = {};
-	result = vkCreateDescriptorSetLayout(deviceObj->device, &descriptorSetLayoutCreateInfo, 0, &descriptorSetLayout);
-	assert(result == VK_SUCCESS);
+	// Only the check below uses the primitives, the sample runs without them
+	if (!isComplete) {
+		std::cout << "Compute primitive kernels not found, the primitives and their check are skipped" << std::endl;
+		return;
+	}
 
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
-	pipelineLayoutCreateInfo.sType						= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutCreateInfo.pNext						= 0;
-	pipelineLayoutCreateInfo.flags						= 0;
-	pipelineLayoutCreateInfo.setLayoutCount				= 1;
-	pipelineLayoutCreateInfo.pSetLayouts				= &descriptorSetLayout;
-	pipelineLayoutCreateInfo.pushConstantRangeCount		= 0;
-	pipelineLayoutCreateInfo.pPushConstantRanges		= 0;
-
-	VkPipelineLayout pipelineLayout = {};
-	result = vkCreatePipelineLayout(deviceObj->device, &pipelineLayoutCreateInfo, 0, &pipelineLayout);
-	assert(result == VK_SUCCESS);
+	// The primitives do not depend on the window, check them on the first initialization only
+	if (!application->isResizing) {
+		checkComputePrimitives(subgroupKernels);
+	}
+}
 
-	VkComputePipelineCreateInfo computePipelineCreateInfo = {};
-	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	computePipelineCreateInfo.pNext = 0;
-	computePipelineCreateInfo.flags = 0;
-	{
-		computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		computePipelineCreateInfo.stage.pNext = 0;
-		computePipelineCreateInfo.stage.flags = 0;
-		computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-		computePipelineCreateInfo.stage.module = computeShaders.shaderStagesVector[0].module;
-		computePipelineCreateInfo.stage.pName = "main";
-		computePipelineCreateInfo.stage.pSpecializationInfo = 0;
-	}
-	computePipelineCreateInfo.layout = pipelineLayout;
-	computePipelineCreateInfo.basePipelineHandle = 0;
-	computePipelineCreateInfo.basePipelineIndex = 0;
-
-	VkPipeline pipeline;
-	result = vkCreateComputePipelines(deviceObj->device, 0, 1, &computePipelineCreateInfo, 0, &pipeline);
-
-	VkDescriptorPoolSize descriptorPoolSize = {
-		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		2
+void VulkanRenderer::checkComputePrimitives(bool subgroupKernels)
+{
+	VkResult result;
+	const uint32_t count = computePrimitives.getCapacity();
+	const uint32_t binCount = ComputePrimitives::maxHistogramBins;
+	const uint32_t histogramShift = 24;
+	const VkDeviceSize arraySize = (VkDeviceSize)count * sizeof(uint32_t);
+
+	// Random values, and one flag in two on average for the compaction
+	std::vector<uint32_t> values(count);
+	std::vector<uint32_t> flags(count);
+	for (uint32_t i = 0; i < count; i++) {
+		values[i]	= ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+		flags[i]	= rand() & 1;
+	}
+
+	enum {
+		CHECK_UPLOAD,		// Values then flags
+		CHECK_READBACK,		// Scan, compaction, sum, compacted count, then bins
+		CHECK_VALUES,
+		CHECK_FLAGS,
+		CHECK_SCAN,
+		CHECK_COMPACT,
+		CHECK_SUM,
+		CHECK_COMPACT_COUNT,
+		CHECK_BINS,
+		CHECK_BUFFER_TOTAL
+	};
+	const VkDeviceSize readbackOffsets[] = { 0, arraySize, 2 * arraySize, 2 * arraySize + 4, 2 * arraySize + 8 };
+
+	// The primitives work on device local memory, the host only reaches it through copies
+	const VkMemoryPropertyFlags hostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	const VkBufferUsageFlags deviceUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	ComputeBuffer buffers[CHECK_BUFFER_TOTAL];
+	computeContext.createBuffer(&buffers[CHECK_UPLOAD], 2 * arraySize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, hostMemory);
+	computeContext.createBuffer(&buffers[CHECK_READBACK], readbackOffsets[4] + binCount * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemory);
+	for (int i = CHECK_VALUES; i <= CHECK_COMPACT; i++) {
+		computeContext.createBuffer(&buffers[i], arraySize, deviceUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+	computeContext.createBuffer(&buffers[CHECK_SUM], sizeof(uint32_t), deviceUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	computeContext.createBuffer(&buffers[CHECK_COMPACT_COUNT], sizeof(uint32_t), deviceUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	computeContext.createBuffer(&buffers[CHECK_BINS], binCount * sizeof(uint32_t), deviceUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	uint32_t* mapped = (uint32_t*)buffers[CHECK_UPLOAD].mapped;
+	memcpy(mapped, values.data(), arraySize);
+	memcpy(mapped + count, flags.data(), arraySize);
+
+	// A pair of timestamps around each primitive, when the compute queue has them
+	const uint32_t timestampBits = deviceObj->queueFamilyProps[deviceObj->computeQueueIndex].timestampValidBits;
+	const uint32_t queryCount = 8;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	if (timestampBits) {
+		VkQueryPoolCreateInfo queryPoolInfo = {};
+		queryPoolInfo.sType			= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.pNext			= NULL;
+		queryPoolInfo.queryType		= VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount	= queryCount;
+		result = vkCreateQueryPool(deviceObj->device, &queryPoolInfo, NULL, &queryPool);
+		assert(result == VK_SUCCESS);
+	}
+
+	if (!getCommandPoolCompute()) createCommandPoolCompute();
+	VkCommandBuffer commandBuffers[2];
+	for (int i = 0; i < 2; i++) {
+		CommandBufferMgr::allocCommandBuffer(&deviceObj->device, getCommandPoolCompute(), &commandBuffers[i]);
+	}
+
+	VkBufferCopy uploadRegions[2] = {
+		{ 0,			0, arraySize },
+		{ arraySize,	0, arraySize },
 	};
+	CommandBufferMgr::beginCommandBuffer(commandBuffers[0]);
+	vkCmdCopyBuffer(commandBuffers[0], buffers[CHECK_UPLOAD].buffer, buffers[CHECK_VALUES].buffer, 1, &uploadRegions[0]);
+	vkCmdCopyBuffer(commandBuffers[0], buffers[CHECK_UPLOAD].buffer, buffers[CHECK_FLAGS].buffer, 1, &uploadRegions[1]);
+	CommandBufferMgr::endCommandBuffer(commandBuffers[0]);
+	CommandBufferMgr::submitCommandBuffer(deviceObj->queueComupte, &commandBuffers[0]);
+
+	// Bottom of pipe timestamps, each one waits for the work recorded before it
+	VkCommandBuffer cmd = commandBuffers[1];
+	CommandBufferMgr::beginCommandBuffer(cmd);
+	if (queryPool) {
+		vkCmdResetQueryPool(cmd, queryPool, 0, queryCount);
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 0);
+	}
+	computePrimitives.recordReduce(cmd, buffers[CHECK_VALUES].buffer, count, buffers[CHECK_SUM].buffer);
+	if (queryPool) {
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2);
+	}
+	computePrimitives.recordScan(cmd, buffers[CHECK_VALUES].buffer, buffers[CHECK_SCAN].buffer, count, true);
+	if (queryPool) {
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 3);
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 4);
+	}
+	computePrimitives.recordCompact(cmd, buffers[CHECK_VALUES].buffer, buffers[CHECK_FLAGS].buffer, count,
+		buffers[CHECK_COMPACT].buffer, buffers[CHECK_COMPACT_COUNT].buffer);
+	if (queryPool) {
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 5);
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 6);
+	}
+	computePrimitives.recordHistogram(cmd, buffers[CHECK_VALUES].buffer, count, histogramShift, binCount, buffers[CHECK_BINS].buffer);
+	if (queryPool) {
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 7);
+	}
 
-	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
-		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-		0,
-		0,
-		1,
-		1,
-		&descriptorPoolSize
+	VkBufferCopy readbackRegions[5] = {
+		{ 0, readbackOffsets[0], arraySize },
+		{ 0, readbackOffsets[1], arraySize },
+		{ 0, readbackOffsets[2], sizeof(uint32_t) },
+		{ 0, readbackOffsets[3], sizeof(uint32_t) },
+		{ 0, readbackOffsets[4], binCount * sizeof(uint32_t) },
 	};
+	const int readbackSources[5] = { CHECK_SCAN, CHECK_COMPACT, CHECK_SUM, CHECK_COMPACT_COUNT, CHECK_BINS };
+	for (int i = 0; i < 5; i++) {
+		vkCmdCopyBuffer(cmd, buffers[readbackSources[i]].buffer, buffers[CHECK_READBACK].buffer, 1, &readbackRegions[i]);
+	}
 
-	VkDescriptorPool descriptorPool;
-	result = vkCreateDescriptorPool(deviceObj->device, &descriptorPoolCreateInfo, 0, &descriptorPool);
-	assert(result == VK_SUCCESS);
+	VkMemoryBarrier hostBarrier = {};
+	hostBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	hostBarrier.pNext			= NULL;
+	hostBarrier.srcAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	hostBarrier.dstAccessMask	= VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, NULL, 0, NULL);
+	CommandBufferMgr::endCommandBuffer(cmd);
+
+	// The first run warms up the pipelines and caches, the second one is timed
+	CommandBufferMgr::submitCommandBuffer(deviceObj->queueComupte, &cmd);
+	CommandBufferMgr::submitCommandBuffer(deviceObj->queueComupte, &cmd);
+
+	uint64_t timestamps[queryCount] = {};
+	if (queryPool) {
+		result = vkGetQueryPoolResults(deviceObj->device, queryPool, 0, queryCount, sizeof(timestamps), timestamps,
+			sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+		assert(result == VK_SUCCESS);
+	}
 
-	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
-		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-		0,
-		descriptorPool,
-		1,
-		&descriptorSetLayout
+	// CPU references
+	const uint32_t referenceSum = ComputePrimitives::reduceReference(values);
+	std::vector<uint32_t> referenceScan, referenceCompact, referenceBins;
+	ComputePrimitives::scanReference(values, true, referenceScan);
+	ComputePrimitives::compactReference(values, flags, referenceCompact);
+	ComputePrimitives::histogramReference(values, histogramShift, binCount, referenceBins);
+
+	mapped = (uint32_t*)buffers[CHECK_READBACK].mapped;
+	const uint32_t compactCount = mapped[readbackOffsets[3] / sizeof(uint32_t)];
+	const bool matches[4] = {
+		mapped[readbackOffsets[2] / sizeof(uint32_t)] == referenceSum,
+		memcmp(mapped, referenceScan.data(), arraySize) == 0,
+		compactCount == referenceCompact.size() &&
+			memcmp(mapped + count, referenceCompact.data(), referenceCompact.size() * sizeof(uint32_t)) == 0,
+		memcmp(mapped + readbackOffsets[4] / sizeof(uint32_t), referenceBins.data(), binCount * sizeof(uint32_t)) == 0,
 	};
 
-	VkDescriptorSet descriptorSet = {};
-	result = vkAllocateDescriptorSets(deviceObj->device, &descriptorSetAllocateInfo, &descriptorSet);
-	assert(result == VK_SUCCESS);
+	// Bytes of the inputs read and the outputs written by each primitive
+	const char* names[4] = { "Reduce", "Inclusive scan", "Compaction", "Histogram" };
+	const double bytes[4] = { (double)arraySize, 2.0 * arraySize, 2.0 * arraySize + (double)referenceCompact.size() * sizeof(uint32_t), (double)arraySize };
+	const uint64_t timestampMask = timestampBits < 64 ? (1ULL << timestampBits) - 1 : ~0ULL;
+
+	std::cout << "Compute primitives on " << count << " values, "
+		<< (subgroupKernels ? "subgroup" : "shared memory") << " kernels:" << std::endl;
+	for (int i = 0; i < 4; i++) {
+		std::cout << "  " << names[i] << ": ";
+		if (queryPool) {
+			const uint64_t ticks = ((timestamps[2 * i + 1] - timestamps[2 * i]) & timestampMask);
+			const double nanoseconds = ticks * (double)deviceObj->gpuProps.limits.timestampPeriod;
+			std::cout << nanoseconds / 1000000.0 << " ms, " << (nanoseconds > 0.0 ? bytes[i] / nanoseconds : 0.0) << " GB/s, ";
+		}
+		std::cout << (matches[i] ? "matches the CPU reference" : "DIFFERS FROM THE CPU REFERENCE") << std::endl;
+		assert(matches[i]);
+	}
 
-	VkDescriptorBufferInfo inputDescBufferInfo = { vkBufferList[0].buffer,  0, VK_WHOLE_SIZE };
-	VkDescriptorBufferInfo outputDescBufferInfo = { vkBufferList[1].buffer, 0, VK_WHOLE_SIZE };
-	
-	VkWriteDescriptorSet writeDescriptorSet[2] = {};
-	memset(&writeDescriptorSet, 0, sizeof(writeDescriptorSet));
-	#define ZERO_SET(X)  memset(&X, 0, sizeof(X));
-
-	// Specify the storage buffer related 
-	// information into first write descriptor
-	writeDescriptorSet[0].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeDescriptorSet[0].dstSet			= descriptorSet;
-	writeDescriptorSet[0].dstBinding		= 0; // DESCRIPTOR_SET_BINDING_INDEX
-	writeDescriptorSet[0].descriptorCount	= 1;
-	writeDescriptorSet[0].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	writeDescriptorSet[0].pBufferInfo		= &inputDescBufferInfo;
-
-	writeDescriptorSet[1].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeDescriptorSet[1].dstSet			= descriptorSet;
-	writeDescriptorSet[1].dstBinding		= 1; // DESCRIPTOR_SET_BINDING_INDEX
-	writeDescriptorSet[1].descriptorCount	= 1;
-	writeDescriptorSet[1].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	writeDescriptorSet[1].pBufferInfo		= &outputDescBufferInfo;
-
-	vkUpdateDescriptorSets(deviceObj->device, 2, writeDescriptorSet, 0, 0);
+	if (queryPool) {
+		vkDestroyQueryPool(deviceObj->device, queryPool, NULL);
+	}
+	vkFreeCommandBuffers(deviceObj->device, getCommandPoolCompute(), 2, commandBuffers);
+	for (int i = 0; i < CHECK_BUFFER_TOTAL; i++) {
+		computeContext.destroyBuffer(&buffers[i]);
+	}
+}
 
-	VkCommandBuffer commandBuffer;
-	// We need command buffers for compute operation, so create a command buffer pool for compute
-	if(!getCommandPoolCompute()) createCommandPoolCompute();
+void VulkanRenderer::destroyComputePrimitives()
+{
+	computePrimitives.destroy();
+}
 
-	CommandBufferMgr::allocCommandBuffer(&deviceObj->device, getCommandPoolCompute(), &commandBuffer);
-	CommandBufferMgr::beginCommandBuffer(commandBuffer);
+void VulkanRenderer::createAsyncCompute()
+{
+	const uint32_t* spirv;
+	size_t spirvSize;
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+	// Wait for the animation kernel queued by compileShaders()
+	const std::vector<unsigned int>& animSPVCode = animSPV.get();
+	spirv		= animSPVCode.empty() ? NULL : animSPVCode.data();
+	spirvSize	= animSPVCode.size() * sizeof(unsigned int);
+#else
+	void* animShaderCode = readFile("./../Animate-comp.spv", &spirvSize);
+	spirv = (uint32_t*)animShaderCode;
+#endif
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, 0);
-	vkCmdDispatch(commandBuffer, bufferSize / sizeof(int32_t), 1, 1);
+	// The drawables draw their rest vertices without the kernel, one frame at a time
+	if (!spirv) {
+		std::cout << "Animate compute shader not found, the async compute animation is off" << std::endl;
+		return;
+	}
 
-	CommandBufferMgr::endCommandBuffer(commandBuffer);
-	CommandBufferMgr::submitCommandBuffer(deviceObj->queueComupte, &commandBuffer);
+	// The drawables share the geometry, the vertices of the first one are animated for all of them
+	if (!getCommandPoolCompute()) createCommandPoolCompute();
+	asyncCompute.create(&computeContext, getCommandPoolCompute(), drawableList[0]->VertexBuffer.buf,
+		sizeof(geometryData) / sizeof(geometryData[0]), sizeof(geometryData[0]), spirv, spirvSize);
+
+#ifndef AUTO_COMPILE_GLSL_TO_SPV
+	free(animShaderCode);
+#endif
+}
+
+void VulkanRenderer::destroyAsyncCompute()
+{
+	asyncCompute.destroy();
+}
 
-	result = vkMapMemory(deviceObj->device, memory, 0, memorySize, 0, (void **)&payload); // TODO: unmap the memory
+void VulkanRenderer::compileShaders()
+{
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+	// Compiled already by a previous initialization
+	if (vertSPV.valid())
+		return;
 
-	for (uint32_t k = 0, e = bufferSize / sizeof(int32_t); k < e; k++) {
-		result =payload[k + e] == payload[k] ? VK_SUCCESS : VK_ERROR_OUT_OF_HOST_MEMORY;
-		if (k<4)
-			printf("[I:%d, C:%d],", payload[k], payload[k + e]);
+	VulkanShaderCompiler* compilerObj = VulkanShaderCompiler::GetInstance();
+	void* shaderCode;
+	size_t size;
+
+	shaderCode	= readFile("./../Texture.vert", &size);
+	vertSPV		= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_VERTEX_BIT);
+	free(shaderCode);
+
+	shaderCode	= readFile("./../Texture.frag", &size);
+	fragSPV		= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_FRAGMENT_BIT);
+	free(shaderCode);
+
+	shaderCode	= readFile("./../Compute.comp", &size);
+	compSPV		= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_COMPUTE_BIT);
+	free(shaderCode);
+
+	shaderCode	= readFile("./../Animate.comp", &size);
+	animSPV		= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_COMPUTE_BIT);
+	free(shaderCode);
+
+	// The compiler targets SPIR-V 1.0, the subgroup variants of the primitives are built offline
+	for (int kernel = 0; kernel < ComputePrimitives::KERNEL_TOTAL; kernel++) {
+		std::string fileName = std::string("./../") + ComputePrimitives::kernelNames[kernel] + ".comp";
+		shaderCode				= readFile(fileName.c_str(), &size);
+		primitivesSPV[kernel]	= compilerObj->compile((const char*)shaderCode, VK_SHADER_STAGE_COMPUTE_BIT);
+		free(shaderCode);
 	}
-	assert(result == VK_SUCCESS);
+#endif
 }
 
 void VulkanRenderer::createShaders()
@@ -1240,12 +1545,13 @@ void VulkanRenderer::createShaders()
 	shaderObj.shaderStagesVector.clear();
 
 #ifdef AUTO_COMPILE_GLSL_TO_SPV
-	vertShaderCode = readFile("./../Texture.vert", &sizeVert);
-	fragShaderCode = readFile("./../Texture.frag", &sizeFrag);
+	// Wait for the graphics stages queued by compileShaders()
+	const std::vector<unsigned int>& vertSPVCode = vertSPV.get();
+	const std::vector<unsigned int>& fragSPVCode = fragSPV.get();
+	assert(!vertSPVCode.empty() && !fragSPVCode.empty());
 
-	//shaderObj.buildShader((const char*)vertShaderCode, (const char*)fragShaderCode);
-	shaderObj.buildShader((const char*)vertShaderCode, "main", VK_SHADER_STAGE_VERTEX_BIT);
-	shaderObj.buildShader((const char*)fragShaderCode, "main", VK_SHADER_STAGE_FRAGMENT_BIT);
+	shaderObj.buildShaderModuleWithSPV((uint32_t*)vertSPVCode.data(), vertSPVCode.size() * sizeof(unsigned int), "main", VK_SHADER_STAGE_VERTEX_BIT);
+	shaderObj.buildShaderModuleWithSPV((uint32_t*)fragSPVCode.data(), fragSPVCode.size() * sizeof(unsigned int), "main", VK_SHADER_STAGE_FRAGMENT_BIT);
 #else
 	vertShaderCode = readFile("./../Texture-vert.spv", &sizeVert);
 	fragShaderCode = readFile("./../Texture-frag.spv", &sizeFrag);
@@ -25,9 +25,12 @@
 
 #version 450
 
-layout (std140, binding = 0) uniform bufferVals {	// DESCRIPTOR_SET_BINDING_INDEX
+// Per-draw data, pushed with the command buffer instead of read from a uniform buffer
+layout (push_constant) uniform PerDraw {
     mat4 mvp;
-} myBufferVals;
+    uint objectID;
+    uint materialIndex;
+} perDraw;
 
 layout (location = 0) in vec4 pos;
 layout (location = 1) in vec2 inUV;
@@ -42,7 +45,7 @@ layout (location = 6) in vec4 instanceRot;
 void main()
 {
    outUV 		 = inUV;
-   //gl_Position 	 = myBufferVals.mvp * pos;
-   gl_Position   = myBufferVals.mvp * instancePos * (pos + instanceRot);
+   //gl_Position 	 = perDraw.mvp * pos;
+   gl_Position   = perDraw.mvp * instancePos * (pos + instanceRot);
    gl_Position.z = (gl_Position.z + gl_Position.w) / 2.0;
 }
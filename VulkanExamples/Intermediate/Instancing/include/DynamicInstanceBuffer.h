@@ -0,0 +1,95 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+
+class VulkanDevice;
+
+// Device buffer of fixed size elements that the CPU updates piecewise. Writes
+// land in a CPU copy and mark their range dirty; once per frame the dirty
+// ranges are coalesced and only those bytes are uploaded, so the upload cost
+// follows what changed rather than the buffer size.
+//
+// When a memory type is both host visible and device local the buffer is
+// mapped and written directly. Otherwise the ranges are packed into a
+// persistently mapped staging ring and copied with one vkCmdCopyBuffer.
+class DynamicInstanceBuffer
+{
+public:
+	DynamicInstanceBuffer();
+	~DynamicInstanceBuffer();
+
+	// Create the buffer for 'count' elements of 'stride' bytes. 'usage' is added to
+	// the vertex buffer and transfer destination usage. The staging ring holds
+	// 'frameCount' uploads, one per frame that may be in flight.
+	void create(VulkanDevice* device, uint32_t stride, uint32_t count, VkBufferUsageFlags usage, uint32_t frameCount = 2);
+	void destroy();
+
+	// Write elements, the change reaches the device with the next recordUpload()
+	void setInstance(uint32_t index, const void* data);
+	void setInstances(uint32_t first, uint32_t count, const void* data);
+
+	bool isDirty() const { return !dirtyRanges.empty(); }
+
+	// CPU copy of an element, as last written or moved
+	const void* getInstance(uint32_t index) const { return &shadow[(size_t)index * elementStride]; }
+
+	// Apply element moves (source, destination) to the CPU copy only, for moves the
+	// device performs itself. The buffer must not be dirty.
+	void moveElements(const std::vector<std::pair<uint32_t, uint32_t> >& moves);
+
+	// Upload the dirty ranges. Returns true when commands were recorded into 'cmd',
+	// they must execute before anything reading the buffer in the same queue.
+	bool recordUpload(VkCommandBuffer cmd);
+
+	VkBuffer		getBuffer() const	{ return buffer; }
+	uint32_t		getStride() const	{ return elementStride; }
+	uint32_t		getCount() const	{ return elementCount; }
+	VkDeviceSize	getSize() const		{ return (VkDeviceSize)elementStride * elementCount; }
+	bool			isHostVisible() const { return mappedBuffer != NULL; }
+
+private:
+	// Sort and merge the dirty ranges, overlapping and adjacent ranges become one
+	void coalesceDirtyRanges();
+
+	VulkanDevice*						deviceObj;
+	uint32_t							elementStride;
+	uint32_t							elementCount;
+
+	VkBuffer							buffer;
+	VkDeviceMemory						memory;
+	uint8_t*							mappedBuffer;		// Direct mapping of 'memory', NULL when staged
+	bool								coherent;			// Direct mapping needs no explicit flush
+
+	VkBuffer							stagingBuffer;
+	VkDeviceMemory						stagingMemory;
+	uint8_t*							mappedStaging;
+	uint32_t							stagingFrameCount;
+	uint32_t							stagingFrame;		// Ring segment used by the next upload
+
+	std::vector<uint8_t>				shadow;				// CPU copy of the whole buffer
+	std::vector<std::pair<uint32_t, uint32_t> > dirtyRanges;	// Element ranges [first, end)
+};
@@ -0,0 +1,75 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+
+class VulkanDevice;
+
+// Animates the instance transforms on the GPU. A compute pass rewrites the model
+// matrix of every instance in the device local instance buffer from compact
+// parameters, so animated instances need no upload after their creation.
+class InstanceAnimator
+{
+public:
+	// Animation parameters of one instance, matches AnimationParams in Animate.comp
+	struct AnimationParams {
+		glm::vec4 position;		// xyz: position at time 0, w: orbit speed around Y in radians per second
+		glm::vec4 spin;			// xyz: spin axis, w: spin speed in radians per second.
+								// A zero axis hides the instance, used for free slots
+		uint32_t  flags;		// ANIMATION_* bits
+		uint32_t  padding[3];	// std430 rounds the struct up to its vec4 alignment
+	};
+
+	// The slot's transform is written by the CPU, the animation leaves it alone
+	static const uint32_t ANIMATION_CPU_DRIVEN = 0x1;
+
+	InstanceAnimator();
+	~InstanceAnimator();
+
+	// Create the compute pipeline from the SPIR-V of Animate.comp. Both buffers
+	// must have the storage buffer usage and hold one element per instance slot.
+	void initialize(VulkanDevice* device, VkBuffer instanceBuffer, VkBuffer paramsBuffer,
+		const uint32_t* spirv, size_t spirvSize);
+
+	// Release the pipeline
+	void destroy();
+
+	bool isInitialized() const { return pipeline != VK_NULL_HANDLE; }
+
+	// Record the update of the first 'instanceCount' transforms at 'time' seconds, outside of
+	// a render pass. A barrier after the dispatch makes them visible to the vertex input.
+	void recordDispatch(VkCommandBuffer cmd, float time, uint32_t instanceCount);
+
+private:
+	VulkanDevice*						deviceObj;
+
+	VkShaderModule						shaderModule;
+	std::vector<VkDescriptorSetLayout>	descLayout;
+	VkPipelineLayout					pipelineLayout;
+	VkDescriptorPool					descriptorPool;
+	VkDescriptorSet						descriptorSet;
+	VkPipeline							pipeline;
+};
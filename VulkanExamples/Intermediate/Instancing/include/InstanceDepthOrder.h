@@ -0,0 +1,85 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include "DynamicInstanceBuffer.h"
+
+class VulkanDevice;
+
+// Coarse front to back ordering of the instances, so the nearest cubes fill the
+// depth buffer first and the early depth test rejects the fragments behind them.
+//
+// The CPU bins the instance positions by view depth with a counting sort and
+// uploads the resulting slot order. Before the draw, the compute shader
+// Gather.comp copies the instances into a second buffer in that order, which is
+// bound as the instance vertex buffer. The slots themselves never move, so the
+// pool, the animation and the compaction keep working on the slot order.
+class InstanceDepthOrder
+{
+public:
+	InstanceDepthOrder();
+	~InstanceDepthOrder();
+
+	// Create the gather pipeline from the SPIR-V of Gather.comp for an instance buffer
+	// of 'capacity' elements of 'stride' bytes, it must have the storage buffer usage.
+	void initialize(VulkanDevice* device, VkBuffer instanceBuffer, uint32_t stride, uint32_t capacity,
+		const uint32_t* spirv, size_t spirvSize);
+	void destroy();
+
+	bool isInitialized() const { return pipeline != VK_NULL_HANDLE; }
+
+	// Order 'count' instances by the view depth of their position, nearest bin first. Positions
+	// are read as vec4 every 'stride' bytes, those with a zero w are not drawn and go last.
+	void sort(const void* positions, size_t stride, uint32_t count, const glm::mat4& modelView);
+
+	// Upload the order of the last sort, see DynamicInstanceBuffer::recordUpload()
+	bool recordUpload(VkCommandBuffer cmd) { return orderBuffer.recordUpload(cmd); }
+
+	// Record the copy of the first 'count' instances in the sorted order, outside of a render pass.
+	// A barrier after the dispatch makes them visible to the vertex input.
+	void recordGather(VkCommandBuffer cmd, uint32_t count);
+
+	// Instance buffer to draw from, in sorted order after recordGather()
+	VkBuffer getOrderedBuffer() const { return orderedBuffer; }
+
+private:
+	VulkanDevice*						deviceObj;
+	uint32_t							elementStride;
+
+	std::vector<float>					depths;
+	std::vector<uint32_t>				order;
+	DynamicInstanceBuffer				orderBuffer;		// Slot of each drawn instance
+
+	VkBuffer							orderedBuffer;
+	VkDeviceMemory						orderedMemory;
+
+	VkShaderModule						shaderModule;
+	std::vector<VkDescriptorSetLayout>	descLayout;
+	VkPipelineLayout					pipelineLayout;
+	VkDescriptorPool					descriptorPool;
+	VkDescriptorSet						descriptorSet;
+	VkPipeline							pipeline;
+};
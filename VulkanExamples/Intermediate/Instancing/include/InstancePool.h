@@ -0,0 +1,99 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include "DynamicInstanceBuffer.h"
+#include <set>
+
+class VulkanDevice;
+
+// Hands out instance slots at runtime. Handles stay valid while the instance
+// lives, whichever slot it occupies. Freed slots go to a free list ordered by
+// slot and new instances take the lowest one, so churn refills the holes and
+// the draw covers slots [0, getDrawCount()).
+//
+// Holes left behind are closed by a compaction pass: live instances above
+// the live count are moved into the holes below it by a compute shader, in
+// every attached buffer, without rebuilding them.
+class InstancePool
+{
+public:
+	typedef uint32_t Handle;
+	static const Handle INVALID_HANDLE = 0xFFFFFFFF;
+
+	InstancePool();
+	~InstancePool();
+
+	void create(VulkanDevice* device, uint32_t capacity);
+	void destroy();
+
+	// Buffers indexed by slot, kept in step by the compaction. Attach them before createCompaction().
+	void attach(DynamicInstanceBuffer* buffer);
+
+	// Create the compaction pipeline from the SPIR-V of Compact.comp, without it the holes stay
+	void createCompaction(const uint32_t* spirv, size_t spirvSize);
+
+	// Take a slot, INVALID_HANDLE when the pool is full
+	Handle add();
+	void remove(Handle handle);
+
+	bool isAlive(Handle handle) const;
+	uint32_t getSlot(Handle handle) const;
+
+	uint32_t getCapacity() const	{ return capacity; }
+	uint32_t getLiveCount() const	{ return liveCount; }
+	uint32_t getDrawCount() const	{ return drawCount; }
+
+	// Record the compaction when the holes exceed the threshold. The attached buffers
+	// must be uploaded first. Returns true when commands were recorded.
+	bool recordCompaction(VkCommandBuffer cmd);
+
+private:
+	// Handles: slot index in the low 24 bits, generation in the high 8 bits
+	static uint32_t handleIndex(Handle handle)		{ return handle & 0xFFFFFF; }
+	static uint32_t handleGeneration(Handle handle)	{ return handle >> 24; }
+
+	VulkanDevice*							deviceObj;
+	uint32_t								capacity;
+	uint32_t								liveCount;
+	uint32_t								drawCount;				// One past the highest live slot
+
+	std::vector<uint32_t>					handleSlots;			// Slot of each handle index
+	std::vector<uint8_t>					handleGenerations;
+	std::vector<uint32_t>					freeHandles;
+	std::vector<uint32_t>					slotHandles;			// Handle index of each live slot
+	std::set<uint32_t>						freeSlots;				// Holes below drawCount
+
+	std::vector<DynamicInstanceBuffer*>		buffers;
+	DynamicInstanceBuffer					moveBuffer;				// (source, destination) slot pairs
+
+	VkShaderModule							shaderModule;
+	std::vector<VkDescriptorSetLayout>		descLayout;
+	VkPipelineLayout						pipelineLayout;
+	VkDescriptorPool						descriptorPool;
+	std::vector<VkDescriptorSet>			descriptorSets;			// One per attached buffer
+	VkPipeline								pipeline;
+};
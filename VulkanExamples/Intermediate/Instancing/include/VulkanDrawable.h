@@ -27,6 +27,13 @@
 #include "Headers.h"
 #include "VulkanDescriptor.h"
 #include "Wrappers.h"
+#include "VulkanReflection.h"
+#include "InstanceAnimator.h"
+#include "DynamicInstanceBuffer.h"
+#include "InstancePool.h"
+#include "InstanceDepthOrder.h"
+#include "PipelineStatistics.h"
+#include <chrono>
 
 class VulkanRenderer;
 class VulkanDrawable : public VulkanDescriptor
@@ -41,23 +48,46 @@ public:
 	void render();
 	void update();
 
+	// Animate the instance transforms with the compute shader Animate.comp,
+	// without it the instances keep the transforms they were added with
+	void createAnimation(const uint32_t* spirv, size_t spirvSize);
+
+	// Close the holes left by removed instances with the compute shader Compact.comp
+	void createCompaction(const uint32_t* spirv, size_t spirvSize);
+
+	// Draw the instances front to back, copied into order by the compute shader Gather.comp
+	void createDepthOrder(const uint32_t* spirv, size_t spirvSize);
+	void setDepthOrder(bool enable);
+	bool getDepthOrder() const { return depthOrderEnabled; }
+
 	////////////////////////////////////////////////////
 	// Per-instance data block
 	struct InstanceData {
 		glm::mat4 MVP;
 		//glm::vec3 pos;
-		glm::vec3 rot;
+		glm::vec4 rot;			// vec4 to match the instanceRot input of the vertex shader
 		//float scale;
 		//uint32_t texIndex;
 	};
+	static_assert(sizeof(InstanceData) == 80, "InstanceData must match the std430 layout of Animate.comp");
+
+	// Per-draw data block, matches the PerDraw push constant block of Texture.vert
+	struct PushConstants {
+		glm::mat4 MVP;
+		uint32_t objectID;
+		uint32_t materialIndex;
+	} pushConstants;
 
 	// Contains the instanced data
-	struct {
-		VkBuffer buffer = VK_NULL_HANDLE;
-		VkDeviceMemory memory = VK_NULL_HANDLE;
-		size_t size = 0;
-		VkDescriptorBufferInfo descriptor;
-	} instanceBuffer;
+	DynamicInstanceBuffer instanceBuffer;
+
+	// Add and remove instances at runtime, the changes are uploaded with the next frame.
+	// Handles stay valid until removed, the handle of a full pool is INVALID_HANDLE.
+	InstancePool::Handle addInstance(const InstanceData& data, const InstanceAnimator::AnimationParams& params);
+	void removeInstance(InstancePool::Handle handle);
+
+	// Move an instance. The instance is CPU driven from then on, the compute animation no longer touches it.
+	void setInstance(InstancePool::Handle handle, const InstanceData& data);
 	////////////////////////////////////////////////////
 
 	void setPipeline(VkPipeline* vulkanPipeline) { pipeline = vulkanPipeline; }
@@ -70,6 +100,13 @@ public:
 	void createDescriptorSetLayout(bool useTexture);
 	void createPipelineLayout();
 
+	// Descriptor layouts, pool sizes, pipeline layout and vertex input
+	// are derived from the reflected shaders, set it before creating them
+	void setShaderLayout(const ShaderLayout* layout);
+
+	// True when the shaders take the per-draw data as push constants instead of the uniform buffer
+	bool usePushConstants() const { return shaderLayout && !shaderLayout->pushConstantRanges.empty(); }
+
 	void initViewports(VkCommandBuffer* cmd);
 	void initScissors(VkCommandBuffer* cmd);
 
@@ -106,12 +143,17 @@ public:
 
 private:
 	std::vector<VkCommandBuffer> vecCmdDraw;			// Command buffer for drawing
+	VkCommandBuffer	cmdInstanceUpload;					// Command buffer for the instance changes of a frame
 	void recordCommandBuffer(int currentImage, VkCommandBuffer* cmdDraw);
+	bool recordInstanceUpload(VkCommandBuffer cmd);		// Returns true when commands were recorded
+	void sortInstancesByDepth();
 	VkViewport viewport;
 	VkRect2D   scissor;
 	VkSemaphore presentCompleteSemaphore;
 	VkSemaphore drawingCompleteSemaphore;
 	TextureData* textures;
+	const ShaderLayout* shaderLayout;
+	uint32_t	vertexStride;
 
 	glm::mat4 Projection;
 	glm::mat4 View;
@@ -120,4 +162,21 @@ private:
 
 	VulkanRenderer* rendererObj;
 	VkPipeline*		pipeline;
+
+	InstancePool										instancePool;
+	DynamicInstanceBuffer								drawCommand;		// Indirect draw of the pool's slots
+	uint32_t											drawnInstances;		// Instance count in drawCommand
+
+	InstanceAnimator									animator;
+	DynamicInstanceBuffer								animationParams;	// Animation parameters of each slot
+	std::chrono::steady_clock::time_point				animationStart;
+	float												animationTime;
+
+	InstanceDepthOrder									depthOrder;
+	bool												depthOrderEnabled;
+	uint32_t											depthOrderFrame;	// Frames since the last sort
+	uint32_t											orderedCount;		// Instances covered by the last sort
+	std::vector<glm::vec4>								instancePositions;	// Positions of the slots, sort input
+
+	PipelineStatistics									statistics;			// Overdraw of the instances
 };
\ No newline at end of file
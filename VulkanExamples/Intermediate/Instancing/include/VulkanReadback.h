@@ -0,0 +1,111 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+class VulkanDevice;
+
+// Number of host visible buffers the captures rotate through
+#define READBACK_RING_SIZE 2
+
+// Asynchronous framebuffer capture. The rendered image is copied into one buffer of
+// a small ring of host visible buffers. A buffer is mapped only once the fence of its
+// copy has signaled and a background thread writes it to a PPM or KTX file, so a
+// capture never makes the frame loop wait on the GPU or on the disk.
+class VulkanReadback
+{
+public:
+	VulkanReadback();
+	~VulkanReadback();
+
+	// Must be called once the logical device is created
+	void initialize(VulkanDevice* device);
+
+	// Write the pending captures and release all the resources
+	void destroy();
+
+	// Capture the next rendered frame, the file format is taken
+	// from the file extension: ".ktx" or ".ppm" (default)
+	void requestCapture(const char* filename);
+
+	// Record and submit the copy of a rendered image if a capture is pending and a buffer
+	// of the ring is free. The copy waits on 'waitSemaphore', the returned semaphore is the
+	// one the presentation must wait on ('waitSemaphore' when nothing was captured).
+	VkSemaphore capture(VkQueue queue, VkImage image, VkFormat format, uint32_t width, uint32_t height, VkSemaphore waitSemaphore);
+
+	// Hand the finished copies to the writer thread and recycle the buffers
+	// already written. Never blocks, called once per frame.
+	void update();
+
+	// Wait until every submitted capture is written to the disk
+	void flush();
+
+private:
+	enum SlotState
+	{
+		SLOT_FREE,			// Ready for a new capture
+		SLOT_COPYING,		// Copy submitted, waiting for the fence
+		SLOT_WRITING,		// Mapped, owned by the writer thread
+		SLOT_WRITTEN		// File written, needs to be unmapped
+	};
+
+	struct ReadbackSlot
+	{
+		VkBuffer		buffer;
+		VkDeviceMemory	memory;
+		VkDeviceSize	size;				// Allocated size of the buffer
+		VkCommandBuffer	cmd;
+		VkFence			fence;
+		VkSemaphore		copyCompleteSemaphore;
+		uint8_t*		pData;				// Valid while the slot is SLOT_WRITING
+
+		uint32_t		width;
+		uint32_t		height;
+		VkFormat		format;
+		std::string		filename;
+		SlotState		state;
+	};
+
+	void createSlotBuffer(ReadbackSlot& slot, VkDeviceSize size);
+	void destroySlotBuffer(ReadbackSlot& slot);
+	void writerThreadMain();
+	static bool writeImage(const ReadbackSlot& slot);
+
+	VulkanDevice*				deviceObj;
+	VkCommandPool				cmdPool;
+	bool						isCoherent;		// Memory type of the buffers does not need invalidation
+	ReadbackSlot				slots[READBACK_RING_SIZE];
+	std::deque<std::string>		requests;		// Captures not yet recorded
+
+	std::thread					writerThread;
+	std::mutex					writerMutex;	// Guards the slot states and the writer queue
+	std::condition_variable		writerCondition;
+	std::deque<ReadbackSlot*>	writerQueue;
+	bool						writerExit;
+};
@@ -0,0 +1,84 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include <map>
+
+// Resources used by the stages of a shader program, as declared in their SPIR-V
+struct ShaderLayout
+{
+	struct DescriptorBinding
+	{
+		uint32_t			set;
+		uint32_t			binding;
+		VkDescriptorType	descriptorType;
+		uint32_t			descriptorCount;
+		VkShaderStageFlags	stageFlags;
+	};
+
+	struct VertexInput
+	{
+		uint32_t	location;
+		VkFormat	format;
+		uint32_t	size;			// Size in bytes of the attribute
+	};
+
+	std::vector<DescriptorBinding>		bindings;			// Sorted by set and binding
+	std::vector<VkPushConstantRange>	pushConstantRanges;	// One range per stage using push constants
+	std::vector<VertexInput>			vertexInputs;		// Sorted by location, matrices take one input per column
+};
+
+// Minimal SPIR-V reflection. Builds the descriptor set layouts, the pipeline layout
+// and the vertex input state from the shader modules instead of keeping hand written
+// copies in sync with the GLSL. Reflected modules are cached by the hash of their code.
+class VulkanReflection
+{
+public:
+	// Reflect one stage, asserts on malformed SPIR-V
+	static const ShaderLayout& reflect(const uint32_t* spirv, size_t spirvSize, VkShaderStageFlagBits stage);
+
+	// Add the resources of one stage to the layout of its program
+	static void merge(ShaderLayout& program, const ShaderLayout& stage);
+
+	// One descriptor set layout per set index, the sets not used by the shaders are left empty
+	static void createDescriptorSetLayouts(VkDevice device, const ShaderLayout& layout, std::vector<VkDescriptorSetLayout>& setLayouts);
+
+	static void createPipelineLayout(VkDevice device, const ShaderLayout& layout, const std::vector<VkDescriptorSetLayout>& setLayouts, VkPipelineLayout* pipelineLayout);
+
+	// Number of descriptors of each type for one descriptor set of every set layout
+	static void getDescriptorPoolSizes(const ShaderLayout& layout, std::vector<VkDescriptorPoolSize>& poolSizes);
+
+	// Vertex inputs below 'firstInstanceLocation' are read per vertex from binding 0,
+	// the others per instance from binding 1. Attributes are tightly packed in location order.
+	static void createVertexInput(const ShaderLayout& layout, uint32_t firstInstanceLocation,
+		std::vector<VkVertexInputBindingDescription>& viIpBind, std::vector<VkVertexInputAttributeDescription>& viIpAttrb);
+
+private:
+	static void parse(const uint32_t* spirv, size_t wordCount, VkShaderStageFlagBits stage, ShaderLayout& layout);
+
+	static std::map<uint64_t, ShaderLayout>	cache;
+	static std::mutex						cacheMutex;
+};
@@ -29,6 +29,7 @@
 #include "VulkanDrawable.h"
 #include "VulkanShader.h"
 #include "VulkanPipeline.h"
+#include "VulkanReadback.h"
 
 // Number of samples needs to be the same at image creation
 // Used at renderpass creation (in attachment) and pipeline creation
@@ -68,6 +69,7 @@ public:
 	inline VkCommandPool* getCommandPool()			{ return &cmdPool; }
 	inline VulkanShader*  getShader()				{ return &shaderObj; }
 	inline VulkanPipeline*	getPipelineObject()		{ return &pipelineObj; }
+	inline VulkanReadback*	getReadback()			{ return &readbackObj; }
 
 	void createCommandPool();							// Create command pool
 	void buildSwapChainAndDepthImage();					// Create swapchain color image and depth image
@@ -78,8 +80,9 @@ public:
 	void createShaders();
 	void createPipelineStateManagement();
 	void createDescriptors();
-	void createTextureLinear (const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
-	void createTextureOptimal(const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+	void createInstanceCompute();						// Compute passes animating, compacting and ordering the instances
+	void createTextureLinear (const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_UNDEFINED);
+	void createTextureOptimal(const char* filename, TextureData *texture, VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT, VkFormat format = VK_FORMAT_UNDEFINED);
 
 	void destroyCommandBuffer();
 	void destroyCommandPool();
@@ -132,4 +135,6 @@ private:
 	std::vector<VulkanDrawable*> drawableList;
 	VulkanShader 	   shaderObj;
 	VulkanPipeline 	   pipelineObj;
+	VulkanReadback	   readbackObj;		// Framebuffer captures
+	uint32_t		   captureCount;	// Number of captures requested with the keyboard
 };
\ No newline at end of file
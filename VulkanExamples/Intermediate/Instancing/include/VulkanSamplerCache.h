@@ -0,0 +1,87 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include <map>
+#include <tuple>
+
+// Samplers are not tied to any image, the textures using the same sampler state
+// share one VkSampler handle. The handles are reference counted and destroyed
+// when the last texture using them releases it. This keeps the number of
+// sampler objects under VkPhysicalDeviceLimits::maxSamplerAllocationCount.
+class VulkanSamplerCache
+{
+public:
+	VulkanSamplerCache();
+	~VulkanSamplerCache();
+
+	// Must be called once the logical device is created
+	void initialize(VkDevice device, uint32_t maxSamplerAllocationCount);
+
+	// Returns a sampler matching the create info, creating it on first use
+	VkSampler acquireSampler(const VkSamplerCreateInfo& samplerCI);
+
+	// Drop a reference, the sampler is destroyed with its last reference
+	void releaseSampler(VkSampler sampler);
+
+	// Destroy all the samplers still alive, before destroying the device
+	void destroySamplers();
+
+private:
+	// Sampler state the cache is keyed by, pNext and flags are not supported
+	struct SamplerKey
+	{
+		SamplerKey(const VkSamplerCreateInfo& samplerCI);
+		bool operator<(const SamplerKey& other) const;
+
+		VkFilter				magFilter;
+		VkFilter				minFilter;
+		VkSamplerMipmapMode		mipmapMode;
+		VkSamplerAddressMode	addressModeU;
+		VkSamplerAddressMode	addressModeV;
+		VkSamplerAddressMode	addressModeW;
+		float					mipLodBias;
+		VkBool32				anisotropyEnable;
+		float					maxAnisotropy;
+		VkBool32				compareEnable;
+		VkCompareOp				compareOp;
+		float					minLod;
+		float					maxLod;
+		VkBorderColor			borderColor;
+		VkBool32				unnormalizedCoordinates;
+	};
+
+	struct SamplerEntry
+	{
+		VkSampler	sampler;
+		uint32_t	refCount;
+	};
+
+	VkDevice							device;
+	uint32_t							maxSamplerCount;
+	std::map<SamplerKey, SamplerEntry>	samplers;
+	std::mutex							cacheMutex;		// Textures may be loaded from worker threads
+};
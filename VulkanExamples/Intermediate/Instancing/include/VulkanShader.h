@@ -25,6 +25,7 @@
 
 #pragma once
 #include "Headers.h"
+#include "VulkanReflection.h"
 
 // Shader class managing the shader conversion, compilation, linking
 class VulkanShader
@@ -59,4 +60,7 @@ public:
 
 	// Vk structure storing vertex & fragment shader information
 	VkPipelineShaderStageCreateInfo shaderStages[2];
+
+	// Descriptors, push constants and vertex inputs reflected from both stages
+	ShaderLayout layout;
 };
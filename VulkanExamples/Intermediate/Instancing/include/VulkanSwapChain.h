@@ -88,6 +88,9 @@ struct SwapChainPublicVariables
 
 	// Format of the image 
 	VkFormat format;
+
+	// Usage of the color images, includes VK_IMAGE_USAGE_TRANSFER_SRC_BIT when they can be captured
+	VkImageUsageFlags imageUsage;
 };
 
 class VulkanSwapChain{
@@ -0,0 +1,267 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DynamicInstanceBuffer.h"
+#include "VulkanDevice.h"
+#include <algorithm>
+
+DynamicInstanceBuffer::DynamicInstanceBuffer()
+{
+	deviceObj			= NULL;
+	elementStride		= 0;
+	elementCount		= 0;
+	buffer				= VK_NULL_HANDLE;
+	memory				= VK_NULL_HANDLE;
+	mappedBuffer		= NULL;
+	coherent			= false;
+	stagingBuffer		= VK_NULL_HANDLE;
+	stagingMemory		= VK_NULL_HANDLE;
+	mappedStaging		= NULL;
+	stagingFrameCount	= 0;
+	stagingFrame		= 0;
+}
+
+DynamicInstanceBuffer::~DynamicInstanceBuffer()
+{
+}
+
+void DynamicInstanceBuffer::create(VulkanDevice* device, uint32_t stride, uint32_t count, VkBufferUsageFlags usage, uint32_t frameCount)
+{
+	VkResult result;
+	bool pass;
+
+	assert(stride > 0 && count > 0 && frameCount > 0);
+	deviceObj			= device;
+	elementStride		= stride;
+	elementCount		= count;
+	stagingFrameCount	= frameCount;
+	stagingFrame		= 0;
+	shadow.assign((size_t)getSize(), 0);
+	dirtyRanges.clear();
+
+	VkBufferCreateInfo bufInfo		= {};
+	bufInfo.sType					= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufInfo.pNext					= NULL;
+	bufInfo.usage					= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage;
+	bufInfo.size					= getSize();
+	bufInfo.sharingMode				= VK_SHARING_MODE_EXCLUSIVE;
+	bufInfo.flags					= 0;
+	result = vkCreateBuffer(deviceObj->device, &bufInfo, NULL, &buffer);
+	assert(result == VK_SUCCESS);
+
+	VkMemoryRequirements memRqrmnt;
+	vkGetBufferMemoryRequirements(deviceObj->device, buffer, &memRqrmnt);
+
+	VkMemoryAllocateInfo allocInfo	= {};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext					= NULL;
+	allocInfo.allocationSize		= memRqrmnt.size;
+
+	// Prefer memory the host can write and the device reads at full speed
+	bool direct = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &allocInfo.memoryTypeIndex);
+	if (!direct) {
+		pass = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocInfo.memoryTypeIndex);
+		assert(pass);
+	}
+	result = vkAllocateMemory(deviceObj->device, &allocInfo, NULL, &memory);
+	assert(result == VK_SUCCESS);
+	result = vkBindBufferMemory(deviceObj->device, buffer, memory, 0);
+	assert(result == VK_SUCCESS);
+
+	if (direct) {
+		coherent = (deviceObj->memoryProperties.memoryTypes[allocInfo.memoryTypeIndex].propertyFlags
+			& VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+		result = vkMapMemory(deviceObj->device, memory, 0, VK_WHOLE_SIZE, 0, (void**)&mappedBuffer);
+		assert(result == VK_SUCCESS);
+		return;
+	}
+
+	// One segment of the whole buffer size per frame in flight, mapped for the lifetime
+	bufInfo.usage	= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufInfo.size	= getSize() * stagingFrameCount;
+	result = vkCreateBuffer(deviceObj->device, &bufInfo, NULL, &stagingBuffer);
+	assert(result == VK_SUCCESS);
+
+	vkGetBufferMemoryRequirements(deviceObj->device, stagingBuffer, &memRqrmnt);
+	allocInfo.allocationSize = memRqrmnt.size;
+	pass = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &allocInfo.memoryTypeIndex);
+	assert(pass);
+	result = vkAllocateMemory(deviceObj->device, &allocInfo, NULL, &stagingMemory);
+	assert(result == VK_SUCCESS);
+	result = vkBindBufferMemory(deviceObj->device, stagingBuffer, stagingMemory, 0);
+	assert(result == VK_SUCCESS);
+
+	result = vkMapMemory(deviceObj->device, stagingMemory, 0, VK_WHOLE_SIZE, 0, (void**)&mappedStaging);
+	assert(result == VK_SUCCESS);
+}
+
+void DynamicInstanceBuffer::destroy()
+{
+	if (!deviceObj) {
+		return;
+	}
+
+	if (mappedBuffer) {
+		vkUnmapMemory(deviceObj->device, memory);
+	}
+	vkDestroyBuffer(deviceObj->device, buffer, NULL);
+	vkFreeMemory(deviceObj->device, memory, NULL);
+
+	if (mappedStaging) {
+		vkUnmapMemory(deviceObj->device, stagingMemory);
+		vkDestroyBuffer(deviceObj->device, stagingBuffer, NULL);
+		vkFreeMemory(deviceObj->device, stagingMemory, NULL);
+	}
+
+	*this = DynamicInstanceBuffer();
+}
+
+void DynamicInstanceBuffer::setInstance(uint32_t index, const void* data)
+{
+	setInstances(index, 1, data);
+}
+
+void DynamicInstanceBuffer::setInstances(uint32_t first, uint32_t count, const void* data)
+{
+	assert(first + count <= elementCount);
+	if (count == 0) {
+		return;
+	}
+
+	memcpy(&shadow[(size_t)first * elementStride], data, (size_t)count * elementStride);
+
+	// Extend the last range when the writes are sequential, the common case
+	if (!dirtyRanges.empty() && first >= dirtyRanges.back().first && first <= dirtyRanges.back().second) {
+		dirtyRanges.back().second = std::max(dirtyRanges.back().second, first + count);
+		return;
+	}
+	dirtyRanges.push_back(std::make_pair(first, first + count));
+}
+
+void DynamicInstanceBuffer::moveElements(const std::vector<std::pair<uint32_t, uint32_t> >& moves)
+{
+	assert(!isDirty());
+	for (size_t i = 0; i < moves.size(); i++) {
+		assert(moves[i].first < elementCount && moves[i].second < elementCount);
+		memcpy(&shadow[(size_t)moves[i].second * elementStride], &shadow[(size_t)moves[i].first * elementStride], elementStride);
+	}
+}
+
+void DynamicInstanceBuffer::coalesceDirtyRanges()
+{
+	std::sort(dirtyRanges.begin(), dirtyRanges.end());
+
+	size_t merged = 0;
+	for (size_t i = 1; i < dirtyRanges.size(); i++) {
+		if (dirtyRanges[i].first <= dirtyRanges[merged].second) {
+			dirtyRanges[merged].second = std::max(dirtyRanges[merged].second, dirtyRanges[i].second);
+		}
+		else {
+			dirtyRanges[++merged] = dirtyRanges[i];
+		}
+	}
+	dirtyRanges.resize(merged + 1);
+}
+
+bool DynamicInstanceBuffer::recordUpload(VkCommandBuffer cmd)
+{
+	if (dirtyRanges.empty()) {
+		return false;
+	}
+
+	coalesceDirtyRanges();
+
+	// Direct path: the submission makes the host writes visible to the device
+	if (mappedBuffer) {
+		std::vector<VkMappedMemoryRange> flushRanges;
+		const VkDeviceSize atom = deviceObj->gpuProps.limits.nonCoherentAtomSize;
+
+		for (size_t i = 0; i < dirtyRanges.size(); i++) {
+			const VkDeviceSize offset	= (VkDeviceSize)dirtyRanges[i].first * elementStride;
+			const VkDeviceSize size		= (VkDeviceSize)(dirtyRanges[i].second - dirtyRanges[i].first) * elementStride;
+			memcpy(mappedBuffer + offset, &shadow[(size_t)offset], (size_t)size);
+
+			if (!coherent) {
+				// Flushed ranges must be aligned to the non coherent atom size
+				VkMappedMemoryRange range	= {};
+				range.sType					= VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+				range.memory				= memory;
+				range.offset				= offset / atom * atom;
+				range.size					= (offset + size - range.offset + atom - 1) / atom * atom;
+				if (range.offset + range.size > getSize()) {
+					range.size = VK_WHOLE_SIZE;
+				}
+				flushRanges.push_back(range);
+			}
+		}
+
+		if (!flushRanges.empty()) {
+			VkResult result = vkFlushMappedMemoryRanges(deviceObj->device, (uint32_t)flushRanges.size(), flushRanges.data());
+			assert(result == VK_SUCCESS);
+		}
+
+		dirtyRanges.clear();
+		return false;
+	}
+
+	// Staged path: pack the ranges into this frame's ring segment, one copy region each
+	const VkDeviceSize segment = getSize() * stagingFrame;
+	stagingFrame = (stagingFrame + 1) % stagingFrameCount;
+
+	std::vector<VkBufferCopy> regions(dirtyRanges.size());
+	VkDeviceSize packed = 0;
+	for (size_t i = 0; i < dirtyRanges.size(); i++) {
+		regions[i].srcOffset	= segment + packed;
+		regions[i].dstOffset	= (VkDeviceSize)dirtyRanges[i].first * elementStride;
+		regions[i].size			= (VkDeviceSize)(dirtyRanges[i].second - dirtyRanges[i].first) * elementStride;
+		memcpy(mappedStaging + regions[i].srcOffset, &shadow[(size_t)regions[i].dstOffset], (size_t)regions[i].size);
+		packed += regions[i].size;
+	}
+	dirtyRanges.clear();
+
+	// Earlier draws and compute passes must be done with the buffer
+	const VkPipelineStageFlags readerStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext			= NULL;
+	barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, readerStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	vkCmdCopyBuffer(cmd, stagingBuffer, buffer, (uint32_t)regions.size(), regions.data());
+
+	// The uploaded elements are read as draw parameters, vertex attributes or by compute shaders
+	barrier.srcAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, readerStages, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	return true;
+}
@@ -0,0 +1,168 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "InstanceAnimator.h"
+#include "VulkanDevice.h"
+#include "VulkanReflection.h"
+
+// Invocations per workgroup, local_size_x of Animate.comp
+#define ANIMATION_WORKGROUP_SIZE 64
+
+// Push constant block of Animate.comp
+struct AnimationConstants {
+	float		time;
+	uint32_t	instanceCount;
+};
+
+InstanceAnimator::InstanceAnimator()
+{
+	deviceObj		= NULL;
+	shaderModule	= VK_NULL_HANDLE;
+	pipelineLayout	= VK_NULL_HANDLE;
+	descriptorPool	= VK_NULL_HANDLE;
+	descriptorSet	= VK_NULL_HANDLE;
+	pipeline		= VK_NULL_HANDLE;
+}
+
+InstanceAnimator::~InstanceAnimator()
+{
+}
+
+void InstanceAnimator::initialize(VulkanDevice* device, VkBuffer instanceBuffer, VkBuffer paramsBuffer,
+	const uint32_t* spirv, size_t spirvSize)
+{
+	VkResult result;
+
+	deviceObj = device;
+
+	// Compute pipeline, the layouts are reflected from the shader
+	VkShaderModuleCreateInfo moduleCreateInfo = {};
+	moduleCreateInfo.sType		= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleCreateInfo.pNext		= NULL;
+	moduleCreateInfo.flags		= 0;
+	moduleCreateInfo.codeSize	= spirvSize;
+	moduleCreateInfo.pCode		= spirv;
+	result = vkCreateShaderModule(deviceObj->device, &moduleCreateInfo, NULL, &shaderModule);
+	assert(result == VK_SUCCESS);
+
+	const ShaderLayout& layout = VulkanReflection::reflect(spirv, spirvSize, VK_SHADER_STAGE_COMPUTE_BIT);
+	VulkanReflection::createDescriptorSetLayouts(deviceObj->device, layout, descLayout);
+	VulkanReflection::createPipelineLayout(deviceObj->device, layout, descLayout, &pipelineLayout);
+	assert(descLayout.size() == 1 && layout.pushConstantRanges.size() == 1);
+	assert(layout.pushConstantRanges[0].size == sizeof(AnimationConstants));
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType					= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext					= NULL;
+	pipelineInfo.flags					= 0;
+	pipelineInfo.stage.sType			= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage			= VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module			= shaderModule;
+	pipelineInfo.stage.pName			= "main";
+	pipelineInfo.layout					= pipelineLayout;
+	result = vkCreateComputePipelines(deviceObj->device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+	assert(result == VK_SUCCESS);
+
+	// Binding 0: instances, binding 1: parameters
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	VulkanReflection::getDescriptorPoolSizes(layout, poolSizes);
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.pNext			= NULL;
+	descriptorPoolCreateInfo.maxSets		= 1;
+	descriptorPoolCreateInfo.poolSizeCount	= (uint32_t)poolSizes.size();
+	descriptorPoolCreateInfo.pPoolSizes		= poolSizes.data();
+	result = vkCreateDescriptorPool(deviceObj->device, &descriptorPoolCreateInfo, NULL, &descriptorPool);
+	assert(result == VK_SUCCESS);
+
+	VkDescriptorSetAllocateInfo dsAllocInfo = {};
+	dsAllocInfo.sType				= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsAllocInfo.pNext				= NULL;
+	dsAllocInfo.descriptorPool		= descriptorPool;
+	dsAllocInfo.descriptorSetCount	= 1;
+	dsAllocInfo.pSetLayouts			= descLayout.data();
+	result = vkAllocateDescriptorSets(deviceObj->device, &dsAllocInfo, &descriptorSet);
+	assert(result == VK_SUCCESS);
+
+	VkDescriptorBufferInfo bufferInfos[2] = {
+		{ instanceBuffer,	0, VK_WHOLE_SIZE },
+		{ paramsBuffer,		0, VK_WHOLE_SIZE },
+	};
+
+	VkWriteDescriptorSet writes[2] = {};
+	for (uint32_t i = 0; i < 2; i++) {
+		writes[i].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet			= descriptorSet;
+		writes[i].dstBinding		= i;
+		writes[i].descriptorCount	= 1;
+		writes[i].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo		= &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(deviceObj->device, 2, writes, 0, NULL);
+}
+
+void InstanceAnimator::destroy()
+{
+	if (!deviceObj) {
+		return;
+	}
+
+	vkDestroyPipeline(deviceObj->device, pipeline, NULL);
+	vkDestroyDescriptorPool(deviceObj->device, descriptorPool, NULL);
+	vkDestroyPipelineLayout(deviceObj->device, pipelineLayout, NULL);
+	for (size_t i = 0; i < descLayout.size(); i++) {
+		vkDestroyDescriptorSetLayout(deviceObj->device, descLayout[i], NULL);
+	}
+	descLayout.clear();
+	vkDestroyShaderModule(deviceObj->device, shaderModule, NULL);
+
+	*this = InstanceAnimator();
+}
+
+void InstanceAnimator::recordDispatch(VkCommandBuffer cmd, float time, uint32_t instanceCount)
+{
+	// The previous frame may still read the transforms in its vertex input
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, NULL, 0, NULL, 0, NULL);
+
+	AnimationConstants constants;
+	constants.time			= time;
+	constants.instanceCount	= instanceCount;
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+	vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(cmd, (instanceCount + ANIMATION_WORKGROUP_SIZE - 1) / ANIMATION_WORKGROUP_SIZE, 1, 1);
+
+	// The transforms written by the dispatch are read as per instance vertex attributes
+	VkMemoryBarrier barrier = {};
+	barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext			= NULL;
+	barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		0, 1, &barrier, 0, NULL, 0, NULL);
+}
@@ -0,0 +1,264 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "InstanceDepthOrder.h"
+#include "VulkanDevice.h"
+#include "VulkanReflection.h"
+#include <cfloat>
+
+// Invocations per workgroup, local_size_x of Gather.comp
+#define GATHER_WORKGROUP_SIZE 64
+
+// Depth bins between the nearest and the farthest instance. The order inside a
+// bin is the slot order, a few bins are enough for the early depth test.
+#define DEPTH_BIN_COUNT 64
+
+// Push constant block of Gather.comp
+struct GatherConstants {
+	uint32_t	strideWords;
+	uint32_t	count;
+};
+
+InstanceDepthOrder::InstanceDepthOrder()
+{
+	deviceObj		= NULL;
+	elementStride	= 0;
+	orderedBuffer	= VK_NULL_HANDLE;
+	orderedMemory	= VK_NULL_HANDLE;
+	shaderModule	= VK_NULL_HANDLE;
+	pipelineLayout	= VK_NULL_HANDLE;
+	descriptorPool	= VK_NULL_HANDLE;
+	descriptorSet	= VK_NULL_HANDLE;
+	pipeline		= VK_NULL_HANDLE;
+}
+
+InstanceDepthOrder::~InstanceDepthOrder()
+{
+}
+
+void InstanceDepthOrder::initialize(VulkanDevice* device, VkBuffer instanceBuffer, uint32_t stride, uint32_t capacity,
+	const uint32_t* spirv, size_t spirvSize)
+{
+	VkResult result;
+	bool pass;
+
+	assert(stride % sizeof(uint32_t) == 0);
+	deviceObj		= device;
+	elementStride	= stride;
+
+	orderBuffer.create(deviceObj, sizeof(uint32_t), capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	// Written by the gather, read as per instance vertex attributes
+	VkBufferCreateInfo bufInfo		= {};
+	bufInfo.sType					= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufInfo.pNext					= NULL;
+	bufInfo.usage					= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	bufInfo.size					= (VkDeviceSize)stride * capacity;
+	bufInfo.sharingMode				= VK_SHARING_MODE_EXCLUSIVE;
+	bufInfo.flags					= 0;
+	result = vkCreateBuffer(deviceObj->device, &bufInfo, NULL, &orderedBuffer);
+	assert(result == VK_SUCCESS);
+
+	VkMemoryRequirements memRqrmnt;
+	vkGetBufferMemoryRequirements(deviceObj->device, orderedBuffer, &memRqrmnt);
+
+	VkMemoryAllocateInfo allocInfo	= {};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext					= NULL;
+	allocInfo.allocationSize		= memRqrmnt.size;
+	pass = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocInfo.memoryTypeIndex);
+	assert(pass);
+	result = vkAllocateMemory(deviceObj->device, &allocInfo, NULL, &orderedMemory);
+	assert(result == VK_SUCCESS);
+	result = vkBindBufferMemory(deviceObj->device, orderedBuffer, orderedMemory, 0);
+	assert(result == VK_SUCCESS);
+
+	// Compute pipeline, the layouts are reflected from the shader
+	VkShaderModuleCreateInfo moduleCreateInfo = {};
+	moduleCreateInfo.sType		= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleCreateInfo.pNext		= NULL;
+	moduleCreateInfo.flags		= 0;
+	moduleCreateInfo.codeSize	= spirvSize;
+	moduleCreateInfo.pCode		= spirv;
+	result = vkCreateShaderModule(deviceObj->device, &moduleCreateInfo, NULL, &shaderModule);
+	assert(result == VK_SUCCESS);
+
+	const ShaderLayout& layout = VulkanReflection::reflect(spirv, spirvSize, VK_SHADER_STAGE_COMPUTE_BIT);
+	VulkanReflection::createDescriptorSetLayouts(deviceObj->device, layout, descLayout);
+	VulkanReflection::createPipelineLayout(deviceObj->device, layout, descLayout, &pipelineLayout);
+	assert(descLayout.size() == 1 && layout.pushConstantRanges.size() == 1);
+	assert(layout.pushConstantRanges[0].size == sizeof(GatherConstants));
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType					= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext					= NULL;
+	pipelineInfo.flags					= 0;
+	pipelineInfo.stage.sType			= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage			= VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module			= shaderModule;
+	pipelineInfo.stage.pName			= "main";
+	pipelineInfo.layout					= pipelineLayout;
+	result = vkCreateComputePipelines(deviceObj->device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+	assert(result == VK_SUCCESS);
+
+	// Binding 0: instances in slot order, binding 1: instances in draw order, binding 2: order
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	VulkanReflection::getDescriptorPoolSizes(layout, poolSizes);
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.pNext			= NULL;
+	descriptorPoolCreateInfo.maxSets		= 1;
+	descriptorPoolCreateInfo.poolSizeCount	= (uint32_t)poolSizes.size();
+	descriptorPoolCreateInfo.pPoolSizes		= poolSizes.data();
+	result = vkCreateDescriptorPool(deviceObj->device, &descriptorPoolCreateInfo, NULL, &descriptorPool);
+	assert(result == VK_SUCCESS);
+
+	VkDescriptorSetAllocateInfo dsAllocInfo = {};
+	dsAllocInfo.sType				= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsAllocInfo.pNext				= NULL;
+	dsAllocInfo.descriptorPool		= descriptorPool;
+	dsAllocInfo.descriptorSetCount	= 1;
+	dsAllocInfo.pSetLayouts			= descLayout.data();
+	result = vkAllocateDescriptorSets(deviceObj->device, &dsAllocInfo, &descriptorSet);
+	assert(result == VK_SUCCESS);
+
+	VkDescriptorBufferInfo bufferInfos[3] = {
+		{ instanceBuffer,			0, VK_WHOLE_SIZE },
+		{ orderedBuffer,			0, VK_WHOLE_SIZE },
+		{ orderBuffer.getBuffer(),	0, VK_WHOLE_SIZE },
+	};
+
+	VkWriteDescriptorSet writes[3] = {};
+	for (uint32_t i = 0; i < 3; i++) {
+		writes[i].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet			= descriptorSet;
+		writes[i].dstBinding		= i;
+		writes[i].descriptorCount	= 1;
+		writes[i].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo		= &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(deviceObj->device, 3, writes, 0, NULL);
+}
+
+void InstanceDepthOrder::destroy()
+{
+	if (!deviceObj) {
+		return;
+	}
+
+	vkDestroyPipeline(deviceObj->device, pipeline, NULL);
+	vkDestroyDescriptorPool(deviceObj->device, descriptorPool, NULL);
+	vkDestroyPipelineLayout(deviceObj->device, pipelineLayout, NULL);
+	for (size_t i = 0; i < descLayout.size(); i++) {
+		vkDestroyDescriptorSetLayout(deviceObj->device, descLayout[i], NULL);
+	}
+	descLayout.clear();
+	vkDestroyShaderModule(deviceObj->device, shaderModule, NULL);
+
+	vkDestroyBuffer(deviceObj->device, orderedBuffer, NULL);
+	vkFreeMemory(deviceObj->device, orderedMemory, NULL);
+	orderBuffer.destroy();
+
+	*this = InstanceDepthOrder();
+}
+
+void InstanceDepthOrder::sort(const void* positions, size_t stride, uint32_t count, const glm::mat4& modelView)
+{
+	assert(count <= orderBuffer.getCount());
+	depths.resize(count);
+	order.resize(count);
+
+	// View space depth is the z row of the model view matrix, negated since the camera looks down -Z
+	const glm::vec4 depthRow(-modelView[0][2], -modelView[1][2], -modelView[2][2], -modelView[3][2]);
+
+	float nearest	= FLT_MAX;
+	float farthest	= -FLT_MAX;
+	for (uint32_t i = 0; i < count; i++) {
+		const glm::vec4& position = *(const glm::vec4*)((const uint8_t*)positions + i * stride);
+		if (position.w == 0.0f) {
+			depths[i] = FLT_MAX;
+			continue;
+		}
+		depths[i]	= glm::dot(depthRow, glm::vec4(glm::vec3(position), 1.0f));
+		nearest		= std::min(nearest, depths[i]);
+		farthest	= std::max(farthest, depths[i]);
+	}
+
+	// Counting sort on the bins, the hidden instances in an extra last bin
+	const float binScale = farthest > nearest ? DEPTH_BIN_COUNT / (farthest - nearest) : 0.0f;
+	uint32_t binOffsets[DEPTH_BIN_COUNT + 1] = {};
+	for (uint32_t i = 0; i < count; i++) {
+		const uint32_t bin = depths[i] == FLT_MAX ? DEPTH_BIN_COUNT :
+			std::min((uint32_t)((depths[i] - nearest) * binScale), (uint32_t)DEPTH_BIN_COUNT - 1);
+		binOffsets[bin]++;
+	}
+
+	uint32_t offset = 0;
+	for (uint32_t bin = 0; bin <= DEPTH_BIN_COUNT; bin++) {
+		const uint32_t binCount = binOffsets[bin];
+		binOffsets[bin] = offset;
+		offset += binCount;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		const uint32_t bin = depths[i] == FLT_MAX ? DEPTH_BIN_COUNT :
+			std::min((uint32_t)((depths[i] - nearest) * binScale), (uint32_t)DEPTH_BIN_COUNT - 1);
+		order[binOffsets[bin]++] = i;
+	}
+
+	if (count) {
+		orderBuffer.setInstances(0, count, order.data());
+	}
+}
+
+void InstanceDepthOrder::recordGather(VkCommandBuffer cmd, uint32_t count)
+{
+	// The instances and the order may have just been written by the animation, the
+	// compaction or an upload. The previous frame may still read the ordered buffer.
+	VkMemoryBarrier barrier = {};
+	barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext			= NULL;
+	barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	GatherConstants constants;
+	constants.strideWords	= elementStride / sizeof(uint32_t);
+	constants.count			= count;
+
+	const uint32_t wordCount = constants.strideWords * count;
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+	vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(cmd, (wordCount + GATHER_WORKGROUP_SIZE - 1) / GATHER_WORKGROUP_SIZE, 1, 1);
+
+	// The ordered instances are read as per instance vertex attributes
+	barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		0, 1, &barrier, 0, NULL, 0, NULL);
+}
@@ -0,0 +1,326 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "InstancePool.h"
+#include "VulkanDevice.h"
+#include "VulkanReflection.h"
+
+// Invocations per workgroup, local_size_x of Compact.comp
+#define COMPACTION_WORKGROUP_SIZE 64
+
+// Compact once the holes reach this fraction of the drawn slots
+#define COMPACTION_THRESHOLD 0.25f
+
+// Push constant block of Compact.comp
+struct CompactionConstants {
+	uint32_t	strideWords;
+	uint32_t	moveCount;
+};
+
+const InstancePool::Handle InstancePool::INVALID_HANDLE;
+
+InstancePool::InstancePool()
+{
+	deviceObj		= NULL;
+	capacity		= 0;
+	liveCount		= 0;
+	drawCount		= 0;
+	shaderModule	= VK_NULL_HANDLE;
+	pipelineLayout	= VK_NULL_HANDLE;
+	descriptorPool	= VK_NULL_HANDLE;
+	pipeline		= VK_NULL_HANDLE;
+}
+
+InstancePool::~InstancePool()
+{
+}
+
+void InstancePool::create(VulkanDevice* device, uint32_t poolCapacity)
+{
+	assert(poolCapacity > 0 && poolCapacity <= 0xFFFFFF);
+	deviceObj	= device;
+	capacity	= poolCapacity;
+	liveCount	= 0;
+	drawCount	= 0;
+
+	handleSlots.clear();
+	handleGenerations.clear();
+	freeHandles.clear();
+	slotHandles.assign(capacity, INVALID_HANDLE);
+	freeSlots.clear();
+	buffers.clear();
+
+	// At most one move per slot
+	moveBuffer.create(deviceObj, 2 * sizeof(uint32_t), capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+}
+
+void InstancePool::destroy()
+{
+	if (!deviceObj) {
+		return;
+	}
+
+	if (pipeline != VK_NULL_HANDLE) {
+		vkDestroyPipeline(deviceObj->device, pipeline, NULL);
+		vkDestroyDescriptorPool(deviceObj->device, descriptorPool, NULL);
+		vkDestroyPipelineLayout(deviceObj->device, pipelineLayout, NULL);
+		for (size_t i = 0; i < descLayout.size(); i++) {
+			vkDestroyDescriptorSetLayout(deviceObj->device, descLayout[i], NULL);
+		}
+		vkDestroyShaderModule(deviceObj->device, shaderModule, NULL);
+	}
+	moveBuffer.destroy();
+
+	*this = InstancePool();
+}
+
+void InstancePool::attach(DynamicInstanceBuffer* buffer)
+{
+	assert(pipeline == VK_NULL_HANDLE);
+	assert(buffer->getCount() >= capacity && buffer->getStride() % sizeof(uint32_t) == 0);
+	buffers.push_back(buffer);
+}
+
+void InstancePool::createCompaction(const uint32_t* spirv, size_t spirvSize)
+{
+	VkResult result;
+
+	VkShaderModuleCreateInfo moduleCreateInfo = {};
+	moduleCreateInfo.sType		= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleCreateInfo.pNext		= NULL;
+	moduleCreateInfo.flags		= 0;
+	moduleCreateInfo.codeSize	= spirvSize;
+	moduleCreateInfo.pCode		= spirv;
+	result = vkCreateShaderModule(deviceObj->device, &moduleCreateInfo, NULL, &shaderModule);
+	assert(result == VK_SUCCESS);
+
+	const ShaderLayout& layout = VulkanReflection::reflect(spirv, spirvSize, VK_SHADER_STAGE_COMPUTE_BIT);
+	VulkanReflection::createDescriptorSetLayouts(deviceObj->device, layout, descLayout);
+	VulkanReflection::createPipelineLayout(deviceObj->device, layout, descLayout, &pipelineLayout);
+	assert(descLayout.size() == 1 && layout.pushConstantRanges.size() == 1);
+	assert(layout.pushConstantRanges[0].size == sizeof(CompactionConstants));
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType					= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext					= NULL;
+	pipelineInfo.flags					= 0;
+	pipelineInfo.stage.sType			= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage			= VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module			= shaderModule;
+	pipelineInfo.stage.pName			= "main";
+	pipelineInfo.layout					= pipelineLayout;
+	result = vkCreateComputePipelines(deviceObj->device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+	assert(result == VK_SUCCESS);
+
+	// One set per attached buffer, all sharing the move list
+	const uint32_t setCount = (uint32_t)buffers.size();
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	VulkanReflection::getDescriptorPoolSizes(layout, poolSizes);
+	for (size_t i = 0; i < poolSizes.size(); i++) {
+		poolSizes[i].descriptorCount *= setCount;
+	}
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.pNext			= NULL;
+	descriptorPoolCreateInfo.maxSets		= setCount;
+	descriptorPoolCreateInfo.poolSizeCount	= (uint32_t)poolSizes.size();
+	descriptorPoolCreateInfo.pPoolSizes		= poolSizes.data();
+	result = vkCreateDescriptorPool(deviceObj->device, &descriptorPoolCreateInfo, NULL, &descriptorPool);
+	assert(result == VK_SUCCESS);
+
+	std::vector<VkDescriptorSetLayout> setLayouts(setCount, descLayout[0]);
+	descriptorSets.resize(setCount);
+
+	VkDescriptorSetAllocateInfo dsAllocInfo = {};
+	dsAllocInfo.sType				= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsAllocInfo.pNext				= NULL;
+	dsAllocInfo.descriptorPool		= descriptorPool;
+	dsAllocInfo.descriptorSetCount	= setCount;
+	dsAllocInfo.pSetLayouts			= setLayouts.data();
+	result = vkAllocateDescriptorSets(deviceObj->device, &dsAllocInfo, descriptorSets.data());
+	assert(result == VK_SUCCESS);
+
+	// Binding 0: elements, binding 1: moves
+	for (uint32_t i = 0; i < setCount; i++) {
+		VkDescriptorBufferInfo bufferInfos[2] = {
+			{ buffers[i]->getBuffer(),	0, VK_WHOLE_SIZE },
+			{ moveBuffer.getBuffer(),	0, VK_WHOLE_SIZE },
+		};
+
+		VkWriteDescriptorSet writes[2] = {};
+		for (uint32_t j = 0; j < 2; j++) {
+			writes[j].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[j].dstSet			= descriptorSets[i];
+			writes[j].dstBinding		= j;
+			writes[j].descriptorCount	= 1;
+			writes[j].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[j].pBufferInfo		= &bufferInfos[j];
+		}
+		vkUpdateDescriptorSets(deviceObj->device, 2, writes, 0, NULL);
+	}
+}
+
+InstancePool::Handle InstancePool::add()
+{
+	if (liveCount == capacity) {
+		return INVALID_HANDLE;
+	}
+
+	// Lowest hole first, keeps the live slots packed at the bottom
+	uint32_t slot;
+	if (!freeSlots.empty()) {
+		slot = *freeSlots.begin();
+		freeSlots.erase(freeSlots.begin());
+	}
+	else {
+		slot = drawCount++;
+	}
+
+	uint32_t index;
+	if (!freeHandles.empty()) {
+		index = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else {
+		index = (uint32_t)handleSlots.size();
+		handleSlots.push_back(0);
+		handleGenerations.push_back(0);
+	}
+
+	handleSlots[index]	= slot;
+	slotHandles[slot]	= index;
+	liveCount++;
+
+	return ((uint32_t)handleGenerations[index] << 24) | index;
+}
+
+void InstancePool::remove(Handle handle)
+{
+	assert(isAlive(handle));
+	const uint32_t index	= handleIndex(handle);
+	const uint32_t slot		= handleSlots[index];
+
+	// A new generation makes the old handle stale
+	handleGenerations[index]++;
+	freeHandles.push_back(index);
+	slotHandles[slot] = INVALID_HANDLE;
+	liveCount--;
+
+	// Holes at the top of the drawn range are dropped instead of kept
+	if (slot + 1 == drawCount) {
+		drawCount--;
+		while (!freeSlots.empty() && *freeSlots.rbegin() + 1 == drawCount) {
+			freeSlots.erase(--freeSlots.end());
+			drawCount--;
+		}
+	}
+	else {
+		freeSlots.insert(slot);
+	}
+}
+
+bool InstancePool::isAlive(Handle handle) const
+{
+	const uint32_t index = handleIndex(handle);
+	return handle != INVALID_HANDLE && index < handleSlots.size() &&
+		handleGenerations[index] == handleGeneration(handle) && slotHandles[handleSlots[index]] == index;
+}
+
+uint32_t InstancePool::getSlot(Handle handle) const
+{
+	assert(isAlive(handle));
+	return handleSlots[handleIndex(handle)];
+}
+
+bool InstancePool::recordCompaction(VkCommandBuffer cmd)
+{
+	if (pipeline == VK_NULL_HANDLE || freeSlots.size() < COMPACTION_THRESHOLD * drawCount) {
+		return false;
+	}
+
+	// Fill the holes below the live count with the live slots above it, the lowest
+	// hole with the highest slot. Both lists have the same length.
+	std::vector<std::pair<uint32_t, uint32_t> > moves;
+	std::vector<uint32_t> moveWords;
+	std::set<uint32_t>::const_iterator hole = freeSlots.begin();
+	uint32_t source = drawCount;
+	while (hole != freeSlots.end() && *hole < liveCount) {
+		do {
+			source--;
+		} while (slotHandles[source] == INVALID_HANDLE);
+
+		moves.push_back(std::make_pair(source, *hole));
+		moveWords.push_back(source);
+		moveWords.push_back(*hole);
+
+		handleSlots[slotHandles[source]]	= *hole;
+		slotHandles[*hole]					= slotHandles[source];
+		slotHandles[source]					= INVALID_HANDLE;
+		++hole;
+	}
+	freeSlots.clear();
+	drawCount = liveCount;
+
+	if (moves.empty()) {
+		return false;
+	}
+
+	for (size_t i = 0; i < buffers.size(); i++) {
+		buffers[i]->moveElements(moves);
+	}
+
+	moveBuffer.setInstances(0, (uint32_t)moves.size(), moveWords.data());
+	moveBuffer.recordUpload(cmd);
+
+	// The destinations may still be read by earlier draws and compute passes
+	VkMemoryBarrier barrier = {};
+	barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext			= NULL;
+	barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	for (size_t i = 0; i < buffers.size(); i++) {
+		CompactionConstants constants;
+		constants.strideWords	= buffers[i]->getStride() / sizeof(uint32_t);
+		constants.moveCount		= (uint32_t)moves.size();
+
+		const uint32_t invocations = constants.strideWords * constants.moveCount;
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[i], 0, NULL);
+		vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(cmd, (invocations + COMPACTION_WORKGROUP_SIZE - 1) / COMPACTION_WORKGROUP_SIZE, 1, 1);
+	}
+
+	// The moved elements are read as vertex attributes and by the animation
+	barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask	= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	return true;
+}
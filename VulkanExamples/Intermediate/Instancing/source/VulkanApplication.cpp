@@ -212,6 +212,7 @@ void VulkanApplication::deInitialize()
 	rendererObj->destroyCommandPool();
 	rendererObj->destroyPresentationWindow();
 	rendererObj->destroyTextureResource();
+	rendererObj->getReadback()->destroy();
 	deviceObj->destroyDevice();
 	if (debugFlag) {
 		instanceObj.layerExtension.destroyDebugReportCallback();
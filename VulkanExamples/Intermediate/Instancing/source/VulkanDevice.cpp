@@ -59,6 +59,14 @@ VkResult VulkanDevice::createDevice(std::vector<const char *>& layers, std::vect
 	VkPhysicalDeviceFeatures setEnabledFeatures = {VK_FALSE};
 	setEnabledFeatures.samplerAnisotropy = deviceFeatures.samplerAnisotropy;
 
+	// Block compressed texture formats are only usable when their feature is enabled
+	setEnabledFeatures.textureCompressionBC			= deviceFeatures.textureCompressionBC;
+	setEnabledFeatures.textureCompressionETC2		= deviceFeatures.textureCompressionETC2;
+	setEnabledFeatures.textureCompressionASTC_LDR	= deviceFeatures.textureCompressionASTC_LDR;
+
+	// Fragment shader invocation counts for the overdraw report
+	setEnabledFeatures.pipelineStatisticsQuery		= deviceFeatures.pipelineStatisticsQuery;
+
 	VkDeviceCreateInfo deviceInfo		= {};
 	deviceInfo.sType					= VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceInfo.pNext					= NULL;
@@ -73,6 +81,8 @@ VkResult VulkanDevice::createDevice(std::vector<const char *>& layers, std::vect
 	result = vkCreateDevice(*gpu, &deviceInfo, NULL, &device);
 	assert(result == VK_SUCCESS);
 
+	samplerCache.initialize(device, gpuProps.limits.maxSamplerAllocationCount);
+
 	return result;
 }
 
@@ -142,6 +152,7 @@ uint32_t VulkanDevice::getGraphicsQueueHandle()
 
 void VulkanDevice::destroyDevice()
 {
+	samplerCache.destroySamplers();
 	vkDestroyDevice(device, NULL);
 }
 
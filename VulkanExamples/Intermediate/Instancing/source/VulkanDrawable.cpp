@@ -31,6 +31,9 @@
 #define VERTEX_BUFFER_BIND_ID 0
 #define INSTANCE_BUFFER_BIND_ID 1
 #define INSTANCE_COUNT 2048*4
+#define INSTANCE_CAPACITY (INSTANCE_COUNT * 2)
+// Frames between two depth sorts of the instances, the order lags behind the animation meanwhile
+#define DEPTH_ORDER_INTERVAL 4
 #define M_PI 3.14
 
 VulkanDrawable::VulkanDrawable(VulkanRenderer* parent) {
@@ -38,6 +41,19 @@ VulkanDrawable::VulkanDrawable(VulkanRenderer* parent) {
 	memset(&UniformData, 0, sizeof(UniformData));
 	memset(&VertexBuffer, 0, sizeof(VertexBuffer));
 	rendererObj = parent;
+	shaderLayout = NULL;
+	vertexStride = 0;
+	cmdInstanceUpload = VK_NULL_HANDLE;
+	drawnInstances = 0;
+	animationTime = 0.0f;
+	animationStart = std::chrono::steady_clock::now();
+	depthOrderEnabled = true;
+	depthOrderFrame = 0;
+	orderedCount = 0xFFFFFFFF;
+
+	pushConstants.MVP			= glm::mat4(1.0f);
+	pushConstants.objectID		= 0;
+	pushConstants.materialIndex	= 0;
 
 	VkSemaphoreCreateInfo presentCompleteSemaphoreCreateInfo;
 	presentCompleteSemaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -64,6 +80,7 @@ void VulkanDrawable::destroyCommandBuffer()
 	for (int i = 0; i<vecCmdDraw.size(); i++) {
 		vkFreeCommandBuffers(deviceObj->device, rendererObj->cmdPool, 1, &vecCmdDraw[i]);
 	}
+	vkFreeCommandBuffers(deviceObj->device, rendererObj->cmdPool, 1, &cmdInstanceUpload);
 }
 
 void VulkanDrawable::destroySynchronizationObjects()
@@ -213,68 +230,22 @@ void VulkanDrawable::createVertexBuffer(const void *vertexData, uint32_t dataSiz
 	result = vkBindBufferMemory(deviceObj->device, VertexBuffer.buf, VertexBuffer.mem, 0);
 	assert(result == VK_SUCCESS);
 
-	vertices.viIpBind.resize(2);
-	// Once the buffer resource is implemented, its binding points are 
-	// stored into the(
-	// The VkVertexInputBinding viIpBind, stores the rate at which the information will be
-	// injected for vertex input.
-	vertices.viIpBind[0].binding = 0;
-	vertices.viIpBind[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-	vertices.viIpBind[0].stride = dataStride;
-
-	vertices.viIpBind[1].binding = INSTANCE_BUFFER_BIND_ID;
-	vertices.viIpBind[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
-	vertices.viIpBind[1].stride = sizeof(InstanceData);
-
-	// The VkVertexInputAttribute - Description) structure, store 
-	// the information that helps in interpreting the data.
-	vertices.viIpAttrb.resize(7);
-	vertices.viIpAttrb[0].binding	= VERTEX_BUFFER_BIND_ID;
-	vertices.viIpAttrb[0].location	= 0;
-	vertices.viIpAttrb[0].format		= VK_FORMAT_R32G32B32A32_SFLOAT;
-	vertices.viIpAttrb[0].offset		= 0;
-	vertices.viIpAttrb[1].binding	= VERTEX_BUFFER_BIND_ID;
-	vertices.viIpAttrb[1].location	= 1;
-	vertices.viIpAttrb[1].format		= useTexture ? VK_FORMAT_R32G32_SFLOAT : VK_FORMAT_R32G32B32A32_SFLOAT;
-	vertices.viIpAttrb[1].offset		= 16; // After, 4 components - RGBA  each of 4 bytes(32bits)
-
-	////////////////////////////////////////////////////////////////////////////////////
-
-	vertices.viIpAttrb[2].binding = INSTANCE_BUFFER_BIND_ID;
-	vertices.viIpAttrb[2].location = 2;
-	vertices.viIpAttrb[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	vertices.viIpAttrb[2].offset = 0;
-
-	vertices.viIpAttrb[3].binding = INSTANCE_BUFFER_BIND_ID;
-	vertices.viIpAttrb[3].location = 3;
-	vertices.viIpAttrb[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	vertices.viIpAttrb[3].offset = 16*1;
-
-	vertices.viIpAttrb[4].binding = INSTANCE_BUFFER_BIND_ID;
-	vertices.viIpAttrb[4].location = 4;
-	vertices.viIpAttrb[4].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	vertices.viIpAttrb[4].offset = 16 * 2;
-
-	vertices.viIpAttrb[5].binding = INSTANCE_BUFFER_BIND_ID;
-	vertices.viIpAttrb[5].location = 5;
-	vertices.viIpAttrb[5].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	vertices.viIpAttrb[5].offset = 16 * 3;
-
-	vertices.viIpAttrb[6].binding = INSTANCE_BUFFER_BIND_ID;
-	vertices.viIpAttrb[6].location = 6;
-	vertices.viIpAttrb[6].format = VK_FORMAT_R32G32B32_SFLOAT;
-	vertices.viIpAttrb[6].offset = 16*4;
-
-	//vertices.viIpAttrb[4].binding = INSTANCE_BUFFER_BIND_ID;
-	//vertices.viIpAttrb[4].location = 4;
-	//vertices.viIpAttrb[4].format = VK_FORMAT_R32_SFLOAT;
-	//vertices.viIpAttrb[4].offset = sizeof(float) * 6;
-
-	//vertices.viIpAttrb[5].binding = INSTANCE_BUFFER_BIND_ID;
-	//vertices.viIpAttrb[5].location = 5;
-	//vertices.viIpAttrb[5].format = VK_FORMAT_R32_SINT;
-	//vertices.viIpAttrb[5].offset = sizeof(float) * 7;
+	vertexStride = dataStride;
+}
+
+void VulkanDrawable::setShaderLayout(const ShaderLayout* layout)
+{
+	shaderLayout = layout;
 
+	// Locations 0 and 1 are the per vertex position and UV,
+	// the instance matrix and rotation follow from location 2.
+	// A shader without instance inputs leaves only the vertex binding.
+	VulkanReflection::createVertexInput(*shaderLayout, 2, vertices.viIpBind, vertices.viIpAttrb);
+	assert(vertices.viIpBind.size() == 1 || vertices.viIpBind[INSTANCE_BUFFER_BIND_ID].stride == sizeof(InstanceData));
+
+	// The vertex buffer may carry more than the shader reads
+	assert(vertices.viIpBind[VERTEX_BUFFER_BIND_ID].stride <= vertexStride);
+	vertices.viIpBind[VERTEX_BUFFER_BIND_ID].stride = vertexStride;
 }
 
 // Creates the descriptor pool, this function depends on - 
@@ -283,24 +254,17 @@ void VulkanDrawable::createDescriptorPool(bool useTexture)
 {
 	VkResult  result;
 	// Define the size of descriptor pool based on the
-	// type of descriptor set being used.
+	// type of descriptor set being used, as reflected from the shaders.
 	std::vector<VkDescriptorPoolSize> descriptorTypePool;
-
-	// The first descriptor pool object is of type Uniform buffer
-	descriptorTypePool.push_back(VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 });
-
-	// If texture is supported then define second object with 
-	// descriptor type to be Image sampler
-	if (useTexture) {
-		descriptorTypePool.push_back(VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 });
-	}
+	assert(shaderLayout);
+	VulkanReflection::getDescriptorPoolSizes(*shaderLayout, descriptorTypePool);
 
 	// Populate the descriptor pool state information
 	// in the create info structure.
 	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
 	descriptorPoolCreateInfo.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descriptorPoolCreateInfo.pNext			= NULL;
-	descriptorPoolCreateInfo.maxSets		= 1;
+	descriptorPoolCreateInfo.maxSets		= (uint32_t)descLayout.size();
 	descriptorPoolCreateInfo.flags			= VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 	descriptorPoolCreateInfo.poolSizeCount	= (uint32_t)descriptorTypePool.size();
 	descriptorPoolCreateInfo.pPoolSizes		= descriptorTypePool.data();
@@ -344,34 +308,42 @@ void VulkanDrawable::createDescriptorSet(bool useTexture)
 	// Allocate two write descriptors for - 1. MVP and 2. Texture
 	VkWriteDescriptorSet writes[2];
 	memset(&writes, 0, sizeof(writes));
-	
-	// Specify the uniform buffer related 
-	// information into first write descriptor
-	writes[0]					= {};
-	writes[0].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writes[0].pNext				= NULL;
-	writes[0].dstSet			= descriptorSet[0];
-	writes[0].descriptorCount	= 1;
-	writes[0].descriptorType	= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	writes[0].pBufferInfo		= &UniformData.bufferInfo;
-	writes[0].dstArrayElement	= 0;
-	writes[0].dstBinding		= 0; // DESCRIPTOR_SET_BINDING_INDEX
+	uint32_t writeCount = 0;
+
+	// The MVP is only read from the uniform buffer when
+	// the shaders do not take it as a push constant
+	if (!usePushConstants())
+	{
+		// Specify the uniform buffer related 
+		// information into first write descriptor
+		writes[writeCount]					= {};
+		writes[writeCount].sType			= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[writeCount].pNext			= NULL;
+		writes[writeCount].dstSet			= descriptorSet[0];
+		writes[writeCount].descriptorCount	= 1;
+		writes[writeCount].descriptorType	= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		writes[writeCount].pBufferInfo		= &UniformData.bufferInfo;
+		writes[writeCount].dstArrayElement	= 0;
+		writes[writeCount].dstBinding		= 0; // DESCRIPTOR_SET_BINDING_INDEX
+		writeCount++;
+	}
 
 	// If texture is used then update the second write descriptor structure
 	if (useTexture)
 	{
-		writes[1]					= {};
-		writes[1].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writes[1].dstSet			= descriptorSet[0];
-		writes[1].dstBinding		= 1; // DESCRIPTOR_SET_BINDING_INDEX
-		writes[1].descriptorCount	= 1;
-		writes[1].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		writes[1].pImageInfo		= &textures->descsImgInfo;
-		writes[1].dstArrayElement	= 0;
+		writes[writeCount]					= {};
+		writes[writeCount].sType			= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[writeCount].dstSet			= descriptorSet[0];
+		writes[writeCount].dstBinding		= 1; // DESCRIPTOR_SET_BINDING_INDEX
+		writes[writeCount].descriptorCount	= 1;
+		writes[writeCount].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[writeCount].pImageInfo		= &textures->descsImgInfo;
+		writes[writeCount].dstArrayElement	= 0;
+		writeCount++;
 	}
 
 	// Update the uniform buffer into the allocated descriptor set
-	vkUpdateDescriptorSets(deviceObj->device, useTexture ? 2 : 1, writes, 0, NULL);
+	vkUpdateDescriptorSets(deviceObj->device, writeCount, writes, 0, NULL);
 }
 
 void VulkanDrawable::initViewports(VkCommandBuffer* cmd)
@@ -398,6 +370,14 @@ void VulkanDrawable::destroyVertexBuffer()
 {
 	vkDestroyBuffer(rendererObj->getDevice()->device, VertexBuffer.buf, NULL);
 	vkFreeMemory(rendererObj->getDevice()->device, VertexBuffer.mem, NULL);
+
+	animator.destroy();
+	depthOrder.destroy();
+	statistics.destroy();
+	instancePool.destroy();
+	instanceBuffer.destroy();
+	animationParams.destroy();
+	drawCommand.destroy();
 }
 
 void VulkanDrawable::destroyUniformBuffer()
@@ -441,17 +421,39 @@ void VulkanDrawable::recordCommandBuffer(int currentImage, VkCommandBuffer* cmdD
 	renderPassBegin.clearValueCount				= 2;
 	renderPassBegin.pClearValues				= clearValues;
 	
+	statistics.recordReset(*cmdDraw);
+
+	// Update the instance transforms before the render pass reads them
+	if (animator.isInitialized()) {
+		animator.recordDispatch(*cmdDraw, animationTime, instancePool.getDrawCount());
+	}
+
+	// Then copy them front to back
+	const bool ordered = depthOrderEnabled && depthOrder.isInitialized();
+	if (ordered) {
+		depthOrder.recordGather(*cmdDraw, instancePool.getDrawCount());
+	}
+
 	// Start recording the render pass instance
 	vkCmdBeginRenderPass(*cmdDraw, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+	statistics.recordBegin(*cmdDraw);
 
 	// Bound the command buffer with the graphics pipeline
 	vkCmdBindPipeline(*cmdDraw, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
 	vkCmdBindDescriptorSets(*cmdDraw, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
 		0, 1, descriptorSet.data(), 0, NULL);
+
+	// Per-draw data goes straight into the command buffer, one range per stage using it
+	for (size_t i = 0; usePushConstants() && i < shaderLayout->pushConstantRanges.size(); i++) {
+		const VkPushConstantRange& range = shaderLayout->pushConstantRanges[i];
+		assert(range.offset + range.size <= sizeof(PushConstants));
+		vkCmdPushConstants(*cmdDraw, pipelineLayout, range.stageFlags, range.offset, range.size, (const uint8_t*)&pushConstants + range.offset);
+	}
 	// Bound the command buffer with the graphics pipeline
 	const VkDeviceSize offsets[1] = { 0 };
 	vkCmdBindVertexBuffers(*cmdDraw, 0, 1, &VertexBuffer.buf, offsets);
-	vkCmdBindVertexBuffers(*cmdDraw, INSTANCE_BUFFER_BIND_ID, 1, &instanceBuffer.buffer, offsets);
+	const VkBuffer instanceVertexBuffer = ordered ? depthOrder.getOrderedBuffer() : instanceBuffer.getBuffer();
+	vkCmdBindVertexBuffers(*cmdDraw, INSTANCE_BUFFER_BIND_ID, 1, &instanceVertexBuffer, offsets);
 
 	// Define the dynamic viewport here
 	initViewports(cmdDraw);
@@ -459,10 +461,12 @@ void VulkanDrawable::recordCommandBuffer(int currentImage, VkCommandBuffer* cmdD
 	// Define the scissoring 
 	initScissors(cmdDraw);
 
-	// Issue the draw command 6 faces consisting of 2 triangles each with 3 vertices.
-	vkCmdDraw(*cmdDraw, 3 * 2 * 6, INSTANCE_COUNT, 0, 0);
+	// Issue the draw command 6 faces consisting of 2 triangles each with 3 vertices,
+	// the instance count follows the pool through the indirect buffer
+	vkCmdDrawIndirect(*cmdDraw, drawCommand.getBuffer(), 0, 1, sizeof(VkDrawIndirectCommand));
 
 	// End of render pass instance recording
+	statistics.recordEnd(*cmdDraw);
 	vkCmdEndRenderPass(*cmdDraw);
 }
 
@@ -483,6 +487,9 @@ void VulkanDrawable::prepare()
 		// Finish the command buffer recording
 		CommandBufferMgr::endCommandBuffer(vecCmdDraw[i]);
 	}
+
+	// Records the instance changes of a frame, submitted ahead of the drawing
+	CommandBufferMgr::allocCommandBuffer(&deviceObj->device, *rendererObj->getCommandPool(), &cmdInstanceUpload);
 }
 
 void VulkanDrawable::update()
@@ -507,6 +514,14 @@ void VulkanDrawable::update()
 
 	glm::mat4 MVP = Projection * View * Model;
 
+	animationTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - animationStart).count();
+
+	// The push constants are recorded again with the command buffer in render()
+	if (usePushConstants()) {
+		pushConstants.MVP = MVP;
+		return;
+	}
+
 	// Invalidate the range of mapped buffer in order to make it visible to the host.
 	// If the memory property is set with VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
 	// then the driver may take care of this, otherwise for non-coherent 
@@ -541,6 +556,20 @@ void VulkanDrawable::render()
 	VkResult result = swapChainObj->fpAcquireNextImageKHR(deviceObj->device, swapChain,
 		UINT64_MAX, presentCompleteSemaphore, VK_NULL_HANDLE, &currentColorImage);
 
+	// Upload the instances changed since the last frame, only the dirty ranges are copied
+	CommandBufferMgr::beginCommandBuffer(cmdInstanceUpload);
+	bool uploaded = recordInstanceUpload(cmdInstanceUpload);
+	CommandBufferMgr::endCommandBuffer(cmdInstanceUpload);
+
+	// Push constants, the animation time and the ordered instance count live in the command buffer, record it again
+	// with this frame's values. The previous submission of this command buffer is complete, the queue was waited on.
+	if (usePushConstants() || animator.isInitialized() || depthOrder.isInitialized()) {
+		CommandBufferMgr::beginCommandBuffer(vecCmdDraw[currentColorImage]);
+		recordCommandBuffer(currentColorImage, &vecCmdDraw[currentColorImage]);
+		CommandBufferMgr::endCommandBuffer(vecCmdDraw[currentColorImage]);
+	}
+	VkCommandBuffer cmdBufs[2] = { cmdInstanceUpload, vecCmdDraw[currentColorImage] };
+
 	VkPipelineStageFlags submitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
 	VkSubmitInfo submitInfo = {};
@@ -549,13 +578,22 @@ void VulkanDrawable::render()
 	submitInfo.waitSemaphoreCount	= 1;
 	submitInfo.pWaitSemaphores		= &presentCompleteSemaphore;
 	submitInfo.pWaitDstStageMask	= &submitPipelineStages;
-	submitInfo.commandBufferCount	= (uint32_t)sizeof(&vecCmdDraw[currentColorImage]) / sizeof(VkCommandBuffer);
-	submitInfo.pCommandBuffers		= &vecCmdDraw[currentColorImage];
+	submitInfo.commandBufferCount	= uploaded ? 2 : 1;
+	submitInfo.pCommandBuffers		= uploaded ? &cmdBufs[0] : &cmdBufs[1];
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores	= &drawingCompleteSemaphore;
 
 	// Queue the command buffer for execution
 	CommandBufferMgr::submitCommandBuffer(deviceObj->queue, &vecCmdDraw[currentColorImage], &submitInfo);
+	statistics.collect(rendererObj->width * rendererObj->height, depthOrderEnabled && depthOrder.isInitialized() ? "front to back" : "slot order");
+
+	// Copy the drawing out if a capture is pending, the presentation then waits on the copy
+	VkSemaphore presentWaitSemaphore = drawingCompleteSemaphore;
+	if (swapChainObj->scPublicVars.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+		presentWaitSemaphore = rendererObj->getReadback()->capture(deviceObj->queue,
+			swapChainObj->scPublicVars.colorBuffer[currentColorImage].image, swapChainObj->scPublicVars.format,
+			rendererObj->width, rendererObj->height, drawingCompleteSemaphore);
+	}
 
 	// Present the image in the window
 	VkPresentInfoKHR present = {};
@@ -564,7 +602,7 @@ void VulkanDrawable::render()
 	present.swapchainCount		= 1;
 	present.pSwapchains			= &swapChain;
 	present.pImageIndices		= &currentColorImage;
-	present.pWaitSemaphores		= &drawingCompleteSemaphore;
+	present.pWaitSemaphores		= &presentWaitSemaphore;
 	present.waitSemaphoreCount	= 1;
 	present.pResults			= NULL;
 
@@ -575,39 +613,11 @@ void VulkanDrawable::render()
 
 void VulkanDrawable::createDescriptorSetLayout(bool useTexture)
 {
-	// Define the layout binding information for the descriptor set(before creating it)
-	// Specify binding point, shader type(like vertex shader below), count etc.
-	VkDescriptorSetLayoutBinding layoutBindings[2];
-	layoutBindings[0].binding				= 0; // DESCRIPTOR_SET_BINDING_INDEX
-	layoutBindings[0].descriptorType		= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	layoutBindings[0].descriptorCount		= 1;
-	layoutBindings[0].stageFlags			= VK_SHADER_STAGE_VERTEX_BIT;
-	layoutBindings[0].pImmutableSamplers	= NULL;
-
-	// If texture is being used then there existing second binding in the fragment shader
-	if (useTexture)
-	{
-		layoutBindings[1].binding				= 1; // DESCRIPTOR_SET_BINDING_INDEX
-		layoutBindings[1].descriptorType		= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		layoutBindings[1].descriptorCount		= 1;
-		layoutBindings[1].stageFlags			= VK_SHADER_STAGE_FRAGMENT_BIT;
-		layoutBindings[1].pImmutableSamplers	= NULL;
-	}
-
-	// Specify the layout bind into the VkDescriptorSetLayoutCreateInfo
-	// and use it to create a descriptor set layout
-	VkDescriptorSetLayoutCreateInfo descriptorLayout = {};
-	descriptorLayout.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	descriptorLayout.pNext			= NULL;
-	descriptorLayout.bindingCount	= useTexture ? 2 : 1;
-	descriptorLayout.pBindings		= layoutBindings;
-
-	VkResult  result;
-	// Allocate required number of descriptor layout objects and  
-	// create them using vkCreateDescriptorSetLayout()
-	descLayout.resize(1);
-	result = vkCreateDescriptorSetLayout(deviceObj->device, &descriptorLayout, NULL, descLayout.data());
-	assert(result == VK_SUCCESS);
+	// The layout bindings, their types and the stages using them
+	// come from the SPIR-V of the shaders instead of being hand written.
+	// The texture binding is present whenever the fragment shader samples one.
+	assert(shaderLayout);
+	VulkanReflection::createDescriptorSetLayouts(deviceObj->device, *shaderLayout, descLayout);
 }
 
 // createPipelineLayout is a virtual function from 
@@ -617,24 +627,28 @@ void VulkanDrawable::createDescriptorSetLayout(bool useTexture)
 // Creates the pipeline layout to inject into the pipeline
 void VulkanDrawable::createPipelineLayout()
 {
-	// Create the pipeline layout with the help of descriptor layout.
-	VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
-	pPipelineLayoutCreateInfo.sType						= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pPipelineLayoutCreateInfo.pNext						= NULL;
-	pPipelineLayoutCreateInfo.pushConstantRangeCount	= 0;
-	pPipelineLayoutCreateInfo.pPushConstantRanges		= NULL;
-	pPipelineLayoutCreateInfo.setLayoutCount			= (uint32_t)descLayout.size();
-	pPipelineLayoutCreateInfo.pSetLayouts				= descLayout.data();
-
-	VkResult  result;
-	result = vkCreatePipelineLayout(deviceObj->device, &pPipelineLayoutCreateInfo, NULL, &pipelineLayout);
-	assert(result == VK_SUCCESS);
+	// Create the pipeline layout with the help of descriptor layout
+	// and the push constant ranges declared by the shaders.
+	assert(shaderLayout);
+	VulkanReflection::createPipelineLayout(deviceObj->device, *shaderLayout, descLayout, &pipelineLayout);
 }
 
 void VulkanDrawable::prepareInstanceData()
 {
-	std::vector<InstanceData> instanceData;
-	instanceData.resize(INSTANCE_COUNT);
+	// Slots for the instances created here and those added at runtime. The instance
+	// buffer is also written by the compute animation and moved by the compaction.
+	instancePool.create(deviceObj, INSTANCE_CAPACITY);
+	instanceBuffer.create(deviceObj, sizeof(InstanceData), INSTANCE_CAPACITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	animationParams.create(deviceObj, sizeof(InstanceAnimator::AnimationParams), INSTANCE_CAPACITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	drawCommand.create(deviceObj, sizeof(VkDrawIndirectCommand), 1, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+	instancePool.attach(&instanceBuffer);
+	instancePool.attach(&animationParams);
+	drawnInstances = 0xFFFFFFFF;
+	orderedCount = 0xFFFFFFFF;
+	statistics.create(deviceObj);
+
+	InstanceData instanceData;
+	InstanceAnimator::AnimationParams params;
 
 	std::mt19937 rndGenerator(time(NULL));
 	std::uniform_real_distribution<double> uniformDist(0.0, 1.0);
@@ -659,138 +673,151 @@ void VulkanDrawable::prepareInstanceData()
 		glm::vec3 pos = glm::vec3(cos(theta), sin(theta), cos(phi)) * 30.0f;
 		Model = glm::translate(Model, pos);
 
-		instanceData[i].MVP = Model;
-		instanceData[i].rot = glm::vec3(1.0f, 1.0f, 1.0f);
+		instanceData.MVP = Model;
+		instanceData.rot = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+
+		// Orbit around Y at the generated position, spin around a random axis
+		glm::vec3 axis = glm::vec3(uniformDist(rndGenerator), uniformDist(rndGenerator), uniformDist(rndGenerator)) * 2.0f - 1.0f;
+		axis = glm::length(axis) > 0.001f ? glm::normalize(axis) : glm::vec3(0.0f, 1.0f, 0.0f);
+		params.position	= glm::vec4(pos, 0.1f + 0.4f * (float)uniformDist(rndGenerator));
+		params.spin		= glm::vec4(axis, 0.5f + 2.0f * (float)uniformDist(rndGenerator));
+		params.flags	= 0;
+
+		addInstance(instanceData, params);
 	}
-	instanceBuffer.size = instanceData.size() * sizeof(InstanceData);
 
-	// Staging
-	// Instanced data is static, copy to device local memory 
-	// This results in better performance
+	// Initial upload of all the instances
+	VkCommandBuffer copyCmd;
+	CommandBufferMgr::allocCommandBuffer(&deviceObj->device, *rendererObj->getCommandPool(), &copyCmd);
+	CommandBufferMgr::beginCommandBuffer(copyCmd);
+	recordInstanceUpload(copyCmd);
+	CommandBufferMgr::endCommandBuffer(copyCmd);
+	CommandBufferMgr::submitCommandBuffer(deviceObj->queue, &copyCmd);
+	vkFreeCommandBuffers(deviceObj->device, *rendererObj->getCommandPool(), 1, &copyCmd);
+}
+
+InstancePool::Handle VulkanDrawable::addInstance(const InstanceData& data, const InstanceAnimator::AnimationParams& params)
+{
+	InstancePool::Handle handle = instancePool.add();
+	if (handle == InstancePool::INVALID_HANDLE) {
+		return handle;
+	}
 
-	struct {
-		VkDeviceMemory memory;
-		VkBuffer buffer;
-	} stagingBuffer;
+	const uint32_t slot = instancePool.getSlot(handle);
+	instanceBuffer.setInstance(slot, &data);
+	animationParams.setInstance(slot, &params);
+	return handle;
+}
 
-	//////////////////////////////////////// 1.
-	{
-		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAllocInfo = {};
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memAllocInfo.pNext = NULL;
-		memAllocInfo.allocationSize = 0;
-		memAllocInfo.memoryTypeIndex = 0;
-
-		VkMemoryAllocateInfo memAlloc = memAllocInfo;
-
-		VkBufferCreateInfo bufCreateInfo = {};
-		bufCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufCreateInfo.pNext = NULL;
-		bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufCreateInfo.size = instanceBuffer.size;
-		bufCreateInfo.flags = 0;
-		VkBufferCreateInfo bufferCreateInfo = bufCreateInfo;
-		VkResult result = vkCreateBuffer(deviceObj->device, &bufferCreateInfo, nullptr, &stagingBuffer.buffer);
-
-		vkGetBufferMemoryRequirements(deviceObj->device, stagingBuffer.buffer, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		// Get the compatible type of memory
-		deviceObj->memoryTypeFromProperties(memReqs.memoryTypeBits,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &memAlloc.memoryTypeIndex);
-
-		//memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-		result = vkAllocateMemory(deviceObj->device, &memAlloc, nullptr, &stagingBuffer.memory);
-		if (instanceData.data() != nullptr)
-		{
-			void *mapped;
-			vkMapMemory(deviceObj->device, stagingBuffer.memory, 0, instanceBuffer.size, 0, &mapped);
-			memcpy(mapped, instanceData.data(), instanceBuffer.size);
-			vkUnmapMemory(deviceObj->device, stagingBuffer.memory);
-		}
-		result = vkBindBufferMemory(deviceObj->device, stagingBuffer.buffer, stagingBuffer.memory, 0);
+void VulkanDrawable::setInstance(InstancePool::Handle handle, const InstanceData& data)
+{
+	// Flag the slot so Animate.comp stops overwriting the transform, both reach the GPU with the next upload
+	const uint32_t slot = instancePool.getSlot(handle);
+	InstanceAnimator::AnimationParams params = *(const InstanceAnimator::AnimationParams*)animationParams.getInstance(slot);
+	params.flags |= InstanceAnimator::ANIMATION_CPU_DRIVEN;
+
+	instanceBuffer.setInstance(slot, &data);
+	animationParams.setInstance(slot, &params);
+}
+
+void VulkanDrawable::removeInstance(InstancePool::Handle handle)
+{
+	// The slot stays drawn until it is reused or compacted away, hide it meanwhile:
+	// a zero matrix collapses the instance and a zero spin axis keeps the animation off it
+	InstanceData hidden;
+	hidden.MVP = glm::mat4(0.0f);
+	hidden.rot = glm::vec4(0.0f);
+
+	InstanceAnimator::AnimationParams hiddenParams;
+	hiddenParams.position	= glm::vec4(0.0f);
+	hiddenParams.spin		= glm::vec4(0.0f);
+	hiddenParams.flags		= 0;
+
+	const uint32_t slot = instancePool.getSlot(handle);
+	instanceBuffer.setInstance(slot, &hidden);
+	animationParams.setInstance(slot, &hiddenParams);
+	instancePool.remove(handle);
+}
+
+bool VulkanDrawable::recordInstanceUpload(VkCommandBuffer cmd)
+{
+	bool recorded = instanceBuffer.recordUpload(cmd);
+	recorded = animationParams.recordUpload(cmd) || recorded;
+
+	// Compact once the uploads are recorded, the moves apply to the uploaded data
+	const bool compacted = instancePool.recordCompaction(cmd);
+	recorded = compacted || recorded;
+
+	// The draw covers the slots up to the highest live one
+	if (drawnInstances != instancePool.getDrawCount()) {
+		drawnInstances = instancePool.getDrawCount();
+
+		VkDrawIndirectCommand draw;
+		draw.vertexCount	= 3 * 2 * 6;
+		draw.instanceCount	= drawnInstances;
+		draw.firstVertex	= 0;
+		draw.firstInstance	= 0;
+		drawCommand.setInstance(0, &draw);
 	}
-	////////////////////////////////////////////// 1.
-
-	//
-	//	VulkanExampleBase::createBuffer(
-	//		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-	//		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-	//		instanceBuffer.size,
-	//		nullptr,
-	//		&instanceBuffer.buffer,
-	//		&instanceBuffer.memory);
-	//
-	//////////////////////////////////////// 2.
-	{
-		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAllocInfo = {};
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memAllocInfo.pNext = NULL;
-		memAllocInfo.allocationSize = 0;
-		memAllocInfo.memoryTypeIndex = 0;
-
-		VkMemoryAllocateInfo memAlloc = memAllocInfo;
-
-		VkBufferCreateInfo bufCreateInfo = {};
-		bufCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufCreateInfo.pNext = NULL;
-		bufCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-		bufCreateInfo.size = instanceBuffer.size;
-		bufCreateInfo.flags = 0;
-		VkBufferCreateInfo bufferCreateInfo = bufCreateInfo;
-
-		vkCreateBuffer(deviceObj->device, &bufferCreateInfo, nullptr, &instanceBuffer.buffer);
-
-		vkGetBufferMemoryRequirements(deviceObj->device, instanceBuffer.buffer, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		// Get the compatible type of memory
-		deviceObj->memoryTypeFromProperties(memReqs.memoryTypeBits,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memAlloc.memoryTypeIndex);
-
-		//memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-		vkAllocateMemory(deviceObj->device, &memAlloc, nullptr, &instanceBuffer.memory);
-		// no unmapping 
-		//if (instanceData.data() != nullptr)
-		//{
-		//	void *mapped;
-		//	vkMapMemory(deviceObj->device, instanceBuffer.memory, 0, instanceBuffer.size, 0, &mapped);
-		//	memcpy(mapped, instanceData.data(), instanceBuffer.size);
-		//	vkUnmapMemory(deviceObj->device, instanceBuffer.memory);
-		//}
-		vkBindBufferMemory(deviceObj->device, instanceBuffer.buffer, instanceBuffer.memory, 0);
+	recorded = drawCommand.recordUpload(cmd) || recorded;
+
+	// The order names slots, sort again as soon as they moved or the drawn range changed
+	if (depthOrderEnabled && depthOrder.isInitialized()) {
+		if (compacted || orderedCount != drawnInstances || ++depthOrderFrame >= DEPTH_ORDER_INTERVAL) {
+			sortInstancesByDepth();
+		}
+		recorded = depthOrder.recordUpload(cmd) || recorded;
 	}
-	////////////////////////////////////////////// 2.
 
-	// Copy to staging buffer
-	VkCommandBuffer copyCmd;
+	return recorded;
+}
 
-	CommandBufferMgr::allocCommandBuffer(&deviceObj->device, *rendererObj->getCommandPool(), &copyCmd);
-	CommandBufferMgr::beginCommandBuffer(copyCmd);
+void VulkanDrawable::sortInstancesByDepth()
+{
+	const uint32_t count = instancePool.getDrawCount();
+	instancePositions.resize(count);
+
+	for (uint32_t slot = 0; slot < count; slot++) {
+		glm::vec4& position = instancePositions[slot];
+		const InstanceAnimator::AnimationParams& params = *(const InstanceAnimator::AnimationParams*)animationParams.getInstance(slot);
+		if (animator.isInitialized() && !(params.flags & InstanceAnimator::ANIMATION_CPU_DRIVEN)) {
+			// Where Animate.comp puts the slot this frame, a zero spin axis marks a free slot
+			const float orbit	= params.position.w * animationTime;
+			const float c		= cosf(orbit);
+			const float s		= sinf(orbit);
+			position = glm::vec4(c * params.position.x + s * params.position.z, params.position.y,
+				c * params.position.z - s * params.position.x, glm::vec3(params.spin) == glm::vec3(0.0f) ? 0.0f : 1.0f);
+		}
+		else {
+			// Translation of the instance matrix, removed instances have a zero matrix
+			position = ((const InstanceData*)instanceBuffer.getInstance(slot))->MVP[3];
+		}
+	}
 
-	VkBufferCopy copyRegion = {};
-	copyRegion.size = instanceBuffer.size;
-	vkCmdCopyBuffer(
-		copyCmd,
-		stagingBuffer.buffer,
-		instanceBuffer.buffer,
-		1,
-		&copyRegion);
+	depthOrder.sort(instancePositions.data(), sizeof(glm::vec4), count, View * Model);
+	orderedCount	= count;
+	depthOrderFrame	= 0;
+}
 
-	// Finish the command buffer recording
-	CommandBufferMgr::endCommandBuffer(copyCmd);
+void VulkanDrawable::setDepthOrder(bool enable)
+{
+	// Sort on the next frame, the last order may be stale
+	depthOrderEnabled	= enable;
+	orderedCount		= 0xFFFFFFFF;
+}
 
-	CommandBufferMgr::submitCommandBuffer(deviceObj->queue, &copyCmd);
+void VulkanDrawable::createAnimation(const uint32_t* spirv, size_t spirvSize)
+{
+	animator.initialize(deviceObj, instanceBuffer.getBuffer(), animationParams.getBuffer(), spirv, spirvSize);
+}
 
-	//vkFreeCommandBuffers(deviceObj->device, rendererObj->cmdPool, 1, &copyCmd);
-	//
-	//	VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
-	//
-	instanceBuffer.descriptor.range = instanceBuffer.size;
-	instanceBuffer.descriptor.buffer = instanceBuffer.buffer;
-	instanceBuffer.descriptor.offset = 0;
-
-	// Destroy staging resources
-	vkDestroyBuffer(deviceObj->device, stagingBuffer.buffer, nullptr);
-	vkFreeMemory(deviceObj->device, stagingBuffer.memory, nullptr);
-}
\ No newline at end of file
+void VulkanDrawable::createCompaction(const uint32_t* spirv, size_t spirvSize)
+{
+	instancePool.createCompaction(spirv, spirvSize);
+}
+
+void VulkanDrawable::createDepthOrder(const uint32_t* spirv, size_t spirvSize)
+{
+	depthOrder.initialize(deviceObj, instanceBuffer.getBuffer(), sizeof(InstanceData), INSTANCE_CAPACITY, spirv, spirvSize);
+	orderedCount = 0xFFFFFFFF;
+}
@@ -0,0 +1,441 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "VulkanReadback.h"
+#include "VulkanDevice.h"
+#include "Wrappers.h"
+
+VulkanReadback::VulkanReadback()
+{
+	deviceObj	= NULL;
+	cmdPool		= VK_NULL_HANDLE;
+	isCoherent	= false;
+	writerExit	= false;
+	for (int i = 0; i < READBACK_RING_SIZE; i++) {
+		slots[i].buffer					= VK_NULL_HANDLE;
+		slots[i].memory					= VK_NULL_HANDLE;
+		slots[i].size					= 0;
+		slots[i].cmd					= VK_NULL_HANDLE;
+		slots[i].fence					= VK_NULL_HANDLE;
+		slots[i].copyCompleteSemaphore	= VK_NULL_HANDLE;
+		slots[i].pData					= NULL;
+		slots[i].state					= SLOT_FREE;
+	}
+}
+
+VulkanReadback::~VulkanReadback()
+{
+}
+
+void VulkanReadback::initialize(VulkanDevice* device)
+{
+	VkResult result;
+	deviceObj = device;
+
+	// The copy command buffers are re-recorded for every capture
+	VkCommandPoolCreateInfo cmdPoolInfo = {};
+	cmdPoolInfo.sType				= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmdPoolInfo.pNext				= NULL;
+	cmdPoolInfo.queueFamilyIndex	= deviceObj->graphicsQueueWithPresentIndex;
+	cmdPoolInfo.flags				= VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	result = vkCreateCommandPool(deviceObj->device, &cmdPoolInfo, NULL, &cmdPool);
+	assert(result == VK_SUCCESS);
+
+	VkFenceCreateInfo fenceCI = {};
+	fenceCI.sType	= VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCI.pNext	= NULL;
+	fenceCI.flags	= 0;
+
+	VkSemaphoreCreateInfo semaphoreCI = {};
+	semaphoreCI.sType	= VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCI.pNext	= NULL;
+	semaphoreCI.flags	= 0;
+
+	for (int i = 0; i < READBACK_RING_SIZE; i++) {
+		CommandBufferMgr::allocCommandBuffer(&deviceObj->device, cmdPool, &slots[i].cmd);
+
+		result = vkCreateFence(deviceObj->device, &fenceCI, NULL, &slots[i].fence);
+		assert(result == VK_SUCCESS);
+
+		result = vkCreateSemaphore(deviceObj->device, &semaphoreCI, NULL, &slots[i].copyCompleteSemaphore);
+		assert(result == VK_SUCCESS);
+	}
+
+	writerExit		= false;
+	writerThread	= std::thread(&VulkanReadback::writerThreadMain, this);
+}
+
+void VulkanReadback::destroy()
+{
+	if (!deviceObj) {
+		return;
+	}
+
+	flush();
+
+	{
+		std::lock_guard<std::mutex> lock(writerMutex);
+		writerExit = true;
+	}
+	writerCondition.notify_one();
+	writerThread.join();
+
+	for (int i = 0; i < READBACK_RING_SIZE; i++) {
+		destroySlotBuffer(slots[i]);
+		vkFreeCommandBuffers(deviceObj->device, cmdPool, 1, &slots[i].cmd);
+		vkDestroyFence(deviceObj->device, slots[i].fence, NULL);
+		vkDestroySemaphore(deviceObj->device, slots[i].copyCompleteSemaphore, NULL);
+	}
+
+	vkDestroyCommandPool(deviceObj->device, cmdPool, NULL);
+	cmdPool		= VK_NULL_HANDLE;
+	deviceObj	= NULL;
+}
+
+void VulkanReadback::requestCapture(const char* filename)
+{
+	requests.push_back(filename);
+}
+
+void VulkanReadback::createSlotBuffer(ReadbackSlot& slot, VkDeviceSize size)
+{
+	VkResult result;
+
+	VkBufferCreateInfo bufInfo = {};
+	bufInfo.sType					= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufInfo.pNext					= NULL;
+	bufInfo.usage					= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufInfo.size					= size;
+	bufInfo.queueFamilyIndexCount	= 0;
+	bufInfo.pQueueFamilyIndices		= NULL;
+	bufInfo.sharingMode				= VK_SHARING_MODE_EXCLUSIVE;
+	bufInfo.flags					= 0;
+
+	result = vkCreateBuffer(deviceObj->device, &bufInfo, NULL, &slot.buffer);
+	assert(result == VK_SUCCESS);
+
+	VkMemoryRequirements memRqrmnt;
+	vkGetBufferMemoryRequirements(deviceObj->device, slot.buffer, &memRqrmnt);
+
+	VkMemoryAllocateInfo memAllocInfo = {};
+	memAllocInfo.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memAllocInfo.pNext				= NULL;
+	memAllocInfo.memoryTypeIndex	= 0;
+	memAllocInfo.allocationSize		= memRqrmnt.size;
+
+	// The host reads the whole image, cached memory makes it much faster than
+	// write combined memory. Fall back on any host visible memory type.
+	bool pass = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &memAllocInfo.memoryTypeIndex);
+	if (!pass) {
+		pass = deviceObj->memoryTypeFromProperties(memRqrmnt.memoryTypeBits,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &memAllocInfo.memoryTypeIndex);
+	}
+	assert(pass);
+
+	isCoherent = (deviceObj->memoryProperties.memoryTypes[memAllocInfo.memoryTypeIndex].propertyFlags
+		& VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	result = vkAllocateMemory(deviceObj->device, &memAllocInfo, NULL, &slot.memory);
+	assert(result == VK_SUCCESS);
+
+	result = vkBindBufferMemory(deviceObj->device, slot.buffer, slot.memory, 0);
+	assert(result == VK_SUCCESS);
+
+	slot.size = size;
+}
+
+void VulkanReadback::destroySlotBuffer(ReadbackSlot& slot)
+{
+	if (slot.buffer == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkDestroyBuffer(deviceObj->device, slot.buffer, NULL);
+	vkFreeMemory(deviceObj->device, slot.memory, NULL);
+	slot.buffer	= VK_NULL_HANDLE;
+	slot.memory	= VK_NULL_HANDLE;
+	slot.size	= 0;
+}
+
+VkSemaphore VulkanReadback::capture(VkQueue queue, VkImage image, VkFormat format, uint32_t width, uint32_t height, VkSemaphore waitSemaphore)
+{
+	if (requests.empty()) {
+		return waitSemaphore;
+	}
+
+	if (format != VK_FORMAT_B8G8R8A8_UNORM && format != VK_FORMAT_B8G8R8A8_SRGB &&
+		format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB) {
+		std::cout << "Capture of the swapchain format " << format << " is not supported" << std::endl;
+		requests.clear();
+		return waitSemaphore;
+	}
+
+	// Find a free buffer, when the ring is full the request waits for a later frame
+	ReadbackSlot* slot = NULL;
+	{
+		std::lock_guard<std::mutex> lock(writerMutex);
+		for (int i = 0; i < READBACK_RING_SIZE && !slot; i++) {
+			if (slots[i].state == SLOT_FREE) {
+				slot = &slots[i];
+			}
+		}
+	}
+	if (!slot) {
+		return waitSemaphore;
+	}
+
+	const VkDeviceSize size = VkDeviceSize(width) * height * 4;
+	if (slot->size < size) {
+		destroySlotBuffer(*slot);
+		createSlotBuffer(*slot, size);
+	}
+
+	slot->width		= width;
+	slot->height	= height;
+	slot->format	= format;
+	slot->filename	= requests.front();
+	requests.pop_front();
+
+	VkResult result = vkResetCommandBuffer(slot->cmd, 0);
+	assert(result == VK_SUCCESS);
+	CommandBufferMgr::beginCommandBuffer(slot->cmd);
+
+	// The render pass leaves the image ready for the presentation,
+	// make it a transfer source for the time of the copy.
+	VkImageMemoryBarrier imgBarrier = {};
+	imgBarrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imgBarrier.pNext							= NULL;
+	imgBarrier.srcAccessMask					= 0;
+	imgBarrier.dstAccessMask					= VK_ACCESS_TRANSFER_READ_BIT;
+	imgBarrier.oldLayout						= VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	imgBarrier.newLayout						= VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imgBarrier.srcQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+	imgBarrier.dstQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+	imgBarrier.image							= image;
+	imgBarrier.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	imgBarrier.subresourceRange.baseMipLevel	= 0;
+	imgBarrier.subresourceRange.levelCount		= 1;
+	imgBarrier.subresourceRange.baseArrayLayer	= 0;
+	imgBarrier.subresourceRange.layerCount		= 1;
+	vkCmdPipelineBarrier(slot->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, NULL, 0, NULL, 1, &imgBarrier);
+
+	VkBufferImageCopy copyRegion = {};
+	copyRegion.bufferOffset						= 0;
+	copyRegion.bufferRowLength					= 0;	// Tightly packed rows
+	copyRegion.bufferImageHeight				= 0;
+	copyRegion.imageSubresource.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	copyRegion.imageSubresource.mipLevel		= 0;
+	copyRegion.imageSubresource.baseArrayLayer	= 0;
+	copyRegion.imageSubresource.layerCount		= 1;
+	copyRegion.imageOffset.x					= 0;
+	copyRegion.imageOffset.y					= 0;
+	copyRegion.imageOffset.z					= 0;
+	copyRegion.imageExtent.width				= width;
+	copyRegion.imageExtent.height				= height;
+	copyRegion.imageExtent.depth				= 1;
+	vkCmdCopyImageToBuffer(slot->cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &copyRegion);
+
+	// Give the image back to the presentation engine
+	imgBarrier.srcAccessMask	= VK_ACCESS_TRANSFER_READ_BIT;
+	imgBarrier.dstAccessMask	= VK_ACCESS_MEMORY_READ_BIT;
+	imgBarrier.oldLayout		= VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imgBarrier.newLayout		= VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	// Make the copied texels visible to the host reads
+	VkBufferMemoryBarrier bufBarrier = {};
+	bufBarrier.sType				= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufBarrier.pNext				= NULL;
+	bufBarrier.srcAccessMask		= VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufBarrier.dstAccessMask		= VK_ACCESS_HOST_READ_BIT;
+	bufBarrier.srcQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	bufBarrier.dstQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	bufBarrier.buffer				= slot->buffer;
+	bufBarrier.offset				= 0;
+	bufBarrier.size					= size;
+	vkCmdPipelineBarrier(slot->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 0, NULL, 1, &bufBarrier, 1, &imgBarrier);
+
+	CommandBufferMgr::endCommandBuffer(slot->cmd);
+
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType				= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext				= NULL;
+	submitInfo.waitSemaphoreCount	= 1;
+	submitInfo.pWaitSemaphores		= &waitSemaphore;
+	submitInfo.pWaitDstStageMask	= &waitStage;
+	submitInfo.commandBufferCount	= 1;
+	submitInfo.pCommandBuffers		= &slot->cmd;
+	submitInfo.signalSemaphoreCount	= 1;
+	submitInfo.pSignalSemaphores	= &slot->copyCompleteSemaphore;
+
+	// The fence is only polled, see update()
+	result = vkQueueSubmit(queue, 1, &submitInfo, slot->fence);
+	assert(result == VK_SUCCESS);
+
+	std::lock_guard<std::mutex> lock(writerMutex);
+	slot->state = SLOT_COPYING;
+	return slot->copyCompleteSemaphore;
+}
+
+void VulkanReadback::update()
+{
+	bool hasWork = false;
+	{
+		std::lock_guard<std::mutex> lock(writerMutex);
+		for (int i = 0; i < READBACK_RING_SIZE; i++) {
+			ReadbackSlot& slot = slots[i];
+
+			if (slot.state == SLOT_WRITTEN) {
+				vkUnmapMemory(deviceObj->device, slot.memory);
+				vkResetFences(deviceObj->device, 1, &slot.fence);
+				slot.pData = NULL;
+				slot.state = SLOT_FREE;
+			}
+			else if (slot.state == SLOT_COPYING && vkGetFenceStatus(deviceObj->device, slot.fence) == VK_SUCCESS) {
+				VkResult result = vkMapMemory(deviceObj->device, slot.memory, 0, VK_WHOLE_SIZE, 0, (void **)&slot.pData);
+				assert(result == VK_SUCCESS);
+
+				if (!isCoherent) {
+					VkMappedMemoryRange range = {};
+					range.sType		= VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+					range.pNext		= NULL;
+					range.memory	= slot.memory;
+					range.offset	= 0;
+					range.size		= VK_WHOLE_SIZE;
+					result = vkInvalidateMappedMemoryRanges(deviceObj->device, 1, &range);
+					assert(result == VK_SUCCESS);
+				}
+
+				slot.state = SLOT_WRITING;
+				writerQueue.push_back(&slot);
+				hasWork = true;
+			}
+		}
+	}
+
+	if (hasWork) {
+		writerCondition.notify_one();
+	}
+}
+
+void VulkanReadback::flush()
+{
+	requests.clear();
+
+	for (int i = 0; i < READBACK_RING_SIZE; i++) {
+		bool isCopying;
+		{
+			std::lock_guard<std::mutex> lock(writerMutex);
+			isCopying = slots[i].state == SLOT_COPYING;
+		}
+		if (isCopying) {
+			VkResult result = vkWaitForFences(deviceObj->device, 1, &slots[i].fence, VK_TRUE, UINT64_MAX);
+			assert(result == VK_SUCCESS);
+		}
+	}
+	update();
+
+	{
+		std::unique_lock<std::mutex> lock(writerMutex);
+		writerCondition.wait(lock, [this]() {
+			for (int i = 0; i < READBACK_RING_SIZE; i++) {
+				if (slots[i].state == SLOT_WRITING) return false;
+			}
+			return true;
+		});
+	}
+	update();
+}
+
+void VulkanReadback::writerThreadMain()
+{
+	std::unique_lock<std::mutex> lock(writerMutex);
+	for (;;) {
+		writerCondition.wait(lock, [this]() { return writerExit || !writerQueue.empty(); });
+		if (writerQueue.empty()) {
+			return;
+		}
+
+		ReadbackSlot* slot = writerQueue.front();
+		writerQueue.pop_front();
+
+		// The slot is owned by this thread until it is marked written
+		lock.unlock();
+		if (!writeImage(*slot)) {
+			std::cout << "Unable to write the capture " << slot->filename << std::endl;
+		}
+		lock.lock();
+
+		slot->state = SLOT_WRITTEN;
+		writerCondition.notify_all();
+	}
+}
+
+bool VulkanReadback::writeImage(const ReadbackSlot& slot)
+{
+	const bool isBGRA = slot.format == VK_FORMAT_B8G8R8A8_UNORM || slot.format == VK_FORMAT_B8G8R8A8_SRGB;
+	const bool isSRGB = slot.format == VK_FORMAT_B8G8R8A8_SRGB || slot.format == VK_FORMAT_R8G8B8A8_SRGB;
+	const uint8_t* src = slot.pData;
+	const size_t texelCount = size_t(slot.width) * slot.height;
+
+	const size_t length = slot.filename.length();
+	if (length > 4 && slot.filename.compare(length - 4, 4, ".ktx") == 0)
+	{
+		gli::texture2D image2D(isSRGB ? gli::FORMAT_RGBA8_SRGB : gli::FORMAT_RGBA8_UNORM, gli::texture2D::dim_type(slot.width, slot.height), 1);
+		uint8_t* dst = (uint8_t*)image2D.data();
+		for (size_t i = 0; i < texelCount; i++) {
+			dst[i * 4 + 0] = src[i * 4 + (isBGRA ? 2 : 0)];
+			dst[i * 4 + 1] = src[i * 4 + 1];
+			dst[i * 4 + 2] = src[i * 4 + (isBGRA ? 0 : 2)];
+			dst[i * 4 + 3] = src[i * 4 + 3];
+		}
+		return gli::save_ktx(image2D, slot.filename.c_str());
+	}
+
+	FILE* fp = fopen(slot.filename.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+
+	fprintf(fp, "P6\n%u %u\n255\n", slot.width, slot.height);
+	std::vector<uint8_t> row(slot.width * 3);
+	for (uint32_t y = 0; y < slot.height; y++) {
+		for (uint32_t x = 0; x < slot.width; x++, src += 4) {
+			row[x * 3 + 0] = src[isBGRA ? 2 : 0];
+			row[x * 3 + 1] = src[1];
+			row[x * 3 + 2] = src[isBGRA ? 0 : 2];
+		}
+		fwrite(row.data(), row.size(), 1, fp);
+	}
+
+	const bool isWritten = ferror(fp) == 0;
+	fclose(fp);
+	return isWritten;
+}
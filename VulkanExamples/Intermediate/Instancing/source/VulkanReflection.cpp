@@ -0,0 +1,470 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "VulkanReflection.h"
+#include <algorithm>
+
+std::map<uint64_t, ShaderLayout>	VulkanReflection::cache;
+std::mutex							VulkanReflection::cacheMutex;
+
+// SPIR-V opcodes, decorations and storage classes the reflection needs
+enum {
+	SpvMagicNumber				= 0x07230203,
+
+	SpvOpDecorate				= 71,
+	SpvOpMemberDecorate			= 72,
+	SpvOpTypeInt				= 21,
+	SpvOpTypeFloat				= 22,
+	SpvOpTypeVector				= 23,
+	SpvOpTypeMatrix				= 24,
+	SpvOpTypeImage				= 25,
+	SpvOpTypeSampler			= 26,
+	SpvOpTypeSampledImage		= 27,
+	SpvOpTypeArray				= 28,
+	SpvOpTypeRuntimeArray		= 29,
+	SpvOpTypeStruct				= 30,
+	SpvOpTypePointer			= 32,
+	SpvOpConstant				= 43,
+	SpvOpVariable				= 59,
+
+	SpvDecorationBlock			= 2,
+	SpvDecorationBufferBlock	= 3,
+	SpvDecorationArrayStride	= 6,
+	SpvDecorationMatrixStride	= 7,
+	SpvDecorationBuiltIn		= 11,
+	SpvDecorationLocation		= 30,
+	SpvDecorationBinding		= 33,
+	SpvDecorationDescriptorSet	= 34,
+	SpvDecorationOffset			= 35,
+
+	SpvStorageUniformConstant	= 0,
+	SpvStorageInput				= 1,
+	SpvStorageUniform			= 2,
+	SpvStoragePushConstant		= 9,
+	SpvStorageStorageBuffer		= 12,
+
+	SpvDimBuffer				= 5,
+	SpvDimSubpassData			= 6,
+};
+
+// Instructions and decorations of a module, indexed by result id
+struct SpirvModule
+{
+	struct Decorations
+	{
+		Decorations() : isBlock(false), isBufferBlock(false), isBuiltIn(false), location(~0u), binding(0), set(0), arrayStride(0) {}
+		bool		isBlock;
+		bool		isBufferBlock;
+		bool		isBuiltIn;
+		uint32_t	location;
+		uint32_t	binding;
+		uint32_t	set;
+		uint32_t	arrayStride;
+		std::map<uint32_t, uint32_t>	memberOffsets;
+		std::map<uint32_t, uint32_t>	memberMatrixStrides;
+	};
+
+	// Opcode followed by the operands, the result id excluded
+	std::map<uint32_t, std::vector<uint32_t> >	types;
+	std::map<uint32_t, Decorations>				decorations;
+	std::vector<std::vector<uint32_t> >			variables;	// Result type, result id, storage class
+
+	const std::vector<uint32_t>& getType(uint32_t id) const
+	{
+		std::map<uint32_t, std::vector<uint32_t> >::const_iterator it = types.find(id);
+		assert(it != types.end());
+		return it->second;
+	}
+
+	uint32_t getConstant(uint32_t id) const
+	{
+		const std::vector<uint32_t>& constant = getType(id);
+		assert(constant[0] == SpvOpConstant);
+		return constant[2];
+	}
+
+	// Size in bytes of a type laid out in a buffer block
+	uint32_t getSize(uint32_t typeId) const
+	{
+		const std::vector<uint32_t>& type = getType(typeId);
+		switch (type[0]) {
+		case SpvOpTypeInt:
+		case SpvOpTypeFloat:
+			return type[1] / 8;
+		case SpvOpTypeVector:
+			return getSize(type[1]) * type[2];
+		case SpvOpTypeMatrix:
+			return getSize(type[1]) * type[2];
+		case SpvOpTypeArray: {
+			std::map<uint32_t, Decorations>::const_iterator it = decorations.find(typeId);
+			uint32_t stride = (it != decorations.end() && it->second.arrayStride) ? it->second.arrayStride : getSize(type[1]);
+			return stride * getConstant(type[2]);
+		}
+		case SpvOpTypeStruct: {
+			std::map<uint32_t, Decorations>::const_iterator it = decorations.find(typeId);
+			uint32_t size = 0;
+			for (uint32_t member = 0; member + 1 < type.size(); member++) {
+				uint32_t offset			= 0;
+				uint32_t memberSize		= getSize(type[member + 1]);
+				if (it != decorations.end()) {
+					std::map<uint32_t, uint32_t>::const_iterator offsetIt = it->second.memberOffsets.find(member);
+					std::map<uint32_t, uint32_t>::const_iterator strideIt = it->second.memberMatrixStrides.find(member);
+					if (offsetIt != it->second.memberOffsets.end())		offset		= offsetIt->second;
+					if (strideIt != it->second.memberMatrixStrides.end())	memberSize	= strideIt->second * getType(type[member + 1])[2];
+				}
+				size = std::max(size, offset + memberSize);
+			}
+			return size;
+		}
+		default:
+			assert(0 && "Type without a size in a block");
+			return 0;
+		}
+	}
+};
+
+static uint64_t hashSpirv(const uint32_t* spirv, size_t wordCount, VkShaderStageFlagBits stage)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL ^ stage;
+	for (size_t i = 0; i < wordCount; i++) {
+		hash ^= spirv[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+const ShaderLayout& VulkanReflection::reflect(const uint32_t* spirv, size_t spirvSize, VkShaderStageFlagBits stage)
+{
+	const size_t wordCount	= spirvSize / sizeof(uint32_t);
+	const uint64_t key		= hashSpirv(spirv, wordCount, stage);
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	std::map<uint64_t, ShaderLayout>::iterator it = cache.find(key);
+	if (it != cache.end()) {
+		return it->second;
+	}
+
+	ShaderLayout& layout = cache[key];
+	parse(spirv, wordCount, stage, layout);
+	return layout;
+}
+
+void VulkanReflection::parse(const uint32_t* spirv, size_t wordCount, VkShaderStageFlagBits stage, ShaderLayout& layout)
+{
+	assert(wordCount > 5 && spirv[0] == SpvMagicNumber);
+
+	SpirvModule module;
+
+	// Skip the header and index the instructions the reflection needs
+	for (size_t i = 5; i < wordCount; ) {
+		const uint32_t opcode		= spirv[i] & 0xffff;
+		const uint32_t instWords	= spirv[i] >> 16;
+		assert(instWords > 0 && i + instWords <= wordCount);
+		const uint32_t* operands	= &spirv[i + 1];
+
+		switch (opcode) {
+		case SpvOpDecorate: {
+			SpirvModule::Decorations& decoration = module.decorations[operands[0]];
+			switch (operands[1]) {
+			case SpvDecorationBlock:			decoration.isBlock			= true; break;
+			case SpvDecorationBufferBlock:		decoration.isBufferBlock	= true; break;
+			case SpvDecorationBuiltIn:			decoration.isBuiltIn		= true; break;
+			case SpvDecorationLocation:			decoration.location			= operands[2]; break;
+			case SpvDecorationBinding:			decoration.binding			= operands[2]; break;
+			case SpvDecorationDescriptorSet:	decoration.set				= operands[2]; break;
+			case SpvDecorationArrayStride:		decoration.arrayStride		= operands[2]; break;
+			}
+			break;
+		}
+		case SpvOpMemberDecorate: {
+			SpirvModule::Decorations& decoration = module.decorations[operands[0]];
+			if (operands[2] == SpvDecorationOffset)			decoration.memberOffsets[operands[1]]		= operands[3];
+			if (operands[2] == SpvDecorationMatrixStride)	decoration.memberMatrixStrides[operands[1]]	= operands[3];
+			if (operands[2] == SpvDecorationBuiltIn)		decoration.isBuiltIn						= true;
+			break;
+		}
+		case SpvOpTypeInt:
+		case SpvOpTypeFloat:
+		case SpvOpTypeVector:
+		case SpvOpTypeMatrix:
+		case SpvOpTypeImage:
+		case SpvOpTypeSampler:
+		case SpvOpTypeSampledImage:
+		case SpvOpTypeArray:
+		case SpvOpTypeRuntimeArray:
+		case SpvOpTypeStruct:
+		case SpvOpTypePointer: {
+			std::vector<uint32_t>& type = module.types[operands[0]];
+			type.push_back(opcode);
+			type.insert(type.end(), operands + 1, operands + instWords - 1);
+			break;
+		}
+		case SpvOpConstant: {
+			// Result type first, the result id second
+			std::vector<uint32_t>& constant = module.types[operands[1]];
+			constant.push_back(opcode);
+			constant.push_back(operands[0]);
+			constant.insert(constant.end(), operands + 2, operands + instWords - 1);
+			break;
+		}
+		case SpvOpVariable:
+			module.variables.push_back(std::vector<uint32_t>(operands, operands + 3));
+			break;
+		}
+
+		i += instWords;
+	}
+
+	for (size_t v = 0; v < module.variables.size(); v++) {
+		const uint32_t variableId	= module.variables[v][1];
+		const uint32_t storage		= module.variables[v][2];
+
+		const std::vector<uint32_t>& pointer = module.getType(module.variables[v][0]);
+		assert(pointer[0] == SpvOpTypePointer);
+		uint32_t typeId = pointer[2];
+
+		SpirvModule::Decorations& varDecoration = module.decorations[variableId];
+
+		if (storage == SpvStorageInput && stage == VK_SHADER_STAGE_VERTEX_BIT) {
+			if (varDecoration.isBuiltIn || module.decorations[typeId].isBuiltIn) {
+				continue;
+			}
+
+			// A matrix takes one location per column
+			const std::vector<uint32_t>* type = &module.getType(typeId);
+			uint32_t columns = 1;
+			if ((*type)[0] == SpvOpTypeMatrix) {
+				columns = (*type)[2];
+				typeId	= (*type)[1];
+				type	= &module.getType(typeId);
+			}
+
+			uint32_t components = 1;
+			uint32_t scalarId	= typeId;
+			if ((*type)[0] == SpvOpTypeVector) {
+				components	= (*type)[2];
+				scalarId	= (*type)[1];
+			}
+
+			const std::vector<uint32_t>& scalar = module.getType(scalarId);
+			assert(scalar[1] == 32 && "Only 32 bit vertex inputs are supported");
+
+			static const VkFormat floatFormats[]	= { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+			static const VkFormat intFormats[]		= { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+			static const VkFormat uintFormats[]		= { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+			ShaderLayout::VertexInput input;
+			input.format	= scalar[0] == SpvOpTypeFloat ? floatFormats[components - 1] : (scalar[2] ? intFormats[components - 1] : uintFormats[components - 1]);
+			input.size		= components * sizeof(uint32_t);
+			for (uint32_t column = 0; column < columns; column++) {
+				input.location = varDecoration.location + column;
+				layout.vertexInputs.push_back(input);
+			}
+			continue;
+		}
+
+		if (storage == SpvStoragePushConstant) {
+			VkPushConstantRange range;
+			range.stageFlags	= stage;
+			range.offset		= 0;
+			range.size			= module.getSize(typeId);
+			layout.pushConstantRanges.push_back(range);
+			continue;
+		}
+
+		if (storage != SpvStorageUniformConstant && storage != SpvStorageUniform && storage != SpvStorageStorageBuffer) {
+			continue;
+		}
+
+		// Arrays of resources take one descriptor per element
+		ShaderLayout::DescriptorBinding binding;
+		binding.set				= varDecoration.set;
+		binding.binding			= varDecoration.binding;
+		binding.descriptorCount	= 1;
+		binding.stageFlags		= stage;
+
+		const std::vector<uint32_t>* type = &module.getType(typeId);
+		if ((*type)[0] == SpvOpTypeArray) {
+			binding.descriptorCount	= module.getConstant((*type)[2]);
+			typeId					= (*type)[1];
+			type					= &module.getType(typeId);
+		}
+
+		switch ((*type)[0]) {
+		case SpvOpTypeStruct:
+			binding.descriptorType = (storage == SpvStorageUniform && !module.decorations[typeId].isBufferBlock) ?
+				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			break;
+		case SpvOpTypeSampledImage:
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			break;
+		case SpvOpTypeSampler:
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+			break;
+		case SpvOpTypeImage: {
+			// Operands: sampled type, dim, depth, arrayed, MS, sampled (1: with a sampler, 2: storage)
+			const uint32_t dim		= (*type)[2];
+			const bool isStorage	= (*type)[6] == 2;
+			if (dim == SpvDimSubpassData)	binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			else if (dim == SpvDimBuffer)	binding.descriptorType = isStorage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			else							binding.descriptorType = isStorage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			break;
+		}
+		default:
+			assert(0 && "Unsupported resource type");
+			continue;
+		}
+
+		layout.bindings.push_back(binding);
+	}
+
+	ShaderLayout sorted;
+	merge(sorted, layout);
+	layout = sorted;
+}
+
+static bool compareBindings(const ShaderLayout::DescriptorBinding& a, const ShaderLayout::DescriptorBinding& b)
+{
+	return a.set < b.set || (a.set == b.set && a.binding < b.binding);
+}
+
+static bool compareInputs(const ShaderLayout::VertexInput& a, const ShaderLayout::VertexInput& b)
+{
+	return a.location < b.location;
+}
+
+void VulkanReflection::merge(ShaderLayout& program, const ShaderLayout& stage)
+{
+	// Stages sharing a binding must agree on its type, they share the descriptor
+	for (size_t i = 0; i < stage.bindings.size(); i++) {
+		bool isShared = false;
+		for (size_t j = 0; j < program.bindings.size() && !isShared; j++) {
+			if (program.bindings[j].set == stage.bindings[i].set && program.bindings[j].binding == stage.bindings[i].binding) {
+				assert(program.bindings[j].descriptorType == stage.bindings[i].descriptorType);
+				program.bindings[j].stageFlags	|= stage.bindings[i].stageFlags;
+				isShared						= true;
+			}
+		}
+		if (!isShared) {
+			program.bindings.push_back(stage.bindings[i]);
+		}
+	}
+	std::sort(program.bindings.begin(), program.bindings.end(), compareBindings);
+
+	program.pushConstantRanges.insert(program.pushConstantRanges.end(), stage.pushConstantRanges.begin(), stage.pushConstantRanges.end());
+
+	program.vertexInputs.insert(program.vertexInputs.end(), stage.vertexInputs.begin(), stage.vertexInputs.end());
+	std::sort(program.vertexInputs.begin(), program.vertexInputs.end(), compareInputs);
+}
+
+void VulkanReflection::createDescriptorSetLayouts(VkDevice device, const ShaderLayout& layout, std::vector<VkDescriptorSetLayout>& setLayouts)
+{
+	const uint32_t setCount = layout.bindings.empty() ? 0 : layout.bindings.back().set + 1;
+	setLayouts.resize(setCount);
+
+	for (uint32_t set = 0; set < setCount; set++) {
+		std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+		for (size_t i = 0; i < layout.bindings.size(); i++) {
+			if (layout.bindings[i].set != set) {
+				continue;
+			}
+
+			VkDescriptorSetLayoutBinding layoutBinding;
+			layoutBinding.binding				= layout.bindings[i].binding;
+			layoutBinding.descriptorType		= layout.bindings[i].descriptorType;
+			layoutBinding.descriptorCount		= layout.bindings[i].descriptorCount;
+			layoutBinding.stageFlags			= layout.bindings[i].stageFlags;
+			layoutBinding.pImmutableSamplers	= NULL;
+			layoutBindings.push_back(layoutBinding);
+		}
+
+		VkDescriptorSetLayoutCreateInfo descriptorLayout = {};
+		descriptorLayout.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		descriptorLayout.pNext			= NULL;
+		descriptorLayout.bindingCount	= (uint32_t)layoutBindings.size();
+		descriptorLayout.pBindings		= layoutBindings.data();
+
+		VkResult result = vkCreateDescriptorSetLayout(device, &descriptorLayout, NULL, &setLayouts[set]);
+		assert(result == VK_SUCCESS);
+	}
+}
+
+void VulkanReflection::createPipelineLayout(VkDevice device, const ShaderLayout& layout, const std::vector<VkDescriptorSetLayout>& setLayouts, VkPipelineLayout* pipelineLayout)
+{
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType						= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.pNext						= NULL;
+	pipelineLayoutCreateInfo.pushConstantRangeCount		= (uint32_t)layout.pushConstantRanges.size();
+	pipelineLayoutCreateInfo.pPushConstantRanges		= layout.pushConstantRanges.data();
+	pipelineLayoutCreateInfo.setLayoutCount				= (uint32_t)setLayouts.size();
+	pipelineLayoutCreateInfo.pSetLayouts				= setLayouts.data();
+
+	VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, NULL, pipelineLayout);
+	assert(result == VK_SUCCESS);
+}
+
+void VulkanReflection::getDescriptorPoolSizes(const ShaderLayout& layout, std::vector<VkDescriptorPoolSize>& poolSizes)
+{
+	poolSizes.clear();
+	for (size_t i = 0; i < layout.bindings.size(); i++) {
+		size_t j = 0;
+		while (j < poolSizes.size() && poolSizes[j].type != layout.bindings[i].descriptorType)
+			j++;
+
+		if (j == poolSizes.size()) {
+			VkDescriptorPoolSize poolSize = { layout.bindings[i].descriptorType, 0 };
+			poolSizes.push_back(poolSize);
+		}
+		poolSizes[j].descriptorCount += layout.bindings[i].descriptorCount;
+	}
+}
+
+void VulkanReflection::createVertexInput(const ShaderLayout& layout, uint32_t firstInstanceLocation,
+	std::vector<VkVertexInputBindingDescription>& viIpBind, std::vector<VkVertexInputAttributeDescription>& viIpAttrb)
+{
+	viIpBind.resize(2);
+	viIpBind[0].binding		= 0;
+	viIpBind[0].inputRate	= VK_VERTEX_INPUT_RATE_VERTEX;
+	viIpBind[0].stride		= 0;
+	viIpBind[1].binding		= 1;
+	viIpBind[1].inputRate	= VK_VERTEX_INPUT_RATE_INSTANCE;
+	viIpBind[1].stride		= 0;
+
+	viIpAttrb.resize(layout.vertexInputs.size());
+	for (size_t i = 0; i < layout.vertexInputs.size(); i++) {
+		VkVertexInputBindingDescription& binding = viIpBind[layout.vertexInputs[i].location < firstInstanceLocation ? 0 : 1];
+
+		viIpAttrb[i].binding	= binding.binding;
+		viIpAttrb[i].location	= layout.vertexInputs[i].location;
+		viIpAttrb[i].format		= layout.vertexInputs[i].format;
+		viIpAttrb[i].offset		= binding.stride;
+		binding.stride			+= layout.vertexInputs[i].size;
+	}
+
+	// No per instance data
+	if (viIpBind[1].stride == 0) {
+		viIpBind.resize(1);
+	}
+}
@@ -37,6 +37,9 @@ VulkanRenderer::VulkanRenderer(VulkanApplication * app, VulkanDevice* deviceObje
 	application = app;
 	deviceObj	= deviceObject;
 
+	readbackObj.initialize(deviceObj);
+	captureCount = 0;
+
 	swapChainObj = new VulkanSwapChain(this);
 	VulkanDrawable* drawableObj = new VulkanDrawable(this);
 	drawableList.push_back(drawableObj);
@@ -94,6 +97,9 @@ void VulkanRenderer::initialize()
 
 	// Manage the pipeline state objects
 	createPipelineStateManagement();
+
+	// Animate and compact the instances on the GPU
+	createInstanceCompute();
 }
 
 void VulkanRenderer::prepare()
@@ -110,6 +116,9 @@ void VulkanRenderer::update()
 	{
 		drawableObj->update();
 	}
+
+	// Write out the captures whose copy has completed
+	readbackObj.update();
 }
 
 bool VulkanRenderer::render()
@@ -143,6 +152,22 @@ LRESULT CALLBACK VulkanRenderer::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LP
 		}
 
 		return 0;
+
+	case WM_KEYDOWN:
+		// 'P' captures the next frame into a PPM file, 'K' into a KTX file
+		if (wParam == 'P' || wParam == 'K') {
+			char filename[64];
+			sprintf(filename, "capture_%03u.%s", appObj->rendererObj->captureCount++, wParam == 'P' ? "ppm" : "ktx");
+			appObj->rendererObj->readbackObj.requestCapture(filename);
+		}
+		// 'O' toggles the front to back ordering of the instances
+		if (wParam == 'O') {
+			for each (VulkanDrawable* drawableObj in appObj->rendererObj->drawableList)
+			{
+				drawableObj->setDepthOrder(!drawableObj->getDepthOrder());
+			}
+		}
+		break;
 	
 	case WM_SIZE:
 		if (wParam != SIZE_MINIMIZED) {
@@ -300,7 +325,8 @@ void VulkanRenderer::createCommandPool()
 	cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	cmdPoolInfo.pNext = NULL;
 	cmdPoolInfo.queueFamilyIndex = deviceObj->graphicsQueueWithPresentIndex;
-	cmdPoolInfo.flags = 0;
+	// The drawing command buffers are recorded again every frame when push constants are used
+	cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 	res = vkCreateCommandPool(deviceObj->device, &cmdPoolInfo, NULL, &cmdPool);
 	assert(res == VK_SUCCESS);
@@ -422,6 +448,28 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 	// Get number of mip-map levels
 	texture->mipMapLevels	= uint32_t(image2D.levels());
 
+	// Use the format stored in the texture file unless the caller overrides it
+	if (format == VK_FORMAT_UNDEFINED) {
+		format = getVulkanFormat(image2D.format());
+	}
+	assert(format != VK_FORMAT_UNDEFINED);
+	texture->format = format;
+
+	// Block compressed formats are optional, make sure the
+	// device can sample the format with optimal tiling
+	VkFormatProperties formatProps;
+	vkGetPhysicalDeviceFormatProperties(*deviceObj->gpu, format, &formatProps);
+	if (!(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+		std::cout << "Texture format " << format << " of " << filename << " cannot be sampled by this device." << std::endl;
+		assert(0);
+		return;
+	}
+
+	// Compressed formats can not be used as storage images, drop the usage if not supported
+	if ((imageUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) && !(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+		imageUsageFlags &= ~VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+
 	// Create a staging buffer resource states using.
 	// Indicate it be the source of the transfer command.
 	// .usage	= VK_BUFFER_USAGE_TRANSFER_SRC_BIT
@@ -533,8 +581,10 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 	std::vector<VkBufferImageCopy> bufferImgCopyList;
 
 
-	uint32_t bufferOffset = 0;
+	VkDeviceSize bufferOffset = 0;
 	// Iterater through each mip level and set buffer image copy -
+	// The extent is given in texels, for block compressed formats the
+	// levels smaller than a block are copied as a whole block.
 	for (uint32_t i = 0; i < texture->mipMapLevels; i++)
 	{
 		VkBufferImageCopy bufImgCopyItem = {};
@@ -550,7 +600,7 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 		bufferImgCopyList.push_back(bufImgCopyItem);
 
 		// adjust buffer offset
-		bufferOffset += uint32_t(image2D[i].size());
+		bufferOffset += image2D[i].size();
 	}
 
 	// Copy the staging buffer memory data contain
@@ -626,8 +676,8 @@ void VulkanRenderer::createTextureOptimal(const char* filename, TextureData *tex
 	samplerCI.borderColor				= VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 	samplerCI.unnormalizedCoordinates	= VK_FALSE;
 
-	error = vkCreateSampler(deviceObj->device, &samplerCI, nullptr, &texture->sampler);
-	assert(!error);
+	// Get a shared sampler from the device sampler cache
+	texture->sampler = deviceObj->samplerCache.acquireSampler(samplerCI);
 
 	// Create image view to allow shader to access the texture information -
 	VkImageViewCreateInfo viewCI = {};
@@ -664,6 +714,22 @@ void VulkanRenderer::createTextureLinear(const char* filename, TextureData *text
 	// Get number of mip-map levels
 	texture->mipMapLevels	= uint32_t(image2D.levels());
 
+	// Use the format stored in the texture file unless the caller overrides it
+	if (format == VK_FORMAT_UNDEFINED) {
+		format = getVulkanFormat(image2D.format());
+	}
+	assert(format != VK_FORMAT_UNDEFINED);
+	texture->format = format;
+
+	// Linear tiling support is very limited and block compressed
+	// formats are generally not supported, use the staging path then
+	VkFormatProperties formatProps;
+	vkGetPhysicalDeviceFormatProperties(*deviceObj->gpu, format, &formatProps);
+	if (!(formatProps.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+		createTextureOptimal(filename, texture, imageUsageFlags, format);
+		return;
+	}
+
 	// Create image resource states using VkImageCreateInfo
 	VkImageCreateInfo imageCreateInfo   = {};
 	imageCreateInfo.sType				= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -728,13 +794,17 @@ void VulkanRenderer::createTextureLinear(const char* filename, TextureData *text
 	error = vkMapMemory(deviceObj->device, texture->mem, 0, texture->memoryAlloc.allocationSize, 0, (void**)&data);
 	assert(!error);
 
-	// Load image texture data in the mapped buffer
+	// Load image texture data in the mapped buffer, a row
+	// is a row of blocks for block compressed formats
+	const gli::dim3_t blockExtent	= gli::block_dimensions(image2D.format());
+	const uint32_t rowCount			= (texture->textureHeight + blockExtent.y - 1) / blockExtent.y;
+	const size_t rowSize			= ((texture->textureWidth + blockExtent.x - 1) / blockExtent.x) * gli::block_size(image2D.format());
+
 	uint8_t* dataTemp = (uint8_t*)image2D.data();
-	for (int y = 0; y < image2D[0].dimensions().y; y++)
+	for (uint32_t y = 0; y < rowCount; y++)
 	{
-		size_t imageSize = image2D[0].dimensions().y * 4;
-		memcpy(data, dataTemp, imageSize);
-		dataTemp += imageSize;
+		memcpy(data, dataTemp, rowSize);
+		dataTemp += rowSize;
 
 		// Advance row by row pitch information
 		data += layout.rowPitch;
@@ -806,9 +876,8 @@ void VulkanRenderer::createTextureLinear(const char* filename, TextureData *text
 	samplerCI.borderColor			= VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 	samplerCI.unnormalizedCoordinates = VK_FALSE;
 
-	// Create the sampler
-	error = vkCreateSampler(deviceObj->device, &samplerCI, NULL, &texture->sampler);
-	assert(!error);
+	// Get a shared sampler from the device sampler cache
+	texture->sampler = deviceObj->samplerCache.acquireSampler(samplerCI);
 
 	// Create image view to allow shader to access the texture information -
 	VkImageViewCreateInfo viewCI	= {};
@@ -971,7 +1040,7 @@ void VulkanRenderer::destroyDrawableUniformBuffer()
 void VulkanRenderer::destroyTextureResource()
 {
 	vkFreeMemory(deviceObj->device, texture.mem, NULL);
-	vkDestroySampler(deviceObj->device, texture.sampler, NULL);
+	deviceObj->samplerCache.releaseSampler(texture.sampler);
 	vkDestroyImage(deviceObj->device, texture.image, NULL);
 	vkDestroyImageView(deviceObj->device, texture.view, NULL);
 }
@@ -1058,6 +1127,70 @@ void VulkanRenderer::createShaders()
 #endif
 }
 
+// Read a compute shader as SPIR-V, compiled from the GLSL source or prebuilt
+static bool readComputeShader(VulkanShader& shaderObj, const char* glslName, const char* spvName, std::vector<unsigned int>& spirv)
+{
+	size_t size;
+	spirv.clear();
+
+#ifdef AUTO_COMPILE_GLSL_TO_SPV
+	void* code = readFile(glslName, &size);
+	if (!code) {
+		return false;
+	}
+
+	bool retVal = shaderObj.GLSLtoSPV(VK_SHADER_STAGE_COMPUTE_BIT, (const char*)code, spirv);
+	assert(retVal);
+#else
+	void* code = readFile(spvName, &size);
+	if (!code) {
+		return false;
+	}
+
+	spirv.assign((const unsigned int*)code, (const unsigned int*)code + size / sizeof(unsigned int));
+#endif
+	free(code);
+	return true;
+}
+
+// The vertex buffers and with them the compute passes are created again on resize
+void VulkanRenderer::createInstanceCompute()
+{
+	std::vector<unsigned int> spirv;
+
+	// Without the compiled shaders the instances are drawn static and removed ones leave holes
+	if (readComputeShader(shaderObj, "./../Animate.comp", "./../Animate-comp.spv", spirv)) {
+		for each (VulkanDrawable* drawableObj in drawableList)
+		{
+			drawableObj->createAnimation(spirv.data(), spirv.size() * sizeof(unsigned int));
+		}
+	}
+	else {
+		std::cout << "Animate compute shader not found, instance animation is off" << std::endl;
+	}
+
+	if (readComputeShader(shaderObj, "./../Compact.comp", "./../Compact-comp.spv", spirv)) {
+		for each (VulkanDrawable* drawableObj in drawableList)
+		{
+			drawableObj->createCompaction(spirv.data(), spirv.size() * sizeof(unsigned int));
+		}
+	}
+	else {
+		std::cout << "Compact compute shader not found, removed instances leave holes" << std::endl;
+	}
+
+	// Without it the instances are drawn in slot order
+	if (readComputeShader(shaderObj, "./../Gather.comp", "./../Gather-comp.spv", spirv)) {
+		for each (VulkanDrawable* drawableObj in drawableList)
+		{
+			drawableObj->createDepthOrder(spirv.data(), spirv.size() * sizeof(unsigned int));
+		}
+	}
+	else {
+		std::cout << "Gather compute shader not found, front to back ordering is off" << std::endl;
+	}
+}
+
 // Create the descriptor set
 void VulkanRenderer::createDescriptors()
 {
@@ -1066,6 +1199,7 @@ void VulkanRenderer::createDescriptors()
 		// It is upto an application how it manages the 
 		// creation of descriptor. Descriptors can be cached 
 		// and reuse for all similar objects.
+		drawableObj->setShaderLayout(&shaderObj.layout);
 		drawableObj->createDescriptorSetLayout(true);
 
 		// Create the descriptor set
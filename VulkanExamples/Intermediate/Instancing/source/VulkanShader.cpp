@@ -26,6 +26,7 @@
 #include "VulkanShader.h"
 #include "VulkanApplication.h"
 #include "VulkanDevice.h"
+#include "SpirvCache.h"
 
 
 void VulkanShader::buildShaderModuleWithSPV(uint32_t *vertShaderText, size_t vertexSPVSize, uint32_t *fragShaderText, size_t fragmentSPVSize)
@@ -67,6 +68,10 @@ void VulkanShader::buildShaderModuleWithSPV(uint32_t *vertShaderText, size_t ver
 	moduleCreateInfo.pCode = fragShaderText;
 	result = vkCreateShaderModule(deviceObj->device, &moduleCreateInfo, NULL, &shaderStages[1].module);
 	assert(result == VK_SUCCESS);
+
+	layout = ShaderLayout();
+	VulkanReflection::merge(layout, VulkanReflection::reflect(vertShaderText, vertexSPVSize, VK_SHADER_STAGE_VERTEX_BIT));
+	VulkanReflection::merge(layout, VulkanReflection::reflect(fragShaderText, fragmentSPVSize, VK_SHADER_STAGE_FRAGMENT_BIT));
 }
 
 void VulkanShader::destroyShaders()
@@ -78,6 +83,16 @@ void VulkanShader::destroyShaders()
 
 #ifdef AUTO_COMPILE_GLSL_TO_SPV
 
+// glslang keeps process wide tables, they are set up on the first
+// compilation only and released when the application exits.
+static void initializeGlslang()
+{
+	static struct GlslangProcess {
+		GlslangProcess()	{ glslang::InitializeProcess(); }
+		~GlslangProcess()	{ glslang::FinalizeProcess(); }
+	} glslangProcess;
+}
+
 // Helper function intaking the GLSL vertex and fragment shader. 
 // It prepares the shaders to be consumed in the SPIR-V format 
 // with the help of glslang library helper functions.
@@ -98,8 +113,6 @@ void VulkanShader::buildShader(const char *vertShaderText, const char *fragShade
 	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
 	shaderStages[0].pName = "main";
 
-	glslang::InitializeProcess();
-
 	retVal = GLSLtoSPV(VK_SHADER_STAGE_VERTEX_BIT, vertShaderText, vertexSPV);
 	assert(retVal);
 
@@ -131,7 +144,9 @@ void VulkanShader::buildShader(const char *vertShaderText, const char *fragShade
 	result = vkCreateShaderModule(deviceObj->device, &moduleCreateInfo, NULL, &shaderStages[1].module);
 	assert(result == VK_SUCCESS);
 
-	glslang::FinalizeProcess();
+	layout = ShaderLayout();
+	VulkanReflection::merge(layout, VulkanReflection::reflect(vertexSPV.data(), vertexSPV.size() * sizeof(unsigned int), VK_SHADER_STAGE_VERTEX_BIT));
+	VulkanReflection::merge(layout, VulkanReflection::reflect(fragSPV.data(), fragSPV.size() * sizeof(unsigned int), VK_SHADER_STAGE_FRAGMENT_BIT));
 }
 
 //
@@ -140,14 +155,22 @@ void VulkanShader::buildShader(const char *vertShaderText, const char *fragShade
 //
 bool VulkanShader::GLSLtoSPV(const VkShaderStageFlagBits shaderType, const char *pshader, std::vector<unsigned int> &spirv)
 {
+	// Enable SPIR-V and Vulkan rules when parsing GLSL
+	EShMessages messages = (EShMessages)(EShMsgSpvRules | EShMsgVulkanRules);
+
+	// Reuse the SPIR-V of a previous run when neither the source nor the options changed
+	const uint64_t cacheKey = SpirvCache::computeKey(pshader, shaderType, "main", messages);
+	if (SpirvCache::load(cacheKey, spirv)) {
+		return true;
+	}
+
+	initializeGlslang();
+
 	glslang::TProgram* program = new glslang::TProgram;
 	const char *shaderStrings[1];
 	TBuiltInResource Resources;
 	initializeResources(Resources);
 
-	// Enable SPIR-V and Vulkan rules when parsing GLSL
-	EShMessages messages = (EShMessages)(EShMsgSpvRules | EShMsgVulkanRules);
-
 	EShLanguage stage = getLanguage(shaderType);
 	glslang::TShader* shader = new glslang::TShader(stage);
 
@@ -172,6 +195,8 @@ bool VulkanShader::GLSLtoSPV(const VkShaderStageFlagBits shaderType, const char
 	glslang::GlslangToSpv(*program->getIntermediate(stage), spirv);
 	delete program;
 	delete shader;
+
+	SpirvCache::store(cacheKey, spirv);
 	return true;
 }
 
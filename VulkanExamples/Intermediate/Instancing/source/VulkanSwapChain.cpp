@@ -319,6 +319,12 @@ void VulkanSwapChain::createSwapChainColorImages()
 	swapChainInfo.clipped				= true;
 	swapChainInfo.imageColorSpace		= VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
 	swapChainInfo.imageUsage			= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+	// Framebuffer captures copy out of the swapchain images
+	if (scPrivateVars.surfCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+		swapChainInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+	scPublicVars.imageUsage				= swapChainInfo.imageUsage;
 	swapChainInfo.imageSharingMode		= VK_SHARING_MODE_EXCLUSIVE;
 	swapChainInfo.queueFamilyIndexCount = 0;
 	swapChainInfo.pQueueFamilyIndices	= NULL;
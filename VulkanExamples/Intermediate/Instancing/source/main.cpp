@@ -42,11 +42,25 @@ std::vector<const char *> deviceExtensionNames = {
 
 int main(int argc, char **argv)
 {
+	// "-capture <frame> <file>" writes the given frame into a PPM or KTX file,
+	// used to compare the rendering against golden images.
+	int captureFrame = -1;
+	const char* captureFile = NULL;
+	for (int i = 1; i + 2 < argc; i++) {
+		if (strcmp(argv[i], "-capture") == 0) {
+			captureFrame = atoi(argv[i + 1]);
+			captureFile = argv[i + 2];
+		}
+	}
+
 	VulkanApplication* appObj = VulkanApplication::GetInstance();
 	appObj->initialize();
 	appObj->prepare();
 	bool isWindowOpen = true;
-	while (isWindowOpen) {
+	for (int frame = 0; isWindowOpen; frame++) {
+		if (frame == captureFrame) {
+			appObj->rendererObj->getReadback()->requestCapture(captureFile);
+		}
 		appObj->update();
 		isWindowOpen = appObj->render();
 	}
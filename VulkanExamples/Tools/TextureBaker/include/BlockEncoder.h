@@ -0,0 +1,56 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+
+// Block compressed formats produced by the baker
+enum BlockFormat
+{
+	BLOCK_FORMAT_BC1,	// RGB, 8 bytes per 4x4 block
+	BLOCK_FORMAT_BC3,	// RGBA, BC1 color with an interpolated alpha block, 16 bytes per 4x4 block
+	BLOCK_FORMAT_BC7	// RGBA, mode 6 only (single subset, 7777.1 endpoints, 4 bit indices), 16 bytes per 4x4 block
+};
+
+// CPU block encoder, the input texels are always RGBA8.
+class BlockEncoder
+{
+public:
+	// Size in bytes of an encoded 4x4 block
+	static uint32_t getBlockSize(BlockFormat format);
+
+	// gli format of the encoded texture
+	static gli::format getTextureFormat(BlockFormat format);
+
+	// Encode 16 RGBA8 texels, stored row by row, into a single block
+	static void encodeBlockBC1(const uint8_t* rgba, uint8_t* block);
+	static void encodeBlockBC3(const uint8_t* rgba, uint8_t* block);
+	static void encodeBlockBC7(const uint8_t* rgba, uint8_t* block);
+
+	// Encode a whole RGBA8 image, the partial blocks at the right and
+	// bottom edges repeat the last column and row of texels.
+	// Rows of blocks are split across 'threadCount' threads.
+	static void encodeImage(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks, uint32_t threadCount);
+};
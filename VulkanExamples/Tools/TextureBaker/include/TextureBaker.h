@@ -0,0 +1,65 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+#include "Headers.h"
+#include "BlockEncoder.h"
+
+// Loads a source image, builds its mip chain and writes it
+// block compressed in a KTX file the samples upload as it is.
+class TextureBaker
+{
+public:
+	TextureBaker();
+	~TextureBaker();
+
+	// Load a PPM (P3/P6), KTX or DDS file, only the base level is kept
+	bool loadSource(const char* filename);
+
+	// Build the complete mip chain of the source image
+	void generateMipmaps(bool kaiserFilter, uint32_t threadCount);
+
+	// Block compress every mip level
+	void encode(BlockFormat format, uint32_t threadCount);
+
+	// Write the encoded texture as KTX
+	bool save(const char* filename);
+
+	// Sizes in bytes used for the report
+	size_t getUncompressedSize();	// RGBA8 with the same number of mip levels
+	size_t getBakedSize();			// Size of the encoded texture data
+
+	// Time the SIMD and scalar mip map paths on random 4096x4096 and 8192x8192
+	// RGBA8 and RGBA32F images, false if they do not produce the same bytes
+	static bool benchmarkMipmaps(uint32_t threadCount);
+
+private:
+	bool loadPPM(const char* filename);
+	bool loadGli(const char* filename);
+	void release();
+
+	gli::texture2D* source;		// RGBA8 texture, base level plus the generated mip levels
+	gli::texture2D* baked;		// Block compressed texture
+};
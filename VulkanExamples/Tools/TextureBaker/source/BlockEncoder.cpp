@@ -0,0 +1,381 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "BlockEncoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+	// Principal axis fit: returns the two end points, in 0..255 range, of the
+	// segment through the mean of the texels along their main direction.
+	void computeEndpoints(const uint8_t* rgba, int channelCount, float endpoint0[4], float endpoint1[4])
+	{
+		float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < channelCount; c++)
+				mean[c] += rgba[i * 4 + c] / 16.0f;
+
+		float covariance[4][4] = {};
+		float minValue[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+		float maxValue[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			float d[4] = {};
+			for (int c = 0; c < channelCount; c++)
+			{
+				d[c] = rgba[i * 4 + c] - mean[c];
+				minValue[c] = std::min(minValue[c], float(rgba[i * 4 + c]));
+				maxValue[c] = std::max(maxValue[c], float(rgba[i * 4 + c]));
+			}
+			for (int r = 0; r < channelCount; r++)
+				for (int c = 0; c < channelCount; c++)
+					covariance[r][c] += d[r] * d[c];
+		}
+
+		// Power iteration, starting from the bounding box diagonal
+		float axis[4] = {};
+		for (int c = 0; c < channelCount; c++)
+			axis[c] = maxValue[c] - minValue[c];
+
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			for (int r = 0; r < channelCount; r++)
+				for (int c = 0; c < channelCount; c++)
+					next[r] += covariance[r][c] * axis[c];
+
+			float length = 0.0f;
+			for (int c = 0; c < channelCount; c++)
+				length = std::max(length, std::fabs(next[c]));
+			if (length == 0.0f)
+				break;
+
+			for (int c = 0; c < channelCount; c++)
+				axis[c] = next[c] / length;
+		}
+
+		float axisLength = 0.0f;
+		for (int c = 0; c < channelCount; c++)
+			axisLength += axis[c] * axis[c];
+
+		// Flat block, both end points are the mean
+		float minT = 0.0f, maxT = 0.0f;
+		if (axisLength > 0.0f)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				float t = 0.0f;
+				for (int c = 0; c < channelCount; c++)
+					t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+				t /= axisLength;
+				minT = std::min(minT, t);
+				maxT = std::max(maxT, t);
+			}
+		}
+
+		for (int c = 0; c < 4; c++)
+		{
+			endpoint0[c] = c < channelCount ? std::min(std::max(mean[c] + minT * axis[c], 0.0f), 255.0f) : 255.0f;
+			endpoint1[c] = c < channelCount ? std::min(std::max(mean[c] + maxT * axis[c], 0.0f), 255.0f) : 255.0f;
+		}
+	}
+
+	int squaredDistance(const int* a, const uint8_t* b, int channelCount)
+	{
+		int distance = 0;
+		for (int c = 0; c < channelCount; c++)
+			distance += (a[c] - b[c]) * (a[c] - b[c]);
+		return distance;
+	}
+
+	uint16_t packColor565(const float color[4])
+	{
+		uint32_t r = uint32_t(color[0] * 31.0f / 255.0f + 0.5f);
+		uint32_t g = uint32_t(color[1] * 63.0f / 255.0f + 0.5f);
+		uint32_t b = uint32_t(color[2] * 31.0f / 255.0f + 0.5f);
+		return uint16_t((r << 11) | (g << 5) | b);
+	}
+
+	void unpackColor565(uint16_t packed, int color[4])
+	{
+		int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+		color[3] = 255;
+	}
+
+	// Writes the bits of a BC7 block from the least significant bit up
+	class BitWriter
+	{
+	public:
+		BitWriter(uint8_t* block) : data(block), position(0) { memset(data, 0, 16); }
+
+		void write(uint32_t value, int bitCount)
+		{
+			for (int i = 0; i < bitCount; i++, position++)
+				data[position >> 3] |= uint8_t(((value >> i) & 1) << (position & 7));
+		}
+
+	private:
+		uint8_t* data;
+		int position;
+	};
+
+	const int bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+}
+
+uint32_t BlockEncoder::getBlockSize(BlockFormat format)
+{
+	return format == BLOCK_FORMAT_BC1 ? 8 : 16;
+}
+
+gli::format BlockEncoder::getTextureFormat(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1:	return gli::FORMAT_RGB_DXT1_UNORM;
+	case BLOCK_FORMAT_BC3:	return gli::FORMAT_RGBA_DXT5_UNORM;
+	default:				return gli::FORMAT_RGB_BP_UNORM;	// BPTC is BC7
+	}
+}
+
+void BlockEncoder::encodeBlockBC1(const uint8_t* rgba, uint8_t* block)
+{
+	float endpoint0[4], endpoint1[4];
+	computeEndpoints(rgba, 3, endpoint0, endpoint1);
+
+	// color0 > color1 selects the four color mode
+	uint16_t color0 = packColor565(endpoint1);
+	uint16_t color1 = packColor565(endpoint0);
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+
+	uint32_t indices = 0;
+	if (color0 != color1)
+	{
+		int palette[4][4];
+		unpackColor565(color0, palette[0]);
+		unpackColor565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			uint32_t best = 0;
+			int bestDistance = squaredDistance(palette[0], &rgba[i * 4], 3);
+			for (uint32_t p = 1; p < 4; p++)
+			{
+				int distance = squaredDistance(palette[p], &rgba[i * 4], 3);
+				if (distance < bestDistance) {
+					best = p;
+					bestDistance = distance;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+	}
+
+	block[0] = uint8_t(color0);
+	block[1] = uint8_t(color0 >> 8);
+	block[2] = uint8_t(color1);
+	block[3] = uint8_t(color1 >> 8);
+	memcpy(&block[4], &indices, sizeof(indices));
+}
+
+void BlockEncoder::encodeBlockBC3(const uint8_t* rgba, uint8_t* block)
+{
+	// Alpha block: alpha0 > alpha1 selects eight interpolated values
+	int alpha0 = 0, alpha1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		alpha0 = std::max(alpha0, int(rgba[i * 4 + 3]));
+		alpha1 = std::min(alpha1, int(rgba[i * 4 + 3]));
+	}
+
+	uint64_t indices = 0;
+	if (alpha0 != alpha1)
+	{
+		int palette[8] = { alpha0, alpha1 };
+		for (int p = 2; p < 8; p++)
+			palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+
+		for (int i = 0; i < 16; i++)
+		{
+			uint64_t best = 0;
+			int bestDistance = 256;
+			for (uint64_t p = 0; p < 8; p++)
+			{
+				int distance = std::abs(palette[p] - int(rgba[i * 4 + 3]));
+				if (distance < bestDistance) {
+					best = p;
+					bestDistance = distance;
+				}
+			}
+			indices |= best << (i * 3);
+		}
+	}
+
+	block[0] = uint8_t(alpha0);
+	block[1] = uint8_t(alpha1);
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = uint8_t(indices >> (i * 8));
+
+	// Color block, always decoded in four color mode for BC3
+	encodeBlockBC1(rgba, block + 8);
+}
+
+void BlockEncoder::encodeBlockBC7(const uint8_t* rgba, uint8_t* block)
+{
+	float endpoint0[4], endpoint1[4];
+	computeEndpoints(rgba, 4, endpoint0, endpoint1);
+
+	// Mode 6 end points are 7 bits per channel plus a shared
+	// least significant bit per end point (p-bit), try the four p-bit pairs.
+	int bestError = -1;
+	int bestQuantized[2][4] = {};
+	int bestPBit[2] = {};
+	int bestIndices[16] = {};
+
+	for (int pBits = 0; pBits < 4; pBits++)
+	{
+		const int pBit[2] = { pBits & 1, pBits >> 1 };
+		int quantized[2][4];
+		int color[2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			quantized[0][c] = std::min(std::max(int((endpoint0[c] - pBit[0]) / 2.0f + 0.5f), 0), 127);
+			quantized[1][c] = std::min(std::max(int((endpoint1[c] - pBit[1]) / 2.0f + 0.5f), 0), 127);
+			color[0][c] = (quantized[0][c] << 1) | pBit[0];
+			color[1][c] = (quantized[1][c] << 1) | pBit[1];
+		}
+
+		int palette[16][4];
+		for (int p = 0; p < 16; p++)
+			for (int c = 0; c < 4; c++)
+				palette[p][c] = ((64 - bc7Weights4[p]) * color[0][c] + bc7Weights4[p] * color[1][c] + 32) >> 6;
+
+		int error = 0;
+		int indices[16];
+		for (int i = 0; i < 16; i++)
+		{
+			int bestDistance = squaredDistance(palette[0], &rgba[i * 4], 4);
+			indices[i] = 0;
+			for (int p = 1; p < 16; p++)
+			{
+				int distance = squaredDistance(palette[p], &rgba[i * 4], 4);
+				if (distance < bestDistance) {
+					indices[i] = p;
+					bestDistance = distance;
+				}
+			}
+			error += bestDistance;
+		}
+
+		if (bestError < 0 || error < bestError)
+		{
+			bestError = error;
+			memcpy(bestQuantized, quantized, sizeof(quantized));
+			memcpy(bestPBit, pBit, sizeof(pBit));
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+	}
+
+	// The most significant bit of the first index is implicit zero,
+	// swap the end points and mirror the indices when it is set.
+	if (bestIndices[0] & 8)
+	{
+		for (int c = 0; c < 4; c++)
+			std::swap(bestQuantized[0][c], bestQuantized[1][c]);
+		std::swap(bestPBit[0], bestPBit[1]);
+		for (int i = 0; i < 16; i++)
+			bestIndices[i] = 15 - bestIndices[i];
+	}
+
+	BitWriter writer(block);
+	writer.write(1 << 6, 7);	// Mode 6
+	for (int c = 0; c < 4; c++)
+	{
+		writer.write(bestQuantized[0][c], 7);
+		writer.write(bestQuantized[1][c], 7);
+	}
+	writer.write(bestPBit[0], 1);
+	writer.write(bestPBit[1], 1);
+	writer.write(bestIndices[0], 3);
+	for (int i = 1; i < 16; i++)
+		writer.write(bestIndices[i], 4);
+}
+
+void BlockEncoder::encodeImage(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks, uint32_t threadCount)
+{
+	const uint32_t blockCountX	= (width + 3) / 4;
+	const uint32_t blockCountY	= (height + 3) / 4;
+	const uint32_t blockSize	= getBlockSize(format);
+
+	void (*encodeBlock)(const uint8_t*, uint8_t*) =
+		format == BLOCK_FORMAT_BC1 ? encodeBlockBC1 :
+		format == BLOCK_FORMAT_BC3 ? encodeBlockBC3 : encodeBlockBC7;
+
+	// Each worker encodes a contiguous range of block rows
+	auto encodeRows = [=](uint32_t firstRow, uint32_t lastRow)
+	{
+		uint8_t texels[16 * 4];
+		for (uint32_t by = firstRow; by < lastRow; by++)
+		{
+			for (uint32_t bx = 0; bx < blockCountX; bx++)
+			{
+				for (uint32_t y = 0; y < 4; y++)
+				{
+					const uint32_t sy = std::min(by * 4 + y, height - 1);
+					for (uint32_t x = 0; x < 4; x++)
+					{
+						const uint32_t sx = std::min(bx * 4 + x, width - 1);
+						memcpy(&texels[(y * 4 + x) * 4], &rgba[(sy * width + sx) * 4], 4);
+					}
+				}
+				encodeBlock(texels, &blocks[(by * blockCountX + bx) * blockSize]);
+			}
+		}
+	};
+
+	threadCount = std::max(std::min(threadCount, blockCountY), 1u);
+	const uint32_t rowsPerThread = (blockCountY + threadCount - 1) / threadCount;
+
+	std::vector<std::thread> workers;
+	for (uint32_t first = rowsPerThread; first < blockCountY; first += rowsPerThread)
+		workers.push_back(std::thread(encodeRows, first, std::min(first + rowsPerThread, blockCountY)));
+
+	encodeRows(0, std::min(rowsPerThread, blockCountY));
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
@@ -0,0 +1,276 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TextureBaker.h"
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <chrono>
+#include <random>
+
+TextureBaker::TextureBaker()
+{
+	source	= NULL;
+	baked	= NULL;
+}
+
+TextureBaker::~TextureBaker()
+{
+	release();
+}
+
+void TextureBaker::release()
+{
+	delete source;
+	delete baked;
+	source	= NULL;
+	baked	= NULL;
+}
+
+bool TextureBaker::loadSource(const char* filename)
+{
+	release();
+
+	std::string name(filename);
+	std::string extension = name.substr(name.find_last_of('.') + 1);
+	for (size_t i = 0; i < extension.size(); i++)
+		extension[i] = char(tolower(extension[i]));
+
+	if (extension == "ppm") {
+		return loadPPM(filename);
+	}
+	return loadGli(filename);
+}
+
+// Reads the next header token of a PPM file, skipping white spaces and comments
+static bool readPPMToken(FILE* fp, std::string& token)
+{
+	token.clear();
+	int ch = fgetc(fp);
+	while (ch != EOF && (isspace(ch) || ch == '#'))
+	{
+		if (ch == '#') {
+			while (ch != EOF && ch != '\n')
+				ch = fgetc(fp);
+		}
+		ch = fgetc(fp);
+	}
+	while (ch != EOF && !isspace(ch))
+	{
+		token.push_back(char(ch));
+		ch = fgetc(fp);
+	}
+	return !token.empty();
+}
+
+bool TextureBaker::loadPPM(const char* filename)
+{
+	FILE* fp = fopen(filename, "rb");
+	if (!fp) {
+		std::cout << "Unable to open " << filename << std::endl;
+		return false;
+	}
+
+	std::string magic, widthToken, heightToken, maxToken;
+	bool valid = readPPMToken(fp, magic) && readPPMToken(fp, widthToken)
+		&& readPPMToken(fp, heightToken) && readPPMToken(fp, maxToken);
+
+	const bool binary	= magic == "P6";
+	const int width		= valid ? atoi(widthToken.c_str()) : 0;
+	const int height	= valid ? atoi(heightToken.c_str()) : 0;
+	const int maxValue	= valid ? atoi(maxToken.c_str()) : 0;
+	if (!valid || (magic != "P3" && magic != "P6") || width <= 0 || height <= 0 || maxValue <= 0 || maxValue > 255) {
+		std::cout << filename << " is not a supported PPM file (8 bit P3 or P6 expected)" << std::endl;
+		fclose(fp);
+		return false;
+	}
+
+	// The single white space ending the header has already been consumed
+	std::vector<uint8_t> rgb(size_t(width) * height * 3);
+	if (binary) {
+		valid = fread(rgb.data(), 1, rgb.size(), fp) == rgb.size();
+	}
+	else {
+		for (size_t i = 0; valid && i < rgb.size(); i++)
+		{
+			int value;
+			valid = fscanf(fp, "%d", &value) == 1;
+			rgb[i] = uint8_t(value);
+		}
+	}
+	fclose(fp);
+
+	if (!valid) {
+		std::cout << filename << " is truncated" << std::endl;
+		return false;
+	}
+
+	source = new gli::texture2D(gli::FORMAT_RGBA8_UNORM, gli::texture2D::dim_type(width, height), 1);
+	uint8_t* rgba = (uint8_t*)(*source)[0].data();
+	for (size_t i = 0; i < size_t(width) * height; i++)
+	{
+		for (int c = 0; c < 3; c++)
+			rgba[i * 4 + c] = uint8_t(rgb[i * 3 + c] * 255 / maxValue);
+		rgba[i * 4 + 3] = 255;
+	}
+	return true;
+}
+
+bool TextureBaker::loadGli(const char* filename)
+{
+	gli::texture2D image2D(gli::load(filename));
+	if (image2D.empty()) {
+		std::cout << "Unable to load " << filename << std::endl;
+		return false;
+	}
+
+	// Only the base level is used, the mip chain is regenerated
+	const gli::format format	= image2D.format();
+	const size_t texelCount		= image2D[0].dimensions().x * image2D[0].dimensions().y;
+	const uint8_t* src			= (const uint8_t*)image2D[0].data();
+
+	int components;
+	bool bgr = false;
+	switch (format)
+	{
+	case gli::FORMAT_RGBA8_UNORM:	components = 4; break;
+	case gli::FORMAT_RGB8_UNORM:	components = 3; break;
+	case gli::FORMAT_BGRA8_UNORM:	components = 4; bgr = true; break;
+	case gli::FORMAT_BGRX8_UNORM:	components = 4; bgr = true; break;
+	default:
+		std::cout << filename << " is already compressed or uses an unsupported format" << std::endl;
+		return false;
+	}
+
+	source = new gli::texture2D(gli::FORMAT_RGBA8_UNORM, gli::texture2D::dim_type(image2D[0].dimensions()), 1);
+	uint8_t* rgba = (uint8_t*)(*source)[0].data();
+	for (size_t i = 0; i < texelCount; i++)
+	{
+		rgba[i * 4 + 0] = src[i * components + (bgr ? 2 : 0)];
+		rgba[i * 4 + 1] = src[i * components + 1];
+		rgba[i * 4 + 2] = src[i * components + (bgr ? 0 : 2)];
+		rgba[i * 4 + 3] = (components == 4 && format != gli::FORMAT_BGRX8_UNORM) ? src[i * components + 3] : 255;
+	}
+	return true;
+}
+
+void TextureBaker::generateMipmaps(bool kaiserFilter, uint32_t threadCount)
+{
+	assert(source);
+	gli::texture2D* mipmapped = new gli::texture2D(gli::generate_mipmaps(*source, kaiserFilter ? gli::FILTER_KAISER : gli::FILTER_BOX, threadCount));
+	delete source;
+	source = mipmapped;
+}
+
+void TextureBaker::encode(BlockFormat format, uint32_t threadCount)
+{
+	assert(source);
+	delete baked;
+	baked = new gli::texture2D(BlockEncoder::getTextureFormat(format), source->dimensions(), source->levels());
+
+	for (size_t level = 0; level < source->levels(); level++)
+	{
+		const gli::image src = (*source)[level];
+		gli::image dst = (*baked)[level];
+		BlockEncoder::encodeImage(format, (const uint8_t*)src.data(),
+			uint32_t(src.dimensions().x), uint32_t(src.dimensions().y), (uint8_t*)dst.data(), threadCount);
+	}
+}
+
+bool TextureBaker::save(const char* filename)
+{
+	assert(baked);
+	return gli::save_ktx(*baked, filename);
+}
+
+size_t TextureBaker::getUncompressedSize()
+{
+	return source ? source->size() : 0;
+}
+
+size_t TextureBaker::getBakedSize()
+{
+	return baked ? baked->size() : 0;
+}
+
+bool TextureBaker::benchmarkMipmaps(uint32_t threadCount)
+{
+	const gli::format formats[]		= { gli::FORMAT_RGBA8_UNORM, gli::FORMAT_RGBA32_SFLOAT };
+	const char* formatNames[]		= { "RGBA8", "RGBA32F" };
+	const gli::filter filters[]		= { gli::FILTER_BOX, gli::FILTER_KAISER };
+	const char* filterNames[]		= { "box", "kaiser" };
+	const uint32_t sizes[]			= { 4096, 8192 };
+
+	std::mt19937 random(0x5eed);
+	bool identical = true;
+	for (uint32_t size : sizes)
+	for (int f = 0; f < 2; f++)
+	for (int filter = 0; filter < 2; filter++)
+	{
+		gli::texture2D* source = new gli::texture2D(formats[f], gli::texture2D::dim_type(size, size), 1);
+		if (formats[f] == gli::FORMAT_RGBA32_SFLOAT) {
+			std::uniform_real_distribution<float> value(0.0f, 1.0f);
+			float* texels = (float*)(*source)[0].data();
+			for (size_t i = 0; i < (*source)[0].size() / sizeof(float); i++)
+				texels[i] = value(random);
+		}
+		else {
+			uint8_t* texels = (uint8_t*)(*source)[0].data();
+			for (size_t i = 0; i < (*source)[0].size(); i++)
+				texels[i] = uint8_t(random());
+		}
+
+		// The first run pays for the page faults of its allocation, it is not timed
+		gli::generate_mipmaps(*source, filters[filter], threadCount);
+
+		auto start = std::chrono::steady_clock::now();
+		gli::texture2D simd = gli::generate_mipmaps(*source, filters[filter], threadCount);
+		const double simdMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// Only the base level is read, the SIMD result replaces the source to save memory
+		delete source;
+		start = std::chrono::steady_clock::now();
+		gli::texture2D scalar = gli::detail::generate_mipmaps_2d(simd, filters[filter], threadCount, true);
+		const double scalarMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		size_t mismatchLevel = simd.levels();
+		for (size_t level = 0; level < simd.levels() && mismatchLevel == simd.levels(); level++)
+		{
+			if (memcmp(simd[level].data(), scalar[level].data(), simd[level].size()))
+				mismatchLevel = level;
+		}
+		identical = identical && mismatchLevel == simd.levels();
+
+		std::cout << size << "x" << size << " " << formatNames[f] << " " << filterNames[filter] << ": scalar "
+			<< std::fixed << std::setprecision(1) << scalarMs << " ms, SIMD " << simdMs << " ms ("
+			<< std::setprecision(2) << scalarMs / simdMs << "x), ";
+		if (mismatchLevel == simd.levels())
+			std::cout << "identical" << std::endl;
+		else
+			std::cout << "level " << mismatchLevel << " differs" << std::endl;
+	}
+
+	return identical;
+}
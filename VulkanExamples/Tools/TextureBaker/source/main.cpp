@@ -0,0 +1,141 @@
+/*
+
+*
+
+
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Headers.h"
+#include "TextureBaker.h"
+#include <cstring>
+#include <thread>
+
+static void printUsage()
+{
+	std::cout << "Usage: TextureBaker [-f bc1|bc3|bc7] [-t threads] [-o output.ktx] [--kaiser] [--no-mips] <input> [<input> ...]" << std::endl;
+	std::cout << "       TextureBaker [-t threads] --benchmark-mips" << std::endl;
+	std::cout << "  Inputs are PPM (P3/P6), KTX or DDS files. Each one is written next to" << std::endl;
+	std::cout << "  the source as <name>-<format>.ktx unless -o is given for a single input." << std::endl;
+	std::cout << "  --benchmark-mips times the SIMD and scalar mip map generation and" << std::endl;
+	std::cout << "  checks they produce the same bytes." << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	BlockFormat format		= BLOCK_FORMAT_BC7;
+	const char* formatName	= "bc7";
+	uint32_t threadCount	= std::max(std::thread::hardware_concurrency(), 1u);
+	bool kaiserFilter		= false;
+	bool generateMipmaps	= true;
+	bool benchmarkMipmaps	= false;
+	const char* output		= NULL;
+	std::vector<const char*> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+			formatName = argv[++i];
+			if (!strcmp(formatName, "bc1"))			format = BLOCK_FORMAT_BC1;
+			else if (!strcmp(formatName, "bc3"))	format = BLOCK_FORMAT_BC3;
+			else if (!strcmp(formatName, "bc7"))	format = BLOCK_FORMAT_BC7;
+			else { printUsage(); return 1; }
+		}
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			threadCount = std::max(atoi(argv[++i]), 1);
+		}
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--kaiser")) {
+			kaiserFilter = true;
+		}
+		else if (!strcmp(argv[i], "--no-mips")) {
+			generateMipmaps = false;
+		}
+		else if (!strcmp(argv[i], "--benchmark-mips")) {
+			benchmarkMipmaps = true;
+		}
+		else if (argv[i][0] == '-') {
+			printUsage();
+			return 1;
+		}
+		else {
+			inputs.push_back(argv[i]);
+		}
+	}
+
+	if (benchmarkMipmaps) {
+		return TextureBaker::benchmarkMipmaps(threadCount) ? 0 : 1;
+	}
+
+	if (inputs.empty() || (output && inputs.size() > 1)) {
+		printUsage();
+		return 1;
+	}
+
+	size_t totalBefore = 0, totalAfter = 0;
+	int failures = 0;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		std::string outputName;
+		if (output) {
+			outputName = output;
+		}
+		else {
+			std::string input(inputs[i]);
+			size_t dot = input.find_last_of('.');
+			outputName = input.substr(0, dot) + "-" + formatName + ".ktx";
+		}
+
+		TextureBaker baker;
+		if (!baker.loadSource(inputs[i])) {
+			failures++;
+			continue;
+		}
+
+		if (generateMipmaps) {
+			baker.generateMipmaps(kaiserFilter, threadCount);
+		}
+		baker.encode(format, threadCount);
+
+		if (!baker.save(outputName.c_str())) {
+			std::cout << "Unable to write " << outputName << std::endl;
+			failures++;
+			continue;
+		}
+
+		// Savings against the RGBA8 data the renderer would upload otherwise
+		const size_t before	= baker.getUncompressedSize();
+		const size_t after	= baker.getBakedSize();
+		totalBefore	+= before;
+		totalAfter	+= after;
+		std::cout << inputs[i] << " -> " << outputName << ": " << before << " bytes RGBA8, "
+			<< after << " bytes " << formatName << " (" << std::fixed << std::setprecision(1)
+			<< 100.0 * (1.0 - double(after) / double(before)) << "% saved)" << std::endl;
+	}
+
+	if (inputs.size() > 1 && totalBefore) {
+		std::cout << "Total: " << totalBefore << " bytes -> " << totalAfter << " bytes ("
+			<< std::fixed << std::setprecision(1) << 100.0 * (1.0 - double(totalAfter) / double(totalBefore)) << "% saved)" << std::endl;
+	}
+
+	return failures ? 1 : 0;
+}
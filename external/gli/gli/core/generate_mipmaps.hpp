@@ -32,8 +32,26 @@
 
 namespace gli
 {
+	enum filter
+	{
+		FILTER_BOX,
+		FILTER_KAISER
+	};
+
+	/// Generate a complete mipmap chain from the base level of Texture.
+	/// Supported formats are uncompressed formats with unsigned 8 bit or 32 bit float components.
+	/// Other formats are not an error: a copy of Texture is returned unchanged, without mipmaps.
+	/// FILTER_BOX averages 2x2 texels, FILTER_KAISER is a separable Kaiser windowed sinc.
+	/// Rows of each level are split across ThreadCount threads, 0 uses std::thread::hardware_concurrency().
 	template <typename texture>
-	texture generate_mipmaps(texture & Texture);
+	texture generate_mipmaps(texture & Texture, filter Filter = FILTER_BOX, std::size_t ThreadCount = 0);
+
+namespace detail
+{
+	/// generate_mipmaps() of a 2D texture. Scalar skips the SIMD paths, they produce the
+	/// same bytes so it is only useful to test and time them.
+	texture2D generate_mipmaps_2d(texture2D & Texture, filter Filter, std::size_t ThreadCount, bool Scalar);
+}//namespace detail
 
 }//namespace gli
 
@@ -26,53 +26,518 @@
 /// @author Christophe Riccio
 ///////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
 namespace gli{
 namespace detail
 {
+	// Split [0, Rows) in contiguous ranges and run Function(Begin, End) on each range in its own thread.
+	template <typename function>
+	inline void parallel_rows(std::size_t Rows, std::size_t ThreadCount, function const & Function)
+	{
+		std::size_t const Count = glm::max<std::size_t>(glm::min(ThreadCount, Rows), 1);
+		std::size_t const Step = (Rows + Count - 1) / Count;
 
-}//namespace detail
+		std::vector<std::thread> Workers;
+		Workers.reserve(Count);
+		for(std::size_t Begin = Step; Begin < Rows; Begin += Step)
+			Workers.push_back(std::thread(Function, Begin, glm::min(Begin + Step, Rows)));
 
-	template <>
-	inline texture2D generate_mipmaps(texture2D & Texture)
+		Function(std::size_t(0), glm::min(Step, Rows));
+
+		for(std::size_t i = 0; i < Workers.size(); ++i)
+			Workers[i].join();
+	}
+
+	// Spawning threads for tiny levels costs more than it saves.
+	inline std::size_t level_thread_count(std::size_t ThreadCount, std::size_t Width, std::size_t Height)
 	{
-		texture2D Result(Texture.format(), Texture.dimensions());
-		texture2D::size_type const Components(gli::component_count(Result.format()));
+		std::size_t const TexelsPerThread = 64 * 1024;
+		return glm::max<std::size_t>(glm::min(ThreadCount, (Width * Height) / TexelsPerThread), 1);
+	}
 
-		for(texture2D::size_type Level = Texture.base_level(); Level < Texture.max_level(); ++Level)
+	//////////////////////////////////////
+	// Box filter
+
+	// Scalar reference, (a + b + c + d) >> 2 for bytes and ((a + b) + c + d) * 0.25 for floats.
+	// XSrc is the first source texel to process, the SIMD paths stop before the edge.
+	inline void box_row_u8(glm::byte const * Src0, glm::byte const * Src1, glm::byte * Dst, std::size_t Begin, std::size_t DstWidth, std::size_t SrcWidth, std::size_t Components)
+	{
+		for(std::size_t i = Begin; i < DstWidth; ++i)
 		{
-			// Src
-			std::size_t BaseWidth = Result[Level].dimensions().x;
-			void * DataSrc = Result[Level + 0].data();
+			std::size_t const x0 = (i << 1) * Components;
+			std::size_t const x1 = glm::min((i << 1) + 1, SrcWidth - 1) * Components;
 
-			// Dst
-			texture2D::dim_type LevelDimensions = texture2D::dim_type(Result[Level].dimensions()) >> texture2D::dim_type(1);
-			LevelDimensions = glm::max(LevelDimensions, texture2D::dim_type(1));
-			void * DataDst = Result[Level + 1].data();
+			for(std::size_t c = 0; c < Components; ++c)
+			{
+				glm::u32 const Sum = glm::u32(Src0[x0 + c]) + glm::u32(Src0[x1 + c]) + glm::u32(Src1[x0 + c]) + glm::u32(Src1[x1 + c]);
+				Dst[i * Components + c] = glm::byte(Sum >> 2);
+			}
+		}
+	}
+
+	inline void box_row_f32(float const * Src0, float const * Src1, float * Dst, std::size_t Begin, std::size_t DstWidth, std::size_t SrcWidth, std::size_t Components)
+	{
+		for(std::size_t i = Begin; i < DstWidth; ++i)
+		{
+			std::size_t const x0 = (i << 1) * Components;
+			std::size_t const x1 = glm::min((i << 1) + 1, SrcWidth - 1) * Components;
 
-			for(std::size_t j = 0; j < LevelDimensions.y; ++j)
-			for(std::size_t i = 0; i < LevelDimensions.x;  ++i)
 			for(std::size_t c = 0; c < Components; ++c)
+				Dst[i * Components + c] = (((Src0[x0 + c] + Src0[x1 + c]) + Src1[x0 + c]) + Src1[x1 + c]) * 0.25f;
+		}
+	}
+
+#	if GLM_ARCH & GLM_ARCH_SSE2
+	// The SIMD paths widen to 16 bits before summing so the result matches box_row_u8 exactly.
+	// They return the number of destination texels processed, the caller finishes the row with the scalar path.
+	inline std::size_t box_row_u8_sse2(glm::byte const * Src0, glm::byte const * Src1, glm::byte * Dst, std::size_t DstWidth, std::size_t Components)
+	{
+		__m128i const Zero = _mm_setzero_si128();
+		std::size_t const DstStep = 16 / Components;
+		std::size_t i = 0;
+
+		if(Components != 1 && Components != 2 && Components != 4)
+			return i;
+
+		for(; i + DstStep <= DstWidth; i += DstStep)
+		{
+			__m128i Sum[4];
+			for(std::size_t k = 0; k < 2; ++k)
+			{
+				__m128i const A = _mm_loadu_si128(reinterpret_cast<__m128i const *>(Src0 + i * Components * 2 + k * 16));
+				__m128i const B = _mm_loadu_si128(reinterpret_cast<__m128i const *>(Src1 + i * Components * 2 + k * 16));
+				Sum[k * 2 + 0] = _mm_add_epi16(_mm_unpacklo_epi8(A, Zero), _mm_unpacklo_epi8(B, Zero));
+				Sum[k * 2 + 1] = _mm_add_epi16(_mm_unpackhi_epi8(A, Zero), _mm_unpackhi_epi8(B, Zero));
+			}
+
+			// Add horizontally adjacent texels then gather the pair sums in two registers of eight 16 bit sums
+			__m128i Lo, Hi;
+			if(Components == 4)
+			{
+				for(std::size_t k = 0; k < 4; ++k)
+					Sum[k] = _mm_add_epi16(Sum[k], _mm_srli_si128(Sum[k], 8));
+				Lo = _mm_unpacklo_epi64(Sum[0], Sum[1]);
+				Hi = _mm_unpacklo_epi64(Sum[2], Sum[3]);
+			}
+			else if(Components == 2)
+			{
+				for(std::size_t k = 0; k < 4; ++k)
+					Sum[k] = _mm_shuffle_epi32(_mm_add_epi16(Sum[k], _mm_srli_epi64(Sum[k], 32)), _MM_SHUFFLE(3, 1, 2, 0));
+				Lo = _mm_unpacklo_epi64(Sum[0], Sum[1]);
+				Hi = _mm_unpacklo_epi64(Sum[2], Sum[3]);
+			}
+			else
+			{
+				__m128i const Mask = _mm_set1_epi32(0x0000FFFF);
+				for(std::size_t k = 0; k < 4; ++k)
+					Sum[k] = _mm_and_si128(_mm_add_epi16(Sum[k], _mm_srli_epi32(Sum[k], 16)), Mask);
+				Lo = _mm_packs_epi32(Sum[0], Sum[1]);
+				Hi = _mm_packs_epi32(Sum[2], Sum[3]);
+			}
+
+			__m128i const Result = _mm_packus_epi16(_mm_srli_epi16(Lo, 2), _mm_srli_epi16(Hi, 2));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(Dst + i * Components), Result);
+		}
+
+		return i;
+	}
+
+	inline std::size_t box_row_f32_sse2(float const * Src0, float const * Src1, float * Dst, std::size_t DstWidth, std::size_t Components)
+	{
+		__m128 const Quarter = _mm_set1_ps(0.25f);
+		std::size_t i = 0;
+
+		if(Components == 4)
+		{
+			for(; i < DstWidth; ++i)
+			{
+				__m128 const A = _mm_loadu_ps(Src0 + i * 8 + 0);
+				__m128 const B = _mm_loadu_ps(Src0 + i * 8 + 4);
+				__m128 const C = _mm_loadu_ps(Src1 + i * 8 + 0);
+				__m128 const D = _mm_loadu_ps(Src1 + i * 8 + 4);
+				_mm_storeu_ps(Dst + i * 4, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(A, B), C), D), Quarter));
+			}
+		}
+		else if(Components == 2 || Components == 1)
+		{
+			// Deinterleave even and odd texels of two registers
+			std::size_t const DstStep = 4 / Components;
+			for(; i + DstStep <= DstWidth; i += DstStep)
+			{
+				__m128 const A0 = _mm_loadu_ps(Src0 + i * Components * 2 + 0);
+				__m128 const A1 = _mm_loadu_ps(Src0 + i * Components * 2 + 4);
+				__m128 const B0 = _mm_loadu_ps(Src1 + i * Components * 2 + 0);
+				__m128 const B1 = _mm_loadu_ps(Src1 + i * Components * 2 + 4);
+
+				__m128 A, B, C, D;
+				if(Components == 2)
+				{
+					A = _mm_shuffle_ps(A0, A1, _MM_SHUFFLE(1, 0, 1, 0));
+					B = _mm_shuffle_ps(A0, A1, _MM_SHUFFLE(3, 2, 3, 2));
+					C = _mm_shuffle_ps(B0, B1, _MM_SHUFFLE(1, 0, 1, 0));
+					D = _mm_shuffle_ps(B0, B1, _MM_SHUFFLE(3, 2, 3, 2));
+				}
+				else
+				{
+					A = _mm_shuffle_ps(A0, A1, _MM_SHUFFLE(2, 0, 2, 0));
+					B = _mm_shuffle_ps(A0, A1, _MM_SHUFFLE(3, 1, 3, 1));
+					C = _mm_shuffle_ps(B0, B1, _MM_SHUFFLE(2, 0, 2, 0));
+					D = _mm_shuffle_ps(B0, B1, _MM_SHUFFLE(3, 1, 3, 1));
+				}
+
+				_mm_storeu_ps(Dst + i * Components, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(A, B), C), D), Quarter));
+			}
+		}
+
+		return i;
+	}
+#	endif//GLM_ARCH & GLM_ARCH_SSE2
+
+#	if GLM_ARCH & GLM_ARCH_AVX2
+	// RGBA8 only, 8 destination texels per iteration
+	inline std::size_t box_row_u8_avx2(glm::byte const * Src0, glm::byte const * Src1, glm::byte * Dst, std::size_t DstWidth, std::size_t Components)
+	{
+		__m256i const Zero = _mm256_setzero_si256();
+		std::size_t i = 0;
+
+		if(Components != 4)
+			return i;
+
+		for(; i + 8 <= DstWidth; i += 8)
+		{
+			__m256i Pairs[2];
+			for(std::size_t k = 0; k < 2; ++k)
+			{
+				__m256i const A = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(Src0 + i * 8 + k * 32));
+				__m256i const B = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(Src1 + i * 8 + k * 32));
+				__m256i Lo = _mm256_add_epi16(_mm256_unpacklo_epi8(A, Zero), _mm256_unpacklo_epi8(B, Zero));
+				__m256i Hi = _mm256_add_epi16(_mm256_unpackhi_epi8(A, Zero), _mm256_unpackhi_epi8(B, Zero));
+				Lo = _mm256_add_epi16(Lo, _mm256_srli_si256(Lo, 8));
+				Hi = _mm256_add_epi16(Hi, _mm256_srli_si256(Hi, 8));
+				Pairs[k] = _mm256_srli_epi16(_mm256_unpacklo_epi64(Lo, Hi), 2);
+			}
+
+			// Packing works per 128 bit lane, restore the texel order afterward
+			__m256i const Result = _mm256_permute4x64_epi64(_mm256_packus_epi16(Pairs[0], Pairs[1]), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(Dst + i * 4), Result);
+		}
+
+		return i;
+	}
+#	endif//GLM_ARCH & GLM_ARCH_AVX2
+
+#	if GLM_ARCH & GLM_ARCH_AVX
+	// RGBA32F only, 2 destination texels per iteration
+	inline std::size_t box_row_f32_avx(float const * Src0, float const * Src1, float * Dst, std::size_t DstWidth, std::size_t Components)
+	{
+		__m256 const Quarter = _mm256_set1_ps(0.25f);
+		std::size_t i = 0;
+
+		if(Components != 4)
+			return i;
+
+		for(; i + 2 <= DstWidth; i += 2)
+		{
+			__m256 const A0 = _mm256_loadu_ps(Src0 + i * 8 + 0);
+			__m256 const A1 = _mm256_loadu_ps(Src0 + i * 8 + 8);
+			__m256 const B0 = _mm256_loadu_ps(Src1 + i * 8 + 0);
+			__m256 const B1 = _mm256_loadu_ps(Src1 + i * 8 + 8);
+
+			__m256 const A = _mm256_permute2f128_ps(A0, A1, 0x20);
+			__m256 const B = _mm256_permute2f128_ps(A0, A1, 0x31);
+			__m256 const C = _mm256_permute2f128_ps(B0, B1, 0x20);
+			__m256 const D = _mm256_permute2f128_ps(B0, B1, 0x31);
+
+			_mm256_storeu_ps(Dst + i * 4, _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(A, B), C), D), Quarter));
+		}
+
+		return i;
+	}
+#	endif//GLM_ARCH & GLM_ARCH_AVX
+
+	inline void box_level(image const & Src, image & Dst, std::size_t Components, bool IsFloat, bool Scalar, std::size_t ThreadCount)
+	{
+		std::size_t const SrcWidth = Src.dimensions().x;
+		std::size_t const SrcHeight = Src.dimensions().y;
+		std::size_t const DstWidth = Dst.dimensions().x;
+		std::size_t const DstHeight = Dst.dimensions().y;
+		std::size_t const SrcPitch = SrcWidth * Components;
+		std::size_t const DstPitch = DstWidth * Components;
+
+		// The SIMD paths read two full source texels per destination texel
+		bool const Vectorize = !Scalar && SrcWidth >= (DstWidth << 1);
+
+		glm::byte const * const SrcData = Src.data<glm::byte>();
+		glm::byte * const DstData = Dst.data<glm::byte>();
+
+		parallel_rows(DstHeight, level_thread_count(ThreadCount, DstWidth, DstHeight), [=](std::size_t Begin, std::size_t End)
+		{
+			for(std::size_t j = Begin; j < End; ++j)
 			{
-				std::size_t x = (i << 1);
-				std::size_t y = (j << 1);
+				std::size_t const y0 = j << 1;
+				std::size_t const y1 = glm::min(y0 + 1, SrcHeight - 1);
+
+				if(IsFloat)
+				{
+					float const * Src0 = reinterpret_cast<float const *>(SrcData) + y0 * SrcPitch;
+					float const * Src1 = reinterpret_cast<float const *>(SrcData) + y1 * SrcPitch;
+					float * Row = reinterpret_cast<float *>(DstData) + j * DstPitch;
+
+					std::size_t i = 0;
+					if(Vectorize)
+					{
+#						if GLM_ARCH & GLM_ARCH_AVX
+							i = box_row_f32_avx(Src0, Src1, Row, DstWidth, Components);
+#						endif
+#						if GLM_ARCH & GLM_ARCH_SSE2
+							i += box_row_f32_sse2(Src0 + i * Components * 2, Src1 + i * Components * 2, Row + i * Components, DstWidth - i, Components);
+#						endif
+					}
+					box_row_f32(Src0, Src1, Row, i, DstWidth, SrcWidth, Components);
+				}
+				else
+				{
+					glm::byte const * Src0 = SrcData + y0 * SrcPitch;
+					glm::byte const * Src1 = SrcData + y1 * SrcPitch;
+					glm::byte * Row = DstData + j * DstPitch;
+
+					std::size_t i = 0;
+					if(Vectorize)
+					{
+#						if GLM_ARCH & GLM_ARCH_AVX2
+							i = box_row_u8_avx2(Src0, Src1, Row, DstWidth, Components);
+#						endif
+#						if GLM_ARCH & GLM_ARCH_SSE2
+							i += box_row_u8_sse2(Src0 + i * Components * 2, Src1 + i * Components * 2, Row + i * Components, DstWidth - i, Components);
+#						endif
+					}
+					box_row_u8(Src0, Src1, Row, i, DstWidth, SrcWidth, Components);
+				}
+			}
+		});
+	}
+
+	//////////////////////////////////////
+	// Kaiser filter
+
+	// Zeroth order modified Bessel function of the first kind
+	inline float bessel_i0(float x)
+	{
+		float Sum = 1.0f;
+		float Term = 1.0f;
+		float const HalfX = x * 0.5f;
+		for(int k = 1; k < 32 && Term > Sum * 1e-8f; ++k)
+		{
+			Term *= (HalfX / float(k)) * (HalfX / float(k));
+			Sum += Term;
+		}
+		return Sum;
+	}
+
+	// For each destination texel, Count source indexes clamped to the edge and their normalized weights.
+	struct kaiser_taps
+	{
+		std::size_t Count;
+		std::vector<std::size_t> Index;
+		std::vector<float> Weight;
+	};
+
+	inline kaiser_taps compute_kaiser_taps(std::size_t SrcSize, std::size_t DstSize)
+	{
+		float const Pi = 3.14159265358979323846f;
+		float const Radius = 2.0f; // In destination texels
+		float const Alpha = 4.0f;
+		float const Scale = float(SrcSize) / float(DstSize);
+		float const Support = Radius * Scale;
 
-				std::size_t Index00 = ((x + 0) + (y + 0) * BaseWidth) * Components + c;
-				std::size_t Index01 = ((x + 0) + (y + 1) * BaseWidth) * Components + c;
-				std::size_t Index11 = ((x + 1) + (y + 1) * BaseWidth) * Components + c;
-				std::size_t Index10 = ((x + 1) + (y + 0) * BaseWidth) * Components + c;
+		kaiser_taps Taps;
+		Taps.Count = static_cast<std::size_t>(std::ceil(Support * 2.0f));
+		Taps.Index.resize(DstSize * Taps.Count);
+		Taps.Weight.resize(DstSize * Taps.Count);
 
-				glm::u32 Data00 = reinterpret_cast<glm::byte *>(DataSrc)[Index00];
-				glm::u32 Data01 = reinterpret_cast<glm::byte *>(DataSrc)[Index01];
-				glm::u32 Data11 = reinterpret_cast<glm::byte *>(DataSrc)[Index11];
-				glm::u32 Data10 = reinterpret_cast<glm::byte *>(DataSrc)[Index10];
+		for(std::size_t i = 0; i < DstSize; ++i)
+		{
+			float const Center = (float(i) + 0.5f) * Scale;
+			int const First = static_cast<int>(std::floor(Center - Support + 0.5f));
 
-				std::size_t IndexDst = (x + y * LevelDimensions.x) * Components + c;
+			float Total = 0.0f;
+			for(std::size_t k = 0; k < Taps.Count; ++k)
+			{
+				int const p = First + static_cast<int>(k);
+				float const x = (float(p) + 0.5f - Center) / Scale;
+				float const t = x / Radius;
 
-				*(reinterpret_cast<glm::byte *>(DataDst) + IndexDst) = (Data00 + Data01 + Data11 + Data10) >> 2;
+				float const Sinc = x == 0.0f ? 1.0f : std::sin(Pi * x) / (Pi * x);
+				float const Window = std::abs(t) < 1.0f ? bessel_i0(Alpha * std::sqrt(1.0f - t * t)) / bessel_i0(Alpha) : 0.0f;
+
+				Taps.Index[i * Taps.Count + k] = static_cast<std::size_t>(glm::clamp(p, 0, static_cast<int>(SrcSize) - 1));
+				Taps.Weight[i * Taps.Count + k] = Sinc * Window;
+				Total += Sinc * Window;
 			}
+
+			for(std::size_t k = 0; k < Taps.Count; ++k)
+				Taps.Weight[i * Taps.Count + k] /= Total;
+		}
+
+		return Taps;
+	}
+
+	inline float load_component(void const * Data, std::size_t Index, bool IsFloat)
+	{
+		return IsFloat ? static_cast<float const *>(Data)[Index] : float(static_cast<glm::byte const *>(Data)[Index]);
+	}
+
+	inline void store_component(void * Data, std::size_t Index, float Value, bool IsFloat)
+	{
+		if(IsFloat)
+			static_cast<float *>(Data)[Index] = Value;
+		else
+			static_cast<glm::byte *>(Data)[Index] = static_cast<glm::byte>(glm::clamp(std::nearbyint(Value), 0.0f, 255.0f));
+	}
+
+	// Horizontal pass on source row y into Dst, DstWidth * Components floats
+	inline void kaiser_row(void const * Src, float * Dst, std::size_t y, std::size_t SrcPitch, std::size_t DstWidth, std::size_t Components, bool IsFloat, bool Scalar, kaiser_taps const & Taps)
+	{
+		std::size_t i = 0;
+
+#		if GLM_ARCH & GLM_ARCH_SSE2
+		if(Components == 4 && !Scalar)
+		{
+			for(; i < DstWidth; ++i)
+			{
+				__m128 Acc = _mm_setzero_ps();
+				for(std::size_t k = 0; k < Taps.Count; ++k)
+				{
+					std::size_t const Offset = y * SrcPitch + Taps.Index[i * Taps.Count + k] * 4;
+
+					__m128 Texel;
+					if(IsFloat)
+						Texel = _mm_loadu_ps(static_cast<float const *>(Src) + Offset);
+					else
+					{
+						int Packed;
+						std::memcpy(&Packed, static_cast<glm::byte const *>(Src) + Offset, sizeof(Packed));
+						__m128i const Zero = _mm_setzero_si128();
+						Texel = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(Packed), Zero), Zero));
+					}
+					Acc = _mm_add_ps(Acc, _mm_mul_ps(Texel, _mm_set1_ps(Taps.Weight[i * Taps.Count + k])));
+				}
+				_mm_storeu_ps(Dst + i * 4, Acc);
+			}
+		}
+#		endif//GLM_ARCH & GLM_ARCH_SSE2
+
+		for(; i < DstWidth; ++i)
+		for(std::size_t c = 0; c < Components; ++c)
+		{
+			float Acc = 0.0f;
+			for(std::size_t k = 0; k < Taps.Count; ++k)
+				Acc += load_component(Src, y * SrcPitch + Taps.Index[i * Taps.Count + k] * Components + c, IsFloat) * Taps.Weight[i * Taps.Count + k];
+			Dst[i * Components + c] = Acc;
+		}
+	}
+
+	inline void kaiser_level(image const & Src, image & Dst, std::size_t Components, bool IsFloat, bool Scalar, std::size_t ThreadCount)
+	{
+		std::size_t const SrcWidth = Src.dimensions().x;
+		std::size_t const SrcHeight = Src.dimensions().y;
+		std::size_t const DstWidth = Dst.dimensions().x;
+		std::size_t const DstHeight = Dst.dimensions().y;
+		std::size_t const SrcPitch = SrcWidth * Components;
+		std::size_t const DstPitch = DstWidth * Components;
+
+		kaiser_taps const TapsX = compute_kaiser_taps(SrcWidth, DstWidth);
+		kaiser_taps const TapsY = compute_kaiser_taps(SrcHeight, DstHeight);
+
+		void const * const SrcData = Src.data();
+		void * const DstData = Dst.data();
+
+		parallel_rows(DstHeight, level_thread_count(ThreadCount, DstWidth, DstHeight), [&](std::size_t Begin, std::size_t End)
+		{
+			// Source rows referenced by this range of destination rows, neighbouring ranges filter their shared rows twice
+			std::size_t RowFirst = SrcHeight;
+			std::size_t RowLast = 0;
+			for(std::size_t n = Begin * TapsY.Count; n < End * TapsY.Count; ++n)
+			{
+				RowFirst = glm::min(RowFirst, TapsY.Index[n]);
+				RowLast = glm::max(RowLast, TapsY.Index[n]);
+			}
+
+			std::vector<float> Rows((RowLast - RowFirst + 1) * DstPitch);
+			for(std::size_t y = RowFirst; y <= RowLast; ++y)
+				kaiser_row(SrcData, &Rows[(y - RowFirst) * DstPitch], y, SrcPitch, DstWidth, Components, IsFloat, Scalar, TapsX);
+
+			std::vector<float> Acc(DstPitch);
+			for(std::size_t j = Begin; j < End; ++j)
+			{
+				std::fill(Acc.begin(), Acc.end(), 0.0f);
+
+				// Vertical pass, components are independent so the whole row is vectorized regardless of the format
+				for(std::size_t k = 0; k < TapsY.Count; ++k)
+				{
+					float const * Row = &Rows[(TapsY.Index[j * TapsY.Count + k] - RowFirst) * DstPitch];
+					float const Weight = TapsY.Weight[j * TapsY.Count + k];
+
+					std::size_t n = 0;
+#					if GLM_ARCH & GLM_ARCH_SSE2
+						__m128 const WeightSIMD = _mm_set1_ps(Weight);
+						for(; !Scalar && n + 4 <= DstPitch; n += 4)
+							_mm_storeu_ps(&Acc[n], _mm_add_ps(_mm_loadu_ps(&Acc[n]), _mm_mul_ps(_mm_loadu_ps(Row + n), WeightSIMD)));
+#					endif//GLM_ARCH & GLM_ARCH_SSE2
+					for(; n < DstPitch; ++n)
+						Acc[n] += Row[n] * Weight;
+				}
+
+				for(std::size_t n = 0; n < DstPitch; ++n)
+					store_component(DstData, j * DstPitch + n, Acc[n], IsFloat);
+			}
+		});
+	}
+
+	inline texture2D generate_mipmaps_2d(texture2D & Texture, filter Filter, std::size_t ThreadCount, bool Scalar)
+	{
+		texture2D::format_type const Format = Texture.format();
+		detail::formatInfo const & Info = detail::get_format_info(Format);
+		std::size_t const Components = component_count(Format);
+
+		bool const IsFloat = (Info.Flags & detail::CAP_FLOAT_BIT) && block_size(Format) == Components * sizeof(float);
+		bool const IsByte = block_size(Format) == Components && !(Info.Flags & (detail::CAP_COMPRESSED_BIT | detail::CAP_PACKED_BIT | detail::CAP_SIGNED_BIT | detail::CAP_DEPTH_BIT | detail::CAP_STENCIL_BIT));
+
+		// The filters only read 8 bit and 32 bit float components, other formats are returned unchanged
+		if(!IsFloat && !IsByte)
+			return Texture;
+
+		texture2D Result(Format, Texture.dimensions());
+		std::memcpy(Result[0].data(), Texture[0].data(), Result[0].size());
+
+		if(ThreadCount == 0)
+			ThreadCount = glm::max(std::thread::hardware_concurrency(), 1u);
+
+		// Building with GLM_FORCE_PURE or passing Scalar selects the scalar reference paths
+		for(texture2D::size_type Level = 0; Level + 1 < Result.levels(); ++Level)
+		{
+			image const Src = Result[Level + 0];
+			image Dst = Result[Level + 1];
+
+			if(Filter == FILTER_KAISER)
+				kaiser_level(Src, Dst, Components, IsFloat, Scalar, ThreadCount);
+			else
+				box_level(Src, Dst, Components, IsFloat, Scalar, ThreadCount);
 		}
 
 		return Result;
 	}
+}//namespace detail
+
+	template <>
+	inline texture2D generate_mipmaps(texture2D & Texture, filter Filter, std::size_t ThreadCount)
+	{
+		return detail::generate_mipmaps_2d(Texture, Filter, ThreadCount, false);
+	}
 
 }//namespace gli
@@ -101,7 +101,7 @@ namespace gli
 		size_type const Faces;
 		size_type const Levels;
 		size_type const BlockSize;
-		dim_type const BlockCount;
+		dim_type const BlockDimensions;
 		dim_type const Dimensions;
 		std::vector<data_type> Data;
 	};
@@ -33,7 +33,7 @@ namespace gli
 		, Faces(0)
 		, Levels(0)
 		, BlockSize(0)
-		, BlockCount(0)
+		, BlockDimensions(0)
 		, Dimensions(0)
 	{}
 
@@ -49,7 +49,7 @@ namespace gli
 		, Faces(Faces)
 		, Levels(Levels)
 		, BlockSize(gli::block_size(Format))
-		, BlockCount(glm::max(Dimensions / block_dimensions(Format), gli::dim3_t(1)))
+		, BlockDimensions(block_dimensions(Format))
 		, Dimensions(Dimensions)
 	{
 		assert(Layers > 0);
@@ -89,7 +89,8 @@ namespace gli
 	{
 		assert(Level < this->Levels);
 
-		return glm::max(this->BlockCount >> storage::dim_type(static_cast<glm::uint>(Level)), storage::dim_type(static_cast<glm::uint>(1)));
+		// Round up, a partial block at the edge of a level is still a full block in memory
+		return glm::max((this->dimensions(Level) + this->BlockDimensions - storage::dim_type(1)) / this->BlockDimensions, storage::dim_type(1));
 	}
 
 	inline storage::dim_type storage::dimensions(size_type Level) const